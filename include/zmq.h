@@ -223,6 +223,35 @@ ZMQ_EXPORT void zmq_version (int *major, int *minor, int *patch);
 #define ZMQ_THREAD_SCHED_POLICY_DFLT -1
 
 ZMQ_EXPORT int zmq_global_init (const char *ip, const char *gw, const char *mask);
+ZMQ_EXPORT int zmq_add_neighbor (const char *ip, const char *mac);
+ZMQ_EXPORT int zmq_load_neighbors (const char *path);
+ZMQ_EXPORT int zmq_set_rx_queues (int queues);
+ZMQ_EXPORT int zmq_set_dpdk_cpus (const int *cpus, int count);
+ZMQ_EXPORT int zmq_register_memory (void *addr, size_t len);
+ZMQ_EXPORT int zmq_unregister_memory (void *addr);
+ZMQ_EXPORT int zmq_trace_dump (const char *path);
+
+/*  Software stand-in for the switch NetML aggregates on, see                 */
+/*  zmq_switch_init(3).                                                       */
+typedef struct zmq_switch_stats_t
+{
+    uint64_t frames;
+    uint64_t forwarded;
+    uint64_t flooded;
+    uint64_t hot;
+    uint64_t summed;
+    uint64_t complete;
+    uint64_t partial;
+    uint64_t cold;
+    uint64_t collisions;
+    uint64_t acks;
+    uint64_t resent;
+    uint64_t dropped;
+} zmq_switch_stats_t;
+
+ZMQ_EXPORT int zmq_switch_init (int slots, int workers, int timeout);
+ZMQ_EXPORT int zmq_switch_add_host (const char *ip, const char *mask);
+ZMQ_EXPORT int zmq_switch_stats (zmq_switch_stats_t *stats);
 ZMQ_EXPORT void *zmq_ctx_new (void);
 ZMQ_EXPORT int zmq_ctx_term (void *context);
 ZMQ_EXPORT int zmq_ctx_shutdown (void *context);
@@ -278,6 +307,52 @@ ZMQ_EXPORT int zmq_msg_get (const zmq_msg_t *msg, int property);
 ZMQ_EXPORT int zmq_msg_set (zmq_msg_t *msg, int property, int optval);
 ZMQ_EXPORT const char *zmq_msg_gets (const zmq_msg_t *msg, const char *property);
 
+/*  A message of a batch, see zmq_msg_send_many. A remote_id of UINT16_MAX   */
+/*  on send keeps the one the message was created with.                      */
+typedef struct zmq_mmsg_t
+{
+    zmq_msg_t *msg;
+    int flags;
+    uint16_t remote_id;
+} zmq_mmsg_t;
+
+ZMQ_EXPORT int zmq_msg_send_many (zmq_mmsg_t *msgs, int count, void *s,
+    int flags);
+ZMQ_EXPORT int zmq_msg_recv_many (zmq_mmsg_t *msgs, int count, void *s,
+    int flags);
+
+/*  Counters of the per-thread caches message contents are allocated from,   */
+/*  summed over all threads. size is the block size of the class asked for,  */
+/*  or 0 for the sum over all classes (size_class -1).                       */
+typedef struct zmq_pool_stats_t
+{
+    size_t size;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t remote_frees;
+    uint64_t misses;
+    uint64_t cached;
+} zmq_pool_stats_t;
+
+ZMQ_EXPORT int zmq_pool_stats (int size_class, zmq_pool_stats_t *stats);
+
+/*  Counters of the I/O threads of a context. rx_queues is how many of them  */
+/*  poll a NIC queue of their own (ZMQ_IO_RUN_TO_COMPLETION). parks is how   */
+/*  many times they blocked (ZMQ_IO_SPIN_US), wakeups[i] counts the wake-ups */
+/*  that took from 2^(i-1) up to 2^i microseconds, the last one everything   */
+/*  longer.                                                                  */
+#define ZMQ_IO_WAKE_BUCKETS 16
+
+typedef struct zmq_io_stats_t
+{
+    uint64_t rx_queues;
+    uint64_t parks;
+    uint64_t wakeups [ZMQ_IO_WAKE_BUCKETS];
+} zmq_io_stats_t;
+
+ZMQ_EXPORT int zmq_io_stats (void *context, int io_thread,
+    zmq_io_stats_t *stats);
+
 /******************************************************************************/
 /*  0MQ socket definition.                                                    */
 /******************************************************************************/
@@ -295,6 +370,7 @@ ZMQ_EXPORT const char *zmq_msg_gets (const zmq_msg_t *msg, const char *property)
 #define ZMQ_XPUB 9
 #define ZMQ_XSUB 10
 #define ZMQ_STREAM 11
+#define ZMQ_AGGREGATOR 19
 
 /*  Deprecated aliases                                                        */
 #define ZMQ_XREQ ZMQ_DEALER
@@ -376,6 +452,15 @@ ZMQ_EXPORT const char *zmq_msg_gets (const zmq_msg_t *msg, const char *property)
 #define ZMQ_USE_FD 89
 
 #define ZMQ_NUM_TARGET 100
+#define ZMQ_RAW_PCB 101
+#define ZMQ_SHARD_RANGES 102
+#define ZMQ_SHARD_RING 103
+#define ZMQ_AGG_WORKERS 104
+#define ZMQ_AGG_REMOTES 105
+#define ZMQ_AGG_TIMEOUT 106
+#define ZMQ_AGG_ARENA 107
+#define ZMQ_TENSOR_CODEC 108
+#define ZMQ_TENSOR_TOPK 109
 
 /*  Message options                                                           */
 #define ZMQ_MORE 1
@@ -388,6 +473,48 @@ ZMQ_EXPORT const char *zmq_msg_gets (const zmq_msg_t *msg, const char *property)
 #define ZMQ_HOT 8
 #define ZMQ_KEY 16
 
+/*  Tensor frames. A message sent with ZMQ_KEY starts with a zmq_tensor_hdr_t */
+/*  followed by 'count' elements of type 'dtype', elements 'offset' and up of */
+/*  the tensor 'key'. It travels in chunks that each fill a segment of its    */
+/*  own and arrive as the parts of a multi-part message, every one with its   */
+/*  own header. A header without the elements it counts asks for them.        */
+#define ZMQ_DTYPE_U8 1
+#define ZMQ_DTYPE_I8 2
+#define ZMQ_DTYPE_F16 3
+#define ZMQ_DTYPE_BF16 4
+#define ZMQ_DTYPE_I32 5
+#define ZMQ_DTYPE_F32 6
+#define ZMQ_DTYPE_I64 7
+#define ZMQ_DTYPE_F64 8
+
+/*  Codecs for the float32 elements of tensor frames, see ZMQ_TENSOR_CODEC.  */
+#define ZMQ_CODEC_NONE 0
+#define ZMQ_CODEC_F16 1
+#define ZMQ_CODEC_BF16 2
+#define ZMQ_CODEC_Q8 3
+#define ZMQ_CODEC_TOPK 4
+
+typedef struct zmq_tensor_hdr_t
+{
+    uint64_t key;
+    uint32_t version;
+    uint8_t dtype;
+    uint8_t workers;
+    uint8_t reserved [2];
+    uint32_t count;
+    uint32_t offset;
+} zmq_tensor_hdr_t;
+
+/*  An entry of ZMQ_SHARD_RANGES: the elements from 'offset' of tensor 'key'  */
+/*  up to the start of the next entry are held by 'remote_id'.                */
+typedef struct zmq_shard_range_t
+{
+    uint64_t key;
+    uint32_t offset;
+    uint16_t remote_id;
+    uint16_t reserved;
+} zmq_shard_range_t;
+
 /*  Security mechanisms                                                       */
 #define ZMQ_NULL 0
 #define ZMQ_PLAIN 1
@@ -480,6 +607,27 @@ ZMQ_EXPORT int  zmq_poll (zmq_pollitem_t *items, int nitems, long timeout);
 ZMQ_EXPORT int zmq_proxy (void *frontend, void *backend, void *capture);
 ZMQ_EXPORT int zmq_proxy_steerable (void *frontend, void *backend, void *capture, void *control);
 
+/******************************************************************************/
+/*  Collectives                                                               */
+/******************************************************************************/
+
+/*  Reduction operations                                                      */
+#define ZMQ_OP_SUM 1
+#define ZMQ_OP_PROD 2
+#define ZMQ_OP_MIN 3
+#define ZMQ_OP_MAX 4
+
+/*  Allreduce algorithms                                                      */
+#define ZMQ_ALLREDUCE_AUTO 0
+#define ZMQ_ALLREDUCE_RING 1
+#define ZMQ_ALLREDUCE_TREE 2
+
+ZMQ_EXPORT void *zmq_group_new (void *socket, const uint16_t *remote_ids,
+    int size, int rank, int algo);
+ZMQ_EXPORT int zmq_group_close (void *group);
+ZMQ_EXPORT int zmq_allreduce (void *group, void *buf, size_t count,
+    int dtype, int op);
+
 /******************************************************************************/
 /*  Probe library capabilities                                                */
 /******************************************************************************/
@@ -622,6 +770,11 @@ ZMQ_EXPORT void zmq_threadclose (void* thread);
 #define ZMQ_THREAD_AFFINITY_CPU_ADD 7
 #define ZMQ_THREAD_AFFINITY_CPU_REMOVE 8
 #define ZMQ_THREAD_NAME_PREFIX 9
+#define ZMQ_IO_SPIN_US 10
+#define ZMQ_IO_RUN_TO_COMPLETION 11
+#define ZMQ_IO_MIGRATE_IVL 12
+#define ZMQ_IO_THREAD_CPU_ADD 13
+#define ZMQ_REAPER_CPU 14
 
 /*  DRAFT Socket methods.                                                     */
 ZMQ_EXPORT int zmq_join (void *s, const char *group);
@@ -969,7 +969,7 @@ netconn_send(struct netconn *conn, struct netbuf *buf)
 err_t
 netconn_write_netml(struct netconn *conn, const void *data,
 				size_t size, u8_t apiflags, size_t *bytes_written,
-				int remote_id)
+				int remote_id, struct netml_ref *ref)
 {
 	struct netvector vector;
 	API_MSG_VAR_DECLARE(msg);
@@ -1003,6 +1003,7 @@ netconn_write_netml(struct netconn *conn, const void *data,
 	API_MSG_VAR_REF(msg).msg.w.len = size;
 	API_MSG_VAR_REF(msg).msg.w.offset = 0;
 	API_MSG_VAR_REF(msg).msg.w.remote_id = remote_id;
+	API_MSG_VAR_REF(msg).msg.w.ref = ref;
 #if LWIP_SO_SNDTIMEO
 	if (conn->send_timeout != 0) {
 		/* get the time we started, which is later compared to
@@ -1032,6 +1033,53 @@ netconn_write_netml(struct netconn *conn, const void *data,
 	return err;
 
 }
+
+/**
+ * Enqueue a batch of NetML data, possibly to several remote nodes, with a
+ * single round trip to the tcpip core and a single tcp_output().
+ *
+ * The batch is always written non-blocking: entries are enqueued in order
+ * until the send buffer or queue is full.
+ *
+ * @param conn the TCP netconn over which to send data
+ * @param vectors entries to send
+ * @param vectorcnt number of entries
+ * @param bytes_written receives the number of bytes enqueued, counted
+ *        across all entries
+ * @return ERR_OK if (part of) the data was enqueued, ERR_WOULDBLOCK if
+ *         nothing could be, any other err_t on error
+ */
+err_t
+netconn_write_netml_batch(struct netconn *conn,
+				const struct netml_vector *vectors, u16_t vectorcnt,
+				size_t *bytes_written)
+{
+	API_MSG_VAR_DECLARE(msg);
+	err_t err;
+
+	LWIP_ERROR("netconn_write_netml_batch: invalid conn", (conn != NULL), return ERR_ARG;);
+	LWIP_ERROR("netconn_write_netml_batch: invalid conn->type",
+			(NETCONNTYPE_GROUP(conn->type) == NETCONN_TCP), return ERR_VAL;);
+	LWIP_ERROR("netconn_write_netml_batch: invalid bytes_written",
+			(bytes_written != NULL), return ERR_ARG;);
+
+	*bytes_written = 0;
+	if (vectorcnt == 0) {
+		return ERR_OK;
+	}
+
+	API_MSG_VAR_ALLOC(msg);
+	API_MSG_VAR_REF(msg).conn = conn;
+	API_MSG_VAR_REF(msg).msg.wb.vector = vectors;
+	API_MSG_VAR_REF(msg).msg.wb.vector_cnt = vectorcnt;
+	API_MSG_VAR_REF(msg).msg.wb.offset = 0;
+
+	err = netconn_apimsg(lwip_netconn_do_write_netml_batch, &API_MSG_VAR_REF(msg));
+	*bytes_written = API_MSG_VAR_REF(msg).msg.wb.offset;
+	API_MSG_VAR_FREE(msg);
+
+	return err;
+}
 #endif
 
 /**
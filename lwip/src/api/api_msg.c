@@ -1741,7 +1741,8 @@ lwip_netconn_do_writemore(struct netconn *conn  WRITE_DELAYED_PARAM)
 	  if (!conn->pcb.tcp->is_bypass && (apiflags & NETCONN_NETML_DATA)) {
 		err = tcp_write_netml(conn->pcb.tcp, dataptr, len,
 						conn->current_msg->msg.w.remote_id,
-						(apiflags & NETCONN_NETML_HOT));
+						(apiflags & NETCONN_NETML_HOT),
+						conn->current_msg->msg.w.ref);
 	  } else {
       	err = tcp_write(conn->pcb.tcp, dataptr, len, apiflags);
 	  }
@@ -1892,6 +1893,102 @@ lwip_netconn_do_write(void *m)
   TCPIP_APIMSG_ACK(msg);
 }
 
+#if LWIP_NETML
+/**
+ * Enqueue a batch of NetML data on a TCP pcb and push it out once.
+ * Called from netconn_write_netml_batch with the core locked, so the whole
+ * batch costs one lock acquisition and one tcp_output().
+ *
+ * @param m the api_msg pointing to the connection
+ */
+void
+lwip_netconn_do_write_netml_batch(void *m)
+{
+  struct api_msg *msg = (struct api_msg *)m;
+  struct netconn *conn = msg->conn;
+  struct tcp_pcb *pcb = conn->pcb.tcp;
+  err_t err = netconn_err(conn);
+  u16_t i;
+
+  if (err == ERR_OK) {
+    if (conn->state != NETCONN_NONE) {
+      /* netconn is connecting, closing or in blocking write */
+      err = ERR_INPROGRESS;
+    } else if (pcb == NULL) {
+      err = ERR_CONN;
+    }
+  }
+
+  if (err == ERR_OK) {
+#if LWIP_TCPIP_CORE_LOCKING
+    LWIP_ASSERT_CORE_LOCKED();
+#endif
+    for (i = 0; i < msg->msg.wb.vector_cnt && err == ERR_OK; i++) {
+      const struct netml_vector *vec = &msg->msg.wb.vector[i];
+      size_t off = 0;
+
+      while (off < vec->len) {
+        const u8_t *dataptr = (const u8_t *)vec->ptr + off;
+        size_t diff = vec->len - off;
+        u16_t len = (diff > 0xffffUL) ? 0xffff : (u16_t)diff;
+        u16_t available = tcp_sndbuf(pcb);
+
+        if (vec->chunk != 0) {
+          /* one record per write, so that it starts a segment, and none
+             cut in two */
+          len = LWIP_MIN(len, vec->chunk);
+          if (available < len) {
+            err = ERR_MEM;
+            break;
+          }
+        }
+        if (available < len) {
+          len = available;
+        }
+        if (len == 0) {
+          err = ERR_MEM;
+          break;
+        }
+
+        if (pcb->is_bypass) {
+          err = tcp_write(pcb, dataptr, len,
+                          TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+        } else {
+          err = tcp_write_netml(pcb, dataptr, len, vec->remote_id,
+                                vec->is_hot, vec->ref);
+        }
+        if (err != ERR_OK) {
+          break;
+        }
+        off += len;
+        msg->msg.wb.offset += len;
+      }
+    }
+
+    if (err == ERR_MEM) {
+      /* partial write: mark the pcb non-writable and let poll_tcp check
+         writable space to mark it writable again */
+      API_EVENT(conn, NETCONN_EVT_SENDMINUS, 0);
+      conn->flags |= NETCONN_FLAG_CHECK_WRITESPACE;
+      err = (msg->msg.wb.offset == 0) ? ERR_WOULDBLOCK : ERR_OK;
+    } else if ((tcp_sndbuf(pcb) <= TCP_SNDLOWAT) ||
+               (tcp_sndqueuelen(pcb) >= TCP_SNDQUEUELOWAT)) {
+      API_EVENT(conn, NETCONN_EVT_SENDMINUS, 0);
+    }
+
+    if (msg->msg.wb.offset > 0) {
+      err_t out_err = tcp_output(pcb);
+      if (out_err == ERR_RTE) {
+        err = out_err;
+      }
+    }
+  }
+
+  msg->err = err;
+  TCPIP_APIMSG_ACK(msg);
+}
+#endif /* LWIP_NETML */
+
 /**
  * Return a connection's local or remote address
  * Called from netconn_getaddr
@@ -0,0 +1,531 @@
+/**
+ * @file
+ * NetML raw TCP transport
+ *
+ * Takes the tcp_pcb of a connected socket away from its netconn and serves
+ * it with the raw TCP callbacks. Received pbufs are queued on the transport
+ * by the recv callback and handed out without a mbox round trip, writes go
+ * straight to tcp_write_netml under the core lock, and readiness is tracked
+ * in two flags that the owner polls after being notified.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_NETML && LWIP_SOCKET && LWIP_TCP
+
+#include <string.h>
+
+#include "lwip/netml_raw.h"
+#include "lwip/sockets.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/api.h"
+#include "lwip/priv/api_msg.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
+#include "lwip/mem.h"
+#include "lwip/pbuf.h"
+#include "lwip/netml.h"
+
+/* Interval (in TCP coarse timer ticks) at which writable space is rechecked
+ * after a partial write, like poll_tcp does for netconns */
+#define NETML_RAW_POLL_INTERVAL 2
+
+struct netml_raw {
+  /* NULL once the connection has failed */
+  struct tcp_pcb *pcb;
+  /* received data not consumed yet, not passed to tcp_recved either */
+  struct pbuf *rx;
+  /* FIN received */
+  u8_t eof;
+  /* error reported by tcp_err */
+  err_t err;
+  /* readiness, written with the core lock held, read without */
+  volatile u8_t readable;
+  volatile u8_t writable;
+  netml_raw_notify_fn notify_fn;
+  void *notify_arg;
+};
+
+static void
+netml_raw_notify(struct netml_raw *raw)
+{
+  if (raw->notify_fn != NULL) {
+    raw->notify_fn(raw->notify_arg);
+  }
+}
+
+static void
+netml_raw_update_readable(struct netml_raw *raw)
+{
+  raw->readable = (raw->rx != NULL) || raw->eof || (raw->err != ERR_OK);
+}
+
+/* Same low-water marks select uses for netconns */
+static int
+netml_raw_has_writespace(struct tcp_pcb *pcb)
+{
+  return (tcp_sndbuf(pcb) > TCP_SNDLOWAT) &&
+         (tcp_sndqueuelen(pcb) < TCP_SNDQUEUELOWAT);
+}
+
+static err_t
+netml_raw_recv_cb(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  struct netml_raw *raw = (struct netml_raw *)arg;
+
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(err);
+  LWIP_ASSERT("netml_raw_recv_cb: no transport", raw != NULL);
+
+  if (p == NULL) {
+    raw->eof = 1;
+  } else if (raw->rx == NULL) {
+    raw->rx = p;
+  } else {
+    pbuf_cat(raw->rx, p);
+  }
+  raw->readable = 1;
+  netml_raw_notify(raw);
+  return ERR_OK;
+}
+
+static err_t
+netml_raw_sent_cb(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  struct netml_raw *raw = (struct netml_raw *)arg;
+
+  LWIP_UNUSED_ARG(len);
+
+  if (!raw->writable && netml_raw_has_writespace(pcb)) {
+    raw->writable = 1;
+    netml_raw_notify(raw);
+  }
+  return ERR_OK;
+}
+
+static err_t
+netml_raw_poll_cb(void *arg, struct tcp_pcb *pcb)
+{
+  return netml_raw_sent_cb(arg, pcb, 0);
+}
+
+/* The pcb has already been freed when this is called */
+static void
+netml_raw_err_cb(void *arg, err_t err)
+{
+  struct netml_raw *raw = (struct netml_raw *)arg;
+
+  raw->pcb = NULL;
+  raw->err = (err == ERR_OK) ? ERR_CLSD : err;
+  raw->readable = 1;
+  raw->writable = 1;
+  netml_raw_notify(raw);
+}
+
+static void
+netml_raw_unhook(struct tcp_pcb *pcb)
+{
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, NULL);
+  tcp_sent(pcb, NULL);
+  tcp_err(pcb, NULL);
+  tcp_poll(pcb, NULL, 0);
+}
+
+/**
+ * Take over the connection of TCP socket s. Data the socket layer has
+ * already received moves over to the transport and the socket is closed,
+ * so s must not be used afterwards. On failure NULL is returned with errno
+ * set and the socket is left alone.
+ */
+struct netml_raw *
+netml_raw_attach(int s)
+{
+  struct lwip_sock *sock;
+  struct netconn *conn;
+  struct tcp_pcb *pcb;
+  struct netml_raw *raw;
+  void *msg;
+  err_t err;
+
+  sock = lwip_socket_dbg_get_socket(s);
+  if ((sock == NULL) || (sock->conn == NULL) ||
+      (NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP)) {
+    set_errno(EBADF);
+    return NULL;
+  }
+  conn = sock->conn;
+
+  raw = (struct netml_raw *)mem_calloc(1, sizeof(struct netml_raw));
+  if (raw == NULL) {
+    set_errno(ENOMEM);
+    return NULL;
+  }
+
+  LOCK_TCPIP_CORE();
+  pcb = conn->pcb.tcp;
+  if ((pcb == NULL) || (pcb->state == LISTEN) ||
+      (conn->state != NETCONN_NONE)) {
+    UNLOCK_TCPIP_CORE();
+    mem_free(raw);
+    set_errno(ENOTCONN);
+    return NULL;
+  }
+
+  /* None of this has been passed to tcp_recved yet, netml_raw_recv* does */
+  raw->rx = sock->lastdata.pbuf;
+  sock->lastdata.pbuf = NULL;
+  if (sys_mbox_valid(&conn->recvmbox)) {
+    while (sys_arch_mbox_tryfetch(&conn->recvmbox, &msg) != SYS_MBOX_EMPTY) {
+      if (lwip_netconn_is_err_msg(msg, &err)) {
+        if (err == ERR_CLSD) {
+          raw->eof = 1;
+        } else {
+          raw->err = err;
+        }
+      } else if (raw->rx == NULL) {
+        raw->rx = (struct pbuf *)msg;
+      } else {
+        pbuf_cat(raw->rx, (struct pbuf *)msg);
+      }
+    }
+  }
+#if LWIP_SO_RCVBUF
+  SYS_ARCH_SET(conn->recv_avail, 0);
+#endif /* LWIP_SO_RCVBUF */
+  if (conn->pending_err != ERR_OK) {
+    raw->err = conn->pending_err;
+  }
+
+  raw->pcb = pcb;
+  netml_raw_update_readable(raw);
+  raw->writable = netml_raw_has_writespace(pcb);
+
+  tcp_arg(pcb, raw);
+  tcp_recv(pcb, netml_raw_recv_cb);
+  tcp_sent(pcb, netml_raw_sent_cb);
+  tcp_err(pcb, netml_raw_err_cb);
+  tcp_poll(pcb, netml_raw_poll_cb, NETML_RAW_POLL_INTERVAL);
+
+  /* The netconn must not close the pcb it no longer owns */
+  conn->pcb.tcp = NULL;
+  UNLOCK_TCPIP_CORE();
+
+  lwip_close(s);
+  return raw;
+}
+
+/* Close the connection gracefully and free the transport */
+void
+netml_raw_close(struct netml_raw *raw)
+{
+  LOCK_TCPIP_CORE();
+  if (raw->pcb != NULL) {
+    netml_raw_unhook(raw->pcb);
+    if (tcp_close(raw->pcb) != ERR_OK) {
+      tcp_abort(raw->pcb);
+    }
+    raw->pcb = NULL;
+  }
+  if (raw->rx != NULL) {
+    pbuf_free(raw->rx);
+    raw->rx = NULL;
+  }
+  UNLOCK_TCPIP_CORE();
+
+  mem_free(raw);
+}
+
+/* Install the function called on readiness changes, NULL to remove it.
+ * Once this returns the previous function is not called any more. */
+void
+netml_raw_setnotify(struct netml_raw *raw, netml_raw_notify_fn fn, void *arg)
+{
+  LOCK_TCPIP_CORE();
+  raw->notify_fn = fn;
+  raw->notify_arg = arg;
+  UNLOCK_TCPIP_CORE();
+}
+
+/* Lock-free snapshot of the readiness, see NETML_RAW_IN etc. */
+int
+netml_raw_events(const struct netml_raw *raw)
+{
+  int events = 0;
+
+  if (raw->readable) {
+    events |= NETML_RAW_IN;
+  }
+  if (raw->writable) {
+    events |= NETML_RAW_OUT;
+  }
+  if (raw->err != ERR_OK) {
+    events |= NETML_RAW_ERR;
+  }
+  return events;
+}
+
+/* Counterpart of lwip_setlocalid */
+int
+netml_raw_setlocalid(struct netml_raw *raw, int id)
+{
+  LOCK_TCPIP_CORE();
+  if ((raw->pcb != NULL) && !raw->pcb->is_bypass) {
+    raw->pcb->local_id = (u16_t)id;
+    if (id == SCHEDULAR_ID) {
+      raw->pcb->is_bypass = 1;
+    }
+  }
+  UNLOCK_TCPIP_CORE();
+  return 0;
+}
+
+/* Nothing queued: end of stream, pending error or EWOULDBLOCK */
+static ssize_t
+netml_raw_nodata(struct netml_raw *raw)
+{
+  raw->readable = raw->eof || (raw->err != ERR_OK);
+  if (raw->eof) {
+    return 0;
+  }
+  if (raw->err != ERR_OK) {
+    set_errno(err_to_errno(raw->err));
+  } else {
+    set_errno(EWOULDBLOCK);
+  }
+  return -1;
+}
+
+/* Copy up to len bytes of received data to mem. Returns the number of
+ * bytes copied, 0 at the end of the stream or -1 with errno set. */
+ssize_t
+netml_raw_recv(struct netml_raw *raw, void *mem, size_t len)
+{
+  u16_t copied;
+  ssize_t ret;
+
+  LOCK_TCPIP_CORE();
+  if (raw->rx == NULL) {
+    ret = netml_raw_nodata(raw);
+    UNLOCK_TCPIP_CORE();
+    return ret;
+  }
+
+  copied = pbuf_copy_partial(raw->rx, mem,
+                             (u16_t)LWIP_MIN(len, 0xffff), 0);
+  raw->rx = pbuf_free_header(raw->rx, copied);
+  if (raw->pcb != NULL) {
+    tcp_recved(raw->pcb, copied);
+  }
+  netml_raw_update_readable(raw);
+  UNLOCK_TCPIP_CORE();
+
+  return (ssize_t)copied;
+}
+
+/* Like lwip_recv_pbuf: hand the first non-empty received pbuf over to the
+ * caller, who releases it with pbuf_free(). */
+ssize_t
+netml_raw_recv_pbuf(struct netml_raw *raw, struct pbuf **p)
+{
+  struct pbuf *q, *rest;
+  ssize_t ret;
+
+  LWIP_ASSERT("p != NULL", p != NULL);
+  *p = NULL;
+
+  LOCK_TCPIP_CORE();
+  for (;;) {
+    q = raw->rx;
+    if (q == NULL) {
+      ret = netml_raw_nodata(raw);
+      UNLOCK_TCPIP_CORE();
+      return ret;
+    }
+
+    /* Split off the head, see lwip_recv_pbuf */
+    rest = q->next;
+    if (rest != NULL) {
+      pbuf_ref(rest);
+      rest = pbuf_dechain(q);
+    }
+    raw->rx = rest;
+
+    /* tcp_input() may leave empty pbufs at the head of a trimmed segment,
+       returning one would read as the end of the stream */
+    if (q->len != 0) {
+      break;
+    }
+    pbuf_free(q);
+  }
+
+  if (raw->pcb != NULL) {
+    tcp_recved(raw->pcb, q->len);
+  }
+  netml_raw_update_readable(raw);
+  UNLOCK_TCPIP_CORE();
+
+  *p = q;
+  return (ssize_t)q->len;
+}
+
+/* Called after a write with the core locked, mirrors lwip_netconn_do_writemore */
+static err_t
+netml_raw_finish_write(struct netml_raw *raw, size_t written, size_t size,
+                       err_t err)
+{
+  struct tcp_pcb *pcb = raw->pcb;
+
+  if ((written < size) || !netml_raw_has_writespace(pcb)) {
+    raw->writable = 0;
+  }
+  if (written > 0) {
+    if (tcp_output(pcb) == ERR_RTE) {
+      return ERR_RTE;
+    }
+  }
+  if (err == ERR_MEM) {
+    err = (written == 0) ? ERR_WOULDBLOCK : ERR_OK;
+  }
+  return err;
+}
+
+static err_t
+netml_raw_conn_err(struct netml_raw *raw)
+{
+  return (raw->err != ERR_OK) ? raw->err : ERR_CLSD;
+}
+
+/* Non-blocking counterpart of lwip_send_netml/lwip_send_netml_ref.
+ * Returns the number of bytes enqueued or -1 with errno set (EWOULDBLOCK
+ * if nothing fit). */
+ssize_t
+netml_raw_send(struct netml_raw *raw, const void *data, size_t size,
+               int flags, int remote_id, struct netml_ref *ref)
+{
+  const u8_t *dataptr = (const u8_t *)data;
+  struct tcp_pcb *pcb;
+  size_t written = 0;
+  err_t err = ERR_OK;
+  u16_t len;
+
+  LOCK_TCPIP_CORE();
+  pcb = raw->pcb;
+  if (pcb == NULL) {
+    err = netml_raw_conn_err(raw);
+    UNLOCK_TCPIP_CORE();
+    set_errno(err_to_errno(err));
+    return -1;
+  }
+
+  while (written < size) {
+    len = (u16_t)LWIP_MIN(size - written, 0xffff);
+    if (tcp_sndbuf(pcb) < len) {
+      len = tcp_sndbuf(pcb);
+    }
+    if (len == 0) {
+      err = ERR_MEM;
+      break;
+    }
+
+    if ((flags & LWIP_MSG_NETML) && !pcb->is_bypass) {
+      err = tcp_write_netml(pcb, dataptr + written, len, (u16_t)remote_id,
+                            (flags & LWIP_MSG_NETML_HOT) ? 1 : 0, ref);
+    } else {
+      err = tcp_write(pcb, dataptr + written, len,
+                      TCP_WRITE_FLAG_COPY |
+                      ((written + len < size) ? TCP_WRITE_FLAG_MORE : 0));
+    }
+    if (err != ERR_OK) {
+      break;
+    }
+    written += len;
+  }
+
+  err = netml_raw_finish_write(raw, written, size, err);
+  UNLOCK_TCPIP_CORE();
+
+  if (err != ERR_OK) {
+    set_errno(err_to_errno(err));
+    return -1;
+  }
+  return (ssize_t)written;
+}
+
+/* Counterpart of lwip_send_netml_batch */
+ssize_t
+netml_raw_send_batch(struct netml_raw *raw, const struct netml_vector *vec,
+                     int vcnt)
+{
+  struct tcp_pcb *pcb;
+  size_t written = 0, total = 0;
+  err_t err = ERR_OK;
+  int i;
+
+  if (vcnt < 0) {
+    set_errno(EINVAL);
+    return -1;
+  }
+  for (i = 0; i < vcnt; i++) {
+    total += vec[i].len;
+  }
+
+  LOCK_TCPIP_CORE();
+  pcb = raw->pcb;
+  if (pcb == NULL) {
+    err = netml_raw_conn_err(raw);
+    UNLOCK_TCPIP_CORE();
+    set_errno(err_to_errno(err));
+    return -1;
+  }
+
+  for (i = 0; i < vcnt && err == ERR_OK; i++) {
+    size_t off = 0;
+
+    while (off < vec[i].len) {
+      const u8_t *dataptr = (const u8_t *)vec[i].ptr + off;
+      u16_t len = (u16_t)LWIP_MIN(vec[i].len - off, 0xffff);
+
+      if (vec[i].chunk != 0) {
+        /* one record per write, so that it starts a segment, and none cut
+           in two */
+        len = LWIP_MIN(len, vec[i].chunk);
+        if (tcp_sndbuf(pcb) < len) {
+          err = ERR_MEM;
+          break;
+        }
+      }
+      if (tcp_sndbuf(pcb) < len) {
+        len = tcp_sndbuf(pcb);
+      }
+      if (len == 0) {
+        err = ERR_MEM;
+        break;
+      }
+
+      if (pcb->is_bypass) {
+        err = tcp_write(pcb, dataptr, len,
+                        TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+      } else {
+        err = tcp_write_netml(pcb, dataptr, len, vec[i].remote_id,
+                              vec[i].is_hot, vec[i].ref);
+      }
+      if (err != ERR_OK) {
+        break;
+      }
+      off += len;
+      written += len;
+    }
+  }
+
+  err = netml_raw_finish_write(raw, written, total, err);
+  UNLOCK_TCPIP_CORE();
+
+  if (err != ERR_OK) {
+    set_errno(err_to_errno(err));
+    return -1;
+  }
+  return (ssize_t)written;
+}
+
+#endif /* LWIP_NETML && LWIP_SOCKET && LWIP_TCP */
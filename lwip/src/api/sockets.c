@@ -531,6 +531,10 @@ alloc_socket(struct netconn *newconn, int accepted)
       sockets[i].sendevent  = (NETCONNTYPE_GROUP(newconn->type) == NETCONN_TCP ? (accepted != 0) : 1);
       sockets[i].errevent   = 0;
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
+#if LWIP_NETML
+      sockets[i].wakeup_fn  = NULL;
+      sockets[i].wakeup_arg = NULL;
+#endif /* LWIP_NETML */
       return i + LWIP_SOCKET_OFFSET;
     }
     SYS_ARCH_UNPROTECT(lev);
@@ -611,7 +615,7 @@ free_socket(struct lwip_sock *sock, int is_tcp)
   }
 }
 
-#ifdef LWIP_NETML
+#if LWIP_NETML
 int lwip_setlocalid(int s, int id) {
 	struct lwip_sock *sock;
 
@@ -657,12 +661,13 @@ int lwip_setbypass(int s) {
 	return 0;
 }
 
-ssize_t
-lwip_send_netml(int s, const void *data, size_t size, int flags, int remote_id)
+static ssize_t
+lwip_send_netml_common(int s, const void *data, size_t size, int flags,
+                       int remote_id, struct netml_ref *ref)
 {
   struct lwip_sock *sock;
   err_t err;
-  u8_t write_flags, dontblock;
+  u8_t write_flags;
   size_t written;
 
 //  fprintf(stdout, "[%s][%d]: lwip_send_netml to %d, sock %d, len %"SZT_F", flags %x\n",
@@ -694,7 +699,8 @@ lwip_send_netml(int s, const void *data, size_t size, int flags, int remote_id)
   }
 
   written = 0;
-  err = netconn_write_netml(sock->conn, data, size, write_flags, &written, remote_id);
+  err = netconn_write_netml(sock->conn, data, size, write_flags, &written,
+				  remote_id, ref);
 
 //  fprintf(stdout, "[%s][%d]: lwip_send_netml(%d) err=%d written=%"SZT_F"\n",
 //				  __FILE__, __LINE__, s, err, written);
@@ -704,6 +710,156 @@ lwip_send_netml(int s, const void *data, size_t size, int flags, int remote_id)
   return (err == ERR_OK ? (ssize_t)written : -1);
 }
 
+ssize_t
+lwip_send_netml(int s, const void *data, size_t size, int flags, int remote_id)
+{
+  return lwip_send_netml_common(s, data, size, flags, remote_id, NULL);
+}
+
+/* Like lwip_send_netml, but the data is not copied: the segments reference
+ * it and hold ref until they are acked (see tcp_write_netml). The caller
+ * keeps its own reference for as long as it may still pass the data in. */
+ssize_t
+lwip_send_netml_ref(int s, const void *data, size_t size, int flags,
+                    int remote_id, struct netml_ref *ref)
+{
+  LWIP_ASSERT("ref != NULL", ref != NULL);
+  return lwip_send_netml_common(s, data, size, flags, remote_id, ref);
+}
+
+/* Enqueue vcnt entries, possibly for different remote ids, under a single
+ * core lock and push them out with a single tcp_output. Always non-blocking:
+ * returns the number of bytes enqueued across the entries, which may stop
+ * in the middle of one, or -1 with errno set (EWOULDBLOCK if nothing fit).
+ */
+ssize_t
+lwip_send_netml_batch(int s, const struct netml_vector *vec, int vcnt)
+{
+  struct lwip_sock *sock;
+  err_t err;
+  size_t written;
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP ||
+      vcnt < 0 || vcnt > 0xffff) {
+    sock_set_errno(sock, err_to_errno(ERR_ARG));
+    done_socket(sock);
+    return -1;
+  }
+
+  written = 0;
+  err = netconn_write_netml_batch(sock->conn, vec, (u16_t)vcnt, &written);
+
+  sock_set_errno(sock, err_to_errno(err));
+  done_socket(sock);
+  return (err == ERR_OK ? (ssize_t)written : -1);
+}
+
+/* Hand the next received pbuf of a TCP socket over to the caller instead of
+ * copying its payload out. Only the first pbuf of a chain is returned, the
+ * rest stays in sock->lastdata for the next call, so *p always describes a
+ * single contiguous payload of (*p)->len > 0 bytes. The caller owns the returned
+ * reference and must release it with pbuf_free(). Returns the payload length,
+ * 0 if the connection was closed by the peer or -1 on error (errno is set).
+ */
+ssize_t
+lwip_recv_pbuf(int s, struct pbuf **p, int flags)
+{
+  struct lwip_sock *sock;
+  struct pbuf *q, *rest;
+  u8_t apiflags = NETCONN_NOAUTORCVD;
+  err_t err;
+  u16_t len;
+
+  LWIP_ASSERT("p != NULL", p != NULL);
+  *p = NULL;
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP) {
+    sock_set_errno(sock, err_to_errno(ERR_ARG));
+    done_socket(sock);
+    return -1;
+  }
+
+  if (flags & LWIP_MSG_DONTWAIT) {
+    apiflags |= NETCONN_DONTBLOCK;
+  }
+
+  do {
+    if (sock->lastdata.pbuf) {
+      q = sock->lastdata.pbuf;
+    } else {
+      err = netconn_recv_tcp_pbuf_flags(sock->conn, &q, apiflags);
+      if (err != ERR_OK) {
+        sock_set_errno(sock, err_to_errno(err));
+        done_socket(sock);
+        return (err == ERR_CLSD) ? 0 : -1;
+      }
+      LWIP_ASSERT("q != NULL", q != NULL);
+    }
+
+    /* Split off the head. pbuf_dechain() drops the reference the head held on
+     * the tail, take one for lastdata first so the tail survives. */
+    rest = q->next;
+    if (rest != NULL) {
+      pbuf_ref(rest);
+      rest = pbuf_dechain(q);
+    }
+    sock->lastdata.pbuf = rest;
+
+    /* Trimming in tcp_input() may leave empty pbufs at the head of a
+       segment. Skip them, 0 is returned at the end of the stream only. */
+    if (q->len == 0) {
+      pbuf_free(q);
+      q = NULL;
+    }
+  } while (q == NULL);
+
+  len = q->len;
+  *p = q;
+
+  /* The data is no longer buffered by the stack, reopen the window now */
+  netconn_tcp_recvd(sock->conn, (size_t)len);
+
+  sock_set_errno(sock, 0);
+  done_socket(sock);
+  return (ssize_t)len;
+}
+
+/* Register fn to be called whenever the socket becomes readable, writable
+ * or gets an error, i.e. on the same edges that wake up a thread blocked in
+ * select. fn runs in whichever thread signals the event, usually with the
+ * core lock held, so it must be short and must not call back into the stack.
+ * Pass NULL to unregister.
+ */
+int
+lwip_setwakeup(int s, lwip_wakeup_fn fn, void *arg)
+{
+  struct lwip_sock *sock;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+
+  SYS_ARCH_PROTECT(lev);
+  sock->wakeup_fn = fn;
+  sock->wakeup_arg = arg;
+  SYS_ARCH_UNPROTECT(lev);
+
+  done_socket(sock);
+  return 0;
+}
+
 #endif /* LWIP_NETML */
 
 /* Below this, the well-known socket functions are implemented.
@@ -2592,6 +2748,10 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
 {
   int s, check_waiters;
   struct lwip_sock *sock;
+#if LWIP_NETML
+  lwip_wakeup_fn wakeup_fn = NULL;
+  void *wakeup_arg = NULL;
+#endif /* LWIP_NETML */
   SYS_ARCH_DECL_PROTECT(lev);
 
   LWIP_UNUSED_ARG(len);
@@ -2659,6 +2819,13 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
       break;
   }
 
+#if LWIP_NETML
+  if (check_waiters) {
+    wakeup_fn = sock->wakeup_fn;
+    wakeup_arg = sock->wakeup_arg;
+  }
+#endif /* LWIP_NETML */
+
   if (sock->select_waiting && check_waiters) {
     /* Save which events are active */
     int has_recvevent, has_sendevent, has_errevent;
@@ -2671,6 +2838,11 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
   } else {
     SYS_ARCH_UNPROTECT(lev);
   }
+#if LWIP_NETML
+  if (wakeup_fn != NULL) {
+    wakeup_fn(wakeup_arg);
+  }
+#endif /* LWIP_NETML */
   done_socket(sock);
 }
 
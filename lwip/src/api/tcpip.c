@@ -121,77 +121,6 @@ again:
 }
 #endif /* !LWIP_TIMERS */
 
-struct arp_entry_s {
-	struct eth_addr mac;
-	ip4_addr_t ip;
-};
-
-static struct arp_entry_s static_arp[5];
-
-static void __init_arp_entries(void)
-{
-	int ret = 0;
-
-	IP4_ADDR(&static_arp[0].ip, 172,168,0,64);
-	IP4_ADDR(&static_arp[1].ip, 172,168,0,65);
-	IP4_ADDR(&static_arp[2].ip, 172,168,0,66);
-	IP4_ADDR(&static_arp[3].ip, 172,168,0,67);
-	IP4_ADDR(&static_arp[4].ip, 172,168,1,72);
-
-	static_arp[0].mac.addr[0] = 0;
-	static_arp[0].mac.addr[1] = 0;
-	static_arp[0].mac.addr[2] = 0;
-	static_arp[0].mac.addr[3] = 0;
-	static_arp[0].mac.addr[4] = 0;
-	static_arp[0].mac.addr[5] = 5;
-	static_arp[1].mac.addr[0] = 0;
-	static_arp[1].mac.addr[1] = 0;
-	static_arp[1].mac.addr[2] = 0;
-	static_arp[1].mac.addr[3] = 0;
-	static_arp[1].mac.addr[4] = 0;
-	static_arp[1].mac.addr[5] = 6;
-	static_arp[2].mac.addr[0] = 0;
-	static_arp[2].mac.addr[1] = 0;
-	static_arp[2].mac.addr[2] = 0;
-	static_arp[2].mac.addr[3] = 0;
-	static_arp[2].mac.addr[4] = 0;
-	static_arp[2].mac.addr[5] = 7;
-	static_arp[3].mac.addr[0] = 0;
-	static_arp[3].mac.addr[1] = 0;
-	static_arp[3].mac.addr[2] = 0;
-	static_arp[3].mac.addr[3] = 0;
-	static_arp[3].mac.addr[4] = 0;
-	static_arp[3].mac.addr[5] = 8;
-	static_arp[4].mac.addr[0] = 0;
-	static_arp[4].mac.addr[1] = 2;
-	static_arp[4].mac.addr[2] = 0;
-	static_arp[4].mac.addr[3] = 0;
-	static_arp[4].mac.addr[4] = 3;
-	static_arp[4].mac.addr[5] = 0;
-//	static_arp[0].mac.addr = {0,0,0,0,0,5};
-//	static_arp[1].mac.addr = {0,0,0,0,0,6};
-//	static_arp[2].mac.addr = {0,0,0,0,0,7};
-//	static_arp[3].mac.addr = {0,0,0,0,0,8};
-//	static_arp[4].mac.addr = {0,2,0,0,3,0};
-
-	fprintf(stdout, "Add static ARP entries\n");
-	for (int i = 0; i < 5; i++) {
-		ret = etharp_add_static_entry(&static_arp[i].ip, &static_arp[i].mac);
-		if (ret != ERR_OK) {
-			fprintf(stdout, "[%s][%d]: Failed (%d) to add static arp entry: %s,%02X:%02X:%02X:%02X:%02X:%02X\n",
-							__FILE__, __LINE__, ret,
-							ip4addr_ntoa(&static_arp[i].ip),
-							static_arp[i].mac.addr[0],
-							static_arp[i].mac.addr[1],
-							static_arp[i].mac.addr[2],
-							static_arp[i].mac.addr[3],
-							static_arp[i].mac.addr[4],
-							static_arp[i].mac.addr[5]);
-
-		}
-	}
-}
-
 /**
  * The main lwIP thread. This thread has exclusive access to lwIP core functions
  * (unless access to them is not locked). Other threads communicate with this
@@ -232,7 +161,6 @@ tcpip_thread(void *arg)
   	seq_tbls[0] = tbl;
   }
 #endif
-  __init_arp_entries();
 
   while (1) {                          /* MAIN Loop */
     LWIP_TCPIP_THREAD_ALIVE();
@@ -719,8 +647,6 @@ tcpip_init(tcpip_init_done_fn initfunc, void *arg)
   	tcpip_init_done(tcpip_init_done_arg);
   }
 
-  __init_arp_entries();
-
 //  LOCK_TCPIP_CORE();
 //  sys_thread_new(TCPIP_THREAD_NAME, tcpip_thread, NULL, TCPIP_THREAD_STACKSIZE, TCPIP_THREAD_PRIO);
 }
@@ -54,6 +54,10 @@
 #include "lwip/autoip.h"
 #include "lwip/prot/iana.h"
 #include "netif/ethernet.h"
+#if LWIP_NETML
+#include "mlib/hmap.h"
+#include "mlib/hash.h"
+#endif /* LWIP_NETML */
 
 #include <string.h>
 
@@ -178,6 +182,9 @@ etharp_free_entry(int i)
   }
   /* recycle entry for re-use */
   arp_table[i].state = ETHARP_STATE_EMPTY;
+#if LWIP_NETML
+  ip4_flow_invalidate_all();
+#endif /* LWIP_NETML */
 #ifdef LWIP_DEBUG
   /* for debugging, clean out the complete entry */
   arp_table[i].ctime = 0;
@@ -462,6 +469,11 @@ etharp_update_arp_entry(struct netif *netif, const ip4_addr_t *ipaddr, struct et
 
   LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_update_arp_entry: updating stable entry %"S16_F"\n", i));
   /* update address */
+#if LWIP_NETML
+  if (memcmp(&arp_table[i].ethaddr, ethaddr, ETH_HWADDR_LEN) != 0) {
+    ip4_flow_invalidate_all();
+  }
+#endif /* LWIP_NETML */
   SMEMCPY(&arp_table[i].ethaddr, ethaddr, ETH_HWADDR_LEN);
   /* reset time stamp */
   arp_table[i].ctime = 0;
@@ -550,6 +562,138 @@ etharp_remove_static_entry(const ip4_addr_t *ipaddr)
 }
 #endif /* ETHARP_SUPPORT_STATIC_ENTRIES */
 
+#if LWIP_NETML
+/* Configured neighbors. Unlike arp_table this is keyed by IP address and
+ * grows with the cluster, so lookups stay O(1) for hundreds of nodes.
+ * Entries are never freed: removing one only invalidates it, so the
+ * pointers cached in the pcbs' netif_hint stay safe to dereference. */
+struct etharp_neigh {
+  struct hmap_node node;
+  ip4_addr_t ipaddr;
+  struct eth_addr ethaddr;
+  u8_t valid;
+};
+
+static struct hmap neigh_table = HMAP_INITIALIZER(&neigh_table);
+
+static struct etharp_neigh *
+etharp_neigh_find(const ip4_addr_t *ipaddr)
+{
+  struct etharp_neigh *neigh;
+
+  HMAP_FOR_EACH_WITH_HASH(neigh, struct etharp_neigh, node,
+                          hash_int(ip4_addr_get_u32(ipaddr), 0), &neigh_table) {
+    if (ip4_addr_cmp(&neigh->ipaddr, ipaddr)) {
+      return neigh;
+    }
+  }
+  return NULL;
+}
+
+/** Add or update a neighbor. Packets to ipaddr are then sent to ethaddr
+ * without going through the ARP table.
+ *
+ * @param ipaddr IP address of the neighbor
+ * @param ethaddr ethernet address of the neighbor
+ * @return ERR_OK or ERR_MEM
+ */
+err_t
+etharp_add_neighbor(const ip4_addr_t *ipaddr, const struct eth_addr *ethaddr)
+{
+  struct etharp_neigh *neigh;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  neigh = etharp_neigh_find(ipaddr);
+  if (neigh == NULL) {
+    neigh = (struct etharp_neigh *)mem_malloc(sizeof(struct etharp_neigh));
+    if (neigh == NULL) {
+      return ERR_MEM;
+    }
+    ip4_addr_copy(neigh->ipaddr, *ipaddr);
+    hmap_insert(&neigh_table, &neigh->node, hash_int(ip4_addr_get_u32(ipaddr), 0));
+  }
+  SMEMCPY(&neigh->ethaddr, ethaddr, ETH_HWADDR_LEN);
+  neigh->valid = 1;
+  ip4_flow_invalidate_all();
+  return ERR_OK;
+}
+
+/** Remove a neighbor added with etharp_add_neighbor.
+ *
+ * @param ipaddr IP address of the neighbor
+ * @return ERR_OK: neighbor removed
+ *         ERR_VAL: neighbor wasn't found
+ */
+err_t
+etharp_remove_neighbor(const ip4_addr_t *ipaddr)
+{
+  struct etharp_neigh *neigh;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  neigh = etharp_neigh_find(ipaddr);
+  if (neigh == NULL || !neigh->valid) {
+    return ERR_VAL;
+  }
+  neigh->valid = 0;
+  ip4_flow_invalidate_all();
+  return ERR_OK;
+}
+
+#if LWIP_TESTMODE
+/** Free every neighbor. For the unit tests only: no pcb may still hold a
+ * hint into the table. */
+void
+etharp_free_neighbors(void)
+{
+  struct hmap_node *node;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  while ((node = hmap_first(&neigh_table)) != NULL) {
+    hmap_remove(&neigh_table, node);
+    mem_free(CONTAINER_OF(node, struct etharp_neigh, node));
+  }
+  ip4_flow_invalidate_all();
+}
+#endif /* LWIP_TESTMODE */
+
+/* Resolve dst_addr against the neighbor table, trying the pcb's cached
+ * entry first. Returns NULL if the address is not a configured neighbor. */
+static const struct etharp_neigh *
+etharp_neigh_resolve(struct netif *netif, const ip4_addr_t *dst_addr)
+{
+  struct etharp_neigh *neigh;
+
+#if LWIP_NETIF_HWADDRHINT
+  if (netif->hints != NULL) {
+    neigh = netif->hints->neigh_hint;
+    if (neigh != NULL && neigh->valid &&
+        ip4_addr_cmp(&neigh->ipaddr, dst_addr)) {
+      return neigh;
+    }
+  }
+#endif /* LWIP_NETIF_HWADDRHINT */
+
+  if (hmap_is_empty(&neigh_table)) {
+    return NULL;
+  }
+  neigh = etharp_neigh_find(dst_addr);
+  if (neigh == NULL || !neigh->valid) {
+    return NULL;
+  }
+#if LWIP_NETIF_HWADDRHINT
+  if (netif->hints != NULL) {
+    netif->hints->neigh_hint = neigh;
+  }
+#else /* LWIP_NETIF_HWADDRHINT */
+  LWIP_UNUSED_ARG(netif);
+#endif /* LWIP_NETIF_HWADDRHINT */
+  return neigh;
+}
+#endif /* LWIP_NETML */
+
 /**
  * Remove all ARP table entries of the specified netif.
  *
@@ -852,6 +996,15 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
         }
       }
     }
+#if LWIP_NETML
+    {
+      const struct etharp_neigh *neigh = etharp_neigh_resolve(netif, dst_addr);
+      if (neigh != NULL) {
+        ETHARP_STATS_INC(etharp.cachehit);
+        return ethernet_output(netif, q, (struct eth_addr *)(netif->hwaddr), &neigh->ethaddr, ETHTYPE_IP);
+      }
+    }
+#endif /* LWIP_NETML */
 #if LWIP_NETIF_HWADDRHINT
     if (netif->hints != NULL) {
       /* per-pcb cached entry was given */
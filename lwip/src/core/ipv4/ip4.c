@@ -1086,6 +1086,101 @@ ip4_output_hinted(struct pbuf *p, const ip4_addr_t *src, const ip4_addr_t *dest,
 }
 #endif /* LWIP_NETIF_USE_HINTS*/
 
+#if LWIP_NETML
+/* Starts at 1 so that a zeroed struct ip4_flow is never valid */
+u32_t ip4_flow_gen = 1;
+
+/**
+ * Cache the Ethernet and IPv4 headers of a packet that has just been sent
+ * by ip4_output_if(). Nothing is learnt unless the packet left as a single
+ * unfragmented Ethernet frame, i.e. p->payload still points to the Ethernet
+ * header directly in front of the IP header and l4hdr.
+ *
+ * @param flow the flow to fill in
+ * @param netif the netif the packet was sent on
+ * @param p the packet, as returned from ip4_output_if()
+ * @param l4hdr the transport header inside p
+ * @param src source address the packet was sent from
+ * @param dest destination address the packet was sent to
+ */
+void
+ip4_flow_learn(struct ip4_flow *flow, struct netif *netif, const struct pbuf *p,
+               const void *l4hdr, const ip4_addr_t *src, const ip4_addr_t *dest)
+{
+  const struct eth_hdr *ethhdr = (const struct eth_hdr *)p->payload;
+  struct ip_hdr *iphdr;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  flow->gen = 0;
+  if (((const u8_t *)l4hdr - (const u8_t *)p->payload) != SIZEOF_ETH_HDR + IP_HLEN ||
+      ethhdr->type != PP_HTONS(ETHTYPE_IP)) {
+    return;
+  }
+  iphdr = (struct ip_hdr *)((u8_t *)p->payload + SIZEOF_ETH_HDR);
+  if (IPH_V(iphdr) != 4 || IPH_HL_BYTES(iphdr) != IP_HLEN ||
+      (IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0 ||
+      !ip4_addr_cmp(&iphdr->src, src) || !ip4_addr_cmp(&iphdr->dest, dest)) {
+    return;
+  }
+
+  MEMCPY(flow->hdr, p->payload, sizeof(flow->hdr));
+  iphdr = (struct ip_hdr *)(flow->hdr + SIZEOF_ETH_HDR);
+  IPH_LEN_SET(iphdr, 0);
+  IPH_ID_SET(iphdr, 0);
+  IPH_CHKSUM_SET(iphdr, 0);
+  flow->sum = (u16_t)~inet_chksum(iphdr, IP_HLEN);
+  flow->netif = netif;
+  flow->gen = ip4_flow_gen;
+}
+
+/**
+ * Send a transport segment with the headers cached in flow, bypassing
+ * routing and ARP. The caller checks ip4_flow_match() first.
+ *
+ * @param flow a flow filled in by ip4_flow_learn()
+ * @param p the packet to send (p->payload pointing to the transport header)
+ * @param netif the netif the flow was learnt on
+ * @return the return value of netif->linkoutput()
+ */
+err_t
+ip4_flow_output(struct ip4_flow *flow, struct pbuf *p, struct netif *netif)
+{
+  struct ip_hdr *iphdr;
+#if CHECKSUM_GEN_IP
+  u32_t sum;
+#endif /* CHECKSUM_GEN_IP */
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_IP_CHECK_PBUF_REF_COUNT_FOR_TX(p);
+
+  MIB2_STATS_INC(mib2.ipoutrequests);
+
+  if (pbuf_add_header(p, SIZEOF_ETH_HDR + IP_HLEN)) {
+    IP_STATS_INC(ip.err);
+    MIB2_STATS_INC(mib2.ipoutdiscards);
+    return ERR_BUF;
+  }
+  MEMCPY(p->payload, flow->hdr, sizeof(flow->hdr));
+
+  iphdr = (struct ip_hdr *)((u8_t *)p->payload + SIZEOF_ETH_HDR);
+  IPH_LEN_SET(iphdr, lwip_htons((u16_t)(p->tot_len - SIZEOF_ETH_HDR)));
+  IPH_ID_SET(iphdr, lwip_htons(ip_id));
+  ++ip_id;
+#if CHECKSUM_GEN_IP
+  IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_IP) {
+    sum = flow->sum + iphdr->_len + iphdr->_id;
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum = (sum >> 16) + sum;
+    iphdr->_chksum = (u16_t)~sum;
+  }
+#endif /* CHECKSUM_GEN_IP */
+
+  IP_STATS_INC(ip.xmit);
+  return netif->linkoutput(netif, p);
+}
+#endif /* LWIP_NETML */
+
 #if IP_DEBUG
 /* Print an IP header by using LWIP_DEBUGF
  * @param p an IP packet, p->payload pointing to the IP header
@@ -468,6 +468,9 @@ netif_do_set_ipaddr(struct netif *netif, const ip4_addr_t *ipaddr, ip_addr_t *ol
     ip_addr_copy(*old_addr, *netif_ip_addr4(netif));
 
     LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_STATE, ("netif_set_ipaddr: netif address being changed\n"));
+#if LWIP_NETML
+    ip4_flow_invalidate_all();
+#endif /* LWIP_NETML */
     netif_do_ip_addr_changed(old_addr, &new_addr);
 
     mib2_remove_ip4(netif);
@@ -531,6 +534,9 @@ netif_do_set_netmask(struct netif *netif, const ip4_addr_t *netmask, ip_addr_t *
     LWIP_UNUSED_ARG(old_nm);
 #endif
     mib2_remove_route_ip4(0, netif);
+#if LWIP_NETML
+    ip4_flow_invalidate_all();
+#endif /* LWIP_NETML */
     /* set new netmask to netif */
     ip4_addr_set(ip_2_ip4(&netif->netmask), netmask);
     IP_SET_TYPE_VAL(netif->netmask, IPADDR_TYPE_V4);
@@ -597,6 +603,9 @@ netif_do_set_gw(struct netif *netif, const ip4_addr_t *gw, ip_addr_t *old_gw)
 
     ip4_addr_set(ip_2_ip4(&netif->gw), gw);
     IP_SET_TYPE_VAL(netif->gw, IPADDR_TYPE_V4);
+#if LWIP_NETML
+    ip4_flow_invalidate_all();
+#endif /* LWIP_NETML */
     LWIP_DEBUGF(NETIF_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("netif: GW address of interface %c%c set to %"U16_F".%"U16_F".%"U16_F".%"U16_F"\n",
                 netif->name[0], netif->name[1],
                 ip4_addr1_16(netif_ip4_gw(netif)),
@@ -748,6 +757,10 @@ netif_remove(struct netif *netif)
 
   netif_invoke_ext_callback(netif, LWIP_NSC_NETIF_REMOVED, NULL);
 
+#if LWIP_NETML
+  ip4_flow_invalidate_all();
+#endif /* LWIP_NETML */
+
 #if LWIP_IPV4
   if (!ip4_addr_isany_val(*netif_ip4_addr(netif))) {
     netif_do_ip_addr_changed(netif_ip_addr4(netif), NULL);
@@ -55,6 +55,7 @@
 #include "lwip/stats.h"
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
+#include "lwip/netml_trace.h"
 #if LWIP_ND6_TCP_REACHABILITY_HINTS
 #include "lwip/nd6.h"
 #endif /* LWIP_ND6_TCP_REACHABILITY_HINTS */
@@ -392,8 +393,7 @@ tcp_receive_data(struct tcp_pcb *pcb)
 	int hret = 0;
 
 	if (pcb->seq_history && rte_hash_lookup(pcb->seq_history, &seqno) >= 0) {
-		fprintf(stdout, "[%s][%d]: recv duplicate packet, seq %u\n",
-						__FILE__, __LINE__, seqno);
+		NETML_TRACE(TCP, TCP_DUP, 0, 0, 0, seqno, pcb);
 		goto endreceive;
 	}
 	else {
@@ -576,8 +576,6 @@ void tcp_netml_input(struct pbuf *p)
       LWIP_ASSERT("pcb->refused_data == NULL", pcb->refused_data == NULL);
 	  LWIP_DEBUGF(TCP_INPUT_DEBUG, ("recv %u data\n", recv_data->tot_len));
       TCP_EVENT_RECV(pcb, recv_data, ERR_OK, err);
-	  if (err != ERR_OK)
-			fprintf(stdout, "[%s][%d]: app cannot recv data\n", __FILE__, __LINE__);
       if (err == ERR_ABRT) {
          goto netmlaborted;
       }
@@ -586,7 +584,7 @@ void tcp_netml_input(struct pbuf *p)
       if (err != ERR_OK) {
          pcb->refused_data = recv_data;
          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_netml_data: keep incoming packet, because pcb is \"full\"\n"));
-         fprintf(stdout, "tcp_netml_data: keep incoming packet, because pcb is \"full\"\n");
+         NETML_TRACE(TCP, TCP_RECV_FULL, 0, 0, recv_data->tot_len, 0, pcb);
       }
 	}
 
@@ -75,6 +75,7 @@
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
 #include "lwip/api.h"
+#include "lwip/netml_trace.h"
 #if LWIP_TCP_TIMESTAMPS
 #include "lwip/sys.h"
 #endif
@@ -363,9 +364,104 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
 }
 
 #if LWIP_NETML
+/* Data pbuf of a NetML segment that points into memory owned by the
+ * application. It holds one reference on the netml_ref describing that
+ * memory and drops it once the segment is freed, i.e. after the ACK. */
+struct netml_ref_pbuf {
+  struct pbuf_custom pc;
+  struct netml_ref *ref;
+};
+
+struct netml_ref *
+netml_ref_alloc(netml_ref_free_fn free_fn, void *arg)
+{
+  struct netml_ref *ref;
+
+  ref = (struct netml_ref *)mem_malloc(sizeof(struct netml_ref));
+  if (ref == NULL) {
+    return NULL;
+  }
+  ref->refcnt = 1;
+  ref->free_fn = free_fn;
+  ref->arg = arg;
+  return ref;
+}
+
+void
+netml_ref_get(struct netml_ref *ref)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  ref->refcnt++;
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+void
+netml_ref_put(struct netml_ref *ref)
+{
+  u32_t refcnt;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  LWIP_ASSERT("netml_ref_put: refcnt > 0", ref->refcnt > 0);
+  refcnt = --ref->refcnt;
+  SYS_ARCH_UNPROTECT(lev);
+
+  if (refcnt == 0) {
+    ref->free_fn(ref->arg);
+    mem_free(ref);
+  }
+}
+
+static void
+netml_ref_pbuf_free(struct pbuf *p)
+{
+  struct netml_ref_pbuf *rp = (struct netml_ref_pbuf *)p;
+  struct netml_ref *ref = rp->ref;
+
+  mem_free(rp);
+  netml_ref_put(ref);
+}
+
+/* Allocate a pbuf referencing len bytes at data, pinned through ref */
+static struct pbuf *
+netml_ref_pbuf_alloc(const void *data, u16_t len, struct netml_ref *ref)
+{
+  struct netml_ref_pbuf *rp;
+  struct pbuf *p;
+
+  rp = (struct netml_ref_pbuf *)mem_malloc(sizeof(struct netml_ref_pbuf));
+  if (rp == NULL) {
+    return NULL;
+  }
+  rp->pc.custom_free_function = netml_ref_pbuf_free;
+  rp->ref = ref;
+
+  p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rp->pc, (void *)data, len);
+  if (p == NULL) {
+    mem_free(rp);
+    return NULL;
+  }
+  netml_ref_get(ref);
+  return p;
+}
+
+/**
+ * Enqueue NetML data for remote_id.
+ *
+ * Without a ref the data is copied into the segments, so the caller may
+ * reuse its buffer as soon as this returns. With a ref the segments point
+ * at the data itself and each of them holds a reference on ref until it
+ * has been acked; the memory must stay untouched until ref->free_fn runs.
+ *
+ * The data always starts a new segment, nothing is appended to the last
+ * unsent one. That keeps the records of a netml_vector with chunk set at
+ * the start of their segments.
+ */
 err_t
 tcp_write_netml(struct tcp_pcb *pcb, const void *arg, u16_t len,
-				u16_t remote_id, u8_t is_hot)
+				u16_t remote_id, u8_t is_hot, struct netml_ref *ref)
 {
   struct pbuf *concat_p = NULL;
   struct tcp_seg *last_unsent = NULL, *seg = NULL, *prev_seg = NULL, *queue = NULL;
@@ -393,8 +489,7 @@ tcp_write_netml(struct tcp_pcb *pcb, const void *arg, u16_t len,
   queuelen = pcb->snd_queuelen;
 
   if (pcb->local_id == UINT16_MAX) {
-  	fprintf(stderr, "[%s][%d]: unknown node id %u->%u\n",
-					__FILE__, __LINE__, pcb->local_id, remote_id);
+	NETML_TRACE(TCP, TCP_NO_LOCALID, remote_id, 0, 0, 0, pcb);
 	return ERR_VAL;
   }
 
@@ -440,40 +535,34 @@ tcp_write_netml(struct tcp_pcb *pcb, const void *arg, u16_t len,
     u8_t chksum_swapped = 0;
 #endif /* TCP_CHECKSUM_ON_COPY */
 
-    /* Copy is not set: First allocate a pbuf for holding the data.
-     * Since the referenced data is available at least until it is
-     * sent out on the link (as it has to be ACKed by the remote
-     * party) we can safely use PBUF_ROM instead of PBUF_REF here.
-     */
-    struct pbuf *p2;
-    if ((p2 = pbuf_alloc(PBUF_TRANSPORT, seglen,
-									PBUF_ROM)) == NULL) {
-	  LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_write: could not allocate memory for zero-copy pbuf\n"));
-      goto memerr;
-    }
-    /* reference the non-volatile payload data */
-	((struct pbuf_rom *)p2)->payload = (const u8_t *)arg + pos;
-#if 0
-	/* allocate a pbuf for internal headers */
-	struct pbuf *p1 = NULL;
-	if ((p1 = pbuf_alloc(PBUF_TRANSPORT, sizeof(struct internal_hdr), PBUF_RAM)) == NULL) {
-		pbuf_free(p1);
-        LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_write: could not allocate memory for internal header pbuf\n"));
+    if (ref != NULL) {
+      /* The data is pinned by the application until ref is released: first
+       * allocate a pbuf referencing it. */
+      struct pbuf *p2;
+      if ((p2 = netml_ref_pbuf_alloc((const u8_t *)arg + pos, seglen, ref)) == NULL) {
+        LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_write: could not allocate memory for zero-copy pbuf\n"));
         goto memerr;
-	}
-	pbuf_cat(p1 /* internal header */, p2 /* data */);
-#endif
+      }
 
-    /* Second, allocate a pbuf for the headers. */
-    if ((p = pbuf_alloc(PBUF_TRANSPORT, optlen + sizeof(struct internal_hdr), PBUF_RAM)) == NULL) {
-      /* If allocation fails, we have to deallocate the data pbuf as
-       * well. */
-		pbuf_free(p2);
+      /* Second, allocate a pbuf for the headers. */
+      if ((p = pbuf_alloc(PBUF_TRANSPORT, optlen + sizeof(struct internal_hdr), PBUF_RAM)) == NULL) {
+        /* If allocation fails, we have to deallocate the data pbuf as
+         * well. */
+        pbuf_free(p2);
         LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_write: could not allocate memory for header pbuf\n"));
         goto memerr;
+      }
+      /* Concatenate the headers and data pbufs together. */
+      pbuf_cat(p/*header + internal_hdr */, p2/* data */);
+    } else {
+      /* The caller reuses its buffer right away: copy the data behind the
+       * option and internal headers. */
+      if ((p = pbuf_alloc(PBUF_TRANSPORT, optlen + sizeof(struct internal_hdr) + seglen, PBUF_RAM)) == NULL) {
+        LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_write: could not allocate memory for pbuf copy size %"U16_F"\n", seglen));
+        goto memerr;
+      }
+      MEMCPY((u8_t *)p->payload + optlen + sizeof(struct internal_hdr), (const u8_t *)arg + pos, seglen);
     }
-    /* Concatenate the headers and data pbufs together. */
-    pbuf_cat(p/*header + internal_hdr */, p2/* data */);
 
     queuelen += pbuf_clen(p);
 
@@ -583,6 +672,7 @@ memerr:
                 pcb->unsent != NULL);
   }
   LWIP_DEBUGF(TCP_QLEN_DEBUG | LWIP_DBG_STATE, ("tcp_write: %"S16_F" (with mem err)\n", pcb->snd_queuelen));
+  return ERR_MEM;
 }
 #endif /* LWIP_NETML */
 
@@ -1625,7 +1715,7 @@ tcp_output(struct tcp_pcb *pcb)
     if (err != ERR_OK) {
       /* segment could not be sent, for whatever reason */
       tcp_set_flags(pcb, TF_NAGLEMEMERR);
-	  fprintf(stdout, "[%s][%d]: failed to send segment, err %d\n", __FILE__, __LINE__, err);
+	  NETML_TRACE(TCP, TCP_OUTPUT_ERR, 0, 0, seg->len, (u32_t)err, pcb);
       return err;
     }
 #if TCP_OVERSIZE_DBGCHECK
@@ -1905,10 +1995,23 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
 #endif
   TCP_STATS_INC(tcp.xmit);
 
-  NETIF_SET_HINTS(netif, &(pcb->netif_hints));
-  err = ip_output_if(seg->p, &pcb->local_ip, &pcb->remote_ip, pcb->ttl,
-                     pcb->tos, IP_PROTO_TCP, netif);
-  NETIF_RESET_HINTS(netif);
+#if LWIP_NETML
+  if (ip4_flow_match(&pcb->flow, netif, seg->p, pcb->ttl, pcb->tos)) {
+    err = ip4_flow_output(&pcb->flow, seg->p, netif);
+  } else
+#endif /* LWIP_NETML */
+  {
+    NETIF_SET_HINTS(netif, &(pcb->netif_hints));
+    err = ip_output_if(seg->p, &pcb->local_ip, &pcb->remote_ip, pcb->ttl,
+                       pcb->tos, IP_PROTO_TCP, netif);
+    NETIF_RESET_HINTS(netif);
+#if LWIP_NETML
+    if (err == ERR_OK) {
+      ip4_flow_learn(&pcb->flow, netif, seg->p, seg->tcphdr,
+                     ip_2_ip4(&pcb->local_ip), ip_2_ip4(&pcb->remote_ip));
+    }
+#endif /* LWIP_NETML */
+  }
 
 #if TCP_CHECKSUM_ON_COPY
   if (seg_chksum_was_swapped) {
@@ -2029,7 +2132,7 @@ tcp_rexmit_data(struct tcp_pcb *pcb, struct tcp_seg * seg)
   u8_t netml_flags = 0;
 
 	if (tcp_output_segment_busy(seg)) {
-		fprintf(stdout, "[%s][%d]: segment busy\n", __FILE__, __LINE__);
+		NETML_TRACE(TCP, TCP_SEG_BUSY, 0, 0, seg->len, 0, pcb);
 		return;
 	}
 
@@ -2348,8 +2451,26 @@ tcp_output_control_segment(const struct tcp_pcb *pcb, struct pbuf *p,
       tos = 0;
     }
     TCP_STATS_INC(tcp.xmit);
-    err = ip_output_if(p, src, dst, ttl, tos, IP_PROTO_TCP, netif);
-//	fprintf(stdout, "[%s][%d]: send ctl message %d\n", __FILE__, __LINE__, err);
+#if LWIP_NETML
+    /* listen pcbs are passed in here too but have no flow */
+    if (pcb != NULL && pcb->state != LISTEN &&
+        ip_addr_cmp(src, &pcb->local_ip) && ip_addr_cmp(dst, &pcb->remote_ip)) {
+      struct ip4_flow *flow = LWIP_CONST_CAST(struct ip4_flow*, &pcb->flow);
+      if (ip4_flow_match(flow, netif, p, ttl, tos)) {
+        err = ip4_flow_output(flow, p, netif);
+      } else {
+        void *tcphdr = p->payload;
+        err = ip_output_if(p, src, dst, ttl, tos, IP_PROTO_TCP, netif);
+        if (err == ERR_OK) {
+          ip4_flow_learn(flow, netif, p, tcphdr, ip_2_ip4(src), ip_2_ip4(dst));
+        }
+      }
+    } else
+#endif /* LWIP_NETML */
+    {
+      err = ip_output_if(p, src, dst, ttl, tos, IP_PROTO_TCP, netif);
+//	  fprintf(stdout, "[%s][%d]: send ctl message %d\n", __FILE__, __LINE__, err);
+    }
     NETIF_RESET_HINTS(netif);
   }
   pbuf_free(p);
@@ -2491,8 +2612,7 @@ tcp_send_empty_ack_netml(struct tcp_pcb *pcb, struct tcp_internal_id *tmpworker,
   err = tcp_output_control_segment(pcb, p, &pcb->local_ip, &pcb->remote_ip);
   if (err != ERR_OK) {
     /* let tcp_fasttmr retry sending this ACK */
-    fprintf(stdout, "[%s][%d]: retry sending ACK, err %d\n",
-			__FILE__, __LINE__, err);
+    NETML_TRACE(TCP, TCP_ACK_RETRY, 0, 0, 0, (u32_t)err, pcb);
     tcp_set_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
   } else {
     /* remove ACK flags from the PCB, as we sent an empty ACK now */
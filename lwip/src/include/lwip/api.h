@@ -214,6 +214,7 @@ struct udp_pcb;
 struct raw_pcb;
 struct netconn;
 struct api_msg;
+struct netml_ref;
 
 /** A callback prototype to inform about events for a netconn */
 typedef void (* netconn_callback)(struct netconn *, enum netconn_evt, u16_t len);
@@ -306,6 +307,29 @@ struct netvector {
   size_t len;
 };
 
+#if LWIP_NETML
+/** One entry of a NetML batch write, see netconn_write_netml_batch() */
+struct netml_vector {
+  /** pointer to the application buffer that contains the data to send */
+  const void *ptr;
+  /** size of the application data to send */
+  size_t len;
+  /** NetML node the data is destined to */
+  u16_t remote_id;
+  /** send as hot (NETML_HOT) instead of cold data */
+  u8_t is_hot;
+  /** if not NULL, ptr is referenced instead of copied (see tcp_write_netml) */
+  struct netml_ref *ref;
+  /** if not 0, the data is made of records of that many bytes (the last one
+   * may be shorter), each written whole into segments of its own */
+  u16_t chunk;
+};
+
+/** Largest record that fits a single NetML segment at TCP_MSS, behind the
+ * internal header and the timestamp option */
+#define NETML_CHUNK_MAX (TCP_MSS - 12 - (LWIP_TCP_TIMESTAMPS ? 12 : 0))
+#endif /* LWIP_NETML */
+
 /** Register an Network connection event */
 #define API_EVENT(c,e,l) if (c->callback) {         \
                            (*c->callback)(c, e, l); \
@@ -356,7 +380,11 @@ err_t   netconn_write_vectors_partly(struct netconn *conn, struct netvector *vec
 
 #if LWIP_NETML
 err_t   netconn_write_netml(struct netconn *conn, const void *dataptr, size_t size,
-				u8_t apiflags, size_t *bytes_written, int remote_id);
+				u8_t apiflags, size_t *bytes_written, int remote_id,
+				struct netml_ref *ref);
+err_t   netconn_write_netml_batch(struct netconn *conn,
+				const struct netml_vector *vectors, u16_t vectorcnt,
+				size_t *bytes_written);
 #endif
 /** @ingroup netconn_tcp */
 #define netconn_write(conn, dataptr, size, apiflags) \
@@ -93,6 +93,14 @@ err_t etharp_add_static_entry(const ip4_addr_t *ipaddr, struct eth_addr *ethaddr
 err_t etharp_remove_static_entry(const ip4_addr_t *ipaddr);
 #endif /* ETHARP_SUPPORT_STATIC_ENTRIES */
 
+#if LWIP_NETML
+err_t etharp_add_neighbor(const ip4_addr_t *ipaddr, const struct eth_addr *ethaddr);
+err_t etharp_remove_neighbor(const ip4_addr_t *ipaddr);
+#if LWIP_TESTMODE
+void etharp_free_neighbors(void);
+#endif /* LWIP_TESTMODE */
+#endif /* LWIP_NETML */
+
 void etharp_input(struct pbuf *p, struct netif *netif);
 
 #ifdef __cplusplus
@@ -47,6 +47,9 @@
 #include "lwip/err.h"
 #include "lwip/netif.h"
 #include "lwip/prot/ip4.h"
+#if LWIP_NETML
+#include "lwip/prot/ethernet.h"
+#endif /* LWIP_NETML */
 
 #ifdef __cplusplus
 extern "C" {
@@ -88,6 +91,35 @@ err_t ip4_output_if_opt_src(struct pbuf *p, const ip4_addr_t *src, const ip4_add
        u16_t optlen);
 #endif /* IP_OPTIONS_SEND */
 
+#if LWIP_NETML
+/** Ethernet + IPv4 header of an established flow, learnt from a packet that
+ * went through routing and ARP. Only total length, id and checksum change
+ * between packets. Any netif or neighbor change bumps ip4_flow_gen, which
+ * invalidates every cached flow at once. */
+struct ip4_flow {
+  struct netif *netif;
+  u32_t gen;
+  u32_t sum;        /* folded sum of the constant IPv4 header words */
+  u8_t hdr[SIZEOF_ETH_HDR + IP_HLEN];
+};
+
+extern u32_t ip4_flow_gen;
+
+#define ip4_flow_invalidate_all() (ip4_flow_gen++)
+
+/** Can p be sent on netif with the cached header of flow? */
+#define ip4_flow_match(flow, nif, p, ttl, tos)                              \
+  (((flow)->gen == ip4_flow_gen) && ((flow)->netif == (nif)) &&           \
+   netif_is_up(nif) && netif_is_link_up(nif) &&                           \
+   ((nif)->mtu == 0 || (p)->tot_len + IP_HLEN <= (nif)->mtu) &&           \
+   (IPH_TTL((struct ip_hdr *)((flow)->hdr + SIZEOF_ETH_HDR)) == (ttl)) &&  \
+   (IPH_TOS((struct ip_hdr *)((flow)->hdr + SIZEOF_ETH_HDR)) == (tos)))
+
+void  ip4_flow_learn(struct ip4_flow *flow, struct netif *netif, const struct pbuf *p,
+       const void *l4hdr, const ip4_addr_t *src, const ip4_addr_t *dest);
+err_t ip4_flow_output(struct ip4_flow *flow, struct pbuf *p, struct netif *netif);
+#endif /* LWIP_NETML */
+
 #if LWIP_MULTICAST_TX_OPTIONS
 void  ip4_set_default_multicast_netif(struct netif* default_multicast_netif);
 #endif /* LWIP_MULTICAST_TX_OPTIONS */
@@ -247,8 +247,15 @@ typedef u8_t netif_addr_idx_t;
 
 #if LWIP_NETIF_HWADDRHINT
 #define LWIP_NETIF_USE_HINTS              1
+#if LWIP_NETML
+struct etharp_neigh;
+#endif /* LWIP_NETML */
 struct netif_hint {
   netif_addr_idx_t addr_hint;
+#if LWIP_NETML
+  /* resolved neighbor table entry, see etharp_add_neighbor() */
+  struct etharp_neigh *neigh_hint;
+#endif /* LWIP_NETML */
 };
 #else /* LWIP_NETIF_HWADDRHINT */
 #define LWIP_NETIF_USE_HINTS              0
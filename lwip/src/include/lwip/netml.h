@@ -62,6 +62,21 @@ struct kv_pair {
 	u64_t value;
 };
 
+/* Application memory handed to the stack by reference (see tcp_write_netml).
+ * The sender holds the initial reference, every segment pointing into the
+ * memory takes one more. free_fn(arg) runs when the last one is dropped. */
+typedef void (*netml_ref_free_fn)(void *arg);
+
+struct netml_ref {
+  u32_t refcnt;
+  netml_ref_free_fn free_fn;
+  void *arg;
+};
+
+struct netml_ref *netml_ref_alloc(netml_ref_free_fn free_fn, void *arg);
+void netml_ref_get(struct netml_ref *ref);
+void netml_ref_put(struct netml_ref *ref);
+
 struct tcp_internal_id {
   u32_t nxtwish;
   u32_t intseq;
@@ -0,0 +1,58 @@
+/**
+ * @file
+ * NetML raw TCP transport
+ *
+ * Drives the tcp_pcb of a connected socket directly with the raw API
+ * (tcp_recv/tcp_sent/tcp_err/tcp_write_netml), skipping the socket and
+ * netconn layers and their mbox posts on the data path.
+ */
+
+#ifndef LWIP_HDR_NETML_RAW_H
+#define LWIP_HDR_NETML_RAW_H
+
+#include "lwip/opt.h"
+
+#if LWIP_NETML && LWIP_SOCKET && LWIP_TCP
+
+#include <stddef.h>
+
+#include "lwip/pbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct netml_raw;
+struct netml_ref;
+struct netml_vector;
+
+/* Readiness bits returned by netml_raw_events */
+#define NETML_RAW_IN   0x01
+#define NETML_RAW_OUT  0x02
+#define NETML_RAW_ERR  0x04
+
+/* Called from whichever thread holds the core lock whenever the connection
+ * may have become readable, writable or failed. Must not call back into the
+ * stack. */
+typedef void (*netml_raw_notify_fn)(void *arg);
+
+struct netml_raw *netml_raw_attach(int s);
+void netml_raw_close(struct netml_raw *raw);
+void netml_raw_setnotify(struct netml_raw *raw, netml_raw_notify_fn fn, void *arg);
+int netml_raw_events(const struct netml_raw *raw);
+int netml_raw_setlocalid(struct netml_raw *raw, int id);
+
+ssize_t netml_raw_recv(struct netml_raw *raw, void *mem, size_t len);
+ssize_t netml_raw_recv_pbuf(struct netml_raw *raw, struct pbuf **p);
+ssize_t netml_raw_send(struct netml_raw *raw, const void *data, size_t size,
+                       int flags, int remote_id, struct netml_ref *ref);
+ssize_t netml_raw_send_batch(struct netml_raw *raw,
+                             const struct netml_vector *vec, int vcnt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_NETML && LWIP_SOCKET && LWIP_TCP */
+
+#endif /* LWIP_HDR_NETML_RAW_H */
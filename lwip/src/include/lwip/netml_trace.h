@@ -0,0 +1,110 @@
+/**
+ * @file
+ * NetML trace points
+ *
+ * Fixed-size binary records written into per-thread rings, for the paths
+ * where a printf would have every thread queue up on the stdio lock. The
+ * rings are dumped with netml_trace_dump and read back by
+ * tools/trace_decode.
+ *
+ * LWIP_NETML_TRACE is the mask of NETML_TRACE_* categories compiled in.
+ * Trace points of the other categories compile to nothing, all of them
+ * with the default of 0.
+ */
+
+#ifndef LWIP_HDR_NETML_TRACE_H
+#define LWIP_HDR_NETML_TRACE_H
+
+#include <stdint.h>
+
+#ifndef LWIP_NETML_TRACE
+#define LWIP_NETML_TRACE 0
+#endif
+
+/* Categories */
+#define NETML_TRACE_ZMQ    0x01  /* engines and pollers */
+#define NETML_TRACE_TCP    0x02  /* lwIP TCP */
+#define NETML_TRACE_NETIF  0x04  /* DPDK interface */
+
+/* Events, see the trace points for what len and aux hold */
+#define NETML_TRACE_EVENTS(X) \
+  X(ENGINE_QUEUE)    /* message taken from the session: len, flags */ \
+  X(ENGINE_WRITE)    /* pass handed to the stack: len bytes, aux entries */ \
+  X(ENGINE_BLOCKED)  /* stack full: aux entries still to write */ \
+  X(POLL_OVERFLOW)   /* more than max_io_events ready: len events */ \
+  X(TCP_NO_LOCALID)  /* data for remote_id before the local id is set */ \
+  X(TCP_OUTPUT_ERR)  /* segment not sent: aux err */ \
+  X(TCP_SEG_BUSY)    /* segment still held by the driver */ \
+  X(TCP_ACK_RETRY)   /* ACK not sent: aux err */ \
+  X(TCP_DUP)         /* duplicate data segment: aux seqno */ \
+  X(TCP_RECV_FULL)   /* application refused data: len */ \
+  X(NETIF_INPUT_ERR) /* packet dropped by the stack: len */ \
+  X(NETIF_NO_PBUF)   /* packet dropped for lack of pbufs: len */
+
+enum netml_trace_event {
+#define NETML_TRACE_ENUM(name) NETML_EV_##name,
+  NETML_TRACE_EVENTS(NETML_TRACE_ENUM)
+#undef NETML_TRACE_ENUM
+  NETML_EV_MAX
+};
+
+/* A record, 32 bytes */
+struct netml_trace_rec {
+  /** TSC (or nanoseconds where there is none) */
+  uint64_t tsc;
+  /** position in the ring, to tell records being overwritten */
+  uint32_t seq;
+  /** socket, pcb or queue the event is about */
+  uint32_t conn;
+  uint32_t len;
+  uint32_t aux;
+  uint16_t event;
+  uint16_t remote_id;
+  uint16_t flags;
+  uint16_t reserved;
+};
+
+/* Dump file: a header, then for each thread a netml_trace_thread followed
+ * by its records, oldest first */
+#define NETML_TRACE_MAGIC "NMLTRC01"
+
+struct netml_trace_header {
+  char magic[8];
+  uint32_t rec_size;
+  uint32_t threads;
+  /** TSC ticks per second */
+  uint64_t tsc_hz;
+};
+
+struct netml_trace_thread {
+  uint32_t tid;
+  uint32_t count;
+  char name[16];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void netml_trace_record(uint16_t event, uint16_t remote_id, uint16_t flags,
+                        uint32_t len, uint32_t aux, uint32_t conn);
+int netml_trace_dump(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if LWIP_NETML_TRACE
+#define NETML_TRACE(cat, ev, remote_id, flags, len, aux, conn) \
+  do { \
+    if (LWIP_NETML_TRACE & NETML_TRACE_##cat) \
+      netml_trace_record(NETML_EV_##ev, (uint16_t)(remote_id), \
+                         (uint16_t)(flags), (uint32_t)(len), \
+                         (uint32_t)(aux), (uint32_t)(uintptr_t)(conn)); \
+  } while (0)
+#else
+#define NETML_TRACE(cat, ev, remote_id, flags, len, aux, conn) \
+  do { } while (0)
+#endif
+
+#endif /* LWIP_HDR_NETML_TRACE_H */
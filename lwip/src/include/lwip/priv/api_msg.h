@@ -121,8 +121,18 @@ struct api_msg {
 
 #if LWIP_NETML
 	  u16_t remote_id;
+	  struct netml_ref *ref;
 #endif
     } w;
+#if LWIP_NETML
+    /** used for lwip_netconn_do_write_netml_batch */
+    struct {
+      const struct netml_vector *vector;
+      u16_t vector_cnt;
+      /** output of bytes written */
+      size_t offset;
+    } wb;
+#endif /* LWIP_NETML */
     /** used for lwip_netconn_do_recv */
     struct {
       size_t len;
@@ -208,6 +218,9 @@ void lwip_netconn_do_recv            (void *m);
 void lwip_netconn_do_accepted        (void *m);
 #endif /* TCP_LISTEN_BACKLOG */
 void lwip_netconn_do_write           (void *m);
+#if LWIP_NETML
+void lwip_netconn_do_write_netml_batch(void *m);
+#endif /* LWIP_NETML */
 void lwip_netconn_do_getaddr         (void *m);
 void lwip_netconn_do_close           (void *m);
 void lwip_netconn_do_shutdown        (void *m);
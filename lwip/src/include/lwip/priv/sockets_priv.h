@@ -81,6 +81,12 @@ struct lwip_sock {
   /** counter of how many threads are waiting for this socket using select */
   SELWAIT_T select_waiting;
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
+#if LWIP_NETML
+  /** called by event_callback() when the socket becomes readable, writable
+      or gets an error, see lwip_setwakeup() */
+  lwip_wakeup_fn wakeup_fn;
+  void *wakeup_arg;
+#endif /* LWIP_NETML */
 #if LWIP_NETCONN_FULLDUPLEX
   /* counter of how many threads are using a struct lwip_sock (not the 'int') */
   u8_t fd_used;
@@ -592,10 +592,22 @@ int fcntl(int s, int cmd, ...);
 #endif /* LWIP_POSIX_SOCKETS_IO_NAMES */
 #endif /* LWIP_COMPAT_SOCKETS == 2 */
 
-#ifdef LWIP_NETML
+#if LWIP_NETML
 int lwip_setlocalid(int s, int id);
 int lwip_setbypass(int s);
 ssize_t lwip_send_netml(int s, const void *dataptr, size_t size, int flags, int remote_id);
+struct netml_ref;
+ssize_t lwip_send_netml_ref(int s, const void *dataptr, size_t size, int flags,
+                            int remote_id, struct netml_ref *ref);
+/* see lwip/netml.h */
+struct netml_ref *netml_ref_alloc(void (*free_fn)(void *arg), void *arg);
+void netml_ref_put(struct netml_ref *ref);
+struct netml_vector;
+ssize_t lwip_send_netml_batch(int s, const struct netml_vector *vec, int vcnt);
+struct pbuf;
+ssize_t lwip_recv_pbuf(int s, struct pbuf **p, int flags);
+typedef void (*lwip_wakeup_fn)(void *arg);
+int lwip_setwakeup(int s, lwip_wakeup_fn fn, void *arg);
 #else
 #define lwip_setlocalid(s,id) (0)
 #define lwip_setbypass(s) (0)
@@ -344,6 +344,8 @@ struct tcp_pcb {
   struct rte_hash *seq_history;
   u64_t last_tsc;
   u8_t is_init_netml;
+  /* prebuilt Ethernet/IPv4 header, see ip4_flow_output() */
+  struct ip4_flow flow;
 #endif
 
   tcpwnd_size_t bytes_acked;
@@ -491,7 +493,7 @@ err_t            tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx);
 
 #if LWIP_NETML
 err_t            tcp_write_netml(struct tcp_pcb *pcb, const void *dataptr, u16_t len,
-                              u16_t remote_id, u8_t is_hot);
+                              u16_t remote_id, u8_t is_hot, struct netml_ref *ref);
 #endif
 
 err_t            tcp_write   (struct tcp_pcb *pcb, const void *dataptr, u16_t len,
@@ -2,6 +2,7 @@
 #define LWIP_DPDKIF_H
 
 #include "lwip/netif.h"
+#include "netif/netml_switch.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -9,6 +10,26 @@ extern "C" {
 int init_dpdk(void);
 err_t dpdk_device_init(struct netif*);
 
+/* Run-to-completion support, see dpdk_poll_rx_queue */
+int dpdk_set_rx_queues(uint16_t queues);
+int dpdk_claim_rx_queue(void);
+void dpdk_release_rx_queue(int queue);
+int dpdk_poll_rx_queue(int queue);
+
+/* Placement, see dpdk_set_cpus */
+int dpdk_set_cpus(const int *cpus, int count);
+int dpdk_get_cpus(int *cpus, int max);
+int dpdk_probe_numa_node(void);
+int dpdk_numa_node(void);
+
+/* Zero-copy sends, see dpdk_register_memory */
+int dpdk_register_memory(void *addr, size_t len);
+int dpdk_unregister_memory(void *addr);
+int dpdk_memory_registered(const void *ptr, size_t len);
+
+/* Switch emulator instead of a NIC, see dpdk_attach_switch */
+int dpdk_attach_switch(struct netml_switch *sw);
+
 #ifdef __cplusplus
 }
 #endif
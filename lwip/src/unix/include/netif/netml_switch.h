@@ -0,0 +1,110 @@
+/**
+ * @file
+ * NetML switch emulator
+ *
+ * A software stand-in for the programmable switch NetML aggregates on, so
+ * that the protocol can be run and measured on one box. It forwards
+ * Ethernet frames between its ports like a learning bridge and sums the
+ * keyed tensor chunks that workers send hot in aggregation slots, see
+ * netml_switch.c for the rules.
+ *
+ * A port is anything that hands the switch frames and takes frames from
+ * it: a netif of the stack (netml_switch_netif_init), standing for a host
+ * with an address of its own, or the other end of the rings the DPDK port
+ * of the stack is built on (dpdk_attach_switch).
+ */
+
+#ifndef LWIP_NETML_SWITCH_H
+#define LWIP_NETML_SWITCH_H
+
+#include "lwip/netif.h"
+#include "lwip/ip4_addr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Ports of a switch */
+#define NETML_SWITCH_MAX_PORTS 64
+
+/* Workers a slot waits for at most, each with a bit of a mask */
+#define NETML_SWITCH_MAX_WORKERS 64
+
+/* Largest frame a port takes */
+#define NETML_SWITCH_FRAME_MAX 1536
+
+struct netml_switch_config {
+  /** aggregation slots; chunks that find theirs taken go through cold */
+  u32_t slots;
+  /** contributions that complete a chunk */
+  u16_t workers;
+  /** milliseconds a slot waits for its last workers before the partial
+   *  sum goes out */
+  u32_t timeout;
+};
+
+struct netml_switch_stats {
+  /** frames taken from the ports */
+  u64_t frames;
+  /** frames passed on to the port of their destination */
+  u64_t forwarded;
+  /** frames sent out of every other port */
+  u64_t flooded;
+  /** hot segments */
+  u64_t hot;
+  /** hot segments summed into a slot */
+  u64_t summed;
+  /** sums sent with all workers in */
+  u64_t complete;
+  /** sums sent on timeout */
+  u64_t partial;
+  /** hot segments passed on unsummed */
+  u64_t cold;
+  /** hot segments whose slot held another chunk */
+  u64_t collisions;
+  /** acks sent to the workers of a sum */
+  u64_t acks;
+  /** sums sent again for a retransmitting worker */
+  u64_t resent;
+  /** frames dropped: malformed, too large or for a full port */
+  u64_t dropped;
+};
+
+struct netml_switch;
+
+/** Takes a frame out of the switch. The frame is only valid for the call. */
+typedef void (*netml_switch_output_fn)(void *arg, const u8_t *frame, u16_t len);
+
+/** Feeds the frames the port has in store to netml_switch_input, returns
+ *  how many */
+typedef int (*netml_switch_poll_fn)(struct netml_switch *sw, int port,
+                                    void *arg);
+
+struct netml_switch *netml_switch_new(const struct netml_switch_config *config);
+void netml_switch_free(struct netml_switch *sw);
+
+int netml_switch_add_port(struct netml_switch *sw,
+                          netml_switch_output_fn output,
+                          netml_switch_poll_fn poll, void *arg);
+void netml_switch_input(struct netml_switch *sw, int port,
+                        const u8_t *frame, u16_t len);
+int netml_switch_poll(struct netml_switch *sw);
+void netml_switch_get_stats(struct netml_switch *sw,
+                            struct netml_switch_stats *stats);
+
+int netml_switch_start(struct netml_switch *sw);
+void netml_switch_stop(struct netml_switch *sw);
+
+/* A netif on a port of the switch passed as its state */
+err_t netml_switch_netif_init(struct netif *netif);
+
+/* LWIP_HOOK_IP4_ROUTE_SRC: hosts on the switch share the stack, a packet
+ * leaves through the netif of its source address */
+struct netif *netml_switch_route_src(const ip4_addr_t *src,
+                                     const ip4_addr_t *dest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_NETML_SWITCH_H */
@@ -14,6 +14,9 @@
 #include <signal.h>
 #include <stdbool.h>
 #include <sys/prctl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
 
 
 #include "lwip/opt.h"
@@ -27,10 +30,13 @@
 #include "lwip/pbuf.h"
 #include "lwip/sys.h"
 #include "lwip/timeouts.h"
+#include "lwip/tcpip.h"
 #include "netif/etharp.h"
 #include "lwip/ethip6.h"
 #include "netif/dpdkif.h"
+#include "netif/netml_switch.h"
 #include "lwip/priv/tcp_priv.h"
+#include "lwip/netml_trace.h"
 
 #include <rte_common.h>
 #include <rte_log.h>
@@ -52,6 +58,19 @@
 #include <rte_ethdev.h>
 #include <rte_mempool.h>
 #include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_eth_ring.h>
+#include <rte_version.h>
+
+/* Registering external memory needs 19.02, mapping it for the DMA of a
+ * device 19.05. Older releases copy everything into the mbufs. */
+#if RTE_VERSION >= RTE_VERSION_NUM(19, 2, 0, 0)
+#define DPDK_EXTMEM 1
+#include <rte_bus.h>
+#include <rte_errno.h>
+#else
+#define DPDK_EXTMEM 0
+#endif
 
 #define RTE_LOGTYPE_L2FWD RTE_LOGTYPE_USER1
 
@@ -74,6 +93,68 @@ struct arg_pass {
 static uint16_t nb_rxd = RTE_TEST_RX_DESC_DEFAULT;
 static uint16_t nb_txd = RTE_TEST_TX_DESC_DEFAULT;
 
+/*
+ * RX queues of port 0. Flows are spread over them with RSS when there is
+ * more than one. dpdk_thread polls every queue nobody has claimed, an io
+ * thread running to completion claims one and polls it itself.
+ */
+#define MAX_RX_QUEUES 16
+
+enum {
+	RXQ_STACK = 0,		/* polled by dpdk_thread */
+	RXQ_CLAIMING,		/* claimed, waiting for dpdk_thread to let go */
+	RXQ_OWNED			/* polled by the thread that claimed it */
+};
+
+static uint16_t nb_rx_queues = 1;
+static uint8_t rxq_state[MAX_RX_QUEUES];
+
+static struct netif *dpdk_netif = NULL;
+
+/*
+ * CPUs given to EAL: the first one is the main lcore (the thread calling
+ * init_dpdk), every other one runs dpdk_thread and polls its share of the
+ * unclaimed RX queues. Without any, EAL gets "-c 3".
+ */
+#define MAX_DPDK_CPUS 16
+
+static int dpdk_cpus[MAX_DPDK_CPUS];
+static int nb_dpdk_cpus = 0;
+
+/*
+ * Application memory registered for zero-copy sends, see
+ * dpdk_register_memory. Slots are filled and emptied under extmem_lock and
+ * published by their length, dpdk_output looks them up without the lock.
+ */
+#define MAX_EXTMEM_REGIONS 16
+
+struct extmem_region {
+	uintptr_t start;	/* as registered by the application */
+	size_t len;
+	uintptr_t base;		/* the pages around it, as given to EAL */
+	size_t span;
+	uint64_t iova;		/* IOVA of base, the device sees it contiguous */
+};
+
+static struct extmem_region extmem[MAX_EXTMEM_REGIONS];
+static int nb_extmem = 0;
+static pthread_mutex_t extmem_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Whether port 0 takes chains of mbufs, set up by init_dpdk */
+static int tx_multi_seg = 0;
+
+/*
+ * Switch emulator port 0 is plugged into instead of a NIC, see
+ * dpdk_attach_switch. Port 0 is then built on a pair of rings, the switch
+ * takes what the stack sends from one and puts what it has for the stack
+ * into the other.
+ */
+#define SWITCH_RING_SIZE 1024
+
+static struct netml_switch *dpdk_switch = NULL;
+static struct rte_ring *switch_rx_ring = NULL;	/* switch to stack */
+static struct rte_ring *switch_tx_ring = NULL;	/* stack to switch */
+
 
 /* ethernet addresses of ports */
 static struct ether_addr l2fwd_port_eth_addr;
@@ -103,8 +184,9 @@ struct l2fwd_port_statistics port_statistics;
 struct rte_mempool * l2fwd_pktmbuf_pool = NULL;
 
 
-//dpdk receive function, receive from mbuf and call tcpip_input to send to protocol stack
-static void dpdk_input(struct rte_mbuf* m, struct netif* netif) {
+//dpdk receive function, receive from mbuf and hand it to the protocol stack
+static void dpdk_input(struct rte_mbuf* m, struct netif* netif,
+				netif_input_fn input) {
 	
 	struct pbuf *p;
 	uint16_t len;
@@ -116,47 +198,152 @@ static void dpdk_input(struct rte_mbuf* m, struct netif* netif) {
 	if (p != NULL) {
 		/*assuming 2048 bytes is enough for independent data packets*/
 		//p->payload = rte_pktmbuf_mtod(m, void *);	
-		pbuf_take(p, rte_pktmbuf_mtod(m, void *), len);
-		if(netif->input(p, netif) != ERR_OK) {
+		/* Chained when a virtual device loops our own sends back */
+		struct rte_mbuf *seg;
+		uint16_t off = 0;
+		for (seg = m; seg != NULL; seg = seg->next) {
+			pbuf_take_at(p, rte_pktmbuf_mtod(seg, void *), seg->data_len, off);
+			off += seg->data_len;
+		}
+		if(input(p, netif) != ERR_OK) {
 			LWIP_DEBUGF(NETIF_DEBUG, ("dpdk_input: input error\n"));
 			pbuf_free(p);
-			fprintf(stdout, "[%s][%d]: failed to handle input packet, len %u\n",
-							__FILE__, __LINE__, len);
+			NETML_TRACE(NETIF, NETIF_INPUT_ERR, 0, 0, len, 0, netif);
 		}
 	    rte_pktmbuf_free(m);
 	}
 	else {
-		fprintf(stdout, "[%s][%d]: failed to alloc pbuf for new packet\n",
-						__FILE__, __LINE__);
+		NETML_TRACE(NETIF, NETIF_NO_PBUF, 0, 0, len, 0, netif);
 		rte_pktmbuf_free(m); 
 	}
 
 }
 
+/* Looks up the registered region holding len bytes at ptr */
+static const struct extmem_region *dpdk_find_region(const void *ptr,
+				size_t len) {
+
+	uintptr_t addr = (uintptr_t)ptr;
+	size_t rlen;
+	int i;
+
+	if (__atomic_load_n(&nb_extmem, __ATOMIC_RELAXED) == 0)
+		return NULL;
+	for (i = 0; i < MAX_EXTMEM_REGIONS; i++) {
+		rlen = __atomic_load_n(&extmem[i].len, __ATOMIC_ACQUIRE);
+		if (rlen != 0 && addr >= extmem[i].start
+				&& addr - extmem[i].start <= rlen
+				&& len <= rlen - (addr - extmem[i].start))
+			return &extmem[i];
+	}
+	return NULL;
+}
+
+#if DPDK_EXTMEM
+/* Keeps a pbuf pointing into registered memory alive while the NIC may
+ * still read from it */
+struct extbuf_ref {
+	struct rte_mbuf_ext_shared_info shinfo;
+	struct pbuf *p;
+};
+
+/* Runs on whichever thread frees the mbuf, which pbuf_free and mem_free
+ * put up with under SYS_LIGHTWEIGHT_PROT */
+static void dpdk_extbuf_free(void *addr, void *opaque) {
+
+	struct extbuf_ref *ref = (struct extbuf_ref *)opaque;
+
+	LWIP_UNUSED_ARG(addr);
+	pbuf_free(ref->p);
+	mem_free(ref);
+}
+
+/* Returns an mbuf carrying the payload of q where it is, or NULL if it has
+ * to be copied. Only custom pbufs are taken, their owner keeps the memory
+ * until the last reference on them is gone. */
+static struct rte_mbuf *dpdk_extbuf_attach(struct pbuf *q) {
+
+	const struct extmem_region *r;
+	struct extbuf_ref *ref;
+	struct rte_mbuf *m;
+	uint64_t iova = RTE_BAD_IOVA;
+
+	if (!tx_multi_seg || !(q->flags & PBUF_FLAG_IS_CUSTOM) || q->len == 0)
+		return NULL;
+	r = dpdk_find_region(q->payload, q->len);
+	if (r == NULL)
+		return NULL;
+	if (r->iova != RTE_BAD_IOVA)
+		iova = r->iova + ((uintptr_t)q->payload - r->base);
+
+	m = rte_pktmbuf_alloc(l2fwd_pktmbuf_pool);
+	if (m == NULL)
+		return NULL;
+	ref = (struct extbuf_ref *)mem_malloc(sizeof(struct extbuf_ref));
+	if (ref == NULL) {
+		rte_pktmbuf_free(m);
+		return NULL;
+	}
+	ref->p = q;
+	ref->shinfo.free_cb = dpdk_extbuf_free;
+	ref->shinfo.fcb_opaque = ref;
+	rte_mbuf_ext_refcnt_set(&ref->shinfo, 1);
+	pbuf_ref(q);
+
+	rte_pktmbuf_attach_extbuf(m, q->payload, iova, q->len, &ref->shinfo);
+	m->data_len = q->len;
+	m->pkt_len = q->len;
+	return m;
+}
+#endif
+
 static err_t dpdk_output(struct netif *netif, struct pbuf *p) {
 	LWIP_UNUSED_ARG(netif);
 
 	struct pbuf *q;
 
-	struct rte_mbuf *m;
+	struct rte_mbuf *m, *tail;
 	int sent = 0;
 	m=rte_pktmbuf_alloc(l2fwd_pktmbuf_pool);
+	if (m == NULL)
+		return ERR_MEM;
 
 	if (p->tot_len > rte_pktmbuf_tailroom(m)) {
        perror("tapif: packet too large");
+       rte_pktmbuf_free(m);
        return ERR_IF;
   	}
 //	fprintf(stdout, "[%s][%d]: %u bytes to send\n",
 //					__FILE__, __LINE__, p->tot_len);
 
-	u64_t offset=0;
-	  //assuming only one packet in pbuf *p, if there is something wrong, change here.
+	/* Headers and small pieces are copied into the mbuf. Payload in
+	 * registered memory goes out in place, in a segment of its own. */
+	tail = m;
 	for(q = p; q != NULL; q = q->next) {
-	    rte_memcpy(rte_pktmbuf_mtod_offset(m, void *,offset),
+#if DPDK_EXTMEM
+		struct rte_mbuf *seg = dpdk_extbuf_attach(q);
+		if (seg != NULL) {
+			tail->next = seg;
+			tail = seg;
+			m->nb_segs++;
+			m->pkt_len += q->len;
+			continue;
+		}
+		if (RTE_MBUF_HAS_EXTBUF(tail)) {
+			seg = rte_pktmbuf_alloc(l2fwd_pktmbuf_pool);
+			if (seg == NULL) {
+				rte_pktmbuf_free(m);
+				return ERR_MEM;
+			}
+			tail->next = seg;
+			tail = seg;
+			m->nb_segs++;
+		}
+#endif
+	    rte_memcpy(rte_pktmbuf_mtod_offset(tail, void *, tail->data_len),
 		   	(void *)q->payload,q->len);
+      	tail->data_len+=q->len;
       	m->pkt_len+=q->len;
-      	m->data_len+=q->len;
-      	offset+=q->len;
     }
 
 //	fprintf(stdout, "[%lu][%s][%d]: dpdk send %u-byte packet\n",
@@ -166,6 +353,9 @@ static err_t dpdk_output(struct netif *netif, struct pbuf *p) {
 	sent = rte_eth_tx_burst(0, 0, &m, 1);
     if (sent)
 		port_statistics.tx += sent;
+	else
+		/* Dropped, TCP sends it again. Freeing lets go of the pbufs too. */
+		rte_pktmbuf_free(m);
 
 	return ERR_OK;
 }
@@ -174,22 +364,47 @@ static int dpdk_thread(void *arg) {
 	prctl(PR_SET_NAME,"dpdk_thread");
 	RTE_LOG(INFO, L2FWD, "dpdk_thread entering main loop\n");
 	unsigned i, nb_rx, sent;
+	uint16_t q;
 	struct rte_mbuf *pkts_burst[MAX_PKT_BURST];
 	struct netif* netif = (struct netif *) arg;
 	uint64_t interval = rte_get_timer_hz() / 4, last_ts = 0, ts = 0;
+	unsigned lcore, idx = 0, nb_poll = rte_lcore_count() - 1;
+
+	/* init_dpdk makes sure there is a poll lcore, this one */
+	if (nb_poll == 0)
+		nb_poll = 1;
+
+	/* Queue q belongs to the poll lcore q % nb_poll, the first one runs
+	 * the TCP timers as well */
+	RTE_LCORE_FOREACH_SLAVE(lcore) {
+		if (lcore == rte_lcore_id())
+			break;
+		idx++;
+	}
 
 	while (1) {
 		port_statistics.tx += sent;
-		nb_rx = rte_eth_rx_burst(0, 0,
-					pkts_burst, MAX_PKT_BURST);
-		port_statistics.rx += nb_rx;
-
-		for (i = 0; i < nb_rx; i++) {
-			dpdk_input(pkts_burst[i], netif); 
+		for (q = idx; q < nb_rx_queues; q += nb_poll) {
+			switch (__atomic_load_n(&rxq_state[q], __ATOMIC_ACQUIRE)) {
+			case RXQ_CLAIMING:
+				/* Done with the queue, hand it over */
+				__atomic_store_n(&rxq_state[q], RXQ_OWNED, __ATOMIC_RELEASE);
+				continue;
+			case RXQ_OWNED:
+				continue;
+			}
+
+			nb_rx = rte_eth_rx_burst(0, q,
+						pkts_burst, MAX_PKT_BURST);
+			__atomic_fetch_add(&port_statistics.rx, nb_rx, __ATOMIC_RELAXED);
+
+			for (i = 0; i < nb_rx; i++) {
+				dpdk_input(pkts_burst[i], netif, netif->input);
+			}
 		}
 
 		ts = rte_rdtsc();
-		if (ts - last_ts >= interval) {
+		if (idx == 0 && ts - last_ts >= interval) {
 			LOCK_TCPIP_CORE();
 			tcp_tmr();
 			UNLOCK_TCPIP_CORE();
@@ -228,6 +443,7 @@ err_t dpdk_device_init(struct netif* netif) {
 					netif->hwaddr[4], netif->hwaddr[5]);
 
 	netif_set_link_up(netif);
+	dpdk_netif = netif;
 	rte_eal_mp_remote_launch(dpdk_thread, (int *)netif, SKIP_MASTER);
 
 	struct arg_pass tmparg;
@@ -241,6 +457,336 @@ err_t dpdk_device_init(struct netif* netif) {
 }
 
 
+int dpdk_set_rx_queues(uint16_t queues) {
+
+	if (dpdk_netif != NULL || queues == 0 || queues > MAX_RX_QUEUES)
+		return -1;
+
+	nb_rx_queues = queues;
+	return 0;
+}
+
+int dpdk_claim_rx_queue(void) {
+
+	uint16_t q;
+	uint8_t expected;
+
+	if (dpdk_netif == NULL)
+		return -1;
+
+	for (q = 0; q < nb_rx_queues; q++) {
+		expected = RXQ_STACK;
+		if (!__atomic_compare_exchange_n(&rxq_state[q], &expected,
+						RXQ_CLAIMING, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			continue;
+
+		/* dpdk_thread may be in the middle of a burst on this queue */
+		while (__atomic_load_n(&rxq_state[q], __ATOMIC_ACQUIRE) != RXQ_OWNED)
+			rte_pause();
+		return q;
+	}
+	return -1;
+}
+
+void dpdk_release_rx_queue(int queue) {
+
+	if (queue < 0 || queue >= nb_rx_queues)
+		return;
+	__atomic_store_n(&rxq_state[queue], RXQ_STACK, __ATOMIC_RELEASE);
+}
+
+/* Poll a claimed RX queue from the calling thread and run the whole burst
+ * through the stack under a single hold of the core lock. Returns the
+ * number of packets received. */
+int dpdk_poll_rx_queue(int queue) {
+
+	struct rte_mbuf *pkts_burst[MAX_PKT_BURST];
+	unsigned i, nb_rx;
+
+	nb_rx = rte_eth_rx_burst(0, queue, pkts_burst, MAX_PKT_BURST);
+	if (nb_rx == 0)
+		return 0;
+	__atomic_fetch_add(&port_statistics.rx, nb_rx, __ATOMIC_RELAXED);
+
+	LOCK_TCPIP_CORE();
+	for (i = 0; i < nb_rx; i++)
+		dpdk_input(pkts_burst[i], dpdk_netif, ethernet_input);
+	UNLOCK_TCPIP_CORE();
+
+	return nb_rx;
+}
+
+
+int dpdk_set_cpus(const int *cpus, int count) {
+
+	int i;
+
+	if (dpdk_netif != NULL || count < 2 || count > MAX_DPDK_CPUS)
+		return -1;
+	for (i = 0; i < count; i++)
+		if (cpus[i] < 0 || cpus[i] >= RTE_MAX_LCORE)
+			return -1;
+
+	memcpy(dpdk_cpus, cpus, count * sizeof(int));
+	nb_dpdk_cpus = count;
+	return 0;
+}
+
+/* Returns the number of CPUs given to EAL, 0 if left to the default */
+int dpdk_get_cpus(int *cpus, int max) {
+
+	int i;
+
+	for (i = 0; i < nb_dpdk_cpus && i < max; i++)
+		cpus[i] = dpdk_cpus[i];
+	return nb_dpdk_cpus;
+}
+
+/* Guesses the NUMA node of the NIC before EAL is up, from the first PCI
+ * device bound to a DPDK capable driver. Returns -1 if there is none. */
+int dpdk_probe_numa_node(void) {
+
+	static const char *drivers[] = {
+		"vfio-pci", "igb_uio", "uio_pci_generic", NULL
+	};
+	char path[512];
+	struct dirent *entry;
+	DIR *dir;
+	FILE *fp;
+	int i, node = -1;
+
+	for (i = 0; drivers[i] != NULL && node < 0; i++) {
+		snprintf(path, sizeof(path), "/sys/bus/pci/drivers/%s", drivers[i]);
+		dir = opendir(path);
+		if (dir == NULL)
+			continue;
+		while ((entry = readdir(dir)) != NULL && node < 0) {
+			/* Devices show up as links named by their PCI address */
+			if (!isxdigit((unsigned char)entry->d_name[0])
+					|| strchr(entry->d_name, ':') == NULL)
+				continue;
+			snprintf(path, sizeof(path), "/sys/bus/pci/drivers/%s/%s/numa_node",
+							drivers[i], entry->d_name);
+			fp = fopen(path, "r");
+			if (fp == NULL)
+				continue;
+			if (fscanf(fp, "%d", &node) != 1)
+				node = -1;
+			fclose(fp);
+		}
+		closedir(dir);
+	}
+	return node;
+}
+
+/* NUMA node of port 0 once EAL is up, -1 if unknown */
+int dpdk_numa_node(void) {
+
+	if (l2fwd_pktmbuf_pool == NULL)
+		return -1;
+	return rte_eth_dev_socket_id(0);
+}
+
+/* Switch side of port 0 */
+static void dpdk_switch_output(void *arg, const u8_t *frame, u16_t len) {
+
+	struct rte_mbuf *m;
+	char *data;
+
+	LWIP_UNUSED_ARG(arg);
+	m = rte_pktmbuf_alloc(l2fwd_pktmbuf_pool);
+	if (m == NULL)
+		return;
+	data = rte_pktmbuf_append(m, len);
+	if (data == NULL || rte_ring_enqueue(switch_rx_ring, m) != 0) {
+		rte_pktmbuf_free(m);
+		return;
+	}
+	rte_memcpy(data, frame, len);
+}
+
+static int dpdk_switch_poll(struct netml_switch *sw, int port, void *arg) {
+
+	struct rte_mbuf *pkts[MAX_PKT_BURST];
+	u8_t frame[NETML_SWITCH_FRAME_MAX];
+	unsigned i, nb;
+
+	LWIP_UNUSED_ARG(arg);
+	nb = rte_ring_dequeue_burst(switch_tx_ring, (void **)pkts, MAX_PKT_BURST
+#if RTE_VERSION >= RTE_VERSION_NUM(17, 5, 0, 0)
+								, NULL
+#endif
+								);
+	for (i = 0; i < nb; i++) {
+		struct rte_mbuf *seg;
+		uint16_t len = 0;
+
+		if (rte_pktmbuf_pkt_len(pkts[i]) <= sizeof(frame)) {
+			for (seg = pkts[i]; seg != NULL; seg = seg->next) {
+				rte_memcpy(frame + len, rte_pktmbuf_mtod(seg, void *),
+						   seg->data_len);
+				len += seg->data_len;
+			}
+			netml_switch_input(sw, port, frame, len);
+		}
+		rte_pktmbuf_free(pkts[i]);
+	}
+	return nb;
+}
+
+/*
+ * Plugs port 0 into switch sw instead of a NIC, no PCI device is probed.
+ * Must be called before init_dpdk. Hosts added to the switch with
+ * netml_switch_netif_init then reach the stack through port 0.
+ */
+int dpdk_attach_switch(struct netml_switch *sw) {
+
+	if (l2fwd_pktmbuf_pool != NULL)
+		return -1;
+	dpdk_switch = sw;
+	return 0;
+}
+
+#if DPDK_EXTMEM
+/* Virtual devices only ever touch the virtual address of the data */
+static int dpdk_port_is_virtual(void) {
+
+	struct rte_eth_dev_info dev_info;
+	struct rte_bus *bus;
+
+	rte_eth_dev_info_get(0, &dev_info);
+	bus = rte_bus_find_by_device(dev_info.device);
+	return bus != NULL && strcmp(bus->name, "vdev") == 0;
+}
+#endif
+
+/*
+ * Registers len bytes at addr for zero-copy sends. The pages around them
+ * are registered with EAL and mapped for the DMA of port 0. Segment
+ * payloads inside the region then go out as external buffer mbufs
+ * pointing at the data, and the pbufs carrying them stay referenced until
+ * the NIC is done. The region must stay registered as long as anything
+ * sent from it may be in flight. Returns 0 or -1 with errno set.
+ */
+int dpdk_register_memory(void *addr, size_t len) {
+
+#if DPDK_EXTMEM
+	struct rte_eth_dev_info dev_info;
+	size_t pgsz = (size_t)sysconf(_SC_PAGESIZE);
+	uintptr_t base, end;
+	uint64_t iova;
+	int i, slot = -1;
+
+	if (dpdk_netif == NULL || addr == NULL || len == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	base = RTE_ALIGN_FLOOR((uintptr_t)addr, pgsz);
+	end = RTE_ALIGN_CEIL((uintptr_t)addr + len, pgsz);
+
+	pthread_mutex_lock(&extmem_lock);
+	for (i = 0; i < MAX_EXTMEM_REGIONS; i++) {
+		if (extmem[i].len == 0) {
+			slot = i;
+			break;
+		}
+	}
+	if (slot < 0) {
+		errno = ENOSPC;
+		goto err;
+	}
+
+	if (rte_extmem_register((void *)base, end - base, NULL, 0, pgsz) < 0) {
+		errno = rte_errno;
+		goto err;
+	}
+
+	if (dpdk_port_is_virtual()) {
+		iova = rte_eal_iova_mode() == RTE_IOVA_VA ? base : RTE_BAD_IOVA;
+	}
+	else {
+#if RTE_VERSION >= RTE_VERSION_NUM(19, 5, 0, 0)
+		/* A NIC only reaches memory EAL did not allocate through the
+		 * IOMMU, which takes IOVA as VA */
+		rte_eth_dev_info_get(0, &dev_info);
+		if (rte_eal_iova_mode() != RTE_IOVA_VA) {
+			errno = ENOTSUP;
+			goto err_unregister;
+		}
+		if (rte_dev_dma_map(dev_info.device, (void *)base, base,
+						end - base) < 0) {
+			errno = rte_errno;
+			goto err_unregister;
+		}
+		iova = base;
+#else
+		(void)dev_info;
+		errno = ENOTSUP;
+		goto err_unregister;
+#endif
+	}
+
+	extmem[slot].start = (uintptr_t)addr;
+	extmem[slot].base = base;
+	extmem[slot].span = end - base;
+	extmem[slot].iova = iova;
+	__atomic_store_n(&extmem[slot].len, len, __ATOMIC_RELEASE);
+	__atomic_store_n(&nb_extmem, nb_extmem + 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&extmem_lock);
+	return 0;
+
+err_unregister:
+	rte_extmem_unregister((void *)base, end - base);
+err:
+	pthread_mutex_unlock(&extmem_lock);
+	return -1;
+#else
+	LWIP_UNUSED_ARG(addr);
+	LWIP_UNUSED_ARG(len);
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+/* Undoes dpdk_register_memory for the region starting at addr */
+int dpdk_unregister_memory(void *addr) {
+
+	int i;
+
+	pthread_mutex_lock(&extmem_lock);
+	for (i = 0; i < MAX_EXTMEM_REGIONS; i++) {
+		if (extmem[i].len != 0 && extmem[i].start == (uintptr_t)addr)
+			break;
+	}
+	if (i == MAX_EXTMEM_REGIONS) {
+		pthread_mutex_unlock(&extmem_lock);
+		errno = EINVAL;
+		return -1;
+	}
+	__atomic_store_n(&extmem[i].len, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&nb_extmem, nb_extmem - 1, __ATOMIC_RELAXED);
+
+#if DPDK_EXTMEM
+#if RTE_VERSION >= RTE_VERSION_NUM(19, 5, 0, 0)
+	if (!dpdk_port_is_virtual()) {
+		struct rte_eth_dev_info dev_info;
+		rte_eth_dev_info_get(0, &dev_info);
+		rte_dev_dma_unmap(dev_info.device, (void *)extmem[i].base,
+						extmem[i].iova, extmem[i].span);
+	}
+#endif
+	rte_extmem_unregister((void *)extmem[i].base, extmem[i].span);
+#endif
+	pthread_mutex_unlock(&extmem_lock);
+	return 0;
+}
+
+/* Whether len bytes at ptr lie in a registered region */
+int dpdk_memory_registered(const void *ptr, size_t len) {
+
+	return dpdk_find_region(ptr, len) != NULL;
+}
+
 /* Check the link status of all ports in up to 9s, and print them finally */
 static void
 check_port_link_status(void)
@@ -302,16 +848,70 @@ init_dpdk(void)
 
 	/* init EAL */
 	int val = 3;
-	char *str[3];
+	char *str[8];
 	str[0] = "netml";
 	char tmpstr1[] = "-c";
 	str[1] = tmpstr1;
 	char tmpstr2[] = "3";
 	str[2] = tmpstr2;
-	
+
+	char lcores[MAX_DPDK_CPUS * 8], master[16];
+	char lopt[] = "-l", mopt[] = "--master-lcore";
+	if (nb_dpdk_cpus > 0) {
+		int i, len = 0;
+		for (i = 0; i < nb_dpdk_cpus; i++)
+			len += snprintf(lcores + len, sizeof(lcores) - len, "%s%d",
+							i ? "," : "", dpdk_cpus[i]);
+		snprintf(master, sizeof(master), "%d", dpdk_cpus[0]);
+		str[1] = lopt;
+		str[2] = lcores;
+		str[3] = mopt;
+		str[4] = master;
+		val = 5;
+	}
+
+	/* NETML_DPDK_VDEV runs the stack on a virtual device, e.g. net_null0
+	 * or net_ring0, instead of the NICs. Handy for testing. */
+	char vopt[] = "--vdev", nopci[] = "--no-pci";
+	char *vdev = getenv("NETML_DPDK_VDEV");
+	if (dpdk_switch != NULL)
+		str[val++] = nopci;
+	else if (vdev != NULL && vdev[0] != '\0') {
+		str[val++] = vopt;
+		str[val++] = vdev;
+		str[val++] = nopci;
+	}
+
 	ret = rte_eal_init(val, str);
 	if (ret < 0)
 		rte_exit(EXIT_FAILURE, "Invalid EAL arguments\n");
+	/* The master lcore only initializes, the others poll the NIC */
+	if (rte_lcore_count() < 2)
+		rte_exit(EXIT_FAILURE, "Need at least 2 lcores, one to poll the NIC\n");
+
+	/* Report what EAL made of the default */
+	if (nb_dpdk_cpus == 0) {
+		unsigned lcore;
+		RTE_LCORE_FOREACH(lcore) {
+			if (nb_dpdk_cpus == MAX_DPDK_CPUS)
+				break;
+			dpdk_cpus[nb_dpdk_cpus++] = lcore;
+		}
+	}
+
+	if (dpdk_switch != NULL) {
+		switch_rx_ring = rte_ring_create("netml_sw_rx", SWITCH_RING_SIZE,
+										 rte_socket_id(),
+										 RING_F_SP_ENQ | RING_F_SC_DEQ);
+		switch_tx_ring = rte_ring_create("netml_sw_tx", SWITCH_RING_SIZE,
+										 rte_socket_id(),
+										 RING_F_SP_ENQ | RING_F_SC_DEQ);
+		if (switch_rx_ring == NULL || switch_tx_ring == NULL)
+			rte_exit(EXIT_FAILURE, "Cannot create switch rings\n");
+		if (rte_eth_from_rings("net_ring_netml", &switch_rx_ring, 1,
+							   &switch_tx_ring, 1, rte_socket_id()) != 0)
+			rte_exit(EXIT_FAILURE, "Cannot build port 0 on the switch rings\n");
+	}
 
 	nb_ports = rte_eth_dev_count();
 	if (nb_ports == 0)
@@ -319,13 +919,21 @@ init_dpdk(void)
 
 	printf("%u port\n", nb_ports);
 
-	/* create the mbuf pool */
+	/* create the mbuf pool next to the NIC */
+	int socket = rte_eth_dev_socket_id(0);
+	if (socket < 0)
+		socket = rte_socket_id();
 	l2fwd_pktmbuf_pool = rte_pktmbuf_pool_create("mbuf_pool", NB_MBUF,
 		MEMPOOL_CACHE_SIZE, 0, RTE_MBUF_DEFAULT_BUF_SIZE,
-		rte_socket_id());
+		socket);
 	if (l2fwd_pktmbuf_pool == NULL)
 		rte_exit(EXIT_FAILURE, "Cannot init mbuf pool\n");
 
+	if (dpdk_switch != NULL &&
+		netml_switch_add_port(dpdk_switch, dpdk_switch_output,
+							  dpdk_switch_poll, NULL) < 0)
+		rte_exit(EXIT_FAILURE, "No switch port left for port 0\n");
+
 	/*
 	 * Each logical core is assigned a dedicated TX queue on each port.
 	 */
@@ -333,10 +941,33 @@ init_dpdk(void)
 
 	printf("lcore 1: RX port 0 \n");
 
+	if (nb_rx_queues > dev_info.max_rx_queues) {
+		printf("Port 0 has only %u RX queues\n", dev_info.max_rx_queues);
+		nb_rx_queues = dev_info.max_rx_queues;
+	}
+
+	struct rte_eth_conf conf = port_conf;
+	if (nb_rx_queues > 1) {
+		conf.rxmode.mq_mode = ETH_MQ_RX_RSS;
+		conf.rx_adv_conf.rss_conf.rss_key = NULL;
+		conf.rx_adv_conf.rss_conf.rss_hf = ETH_RSS_IP | ETH_RSS_TCP;
+	}
+
+#if DPDK_EXTMEM
+	/* Sends from registered memory chain an mbuf per piece. Virtual
+	 * devices take chains whatever they advertise. */
+	if (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_MULTI_SEGS) {
+		conf.txmode.offloads |= DEV_TX_OFFLOAD_MULTI_SEGS;
+		tx_multi_seg = 1;
+	}
+	else if (dpdk_port_is_virtual())
+		tx_multi_seg = 1;
+#endif
+
 	/* init port 0 */
 	printf("Initializing port 0 ... \n");
 	fflush(stdout);
-	ret = rte_eth_dev_configure(0, 1, 1, &port_conf);
+	ret = rte_eth_dev_configure(0, nb_rx_queues, 1, &conf);
 	if (ret < 0)
 		rte_exit(EXIT_FAILURE, "Cannot configure device: err=%d, port=0\n", ret);
 
@@ -347,14 +978,17 @@ init_dpdk(void)
 
 		rte_eth_macaddr_get(0,&l2fwd_port_eth_addr);
 
-	/* init one RX queue */
+	/* init the RX queues */
 	fflush(stdout);
-	ret = rte_eth_rx_queue_setup(0, 0, nb_rxd,
-					   rte_eth_dev_socket_id(0),
-					   NULL,
-					   l2fwd_pktmbuf_pool);
-	if (ret < 0)
-		rte_exit(EXIT_FAILURE, "rte_eth_rx_queue_setup:err=%d, port=0\n", ret);
+	for (uint16_t q = 0; q < nb_rx_queues; q++) {
+		ret = rte_eth_rx_queue_setup(0, q, nb_rxd,
+						   rte_eth_dev_socket_id(0),
+						   NULL,
+						   l2fwd_pktmbuf_pool);
+		if (ret < 0)
+			rte_exit(EXIT_FAILURE, "rte_eth_rx_queue_setup:err=%d, port=0, queue=%u\n",
+							ret, q);
+	}
 
 	/* init one TX queue on each port */
 	fflush(stdout);
@@ -382,6 +1016,15 @@ init_dpdk(void)
 			l2fwd_port_eth_addr.addr_bytes[4],
 			l2fwd_port_eth_addr.addr_bytes[5]);
 
+	/* The poll lcores, see dpdk_thread */
+	if (dpdk_numa_node() >= 0) {
+		unsigned lcore;
+		RTE_LCORE_FOREACH_SLAVE(lcore) {
+			if ((int)rte_lcore_to_socket_id(lcore) != dpdk_numa_node())
+				printf("lcore %u polls port 0 from another NUMA node\n", lcore);
+		}
+	}
+
 		/* initialize port stats */
 	memset(&port_statistics, 0, sizeof(port_statistics));
 
@@ -0,0 +1,1123 @@
+/**
+ * @file
+ * NetML switch emulator
+ *
+ * Frames are forwarded by destination MAC, learnt from the source MAC of
+ * what comes in; frames for unknown or broadcast destinations go out of
+ * every other port. NetML segments other than hot ones pass unchanged.
+ *
+ * A hot segment that carries an uncoded float32 or int32 tensor chunk is
+ * summed into the slot its chunk (destination, key, version, offset)
+ * hashes to. The first worker's segment becomes the sum; once the
+ * contributions of all workers are in, it goes to the destination marked
+ * NETML_AGG, on the connection of that first worker. Hot segments do not
+ * move the tunnel sequence, so the receiver takes AGG segments at their
+ * tunnel number without moving it either.
+ *
+ * Rules:
+ * - A chunk whose slot holds another chunk still being summed or waiting
+ *   for its ack, or that cannot be summed, goes through on its own,
+ *   marked NETML_AGG with a count of one worker. So does one from a
+ *   worker that is not part of the sum of its slot, e.g. after a timeout.
+ * - A slot waits config.timeout milliseconds for its last workers, then
+ *   sends what it has. The tensor header counts the workers summed, so
+ *   the receiver can tell how many contributions are still to come.
+ * - The NETML_AGG_ACK of the receiver for a sum is not passed on. Every
+ *   worker of the sum gets an ack of its own instead, for the segment it
+ *   sent. The slot keeps its workers until another chunk takes it, so a
+ *   worker that retransmits after the ack was lost is acked by the switch.
+ * - A worker that retransmits while the sum waits for its ack gets the
+ *   sum sent again, at most once per timeout.
+ *
+ * Sums and pass-through segments clear the more flag of their chunk: the
+ * parts of a message may end up on different connections, every chunk
+ * carries its own header anyway.
+ *
+ * The switch is driven by one thread at a time, netml_switch_poll or the
+ * thread of netml_switch_start.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/pbuf.h"
+#include "lwip/sys.h"
+#include "lwip/tcp.h"
+#include "lwip/netml.h"
+#include "netif/etharp.h"
+#include "netif/netml_switch.h"
+
+/* Frames a netif port queues for the switch, a power of two */
+#define NETML_SWITCH_QUEUE_LEN 256
+
+/* Frames taken from a port in one go */
+#define NETML_SWITCH_BURST 32
+
+/* Microseconds the thread sleeps when no port had anything */
+#define NETML_SWITCH_IDLE_US 20
+
+/* MAC addresses learnt */
+#define NETML_SWITCH_MACS (NETML_SWITCH_MAX_PORTS * 4)
+
+/* Headers */
+#define ETH_HDR_LEN 14
+#define ETH_TYPE_IPV4 0x0800
+#define IP_HDR_LEN 20
+#define TCP_HDR_LEN 20
+#define INT_HDR_LEN 12
+#define TCP_FLAG_ACK 0x10
+
+/* ZMTP frame of a tensor chunk: flags, codec, size, tensor header. The
+ * flags are those of v2_protocol_t, the dtypes those of zmq.h. */
+#define CHUNK_FRAME_LEN 6
+#define CHUNK_HDR_LEN 24
+#define CHUNK_MORE 0x01
+#define CHUNK_LARGE 0x02
+#define CHUNK_COMMAND 0x04
+#define CHUNK_KEY 0x08
+#define CHUNK_DTYPE_I32 5
+#define CHUNK_DTYPE_F32 6
+/* Offset of the workers count in the tensor header */
+#define CHUNK_WORKERS 13
+
+#define NIL 0xffffffffU
+
+enum {
+  SLOT_FREE = 0,
+  SLOT_SUMMING,
+  SLOT_SENT,
+  SLOT_DONE
+};
+
+/* A worker of a sum, what it takes to ack its segment */
+struct netml_switch_worker {
+  u8_t mac[6];
+  u16_t port;
+  u16_t src_id;
+  u16_t tcp_port;
+  u32_t ip;
+  u32_t seqno;
+  u32_t ackno;
+  u32_t int_seqno;
+  u16_t len;
+};
+
+struct netml_switch_slot {
+  u8_t state;
+  u8_t dtype;
+  u16_t nworkers;
+  u32_t count;
+  u64_t key;
+  u32_t version;
+  u32_t offset;
+  u32_t dst_ip;
+  u16_t dst_port;
+  /** contributions summed, a segment may count several */
+  u16_t summed;
+  u64_t mask;
+  u32_t born;
+  u32_t sent;
+  /** list of summing slots, oldest first */
+  u32_t older, newer;
+  /** what the receiver acked the sum with, to ack retransmissions */
+  u16_t ack_wnd;
+  u16_t ack_src_id;
+  u32_t ack_tunlno;
+  /** the segment of the first worker, holding the sum */
+  u16_t frame_len;
+  u16_t elems;
+  u8_t *frame;
+  struct netml_switch_worker *workers;
+};
+
+struct netml_switch_port {
+  netml_switch_output_fn output;
+  netml_switch_poll_fn poll;
+  void *arg;
+};
+
+struct netml_switch_mac {
+  u8_t mac[6];
+  u16_t port;
+};
+
+struct netml_switch {
+  struct netml_switch_config config;
+  struct netml_switch_port ports[NETML_SWITCH_MAX_PORTS];
+  int nports;
+  struct netml_switch_mac macs[NETML_SWITCH_MACS];
+  int nmacs;
+  struct netml_switch_slot *slots;
+  /** summing slots by age */
+  u32_t oldest, newest;
+  /** sums waiting for their ack by connection and ack number, slot + 1 */
+  u32_t *acks;
+  u32_t ack_mask;
+  struct netml_switch_stats stats;
+  /** frames dropped by ports outside the switch thread */
+  u64_t port_dropped;
+  u8_t scratch[NETML_SWITCH_FRAME_MAX];
+  pthread_t thread;
+  int running;
+  int stop;
+};
+
+/* A frame taken apart */
+struct netml_frame {
+  u16_t ip;
+  u16_t tcp;
+  u16_t tcp_len;
+  u16_t payload;
+  u16_t payload_len;
+  u8_t netml;
+};
+
+static inline u16_t
+get16(const u8_t *p)
+{
+  return (u16_t)(p[0] << 8 | p[1]);
+}
+
+static inline u32_t
+get32(const u8_t *p)
+{
+  return (u32_t)p[0] << 24 | (u32_t)p[1] << 16 | (u32_t)p[2] << 8 | p[3];
+}
+
+static inline void
+put16(u8_t *p, u16_t v)
+{
+  p[0] = (u8_t)(v >> 8);
+  p[1] = (u8_t)v;
+}
+
+static inline void
+put32(u8_t *p, u32_t v)
+{
+  p[0] = (u8_t)(v >> 24);
+  p[1] = (u8_t)(v >> 16);
+  p[2] = (u8_t)(v >> 8);
+  p[3] = (u8_t)v;
+}
+
+static u32_t
+netml_switch_sum16(const u8_t *p, u32_t len, u32_t acc)
+{
+  u32_t i;
+
+  for (i = 0; i + 1 < len; i += 2) {
+    acc += (u32_t)(p[i] << 8 | p[i + 1]);
+  }
+  if (len & 1) {
+    acc += (u32_t)p[len - 1] << 8;
+  }
+  return acc;
+}
+
+static u16_t
+netml_switch_fold(u32_t acc)
+{
+  while (acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
+  }
+  return (u16_t)~acc;
+}
+
+/* Fills in the IPv4 and TCP checksums of frame */
+static void
+netml_switch_checksum(u8_t *frame, const struct netml_frame *f, int ip)
+{
+  u8_t *iph = frame + f->ip;
+  u8_t *tcph = frame + f->tcp;
+  u16_t seg_len = (u16_t)(f->tcp_len + INT_HDR_LEN + f->payload_len);
+  u32_t acc;
+
+  if (ip) {
+    put16(iph + 10, 0);
+    put16(iph + 10, netml_switch_fold(netml_switch_sum16(iph, f->tcp - f->ip, 0)));
+  }
+
+  put16(tcph + 16, 0);
+  acc = netml_switch_sum16(iph + 12, 8, 0);
+  acc += IP_PROTO_TCP + seg_len;
+  acc = netml_switch_sum16(tcph, seg_len, acc);
+  put16(tcph + 16, netml_switch_fold(acc));
+}
+
+static int
+netml_switch_parse(const u8_t *frame, u16_t len, struct netml_frame *f)
+{
+  const u8_t *iph, *tcph;
+  u16_t ip_len, ip_hlen;
+
+  if (len < ETH_HDR_LEN + IP_HDR_LEN ||
+      get16(frame + 12) != ETH_TYPE_IPV4) {
+    return -1;
+  }
+  iph = frame + ETH_HDR_LEN;
+  ip_hlen = (u16_t)((iph[0] & 0x0f) * 4);
+  ip_len = get16(iph + 2);
+  if ((iph[0] >> 4) != 4 || ip_hlen < IP_HDR_LEN || iph[9] != IP_PROTO_TCP ||
+      ip_len < ip_hlen + TCP_HDR_LEN || ETH_HDR_LEN + ip_len > len) {
+    return -1;
+  }
+  tcph = iph + ip_hlen;
+  f->ip = ETH_HDR_LEN;
+  f->tcp = (u16_t)(ETH_HDR_LEN + ip_hlen);
+  f->tcp_len = (u16_t)((tcph[12] >> 4) * 4);
+  f->netml = tcph[12] & TCP_OFFSET_FLAGS;
+  if (f->tcp_len < TCP_HDR_LEN || ip_hlen + f->tcp_len > ip_len) {
+    return -1;
+  }
+
+  /* Only NetML data and acks carry the internal header */
+  if (INTH_BYPASS(f->netml) || INTH_CTL(f->netml)) {
+    f->payload = f->payload_len = 0;
+    return 0;
+  }
+  if (ip_hlen + f->tcp_len + INT_HDR_LEN > ip_len) {
+    return -1;
+  }
+  f->payload = (u16_t)(f->tcp + f->tcp_len + INT_HDR_LEN);
+  f->payload_len = (u16_t)(ip_len - ip_hlen - f->tcp_len - INT_HDR_LEN);
+  return 0;
+}
+
+/* Whether the payload of f is one tensor chunk the switch can sum */
+static int
+netml_switch_chunk(const u8_t *frame, const struct netml_frame *f)
+{
+  const u8_t *p = frame + f->payload;
+  u32_t count;
+
+  if (f->payload_len < CHUNK_FRAME_LEN + CHUNK_HDR_LEN ||
+      (p[0] & (CHUNK_KEY | CHUNK_LARGE | CHUNK_COMMAND)) != (CHUNK_KEY | CHUNK_LARGE) ||
+      p[1] != 0 ||
+      get32(p + 2) != (u32_t)(f->payload_len - CHUNK_FRAME_LEN)) {
+    return 0;
+  }
+  p += CHUNK_FRAME_LEN;
+  count = get32(p + 16);
+  return (p[12] == CHUNK_DTYPE_F32 || p[12] == CHUNK_DTYPE_I32) && count != 0 &&
+         CHUNK_HDR_LEN + count * 4 == (u32_t)(f->payload_len - CHUNK_FRAME_LEN);
+}
+
+/* Forwarding */
+
+static void
+netml_switch_learn(struct netml_switch *sw, const u8_t *mac, int port)
+{
+  int i;
+
+  if (mac[0] & 1) {
+    return;
+  }
+  for (i = 0; i < sw->nmacs; i++) {
+    if (memcmp(sw->macs[i].mac, mac, 6) == 0) {
+      sw->macs[i].port = (u16_t)port;
+      return;
+    }
+  }
+  if (sw->nmacs == NETML_SWITCH_MACS) {
+    return;
+  }
+  memcpy(sw->macs[sw->nmacs].mac, mac, 6);
+  sw->macs[sw->nmacs].port = (u16_t)port;
+  sw->nmacs++;
+}
+
+static int
+netml_switch_lookup(struct netml_switch *sw, const u8_t *mac)
+{
+  int i;
+
+  if (mac[0] & 1) {
+    return -1;
+  }
+  for (i = 0; i < sw->nmacs; i++) {
+    if (memcmp(sw->macs[i].mac, mac, 6) == 0) {
+      return sw->macs[i].port;
+    }
+  }
+  return -1;
+}
+
+/* Sends frame towards its destination, never back out of port from */
+static void
+netml_switch_send(struct netml_switch *sw, int from, const u8_t *frame,
+                  u16_t len)
+{
+  int n = __atomic_load_n(&sw->nports, __ATOMIC_ACQUIRE);
+  int to = netml_switch_lookup(sw, frame);
+  int i;
+
+  if (to >= 0) {
+    if (to != from) {
+      sw->ports[to].output(sw->ports[to].arg, frame, len);
+      sw->stats.forwarded++;
+    }
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    if (i != from) {
+      sw->ports[i].output(sw->ports[i].arg, frame, len);
+    }
+  }
+  sw->stats.flooded++;
+}
+
+/* Sums waiting for their ack */
+
+static u32_t
+netml_switch_ack_hash(struct netml_switch *sw, u32_t ip, u16_t port,
+                      u16_t dst_port, u32_t ackno)
+{
+  u64_t h = ((u64_t)ip << 32 | (u32_t)port << 16 | dst_port) ^
+            ((u64_t)ackno * 0x9e3779b97f4a7c15ULL);
+  h ^= h >> 31;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 29;
+  return (u32_t)h & sw->ack_mask;
+}
+
+static u32_t
+netml_switch_slot_ack_hash(struct netml_switch *sw,
+                           const struct netml_switch_slot *slot)
+{
+  const struct netml_switch_worker *w = &slot->workers[0];
+  return netml_switch_ack_hash(sw, w->ip, w->tcp_port, slot->dst_port,
+                               w->seqno + w->len);
+}
+
+static void
+netml_switch_ack_insert(struct netml_switch *sw, u32_t idx)
+{
+  u32_t pos = netml_switch_slot_ack_hash(sw, &sw->slots[idx]);
+
+  while (sw->acks[pos] != 0) {
+    pos = (pos + 1) & sw->ack_mask;
+  }
+  sw->acks[pos] = idx + 1;
+}
+
+/* Position of the sum ip:port acked with ackno from dst_port, or NIL */
+static u32_t
+netml_switch_ack_find(struct netml_switch *sw, u32_t ip, u16_t port,
+                      u16_t dst_port, u32_t ackno)
+{
+  u32_t pos = netml_switch_ack_hash(sw, ip, port, dst_port, ackno);
+
+  for (; sw->acks[pos] != 0; pos = (pos + 1) & sw->ack_mask) {
+    const struct netml_switch_slot *slot = &sw->slots[sw->acks[pos] - 1];
+    const struct netml_switch_worker *w = &slot->workers[0];
+
+    if (w->ip == ip && w->tcp_port == port && slot->dst_port == dst_port &&
+        w->seqno + w->len == ackno) {
+      return pos;
+    }
+  }
+  return NIL;
+}
+
+/* Removes the entry at pos, moving up those it displaced */
+static void
+netml_switch_ack_remove(struct netml_switch *sw, u32_t pos)
+{
+  u32_t next = pos;
+
+  sw->acks[pos] = 0;
+  for (;;) {
+    u32_t home;
+
+    next = (next + 1) & sw->ack_mask;
+    if (sw->acks[next] == 0) {
+      return;
+    }
+    home = netml_switch_slot_ack_hash(sw, &sw->slots[sw->acks[next] - 1]);
+    /* Stays put if its home lies cyclically in (pos, next] */
+    if (pos <= next ? (pos < home && home <= next) : (pos < home || home <= next)) {
+      continue;
+    }
+    sw->acks[pos] = sw->acks[next];
+    sw->acks[next] = 0;
+    pos = next;
+  }
+}
+
+/* Slots */
+
+static u32_t
+netml_switch_slot_of(struct netml_switch *sw, u32_t dst_ip, u16_t dst_port,
+                     u64_t key, u32_t version, u32_t offset)
+{
+  u64_t h = key ^ ((u64_t)version << 32 | offset) ^
+            ((u64_t)dst_ip << 16 | dst_port) * 0x9e3779b97f4a7c15ULL;
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return (u32_t)(h % sw->config.slots);
+}
+
+static void
+netml_switch_unlink(struct netml_switch *sw, u32_t idx)
+{
+  struct netml_switch_slot *slot = &sw->slots[idx];
+
+  if (slot->older != NIL) {
+    sw->slots[slot->older].newer = slot->newer;
+  } else {
+    sw->oldest = slot->newer;
+  }
+  if (slot->newer != NIL) {
+    sw->slots[slot->newer].older = slot->older;
+  } else {
+    sw->newest = slot->older;
+  }
+  slot->older = slot->newer = NIL;
+}
+
+static int
+netml_switch_worker_of(const struct netml_switch_slot *slot, u16_t src_id)
+{
+  int i;
+
+  for (i = 0; i < slot->nworkers; i++) {
+    if (slot->workers[i].src_id == src_id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void
+netml_switch_add_worker(struct netml_switch_slot *slot, int port,
+                        const u8_t *frame, const struct netml_frame *f)
+{
+  struct netml_switch_worker *w = &slot->workers[slot->nworkers];
+  const u8_t *tcph = frame + f->tcp;
+  const u8_t *inth = tcph + f->tcp_len;
+  const u8_t *hdr = frame + f->payload + CHUNK_FRAME_LEN;
+  u16_t weight = hdr[CHUNK_WORKERS] ? hdr[CHUNK_WORKERS] : 1;
+
+  memcpy(w->mac, frame + 6, 6);
+  w->port = (u16_t)port;
+  memcpy(&w->ip, frame + f->ip + 12, 4);
+  w->tcp_port = get16(tcph);
+  w->seqno = get32(tcph + 4);
+  w->ackno = get32(tcph + 8);
+  w->src_id = get16(inth + 2);
+  w->int_seqno = get32(inth + 4);
+  w->len = f->payload_len;
+
+  slot->mask |= (u64_t)1 << slot->nworkers;
+  slot->nworkers++;
+  slot->summed = (u16_t)(slot->summed + weight);
+}
+
+static void
+netml_switch_sum(struct netml_switch_slot *slot, const u8_t *elems)
+{
+  u8_t *sum = slot->frame + slot->elems;
+  u32_t i;
+
+  if (slot->dtype == CHUNK_DTYPE_F32) {
+    for (i = 0; i < slot->count; i++) {
+      float a, b;
+      memcpy(&a, sum + i * 4, 4);
+      memcpy(&b, elems + i * 4, 4);
+      a += b;
+      memcpy(sum + i * 4, &a, 4);
+    }
+  } else {
+    for (i = 0; i < slot->count; i++) {
+      u32_t a, b;
+      memcpy(&a, sum + i * 4, 4);
+      memcpy(&b, elems + i * 4, 4);
+      a += b;
+      memcpy(sum + i * 4, &a, 4);
+    }
+  }
+}
+
+/* Sends the sum of slot idx to its destination */
+static void
+netml_switch_emit(struct netml_switch *sw, u32_t idx, u32_t now)
+{
+  struct netml_switch_slot *slot = &sw->slots[idx];
+  struct netml_frame f;
+  u8_t *tcph;
+
+  netml_switch_unlink(sw, idx);
+  netml_switch_parse(slot->frame, slot->frame_len, &f);
+  tcph = slot->frame + f.tcp;
+  tcph[12] = (u8_t)((tcph[12] & ~TCP_OFFSET_FLAGS) | NETML_AGG);
+  slot->frame[slot->elems - CHUNK_HDR_LEN + CHUNK_WORKERS] =
+    (u8_t)LWIP_MIN(slot->summed, 255);
+  netml_switch_checksum(slot->frame, &f, 0);
+
+  slot->state = SLOT_SENT;
+  slot->sent = now;
+  netml_switch_ack_insert(sw, idx);
+  netml_switch_send(sw, slot->workers[0].port, slot->frame, slot->frame_len);
+}
+
+/* Acks the segment worker w of slot sent */
+static void
+netml_switch_ack(struct netml_switch *sw, const struct netml_switch_slot *slot,
+                 const struct netml_switch_worker *w)
+{
+  u8_t *frame = sw->scratch;
+  u8_t *iph = frame + ETH_HDR_LEN;
+  u8_t *tcph = iph + IP_HDR_LEN;
+  u8_t *inth = tcph + TCP_HDR_LEN;
+  struct netml_frame f;
+  int n = __atomic_load_n(&sw->nports, __ATOMIC_ACQUIRE);
+
+  memset(frame, 0, ETH_HDR_LEN + IP_HDR_LEN + TCP_HDR_LEN + INT_HDR_LEN);
+  memcpy(frame, w->mac, 6);
+  memcpy(frame + 6, slot->frame, 6);
+  put16(frame + 12, ETH_TYPE_IPV4);
+
+  iph[0] = 0x45;
+  put16(iph + 2, IP_HDR_LEN + TCP_HDR_LEN + INT_HDR_LEN);
+  iph[8] = 255;
+  iph[9] = IP_PROTO_TCP;
+  put32(iph + 12, lwip_ntohl(slot->dst_ip));
+  memcpy(iph + 16, &w->ip, 4);
+
+  put16(tcph, slot->dst_port);
+  put16(tcph + 2, w->tcp_port);
+  put32(tcph + 4, w->ackno);
+  put32(tcph + 8, w->seqno + w->len);
+  tcph[12] = (u8_t)((TCP_HDR_LEN / 4) << 4 | NETML_AGG_ACK);
+  tcph[13] = TCP_FLAG_ACK;
+  put16(tcph + 14, slot->ack_wnd);
+
+  put16(inth, w->src_id);
+  put16(inth + 2, slot->ack_src_id);
+  put32(inth + 4, w->int_seqno + w->len);
+  put32(inth + 8, slot->ack_tunlno);
+
+  f.ip = ETH_HDR_LEN;
+  f.tcp = ETH_HDR_LEN + IP_HDR_LEN;
+  f.tcp_len = TCP_HDR_LEN;
+  f.payload = (u16_t)(f.tcp + TCP_HDR_LEN + INT_HDR_LEN);
+  f.payload_len = 0;
+  netml_switch_checksum(frame, &f, 1);
+
+  if (w->port < n) {
+    sw->ports[w->port].output(sw->ports[w->port].arg, frame, f.payload);
+    sw->stats.acks++;
+  }
+}
+
+/* Passes a hot segment on unsummed */
+static void
+netml_switch_cold(struct netml_switch *sw, int port, const u8_t *frame,
+                  u16_t len, const struct netml_frame *f, int chunk)
+{
+  u8_t *copy = sw->scratch;
+
+  memcpy(copy, frame, len);
+  copy[f->tcp + 12] = (u8_t)((copy[f->tcp + 12] & ~TCP_OFFSET_FLAGS) | NETML_AGG);
+  if (chunk) {
+    copy[f->payload] &= (u8_t)~CHUNK_MORE;
+  }
+  netml_switch_checksum(copy, f, 0);
+  sw->stats.cold++;
+  netml_switch_send(sw, port, copy, len);
+}
+
+static void
+netml_switch_hot(struct netml_switch *sw, int port, const u8_t *frame,
+                 u16_t len, const struct netml_frame *f)
+{
+  const u8_t *hdr = frame + f->payload + CHUNK_FRAME_LEN;
+  const u8_t *inth = frame + f->tcp + f->tcp_len;
+  struct netml_switch_slot *slot;
+  u32_t now = sys_now();
+  u32_t dst_ip, idx;
+  u16_t dst_port;
+  u64_t key;
+  u32_t version, offset, count;
+  int worker;
+
+  sw->stats.hot++;
+  if (!netml_switch_chunk(frame, f)) {
+    netml_switch_cold(sw, port, frame, len, f, 0);
+    return;
+  }
+
+  memcpy(&dst_ip, frame + f->ip + 16, 4);
+  dst_port = get16(frame + f->tcp + 2);
+  key = (u64_t)get32(hdr) << 32 | get32(hdr + 4);
+  version = get32(hdr + 8);
+  count = get32(hdr + 16);
+  offset = get32(hdr + 20);
+
+  idx = netml_switch_slot_of(sw, dst_ip, dst_port, key, version, offset);
+  slot = &sw->slots[idx];
+
+  if (slot->state != SLOT_FREE && slot->key == key &&
+      slot->version == version && slot->offset == offset &&
+      slot->dst_ip == dst_ip && slot->dst_port == dst_port) {
+    worker = netml_switch_worker_of(slot, get16(inth + 2));
+    switch (slot->state) {
+    case SLOT_SUMMING:
+      if (worker >= 0) {
+        /* Acked with the others */
+        return;
+      }
+      if (slot->dtype != hdr[12] || slot->count != count ||
+          slot->nworkers == sw->config.workers) {
+        break;
+      }
+      netml_switch_sum(slot, hdr + CHUNK_HDR_LEN);
+      netml_switch_add_worker(slot, port, frame, f);
+      sw->stats.summed++;
+      if (slot->summed >= sw->config.workers) {
+        sw->stats.complete++;
+        netml_switch_emit(sw, idx, now);
+      }
+      return;
+    case SLOT_SENT:
+      if (worker < 0) {
+        break;
+      }
+      if ((u32_t)(now - slot->sent) >= sw->config.timeout) {
+        slot->sent = now;
+        sw->stats.resent++;
+        netml_switch_send(sw, slot->workers[0].port, slot->frame,
+                          slot->frame_len);
+      }
+      return;
+    case SLOT_DONE:
+      if (worker < 0) {
+        break;
+      }
+      netml_switch_ack(sw, slot, &slot->workers[worker]);
+      return;
+    }
+    netml_switch_cold(sw, port, frame, len, f, 1);
+    return;
+  }
+
+  if (slot->state == SLOT_SUMMING || slot->state == SLOT_SENT) {
+    sw->stats.collisions++;
+    netml_switch_cold(sw, port, frame, len, f, 1);
+    return;
+  }
+
+  /* Free, or done with: the segment becomes the sum */
+  memcpy(slot->frame, frame, len);
+  slot->frame[f->payload] &= (u8_t)~CHUNK_MORE;
+  slot->frame_len = len;
+  slot->elems = (u16_t)(f->payload + CHUNK_FRAME_LEN + CHUNK_HDR_LEN);
+  slot->state = SLOT_SUMMING;
+  slot->dtype = hdr[12];
+  slot->count = count;
+  slot->key = key;
+  slot->version = version;
+  slot->offset = offset;
+  slot->dst_ip = dst_ip;
+  slot->dst_port = dst_port;
+  slot->nworkers = 0;
+  slot->summed = 0;
+  slot->mask = 0;
+  slot->born = now;
+  netml_switch_add_worker(slot, port, frame, f);
+  sw->stats.summed++;
+
+  slot->older = sw->newest;
+  slot->newer = NIL;
+  if (sw->newest != NIL) {
+    sw->slots[sw->newest].newer = idx;
+  } else {
+    sw->oldest = idx;
+  }
+  sw->newest = idx;
+
+  if (slot->summed >= sw->config.workers) {
+    sw->stats.complete++;
+    netml_switch_emit(sw, idx, now);
+  }
+}
+
+/* Returns 1 if the ack was for a sum and has been handled */
+static int
+netml_switch_agg_ack(struct netml_switch *sw, const u8_t *frame,
+                     const struct netml_frame *f)
+{
+  const u8_t *tcph = frame + f->tcp;
+  const u8_t *inth = tcph + f->tcp_len;
+  struct netml_switch_slot *slot;
+  u32_t ip, pos;
+  int i;
+
+  if (!(tcph[13] & TCP_FLAG_ACK)) {
+    return 0;
+  }
+  memcpy(&ip, frame + f->ip + 16, 4);
+  pos = netml_switch_ack_find(sw, ip, get16(tcph + 2), get16(tcph),
+                              get32(tcph + 8));
+  if (pos == NIL) {
+    return 0;
+  }
+
+  slot = &sw->slots[sw->acks[pos] - 1];
+  netml_switch_ack_remove(sw, pos);
+  slot->state = SLOT_DONE;
+  slot->ack_wnd = get16(tcph + 14);
+  slot->ack_src_id = get16(inth + 2);
+  slot->ack_tunlno = get32(inth + 8);
+  for (i = 0; i < slot->nworkers; i++) {
+    netml_switch_ack(sw, slot, &slot->workers[i]);
+  }
+  return 1;
+}
+
+static void
+netml_switch_expire(struct netml_switch *sw, u32_t now)
+{
+  while (sw->oldest != NIL &&
+         (u32_t)(now - sw->slots[sw->oldest].born) >= sw->config.timeout) {
+    sw->stats.partial++;
+    netml_switch_emit(sw, sw->oldest, now);
+  }
+}
+
+/* API */
+
+struct netml_switch *
+netml_switch_new(const struct netml_switch_config *config)
+{
+  struct netml_switch *sw;
+  u32_t acks = 2, i;
+
+  if (config->slots == 0 || config->slots > 0x40000000U ||
+      config->workers == 0 || config->workers > NETML_SWITCH_MAX_WORKERS) {
+    return NULL;
+  }
+
+  sw = (struct netml_switch *)calloc(1, sizeof(*sw));
+  if (sw == NULL) {
+    return NULL;
+  }
+  sw->config = *config;
+  sw->oldest = sw->newest = NIL;
+
+  while (acks < 2 * config->slots) {
+    acks <<= 1;
+  }
+  sw->ack_mask = acks - 1;
+  sw->acks = (u32_t *)calloc(acks, sizeof(u32_t));
+  sw->slots = (struct netml_switch_slot *)calloc(config->slots,
+                                                 sizeof(struct netml_switch_slot));
+  if (sw->acks == NULL || sw->slots == NULL) {
+    netml_switch_free(sw);
+    return NULL;
+  }
+  for (i = 0; i < config->slots; i++) {
+    struct netml_switch_slot *slot = &sw->slots[i];
+
+    slot->older = slot->newer = NIL;
+    slot->frame = (u8_t *)malloc(NETML_SWITCH_FRAME_MAX);
+    slot->workers = (struct netml_switch_worker *)calloc(config->workers,
+                                                         sizeof(struct netml_switch_worker));
+    if (slot->frame == NULL || slot->workers == NULL) {
+      netml_switch_free(sw);
+      return NULL;
+    }
+  }
+  return sw;
+}
+
+/** Frees sw once its thread is stopped and its ports are gone */
+void
+netml_switch_free(struct netml_switch *sw)
+{
+  u32_t i;
+
+  if (sw == NULL) {
+    return;
+  }
+  netml_switch_stop(sw);
+  if (sw->slots != NULL) {
+    for (i = 0; i < sw->config.slots; i++) {
+      free(sw->slots[i].frame);
+      free(sw->slots[i].workers);
+    }
+  }
+  free(sw->slots);
+  free(sw->acks);
+  free(sw);
+}
+
+/**
+ * Adds a port, returns its number or -1 if the switch has no room. Ports
+ * may be added while the switch runs; poll may be NULL for ports that
+ * call netml_switch_input themselves from the thread driving the switch.
+ */
+int
+netml_switch_add_port(struct netml_switch *sw, netml_switch_output_fn output,
+                      netml_switch_poll_fn poll, void *arg)
+{
+  int port = __atomic_load_n(&sw->nports, __ATOMIC_RELAXED);
+
+  if (port == NETML_SWITCH_MAX_PORTS) {
+    return -1;
+  }
+  sw->ports[port].output = output;
+  sw->ports[port].poll = poll;
+  sw->ports[port].arg = arg;
+  __atomic_store_n(&sw->nports, port + 1, __ATOMIC_RELEASE);
+  return port;
+}
+
+void
+netml_switch_input(struct netml_switch *sw, int port, const u8_t *frame,
+                   u16_t len)
+{
+  struct netml_frame f;
+
+  sw->stats.frames++;
+  if (len < ETH_HDR_LEN || len > NETML_SWITCH_FRAME_MAX) {
+    sw->stats.dropped++;
+    return;
+  }
+  netml_switch_learn(sw, frame + 6, port);
+
+  if (netml_switch_parse(frame, len, &f) == 0) {
+    if (f.netml == NETML_HOT || f.netml == NETML_HOT_RE) {
+      netml_switch_hot(sw, port, frame, len, &f);
+      return;
+    }
+    if (f.netml == NETML_AGG_ACK && netml_switch_agg_ack(sw, frame, &f)) {
+      return;
+    }
+  }
+  netml_switch_send(sw, port, frame, len);
+}
+
+/** Polls every port once and sends the sums that timed out. Returns the
+ *  number of frames taken. */
+int
+netml_switch_poll(struct netml_switch *sw)
+{
+  int n = __atomic_load_n(&sw->nports, __ATOMIC_ACQUIRE);
+  int i, frames = 0;
+
+  for (i = 0; i < n; i++) {
+    if (sw->ports[i].poll != NULL) {
+      frames += sw->ports[i].poll(sw, i, sw->ports[i].arg);
+    }
+  }
+  netml_switch_expire(sw, sys_now());
+  return frames;
+}
+
+void
+netml_switch_get_stats(struct netml_switch *sw, struct netml_switch_stats *stats)
+{
+  memcpy(stats, &sw->stats, sizeof(*stats));
+  stats->dropped += __atomic_load_n(&sw->port_dropped, __ATOMIC_RELAXED);
+}
+
+static void *
+netml_switch_thread(void *arg)
+{
+  struct netml_switch *sw = (struct netml_switch *)arg;
+
+  prctl(PR_SET_NAME, "netml_switch");
+  while (!__atomic_load_n(&sw->stop, __ATOMIC_ACQUIRE)) {
+    if (netml_switch_poll(sw) == 0) {
+      usleep(NETML_SWITCH_IDLE_US);
+    }
+  }
+  return NULL;
+}
+
+/** Runs the switch on a thread of its own */
+int
+netml_switch_start(struct netml_switch *sw)
+{
+  if (sw->running) {
+    return 0;
+  }
+  sw->stop = 0;
+  if (pthread_create(&sw->thread, NULL, netml_switch_thread, sw) != 0) {
+    return -1;
+  }
+  sw->running = 1;
+  return 0;
+}
+
+void
+netml_switch_stop(struct netml_switch *sw)
+{
+  if (!sw->running) {
+    return;
+  }
+  __atomic_store_n(&sw->stop, 1, __ATOMIC_RELEASE);
+  pthread_join(sw->thread, NULL);
+  sw->running = 0;
+}
+
+/* Netif ports */
+
+struct netml_switch_netif {
+  struct netml_switch *sw;
+  struct netif *netif;
+  int port;
+  pthread_mutex_t lock;
+  /* frames queued and taken so far */
+  u32_t head, tail;
+  u16_t lens[NETML_SWITCH_QUEUE_LEN];
+  u8_t frames[NETML_SWITCH_QUEUE_LEN][NETML_SWITCH_FRAME_MAX];
+};
+
+static int netml_switch_netifs = 0;
+static u32_t netml_switch_hosts = 0;
+
+/* Runs under the core lock: the frame waits for the switch thread, which
+ * may itself be waiting for the core lock to deliver a frame */
+static err_t
+netml_switch_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  struct netml_switch_netif *nsif = (struct netml_switch_netif *)netif->state;
+  u32_t slot;
+
+  if (p->tot_len > NETML_SWITCH_FRAME_MAX) {
+    return ERR_IF;
+  }
+  pthread_mutex_lock(&nsif->lock);
+  if (nsif->head - nsif->tail == NETML_SWITCH_QUEUE_LEN) {
+    pthread_mutex_unlock(&nsif->lock);
+    /* Dropped, TCP sends it again */
+    __atomic_fetch_add(&nsif->sw->port_dropped, 1, __ATOMIC_RELAXED);
+    return ERR_OK;
+  }
+  slot = nsif->head & (NETML_SWITCH_QUEUE_LEN - 1);
+  pbuf_copy_partial(p, nsif->frames[slot], p->tot_len, 0);
+  nsif->lens[slot] = p->tot_len;
+  nsif->head++;
+  pthread_mutex_unlock(&nsif->lock);
+  return ERR_OK;
+}
+
+static int
+netml_switch_netif_poll(struct netml_switch *sw, int port, void *arg)
+{
+  struct netml_switch_netif *nsif = (struct netml_switch_netif *)arg;
+  u8_t frame[NETML_SWITCH_FRAME_MAX];
+  int count;
+
+  for (count = 0; count < NETML_SWITCH_BURST; count++) {
+    u32_t slot;
+    u16_t len;
+
+    pthread_mutex_lock(&nsif->lock);
+    if (nsif->tail == nsif->head) {
+      pthread_mutex_unlock(&nsif->lock);
+      break;
+    }
+    slot = nsif->tail & (NETML_SWITCH_QUEUE_LEN - 1);
+    len = nsif->lens[slot];
+    memcpy(frame, nsif->frames[slot], len);
+    nsif->tail++;
+    pthread_mutex_unlock(&nsif->lock);
+
+    netml_switch_input(sw, port, frame, len);
+  }
+  return count;
+}
+
+static void
+netml_switch_netif_output(void *arg, const u8_t *frame, u16_t len)
+{
+  struct netml_switch_netif *nsif = (struct netml_switch_netif *)arg;
+  struct pbuf *p;
+
+  p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+  if (p == NULL) {
+    __atomic_fetch_add(&nsif->sw->port_dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  pbuf_take(p, frame, len);
+  if (nsif->netif->input(p, nsif->netif) != ERR_OK) {
+    pbuf_free(p);
+  }
+}
+
+/**
+ * netif init function: netif_add(netif, ip, mask, gw, sw, netml_switch_netif_init,
+ * tcpip_input) plugs a host into a port of switch sw. Every host gets a
+ * locally administered MAC of its own.
+ */
+err_t
+netml_switch_netif_init(struct netif *netif)
+{
+  struct netml_switch *sw = (struct netml_switch *)netif->state;
+  struct netml_switch_netif *nsif;
+  u32_t host;
+
+  nsif = (struct netml_switch_netif *)calloc(1, sizeof(*nsif));
+  if (nsif == NULL) {
+    return ERR_MEM;
+  }
+  pthread_mutex_init(&nsif->lock, NULL);
+  nsif->sw = sw;
+  nsif->netif = netif;
+  nsif->port = netml_switch_add_port(sw, netml_switch_netif_output,
+                                     netml_switch_netif_poll, nsif);
+  if (nsif->port < 0) {
+    pthread_mutex_destroy(&nsif->lock);
+    free(nsif);
+    return ERR_IF;
+  }
+
+  host = __atomic_fetch_add(&netml_switch_hosts, 1, __ATOMIC_RELAXED);
+  netif->state = nsif;
+  netif->name[0] = 's';
+  netif->name[1] = 'w';
+  netif->output = etharp_output;
+  netif->linkoutput = netml_switch_linkoutput;
+  netif->mtu = 1500;
+  netif->hwaddr_len = 6;
+  netif->hwaddr[0] = 0x02;
+  netif->hwaddr[1] = 'N';
+  netif->hwaddr[2] = 'M';
+  netif->hwaddr[3] = (u8_t)(host >> 16);
+  netif->hwaddr[4] = (u8_t)(host >> 8);
+  netif->hwaddr[5] = (u8_t)host;
+  netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP;
+  netif_set_link_up(netif);
+
+  __atomic_fetch_add(&netml_switch_netifs, 1, __ATOMIC_RELEASE);
+  return ERR_OK;
+}
+
+struct netif *
+netml_switch_route_src(const ip4_addr_t *src, const ip4_addr_t *dest)
+{
+  struct netif *netif;
+
+  LWIP_UNUSED_ARG(dest);
+  if (src == NULL || ip4_addr_isany(src) ||
+      __atomic_load_n(&netml_switch_netifs, __ATOMIC_ACQUIRE) == 0) {
+    return NULL;
+  }
+  NETIF_FOREACH(netif) {
+    if (netif_is_up(netif) && ip4_addr_cmp(src, netif_ip4_addr(netif))) {
+      return netif;
+    }
+  }
+  return NULL;
+}
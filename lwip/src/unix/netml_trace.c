@@ -0,0 +1,214 @@
+/**
+ * @file
+ * NetML trace rings
+ *
+ * Every thread that hits a trace point gets a ring of its own on first use
+ * and is its only writer, so recording takes no lock and no atomic
+ * read-modify-write. The rings overwrite their oldest records. A dump may
+ * run concurrently with the writers: each record carries its position,
+ * which is cleared while the record is rewritten, and records that change
+ * under the reader are left out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#include "lwip/netml_trace.h"
+
+/* Records per thread, a power of two */
+#define NETML_TRACE_RING_SIZE 16384
+#define NETML_TRACE_RING_MASK (NETML_TRACE_RING_SIZE - 1)
+
+/* Marks a record being rewritten */
+#define NETML_TRACE_SEQ_BUSY 0xffffffffU
+
+struct netml_trace_ring {
+  struct netml_trace_ring *next;
+  uint32_t tid;
+  char name[16];
+  /* records written so far */
+  uint32_t head;
+  struct netml_trace_rec recs[NETML_TRACE_RING_SIZE];
+};
+
+static struct netml_trace_ring *rings = NULL;
+static __thread struct netml_trace_ring *ring = NULL;
+
+/* Where the TSC was at the first record, to calibrate it on dump */
+static uint64_t origin_tsc = 0;
+static uint64_t origin_ns = 0;
+
+static uint64_t
+netml_trace_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t
+netml_trace_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return netml_trace_ns();
+#endif
+}
+
+static struct netml_trace_ring *
+netml_trace_ring_new(void)
+{
+  struct netml_trace_ring *r;
+
+  r = (struct netml_trace_ring *)calloc(1, sizeof(*r));
+  if (r == NULL) {
+    return NULL;
+  }
+  r->tid = (uint32_t)syscall(SYS_gettid);
+  prctl(PR_GET_NAME, r->name, 0, 0, 0);
+
+  if (__atomic_load_n(&origin_ns, __ATOMIC_ACQUIRE) == 0) {
+    uint64_t expected = 0;
+    uint64_t tsc = netml_trace_tsc();
+    if (__atomic_compare_exchange_n(&origin_ns, &expected, netml_trace_ns(),
+                                    0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+      __atomic_store_n(&origin_tsc, tsc, __ATOMIC_RELEASE);
+    }
+  }
+
+  /* Rings are never freed, a dump walks the list without a lock */
+  r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  ring = r;
+  return r;
+}
+
+void
+netml_trace_record(uint16_t event, uint16_t remote_id, uint16_t flags,
+                   uint32_t len, uint32_t aux, uint32_t conn)
+{
+  struct netml_trace_ring *r = ring;
+  struct netml_trace_rec *rec;
+  uint32_t seq;
+
+  if (r == NULL && (r = netml_trace_ring_new()) == NULL) {
+    return;
+  }
+
+  seq = r->head;
+  rec = &r->recs[seq & NETML_TRACE_RING_MASK];
+
+  __atomic_store_n(&rec->seq, NETML_TRACE_SEQ_BUSY, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  rec->tsc = netml_trace_tsc();
+  rec->conn = conn;
+  rec->len = len;
+  rec->aux = aux;
+  rec->event = event;
+  rec->remote_id = remote_id;
+  rec->flags = flags;
+  rec->reserved = 0;
+  __atomic_store_n(&rec->seq, seq, __ATOMIC_RELEASE);
+  __atomic_store_n(&r->head, seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Copies the records of r still intact into out, oldest first */
+static uint32_t
+netml_trace_snapshot(struct netml_trace_ring *r, struct netml_trace_rec *out)
+{
+  uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  uint32_t seq = head > NETML_TRACE_RING_SIZE ? head - NETML_TRACE_RING_SIZE : 0;
+  uint32_t count = 0;
+
+  for (; seq != head; seq++) {
+    struct netml_trace_rec *rec = &r->recs[seq & NETML_TRACE_RING_MASK];
+
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != seq) {
+      continue;
+    }
+    out[count] = *rec;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) != seq) {
+      continue;
+    }
+    count++;
+  }
+  return count;
+}
+
+/**
+ * Writes all rings to path. Returns the number of records written or -1
+ * on error (with errno set).
+ */
+int
+netml_trace_dump(const char *path)
+{
+  struct netml_trace_header hdr;
+  struct netml_trace_ring *first, *r;
+  uint32_t i;
+  struct netml_trace_rec *recs;
+  uint64_t now_tsc, now_ns;
+  int total = 0;
+  FILE *fp;
+
+  recs = (struct netml_trace_rec *)malloc(NETML_TRACE_RING_SIZE * sizeof(*recs));
+  if (recs == NULL) {
+    return -1;
+  }
+  fp = fopen(path, "wb");
+  if (fp == NULL) {
+    free(recs);
+    return -1;
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, NETML_TRACE_MAGIC, sizeof(hdr.magic));
+  hdr.rec_size = sizeof(struct netml_trace_rec);
+  /* Threads that start tracing meanwhile show up in the next dump */
+  first = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+  for (r = first; r != NULL; r = r->next) {
+    hdr.threads++;
+  }
+  now_tsc = netml_trace_tsc();
+  now_ns = netml_trace_ns();
+  hdr.tsc_hz = 1000000000ULL;
+  if (origin_ns != 0 && now_ns > origin_ns) {
+    hdr.tsc_hz = (uint64_t)((double)(now_tsc - origin_tsc) * 1e9 /
+                            (double)(now_ns - origin_ns));
+  }
+  if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+    goto err;
+  }
+
+  for (i = 0, r = first; i < hdr.threads; i++, r = r->next) {
+    struct netml_trace_thread thr;
+
+    memset(&thr, 0, sizeof(thr));
+    thr.tid = r->tid;
+    memcpy(thr.name, r->name, sizeof(thr.name));
+    thr.count = netml_trace_snapshot(r, recs);
+    if (fwrite(&thr, sizeof(thr), 1, fp) != 1 ||
+        fwrite(recs, sizeof(*recs), thr.count, fp) != thr.count) {
+      goto err;
+    }
+    total += thr.count;
+  }
+
+  free(recs);
+  if (fclose(fp) != 0) {
+    return -1;
+  }
+  return total;
+
+err:
+  free(recs);
+  fclose(fp);
+  return -1;
+}
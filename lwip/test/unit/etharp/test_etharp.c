@@ -20,6 +20,7 @@ struct eth_addr test_ethaddr2 = {{1,1,1,1,1,2}};
 struct eth_addr test_ethaddr3 = {{1,1,1,1,1,3}};
 struct eth_addr test_ethaddr4 = {{1,1,1,1,1,4}};
 static int linkoutput_ctr;
+static struct eth_addr linkoutput_dest;
 
 /* Helper functions */
 static void
@@ -38,6 +39,9 @@ default_netif_linkoutput(struct netif *netif, struct pbuf *p)
   fail_unless(netif == &test_netif);
   fail_unless(p != NULL);
   linkoutput_ctr++;
+  if (p->len >= SIZEOF_ETH_HDR) {
+    SMEMCPY(&linkoutput_dest, &((struct eth_hdr*)p->payload)->dest, ETH_HWADDR_LEN);
+  }
   return ERR_OK;
 }
 
@@ -113,6 +117,21 @@ create_arp_response(ip4_addr_t *adr)
   ethernet_input(p, &test_netif);
 }
 
+#if LWIP_NETML
+static void
+send_udp(struct udp_pcb *pcb, const ip4_addr_t *adr)
+{
+  struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 10, PBUF_RAM);
+  fail_unless(p != NULL);
+  if (p != NULL) {
+    ip_addr_t dst;
+    ip_addr_copy_from_ip4(dst, *adr);
+    fail_unless(udp_sendto(pcb, p, &dst, 123) == ERR_OK);
+    pbuf_free(p);
+  }
+}
+#endif /* LWIP_NETML */
+
 /* Setups/teardown functions */
 
 static void
@@ -126,6 +145,9 @@ etharp_setup(void)
 static void
 etharp_teardown(void)
 {
+#if LWIP_NETML
+  etharp_free_neighbors();
+#endif /* LWIP_NETML */
   etharp_remove_all();
   default_netif_remove();
   lwip_check_ensure_no_alloc(SKIP_POOL(MEMP_SYS_TIMEOUT));
@@ -260,13 +282,87 @@ START_TEST(test_etharp_table)
 }
 END_TEST
 
+#if LWIP_NETML
+START_TEST(test_etharp_neighbor)
+{
+  ip4_addr_t adrs[ARP_TABLE_SIZE * 4];
+  struct eth_addr ethaddrs[ARP_TABLE_SIZE * 4];
+  const ip4_addr_t *unused_ipaddr;
+  struct eth_addr *unused_ethaddr;
+  struct udp_pcb* pcb;
+  int i;
+  LWIP_UNUSED_ARG(_i);
+
+  pcb = udp_new();
+  fail_unless(pcb != NULL);
+  if (pcb == NULL) {
+    return;
+  }
+
+  /* more neighbors than the ARP table holds, so the table has to grow */
+  for(i = 0; i < ARP_TABLE_SIZE * 4; i++) {
+    struct eth_addr ethaddr = {{2,0,0,0,1,0}};
+    ethaddr.addr[5] = (u8_t)i;
+    ethaddrs[i] = ethaddr;
+    IP4_ADDR(&adrs[i], 192,168,1,i+1);
+    fail_unless(etharp_add_neighbor(&adrs[i], &ethaddrs[i]) == ERR_OK);
+  }
+
+  /* every neighbor is resolved without an ARP request or an ARP entry */
+  linkoutput_ctr = 0;
+  for(i = 0; i < ARP_TABLE_SIZE * 4; i++) {
+    send_udp(pcb, &adrs[i]);
+    fail_unless(linkoutput_ctr == i + 1);
+    fail_unless(eth_addr_cmp(&linkoutput_dest, &ethaddrs[i]));
+    fail_unless(etharp_find_addr(NULL, &adrs[i], &unused_ethaddr, &unused_ipaddr) == -1);
+  }
+
+  /* adding a neighbor again replaces its address, also for a pcb that has
+     the entry cached */
+  send_udp(pcb, &adrs[0]);
+  fail_unless(eth_addr_cmp(&linkoutput_dest, &ethaddrs[0]));
+  fail_unless(etharp_add_neighbor(&adrs[0], &test_ethaddr3) == ERR_OK);
+  send_udp(pcb, &adrs[0]);
+  fail_unless(eth_addr_cmp(&linkoutput_dest, &test_ethaddr3));
+  send_udp(pcb, &adrs[1]);
+  fail_unless(eth_addr_cmp(&linkoutput_dest, &ethaddrs[1]));
+  send_udp(pcb, &adrs[0]);
+  fail_unless(eth_addr_cmp(&linkoutput_dest, &test_ethaddr3));
+
+  /* a removed neighbor goes through ARP again */
+  fail_unless(etharp_remove_neighbor(&adrs[0]) == ERR_OK);
+  fail_unless(etharp_remove_neighbor(&adrs[0]) == ERR_VAL);
+  fail_unless(etharp_remove_neighbor(&test_ipaddr) == ERR_VAL);
+  linkoutput_ctr = 0;
+  send_udp(pcb, &adrs[0]);
+  fail_unless(linkoutput_ctr == 1);
+  fail_unless(eth_addr_cmp(&linkoutput_dest, &ethbroadcast));
+  create_arp_response(&adrs[0]);
+  fail_unless(linkoutput_ctr == 2);
+  fail_unless(eth_addr_cmp(&linkoutput_dest, &test_ethaddr2));
+  fail_unless(etharp_find_addr(NULL, &adrs[0], &unused_ethaddr, &unused_ipaddr) >= 0);
+
+  /* and a neighbor takes precedence over the ARP entry */
+  fail_unless(etharp_add_neighbor(&adrs[0], &test_ethaddr4) == ERR_OK);
+  send_udp(pcb, &adrs[0]);
+  fail_unless(linkoutput_ctr == 3);
+  fail_unless(eth_addr_cmp(&linkoutput_dest, &test_ethaddr4));
+
+  udp_remove(pcb);
+}
+END_TEST
+#endif /* LWIP_NETML */
+
 
 /** Create the suite including all tests for this module */
 Suite *
 etharp_suite(void)
 {
   testfunc tests[] = {
-    TESTFUNC(test_etharp_table)
+    TESTFUNC(test_etharp_table),
+#if LWIP_NETML
+    TESTFUNC(test_etharp_neighbor)
+#endif /* LWIP_NETML */
   };
   return create_suite("ETHARP", tests, sizeof(tests)/sizeof(testfunc), etharp_setup, etharp_teardown);
 }
@@ -7,6 +7,12 @@
 #include "lwip/prot/ip4.h"
 
 #include "lwip/tcpip.h"
+#if LWIP_NETML
+#include "lwip/etharp.h"
+#include "netif/ethernet.h"
+#include "lwip/prot/etharp.h"
+#include "lwip/prot/iana.h"
+#endif /* LWIP_NETML */
 
 #if !LWIP_IPV4 || !IP_REASSEMBLY || !MIB2_STATS || !IPFRAG_STATS
 #error "This tests needs LWIP_IPV4, IP_REASSEMBLY; MIB2- and IPFRAG-statistics enabled"
@@ -52,6 +58,95 @@ create_ip4_input_fragment(u16_t ip_id, u16_t start, u16_t len, int last)
   }
 }
 
+#if LWIP_NETML
+static struct netif flow_netif;
+static struct eth_addr flow_ethaddr = {{2,0,0,0,0,1}};
+static u8_t flow_frame[SIZEOF_ETH_HDR + IP_HLEN + 8];
+static int flow_linkoutput_ctr;
+
+static err_t
+flow_netif_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  fail_unless(netif == &flow_netif);
+  flow_linkoutput_ctr++;
+  pbuf_copy_partial(p, flow_frame, sizeof(flow_frame), 0);
+  return ERR_OK;
+}
+
+static err_t
+flow_netif_init(struct netif *netif)
+{
+  netif->linkoutput = flow_netif_linkoutput;
+  netif->output = etharp_output;
+  netif->mtu = 1500;
+  netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
+  netif->hwaddr_len = ETH_HWADDR_LEN;
+  SMEMCPY(netif->hwaddr, &flow_ethaddr, ETH_HWADDR_LEN);
+  return ERR_OK;
+}
+
+/* Send an 8 byte segment to dest the slow way and learn its headers */
+static void
+flow_learn(struct ip4_flow *flow, const ip4_addr_t *dest, u8_t ttl, u8_t tos)
+{
+  struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 8, PBUF_RAM);
+  void *l4hdr;
+  fail_unless(p != NULL);
+  if (p == NULL) {
+    return;
+  }
+  l4hdr = p->payload;
+  fail_unless(ip4_output_if(p, netif_ip4_addr(&flow_netif), dest, ttl, tos,
+                            IP_PROTO_UDP, &flow_netif) == ERR_OK);
+  ip4_flow_learn(flow, &flow_netif, p, l4hdr, netif_ip4_addr(&flow_netif), dest);
+  fail_unless(ip4_flow_match(flow, &flow_netif, p, ttl, tos));
+  pbuf_free(p);
+}
+
+/* Send an 8 byte segment with the cached headers */
+static void
+flow_send(struct ip4_flow *flow)
+{
+  struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 8, PBUF_RAM);
+  fail_unless(p != NULL);
+  if (p == NULL) {
+    return;
+  }
+  fail_unless(ip4_flow_output(flow, p, &flow_netif) == ERR_OK);
+  pbuf_free(p);
+}
+
+static void
+flow_arp_reply(const ip4_addr_t *adr, const struct eth_addr *ethaddr)
+{
+  struct eth_hdr *ethhdr;
+  struct etharp_hdr *etharphdr;
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, SIZEOF_ETH_HDR + SIZEOF_ETHARP_HDR, PBUF_RAM);
+  fail_unless(p != NULL);
+  if (p == NULL) {
+    return;
+  }
+  ethhdr = (struct eth_hdr *)p->payload;
+  etharphdr = (struct etharp_hdr *)(ethhdr + 1);
+
+  ethhdr->dest = flow_ethaddr;
+  ethhdr->src = *ethaddr;
+  ethhdr->type = PP_HTONS(ETHTYPE_ARP);
+
+  etharphdr->hwtype = PP_HTONS(LWIP_IANA_HWTYPE_ETHERNET);
+  etharphdr->proto = PP_HTONS(ETHTYPE_IP);
+  etharphdr->hwlen = ETH_HWADDR_LEN;
+  etharphdr->protolen = sizeof(ip4_addr_t);
+  etharphdr->opcode = PP_HTONS(ARP_REPLY);
+  etharphdr->shwaddr = *ethaddr;
+  etharphdr->dhwaddr = flow_ethaddr;
+  SMEMCPY(&etharphdr->sipaddr, adr, sizeof(ip4_addr_t));
+  SMEMCPY(&etharphdr->dipaddr, netif_ip4_addr(&flow_netif), sizeof(ip4_addr_t));
+
+  ethernet_input(p, &flow_netif);
+}
+#endif /* LWIP_NETML */
+
 /* Setups/teardown functions */
 
 static void
@@ -148,6 +243,109 @@ START_TEST(test_ip4_reass)
 }
 END_TEST
 
+#if LWIP_NETML
+START_TEST(test_ip4_flow)
+{
+  struct ip4_flow flow;
+  struct pbuf *p;
+  struct eth_hdr *ethhdr = (struct eth_hdr *)flow_frame;
+  struct ip_hdr *iphdr = (struct ip_hdr *)(flow_frame + SIZEOF_ETH_HDR);
+  ip4_addr_t ipaddr, netmask, gw, peer, arp_peer, other;
+  struct eth_addr peer_ethaddr = {{2,0,0,0,0,2}};
+  struct eth_addr peer_ethaddr2 = {{2,0,0,0,0,3}};
+  LWIP_UNUSED_ARG(_i);
+
+  IP4_ADDR(&ipaddr, 10,0,0,1);
+  IP4_ADDR(&netmask, 255,255,255,0);
+  IP4_ADDR(&gw, 10,0,0,254);
+  IP4_ADDR(&peer, 10,0,0,2);
+  IP4_ADDR(&arp_peer, 10,0,0,3);
+  IP4_ADDR(&other, 10,0,0,9);
+  fail_unless(netif_add(&flow_netif, &ipaddr, &netmask, &gw, NULL,
+                        flow_netif_init, ethernet_input) == &flow_netif);
+  netif_set_up(&flow_netif);
+  fail_unless(etharp_add_neighbor(&peer, &peer_ethaddr) == ERR_OK);
+
+  /* the cached headers give the same frame as the slow path */
+  memset(&flow, 0, sizeof(flow));
+  flow_learn(&flow, &peer, 64, 0);
+  flow_linkoutput_ctr = 0;
+  flow_send(&flow);
+  fail_unless(flow_linkoutput_ctr == 1);
+  fail_unless(eth_addr_cmp(&ethhdr->dest, &peer_ethaddr));
+  fail_unless(eth_addr_cmp(&ethhdr->src, &flow_ethaddr));
+  fail_unless(ip4_addr_cmp(&iphdr->src, &ipaddr));
+  fail_unless(ip4_addr_cmp(&iphdr->dest, &peer));
+  fail_unless(IPH_LEN(iphdr) == PP_HTONS(IP_HLEN + 8));
+  fail_unless(IPH_TTL(iphdr) == 64);
+  fail_unless(inet_chksum(iphdr, IP_HLEN) == 0);
+
+  p = pbuf_alloc(PBUF_TRANSPORT, 8, PBUF_RAM);
+  fail_unless(p != NULL);
+  if (p == NULL) {
+    return;
+  }
+
+  /* a TTL or TOS change needs new headers */
+  fail_unless(!ip4_flow_match(&flow, &flow_netif, p, 32, 0));
+  fail_unless(!ip4_flow_match(&flow, &flow_netif, p, 64, 0x10));
+
+  /* so does a packet over the MTU or a netif that went down */
+  flow_netif.mtu = IP_HLEN + 7;
+  fail_unless(!ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+  flow_netif.mtu = 1500;
+  fail_unless(ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+  netif_set_down(&flow_netif);
+  fail_unless(!ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+  netif_set_up(&flow_netif);
+  netif_set_link_down(&flow_netif);
+  fail_unless(!ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+  netif_set_link_up(&flow_netif);
+
+  /* every address change invalidates the cached headers */
+  flow_learn(&flow, &peer, 64, 0);
+  netif_set_ipaddr(&flow_netif, &other);
+  fail_unless(!ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+  netif_set_ipaddr(&flow_netif, &ipaddr);
+  flow_learn(&flow, &peer, 64, 0);
+  IP4_ADDR(&netmask, 255,255,0,0);
+  netif_set_netmask(&flow_netif, &netmask);
+  fail_unless(!ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+  flow_learn(&flow, &peer, 64, 0);
+  netif_set_gw(&flow_netif, &other);
+  fail_unless(!ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+  flow_learn(&flow, &peer, 64, 0);
+  netif_set_gw(&flow_netif, &other);
+  fail_unless(ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+
+  /* and so does a neighbor with a new address */
+  fail_unless(etharp_add_neighbor(&peer, &peer_ethaddr2) == ERR_OK);
+  fail_unless(!ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+  flow_learn(&flow, &peer, 64, 0);
+  flow_send(&flow);
+  fail_unless(eth_addr_cmp(&ethhdr->dest, &peer_ethaddr2));
+
+  /* an ARP entry only when its address changes */
+  flow_arp_reply(&arp_peer, &peer_ethaddr);
+  flow_learn(&flow, &arp_peer, 64, 0);
+  flow_arp_reply(&arp_peer, &peer_ethaddr);
+  fail_unless(ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+  flow_arp_reply(&arp_peer, &peer_ethaddr2);
+  fail_unless(!ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+  flow_learn(&flow, &arp_peer, 64, 0);
+  flow_send(&flow);
+  fail_unless(eth_addr_cmp(&ethhdr->dest, &peer_ethaddr2));
+
+  /* removing the netif leaves no flow behind */
+  netif_remove(&flow_netif);
+  fail_unless(flow.gen != ip4_flow_gen);
+  fail_unless(!ip4_flow_match(&flow, &flow_netif, p, 64, 0));
+
+  pbuf_free(p);
+  etharp_free_neighbors();
+}
+END_TEST
+#endif /* LWIP_NETML */
 
 /** Create the suite including all tests for this module */
 Suite *
@@ -155,6 +353,9 @@ ip4_suite(void)
 {
   testfunc tests[] = {
     TESTFUNC(test_ip4_reass),
+#if LWIP_NETML
+    TESTFUNC(test_ip4_flow),
+#endif /* LWIP_NETML */
   };
   return create_suite("IPv4", tests, sizeof(tests)/sizeof(testfunc), ip4_setup, ip4_teardown);
 }
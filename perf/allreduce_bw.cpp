@@ -0,0 +1,180 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+//  Bus bandwidth of zmq_allreduce against tensor size. Every member of the
+//  group runs allreduce_bw with its own <rank>; rank 0 is usually the one
+//  to bind. Member i is reached at remote ID <first-id> + i. The tensors
+//  are floats, from 4 bytes up to <max-size> in powers of two, each size
+//  reduced <iterations> times. Bus bandwidth is the algorithm bandwidth
+//  times 2 (size - 1) / size, the share of the data every link carries,
+//  so that ring and tree runs of different group sizes compare.
+
+#include "../include/zmq.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main (int argc, char *argv [])
+{
+    const char *endpoint;
+    int rank;
+    int size;
+    int first_id;
+    int algo;
+    size_t max_size;
+    int iterations;
+    bool binding;
+    void *ctx;
+    void *s;
+    void *group;
+    uint16_t *remote_ids;
+    float *buf;
+    int rc;
+    int i;
+
+    if (argc != 9 || (strcmp (argv [1], "bind") && strcmp (argv [1], "connect"))) {
+        printf ("usage: allreduce_bw <bind|connect> <endpoint> <rank> <size> "
+            "<first-id> <auto|ring|tree> <max-size> <iterations>\n");
+        return 1;
+    }
+    binding = strcmp (argv [1], "bind") == 0;
+    endpoint = argv [2];
+    rank = atoi (argv [3]);
+    size = atoi (argv [4]);
+    first_id = atoi (argv [5]);
+    if (strcmp (argv [6], "ring") == 0)
+        algo = ZMQ_ALLREDUCE_RING;
+    else
+    if (strcmp (argv [6], "tree") == 0)
+        algo = ZMQ_ALLREDUCE_TREE;
+    else
+        algo = ZMQ_ALLREDUCE_AUTO;
+    max_size = atoi (argv [7]);
+    iterations = atoi (argv [8]);
+    if (size < 1 || rank < 0 || rank >= size || iterations < 1) {
+        printf ("need 0 <= rank < size and at least one iteration\n");
+        return 1;
+    }
+
+    ctx = zmq_ctx_new ();
+    if (!ctx) {
+        printf ("error in zmq_ctx_new: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    s = zmq_socket (ctx, ZMQ_DEALER);
+    if (!s) {
+        printf ("error in zmq_socket: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    rc = zmq_set_localid (s, (uint16_t) (first_id + rank));
+    if (rc != 0) {
+        printf ("error in zmq_set_localid: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    rc = binding ? zmq_bind (s, endpoint) : zmq_connect (s, endpoint);
+    if (rc != 0) {
+        printf ("error in %s: %s\n", binding ? "zmq_bind" : "zmq_connect",
+            zmq_strerror (errno));
+        return -1;
+    }
+
+    remote_ids = (uint16_t *) calloc (size, sizeof (uint16_t));
+    for (i = 0; i != size; i++)
+        remote_ids [i] = (uint16_t) (first_id + i);
+    group = zmq_group_new (s, remote_ids, size, rank, algo);
+    if (!group) {
+        printf ("error in zmq_group_new: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    buf = (float *) malloc (max_size < 4 ? 4 : max_size);
+    printf ("%12s %12s %12s %12s\n", "size [B]", "time [us]", "alg [Gb/s]",
+        "bus [Gb/s]");
+
+    for (size_t bytes = 4; bytes <= max_size; bytes *= 2) {
+        size_t count = bytes / sizeof (float);
+        unsigned long elapsed = 0;
+
+        //  The first round brings the group in step.
+        for (int it = 0; it <= iterations; it++) {
+            for (size_t j = 0; j != count; j++)
+                buf [j] = (float) (rank + 1);
+
+            void *watch = zmq_stopwatch_start ();
+            rc = zmq_allreduce (group, buf, count, ZMQ_DTYPE_F32, ZMQ_OP_SUM);
+            unsigned long us = zmq_stopwatch_stop (watch);
+            if (rc != 0) {
+                printf ("error in zmq_allreduce: %s\n", zmq_strerror (errno));
+                return -1;
+            }
+            if (buf [0] != (float) (size * (size + 1) / 2) ||
+                  buf [count - 1] != buf [0]) {
+                printf ("wrong result for %d bytes\n", (int) bytes);
+                return -1;
+            }
+            if (it)
+                elapsed += us;
+        }
+
+        double per_op = (double) elapsed / iterations;
+        if (per_op <= 0)
+            per_op = 1;
+        double algbw = (double) bytes * 8 / per_op / 1000;
+        double busbw = algbw * 2 * (size - 1) / size;
+        printf ("%12d %12.1f %12.3f %12.3f\n", (int) bytes, per_op, algbw,
+            busbw);
+    }
+
+    free (buf);
+    free (remote_ids);
+
+    rc = zmq_group_close (group);
+    if (rc != 0) {
+        printf ("error in zmq_group_close: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    rc = zmq_close (s);
+    if (rc != 0) {
+        printf ("error in zmq_close: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    rc = zmq_ctx_term (ctx);
+    if (rc != 0) {
+        printf ("error in zmq_ctx_term: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    return 0;
+}
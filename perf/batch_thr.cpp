@@ -0,0 +1,247 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//  In-process throughput with messages sent and received in batches of
+//  <batch-size> by zmq_msg_send_many and zmq_msg_recv_many. A batch size
+//  of 1 uses zmq_msg_send and zmq_msg_recv instead, which makes the run
+//  comparable with inproc_thr.
+
+#include "../include/zmq.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+static int message_count;
+static size_t message_size;
+static int batch_size;
+
+static void *worker (void *ctx_)
+{
+    zmq_msg_t *msgs = (zmq_msg_t *) calloc (batch_size, sizeof (zmq_msg_t));
+    zmq_mmsg_t *batch = (zmq_mmsg_t *) calloc (batch_size, sizeof (zmq_mmsg_t));
+    int rc;
+    int i;
+
+    void *s = zmq_socket (ctx_, ZMQ_PUSH);
+    if (!s) {
+        printf ("error in zmq_socket: %s\n", zmq_strerror (errno));
+        exit (1);
+    }
+
+    rc = zmq_connect (s, "inproc://batch_thr");
+    if (rc != 0) {
+        printf ("error in zmq_connect: %s\n", zmq_strerror (errno));
+        exit (1);
+    }
+
+    int sent = 0;
+    while (sent != message_count) {
+        int n = message_count - sent < batch_size ?
+            message_count - sent : batch_size;
+        for (i = 0; i != n; i++) {
+            rc = zmq_msg_init_size (&msgs [i], message_size);
+            if (rc != 0) {
+                printf ("error in zmq_msg_init_size: %s\n",
+                    zmq_strerror (errno));
+                exit (1);
+            }
+            batch [i].msg = &msgs [i];
+            batch [i].flags = 0;
+            batch [i].remote_id = UINT16_MAX;
+        }
+
+        if (batch_size == 1) {
+            rc = zmq_msg_send (&msgs [0], s, 0);
+            if (rc < 0) {
+                printf ("error in zmq_msg_send: %s\n", zmq_strerror (errno));
+                exit (1);
+            }
+            sent++;
+            continue;
+        }
+
+        //  Whatever did not go in one call goes in the next.
+        i = 0;
+        while (i != n) {
+            rc = zmq_msg_send_many (batch + i, n - i, s, 0);
+            if (rc < 0) {
+                printf ("error in zmq_msg_send_many: %s\n",
+                    zmq_strerror (errno));
+                exit (1);
+            }
+            i += rc;
+        }
+        sent += n;
+    }
+
+    rc = zmq_close (s);
+    if (rc != 0) {
+        printf ("error in zmq_close: %s\n", zmq_strerror (errno));
+        exit (1);
+    }
+
+    free (batch);
+    free (msgs);
+    return NULL;
+}
+
+int main (int argc, char *argv [])
+{
+    pthread_t local_thread;
+    zmq_msg_t *msgs;
+    zmq_mmsg_t *batch;
+    void *ctx;
+    void *s;
+    int rc;
+    int i;
+
+    if (argc != 4) {
+        printf ("usage: batch_thr <message-size> <message-count> "
+            "<batch-size>\n");
+        return 1;
+    }
+
+    message_size = atoi (argv [1]);
+    message_count = atoi (argv [2]);
+    batch_size = atoi (argv [3]);
+    if (message_count < 1 || batch_size < 1) {
+        printf ("need at least one message in batches of at least one\n");
+        return 1;
+    }
+
+    ctx = zmq_ctx_new ();
+    if (!ctx) {
+        printf ("error in zmq_ctx_new: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    s = zmq_socket (ctx, ZMQ_PULL);
+    if (!s) {
+        printf ("error in zmq_socket: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    rc = zmq_bind (s, "inproc://batch_thr");
+    if (rc != 0) {
+        printf ("error in zmq_bind: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    rc = pthread_create (&local_thread, NULL, worker, ctx);
+    if (rc != 0) {
+        printf ("error in pthread_create: %s\n", zmq_strerror (rc));
+        return -1;
+    }
+
+    msgs = (zmq_msg_t *) calloc (batch_size, sizeof (zmq_msg_t));
+    batch = (zmq_mmsg_t *) calloc (batch_size, sizeof (zmq_mmsg_t));
+    for (i = 0; i != batch_size; i++) {
+        rc = zmq_msg_init (&msgs [i]);
+        if (rc != 0) {
+            printf ("error in zmq_msg_init: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+        batch [i].msg = &msgs [i];
+    }
+
+    printf ("message size: %d [B]\n", (int) message_size);
+    printf ("message count: %d\n", (int) message_count);
+    printf ("batch size: %d\n", (int) batch_size);
+
+    //  Start the clock with the first message, like inproc_thr.
+    rc = zmq_msg_recv (&msgs [0], s, 0);
+    if (rc < 0) {
+        printf ("error in zmq_msg_recv: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    void *watch = zmq_stopwatch_start ();
+
+    int received = 1;
+    while (received != message_count) {
+        int n = message_count - received < batch_size ?
+            message_count - received : batch_size;
+        if (batch_size == 1)
+            rc = zmq_msg_recv (&msgs [0], s, 0) < 0 ? -1 : 1;
+        else
+            rc = zmq_msg_recv_many (batch, n, s, 0);
+        if (rc < 0) {
+            printf ("error in zmq_msg_recv: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+        for (i = 0; i != rc; i++)
+            if (zmq_msg_size (&msgs [i]) != message_size) {
+                printf ("message of incorrect size received\n");
+                return -1;
+            }
+        received += rc;
+    }
+
+    unsigned long elapsed = zmq_stopwatch_stop (watch);
+    if (elapsed == 0)
+        elapsed = 1;
+
+    for (i = 0; i != batch_size; i++) {
+        rc = zmq_msg_close (&msgs [i]);
+        if (rc != 0) {
+            printf ("error in zmq_msg_close: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+    }
+    free (batch);
+    free (msgs);
+
+    rc = pthread_join (local_thread, NULL);
+    if (rc != 0) {
+        printf ("error in pthread_join: %s\n", zmq_strerror (rc));
+        return -1;
+    }
+
+    rc = zmq_close (s);
+    if (rc != 0) {
+        printf ("error in zmq_close: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    rc = zmq_ctx_term (ctx);
+    if (rc != 0) {
+        printf ("error in zmq_ctx_term: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    unsigned long throughput = (unsigned long)
+        ((double) message_count / (double) elapsed * 1000000);
+    double megabits = (double) (throughput * message_size * 8) / 1000000;
+
+    printf ("mean throughput: %d [msg/s]\n", (int) throughput);
+    printf ("mean throughput: %.3f [Mb/s]\n", (double) megabits);
+
+    return 0;
+}
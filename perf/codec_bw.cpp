@@ -0,0 +1,267 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+//  Throughput against accuracy of the tensor codecs. The connect side sends
+//  <iterations> gradients of <elements> floats as keyed messages, coded
+//  with <codec>. The gradients are normally distributed and derived from
+//  the iteration and element index, so that the bind side can tell the
+//  error of every element it gets. It is given the codec too and fails
+//  if none of the elements shows its loss. Throughput counts the floats
+//  before coding, so that codecs compare.
+
+#include "../include/zmq.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//  Element i of the gradient of iteration it.
+static float gradient (uint32_t it, uint32_t i)
+{
+    uint64_t z = ((uint64_t) it << 32 | i) + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+
+    //  Box-Muller on two 24-bit uniforms.
+    const double u1 = ((double) (z >> 40) + 1) / 16777217;
+    const double u2 = (double) ((z >> 16) & 0xffffff) / 16777216;
+    return (float) (0.01 * sqrt (-2 * log (u1)) * cos (2 * M_PI * u2));
+}
+
+static int send_gradients (void *s, size_t elements, int iterations)
+{
+    const size_t size = sizeof (zmq_tensor_hdr_t) + elements * sizeof (float);
+    char *buf = (char *) malloc (size);
+    zmq_tensor_hdr_t hdr;
+    memset (&hdr, 0, sizeof hdr);
+    hdr.key = 1;
+    hdr.dtype = ZMQ_DTYPE_F32;
+    hdr.count = (uint32_t) elements;
+    float *elems = (float *) (buf + sizeof hdr);
+    int rc;
+
+    for (int it = 0; it != iterations; it++) {
+        hdr.version = (uint32_t) it;
+        memcpy (buf, &hdr, sizeof hdr);
+        for (size_t i = 0; i != elements; i++)
+            elems [i] = gradient ((uint32_t) it, (uint32_t) i);
+        rc = zmq_send (s, buf, size, ZMQ_KEY);
+        if (rc < 0) {
+            printf ("error in zmq_send: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+    }
+
+    //  An empty message tells the end.
+    rc = zmq_send (s, NULL, 0, 0);
+    if (rc < 0) {
+        printf ("error in zmq_send: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    free (buf);
+    return 0;
+}
+
+static int receive_gradients (void *s, bool lossy, size_t elements,
+    int iterations)
+{
+    void *watch = NULL;
+    double err2 = 0;
+    double ref2 = 0;
+    double max_err = 0;
+    size_t received = 0;
+    zmq_msg_t msg;
+    int rc;
+
+    rc = zmq_msg_init (&msg);
+    if (rc != 0) {
+        printf ("error in zmq_msg_init: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    //  Every chunk is a part of its own, with its own header.
+    while (true) {
+        rc = zmq_msg_recv (&msg, s, 0);
+        if (rc < 0) {
+            printf ("error in zmq_msg_recv: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+        if (!watch)
+            watch = zmq_stopwatch_start ();
+        if (zmq_msg_size (&msg) == 0)
+            break;
+
+        zmq_tensor_hdr_t hdr;
+        if (zmq_msg_size (&msg) < sizeof hdr) {
+            printf ("message of incorrect size received\n");
+            return -1;
+        }
+        memcpy (&hdr, zmq_msg_data (&msg), sizeof hdr);
+        if (hdr.dtype != ZMQ_DTYPE_F32 ||
+              zmq_msg_size (&msg) != sizeof hdr + hdr.count * sizeof (float)) {
+            printf ("chunk of incorrect size received\n");
+            return -1;
+        }
+
+        const float *elems =
+            (const float *) ((const char *) zmq_msg_data (&msg) + sizeof hdr);
+        for (uint32_t i = 0; i != hdr.count; i++) {
+            const double want = gradient (hdr.version, hdr.offset + i);
+            const double err = fabs (elems [i] - want);
+            err2 += err * err;
+            ref2 += want * want;
+            if (err > max_err)
+                max_err = err;
+        }
+        received += hdr.count;
+    }
+
+    unsigned long elapsed = zmq_stopwatch_stop (watch);
+    if (elapsed == 0)
+        elapsed = 1;
+
+    zmq_msg_close (&msg);
+
+    if (received != elements * iterations)
+        printf ("received %lu of %lu elements\n", (unsigned long) received,
+            (unsigned long) (elements * iterations));
+
+    const double throughput = (double) received / elapsed * 1000000;
+    printf ("elements: %lu\n", (unsigned long) elements);
+    printf ("iterations: %d\n", iterations);
+    printf ("mean throughput: %.0f [elements/s]\n", throughput);
+    printf ("mean throughput: %.3f [Mb/s] of float32\n",
+        throughput * sizeof (float) * 8 / 1000000);
+    printf ("relative L2 error: %.6g\n", ref2 > 0 ? sqrt (err2 / ref2) : 0);
+    printf ("max abs error: %.6g\n", max_err);
+
+    //  Exact elements from a lossy codec mean the chunks went out uncoded.
+    if (lossy && received > 0 && max_err == 0) {
+        printf ("no coded chunk received\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main (int argc, char *argv [])
+{
+    const char *endpoint;
+    int codec;
+    int topk;
+    size_t elements;
+    int iterations;
+    bool binding;
+    void *ctx;
+    void *s;
+    int rc;
+
+    if (argc != 7 || (strcmp (argv [1], "bind") && strcmp (argv [1], "connect"))) {
+        printf ("usage: codec_bw <bind|connect> <endpoint> "
+            "<none|f16|bf16|q8|topk> <topk-per-1000> <elements> "
+            "<iterations>\n");
+        return 1;
+    }
+    binding = strcmp (argv [1], "bind") == 0;
+    endpoint = argv [2];
+    if (strcmp (argv [3], "f16") == 0)
+        codec = ZMQ_CODEC_F16;
+    else
+    if (strcmp (argv [3], "bf16") == 0)
+        codec = ZMQ_CODEC_BF16;
+    else
+    if (strcmp (argv [3], "q8") == 0)
+        codec = ZMQ_CODEC_Q8;
+    else
+    if (strcmp (argv [3], "topk") == 0)
+        codec = ZMQ_CODEC_TOPK;
+    else
+        codec = ZMQ_CODEC_NONE;
+    topk = atoi (argv [4]);
+    elements = atoi (argv [5]);
+    iterations = atoi (argv [6]);
+    if (iterations < 1) {
+        printf ("need at least one iteration\n");
+        return 1;
+    }
+
+    ctx = zmq_ctx_new ();
+    if (!ctx) {
+        printf ("error in zmq_ctx_new: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    s = zmq_socket (ctx, ZMQ_DEALER);
+    if (!s) {
+        printf ("error in zmq_socket: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    //  Only the sender codes, the receiver decodes whatever comes.
+    if (!binding) {
+        rc = zmq_setsockopt (s, ZMQ_TENSOR_CODEC, &codec, sizeof codec);
+        if (rc == 0 && codec == ZMQ_CODEC_TOPK)
+            rc = zmq_setsockopt (s, ZMQ_TENSOR_TOPK, &topk, sizeof topk);
+        if (rc != 0) {
+            printf ("error in zmq_setsockopt: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+    }
+
+    rc = binding ? zmq_bind (s, endpoint) : zmq_connect (s, endpoint);
+    if (rc != 0) {
+        printf ("error in %s: %s\n", binding ? "zmq_bind" : "zmq_connect",
+            zmq_strerror (errno));
+        return -1;
+    }
+
+    if (binding)
+        rc = receive_gradients (s, codec != ZMQ_CODEC_NONE &&
+            !(codec == ZMQ_CODEC_TOPK && topk >= 1000), elements, iterations);
+    else
+        rc = send_gradients (s, elements, iterations);
+    if (rc != 0)
+        return -1;
+
+    rc = zmq_close (s);
+    if (rc != 0) {
+        printf ("error in zmq_close: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    rc = zmq_ctx_term (ctx);
+    if (rc != 0) {
+        printf ("error in zmq_ctx_term: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,274 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//  Throughput under skewed traffic. The connect side opens <conns> PUSH
+//  connections one at a time, so that they are spread round robin over the
+//  I/O threads. Connections i with i % <io-threads> == 0 all land on the
+//  first I/O thread and send skew times as many messages as the others.
+//  Run both sides once with <migrate-ivl> 0 and once with e.g. 100 to see
+//  what handing connections over to idle I/O threads buys.
+
+#include "../include/zmq.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef ZMQ_IO_MIGRATE_IVL
+#define ZMQ_IO_MIGRATE_IVL 12
+#endif
+
+static const int skew = 16;
+
+//  Sends messages for that many rounds between two looks at the clock.
+static const int rounds_per_check = 1024;
+
+static int receive_all (void **socks, int conns, size_t message_size)
+{
+    zmq_pollitem_t *items =
+        (zmq_pollitem_t *) calloc (conns, sizeof (zmq_pollitem_t));
+    unsigned long *counts = (unsigned long *) calloc (conns, sizeof (long));
+    int remaining = conns;
+    void *watch = NULL;
+    zmq_msg_t msg;
+    int rc;
+    int i;
+
+    for (i = 0; i != conns; i++) {
+        items [i].socket = socks [i];
+        items [i].events = ZMQ_POLLIN;
+    }
+
+    rc = zmq_msg_init (&msg);
+    if (rc != 0) {
+        printf ("error in zmq_msg_init: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    //  Every sender ends with an empty message.
+    while (remaining) {
+        rc = zmq_poll (items, conns, -1);
+        if (rc < 0) {
+            printf ("error in zmq_poll: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+        for (i = 0; i != conns; i++) {
+            if (!(items [i].revents & ZMQ_POLLIN))
+                continue;
+            while (zmq_msg_recv (&msg, socks [i], ZMQ_DONTWAIT) >= 0) {
+                if (!watch)
+                    watch = zmq_stopwatch_start ();
+                if (zmq_msg_size (&msg) == 0) {
+                    items [i].events = 0;
+                    remaining--;
+                    break;
+                }
+                if (zmq_msg_size (&msg) != message_size) {
+                    printf ("message of incorrect size received\n");
+                    return -1;
+                }
+                counts [i]++;
+            }
+        }
+    }
+
+    unsigned long elapsed = zmq_stopwatch_stop (watch);
+    if (elapsed == 0)
+        elapsed = 1;
+
+    zmq_msg_close (&msg);
+
+    unsigned long total = 0;
+    for (i = 0; i != conns; i++) {
+        printf ("connection %d: %lu [msg/s]\n", i,
+            (unsigned long) ((double) counts [i] / elapsed * 1000000));
+        total += counts [i];
+    }
+    double throughput = (double) total / elapsed * 1000000;
+    printf ("message size: %d [B]\n", (int) message_size);
+    printf ("mean throughput: %d [msg/s]\n", (int) throughput);
+    printf ("mean throughput: %.3f [Mb/s]\n",
+        throughput * message_size * 8 / 1000000);
+
+    free (counts);
+    free (items);
+    return 0;
+}
+
+static int send_skewed (void **socks, int conns, int io_threads,
+    size_t message_size, int seconds)
+{
+    unsigned long *counts = (unsigned long *) calloc (conns, sizeof (long));
+    unsigned long elapsed = 0;
+    zmq_msg_t msg;
+    int rc;
+    int i;
+
+    while (elapsed < (unsigned long) seconds * 1000000) {
+        void *watch = zmq_stopwatch_start ();
+        for (int round = 0; round != rounds_per_check; round++) {
+            for (i = 0; i != conns; i++) {
+                int n = i % io_threads == 0 ? skew : 1;
+                while (n--) {
+                    rc = zmq_msg_init_size (&msg, message_size);
+                    if (rc != 0) {
+                        printf ("error in zmq_msg_init_size: %s\n",
+                            zmq_strerror (errno));
+                        return -1;
+                    }
+                    rc = zmq_msg_send (&msg, socks [i], ZMQ_DONTWAIT);
+                    if (rc < 0) {
+                        zmq_msg_close (&msg);
+                        if (errno != EAGAIN) {
+                            printf ("error in zmq_msg_send: %s\n",
+                                zmq_strerror (errno));
+                            return -1;
+                        }
+                        break;
+                    }
+                    counts [i]++;
+                }
+            }
+        }
+        elapsed += zmq_stopwatch_stop (watch);
+    }
+
+    for (i = 0; i != conns; i++) {
+        rc = zmq_send (socks [i], NULL, 0, 0);
+        if (rc < 0) {
+            printf ("error in zmq_send: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+        printf ("connection %d: %lu [msg/s] offered\n", i,
+            (unsigned long) ((double) counts [i] / elapsed * 1000000));
+    }
+
+    free (counts);
+    return 0;
+}
+
+int main (int argc, char *argv [])
+{
+    const char *ip;
+    int base_port;
+    int conns;
+    int io_threads;
+    int migrate_ivl;
+    size_t message_size;
+    int seconds;
+    bool binding;
+    void *ctx;
+    void **socks;
+    char endpoint [64];
+    int rc;
+    int i;
+
+    if (argc != 9 || (strcmp (argv [1], "bind") && strcmp (argv [1], "connect"))) {
+        printf ("usage: skew_thr <bind|connect> <ip> <base-port> <conns> "
+            "<io-threads> <migrate-ivl> <message-size> <seconds>\n");
+        return 1;
+    }
+    binding = strcmp (argv [1], "bind") == 0;
+    ip = argv [2];
+    base_port = atoi (argv [3]);
+    conns = atoi (argv [4]);
+    io_threads = atoi (argv [5]);
+    migrate_ivl = atoi (argv [6]);
+    message_size = atoi (argv [7]);
+    seconds = atoi (argv [8]);
+    if (conns < 1 || io_threads < 1) {
+        printf ("need at least one connection and one I/O thread\n");
+        return 1;
+    }
+
+    ctx = zmq_ctx_new ();
+    if (!ctx) {
+        printf ("error in zmq_ctx_new: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    rc = zmq_ctx_set (ctx, ZMQ_IO_THREADS, io_threads);
+    if (rc != 0) {
+        printf ("error in zmq_ctx_set: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    rc = zmq_ctx_set (ctx, ZMQ_IO_MIGRATE_IVL, migrate_ivl);
+    if (rc != 0) {
+        printf ("error in zmq_ctx_set: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    socks = (void **) calloc (conns, sizeof (void *));
+    for (i = 0; i != conns; i++) {
+        socks [i] = zmq_socket (ctx, binding ? ZMQ_PULL : ZMQ_PUSH);
+        if (!socks [i]) {
+            printf ("error in zmq_socket: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+
+        snprintf (endpoint, sizeof endpoint, "tcp://%s:%d", ip, base_port + i);
+        rc = binding ? zmq_bind (socks [i], endpoint)
+                  : zmq_connect (socks [i], endpoint);
+        if (rc != 0) {
+            printf ("error in %s: %s\n", binding ? "zmq_bind" : "zmq_connect",
+                zmq_strerror (errno));
+            return -1;
+        }
+
+        //  Let the I/O thread register the connection, so that the next
+        //  one goes to the next thread.
+        if (!binding)
+            usleep (100000);
+    }
+
+    if (binding)
+        rc = receive_all (socks, conns, message_size);
+    else
+        rc = send_skewed (socks, conns, io_threads, message_size, seconds);
+    if (rc != 0)
+        return -1;
+
+    for (i = 0; i != conns; i++) {
+        rc = zmq_close (socks [i]);
+        if (rc != 0) {
+            printf ("error in zmq_close: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+    }
+    free (socks);
+
+    rc = zmq_ctx_term (ctx);
+    if (rc != 0) {
+        printf ("error in zmq_ctx_term: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,293 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+//  Throughput of fast receivers sharing an I/O thread with a slow one. The
+//  connect side opens <conns> PUSH connections on a single I/O thread and
+//  offers them as much as they take. The bind side drains connection 0 at
+//  one message every <slow-us> microseconds and the others as fast as it
+//  can. As long as the slow receiver's window is full its writes have to
+//  wait, the fast connections should not notice.
+
+#include "../include/zmq.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//  Messages queued for the slow receiver before its sender backs off.
+static const int slow_hwm = 16;
+
+static int receive_all (void **socks, int conns, size_t message_size,
+    unsigned long slow_us)
+{
+    zmq_pollitem_t *items =
+        (zmq_pollitem_t *) calloc (conns, sizeof (zmq_pollitem_t));
+    unsigned long *counts = (unsigned long *) calloc (conns, sizeof (long));
+    int remaining = conns - 1;
+    void *watch = NULL;
+    unsigned long elapsed = 0;
+    unsigned long slow_next = 0;
+    zmq_msg_t msg;
+    int rc;
+    int i;
+
+    for (i = 0; i != conns; i++) {
+        items [i].socket = socks [i];
+        items [i].events = ZMQ_POLLIN;
+    }
+
+    rc = zmq_msg_init (&msg);
+    if (rc != 0) {
+        printf ("error in zmq_msg_init: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    //  Every fast sender ends with an empty message. The slow receiver
+    //  would take forever to get to its one, it is not waited for.
+    while (remaining) {
+        items [0].events = elapsed >= slow_next ? ZMQ_POLLIN : 0;
+        rc = zmq_poll (items, conns, 1);
+        if (rc < 0) {
+            printf ("error in zmq_poll: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+
+        //  The clock runs from the first message on.
+        if (watch) {
+            elapsed += zmq_stopwatch_stop (watch);
+            watch = zmq_stopwatch_start ();
+        }
+
+        for (i = 0; i != conns; i++) {
+            if (!(items [i].revents & ZMQ_POLLIN))
+                continue;
+            while (zmq_msg_recv (&msg, socks [i], ZMQ_DONTWAIT) >= 0) {
+                if (!watch)
+                    watch = zmq_stopwatch_start ();
+                if (zmq_msg_size (&msg) == 0) {
+                    if (i) {
+                        items [i].events = 0;
+                        remaining--;
+                    }
+                    break;
+                }
+                if (zmq_msg_size (&msg) != message_size) {
+                    printf ("message of incorrect size received\n");
+                    return -1;
+                }
+                counts [i]++;
+
+                //  One message per turn for the slow receiver.
+                if (i == 0) {
+                    slow_next = elapsed + slow_us;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (watch)
+        elapsed += zmq_stopwatch_stop (watch);
+    if (elapsed == 0)
+        elapsed = 1;
+
+    zmq_msg_close (&msg);
+
+    unsigned long fast = 0;
+    for (i = 0; i != conns; i++) {
+        printf ("connection %d%s: %lu [msg/s]\n", i, i ? "" : " (slow)",
+            (unsigned long) ((double) counts [i] / elapsed * 1000000));
+        if (i)
+            fast += counts [i];
+    }
+    double throughput = (double) fast / elapsed * 1000000;
+    printf ("message size: %d [B]\n", (int) message_size);
+    printf ("fast connections throughput: %d [msg/s]\n", (int) throughput);
+    printf ("fast connections throughput: %.3f [Mb/s]\n",
+        throughput * message_size * 8 / 1000000);
+
+    free (counts);
+    free (items);
+    return 0;
+}
+
+static int send_all (void **socks, int conns, size_t message_size,
+    int seconds)
+{
+    unsigned long *counts = (unsigned long *) calloc (conns, sizeof (long));
+    unsigned long elapsed = 0;
+    zmq_msg_t msg;
+    int rc;
+    int i;
+
+    while (elapsed < (unsigned long) seconds * 1000000) {
+        void *watch = zmq_stopwatch_start ();
+        for (int round = 0; round != 1024; round++) {
+            for (i = 0; i != conns; i++) {
+                rc = zmq_msg_init_size (&msg, message_size);
+                if (rc != 0) {
+                    printf ("error in zmq_msg_init_size: %s\n",
+                        zmq_strerror (errno));
+                    return -1;
+                }
+                rc = zmq_msg_send (&msg, socks [i], ZMQ_DONTWAIT);
+                if (rc < 0) {
+                    zmq_msg_close (&msg);
+                    if (errno != EAGAIN) {
+                        printf ("error in zmq_msg_send: %s\n",
+                            zmq_strerror (errno));
+                        return -1;
+                    }
+                    continue;
+                }
+                counts [i]++;
+            }
+        }
+        elapsed += zmq_stopwatch_stop (watch);
+    }
+
+    //  The slow receiver does not wait for its end marker.
+    for (i = 0; i != conns; i++) {
+        rc = zmq_send (socks [i], NULL, 0, i ? 0 : ZMQ_DONTWAIT);
+        if (rc < 0 && (i || errno != EAGAIN)) {
+            printf ("error in zmq_send: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+        printf ("connection %d%s: %lu [msg/s] accepted\n", i,
+            i ? "" : " (slow)",
+            (unsigned long) ((double) counts [i] / elapsed * 1000000));
+    }
+
+    free (counts);
+    return 0;
+}
+
+int main (int argc, char *argv [])
+{
+    const char *ip;
+    int base_port;
+    int conns;
+    size_t message_size;
+    int seconds;
+    unsigned long slow_us;
+    bool binding;
+    void *ctx;
+    void **socks;
+    char endpoint [64];
+    int linger = 0;
+    int rc;
+    int i;
+
+    if (argc != 8 || (strcmp (argv [1], "bind") && strcmp (argv [1], "connect"))) {
+        printf ("usage: slow_peer_thr <bind|connect> <ip> <base-port> <conns> "
+            "<message-size> <seconds> <slow-us>\n");
+        return 1;
+    }
+    binding = strcmp (argv [1], "bind") == 0;
+    ip = argv [2];
+    base_port = atoi (argv [3]);
+    conns = atoi (argv [4]);
+    message_size = atoi (argv [5]);
+    seconds = atoi (argv [6]);
+    slow_us = strtoul (argv [7], NULL, 10);
+    if (conns < 2) {
+        printf ("need the slow connection and at least one fast one\n");
+        return 1;
+    }
+
+    ctx = zmq_ctx_new ();
+    if (!ctx) {
+        printf ("error in zmq_ctx_new: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    //  All connections of a side share the I/O thread.
+    rc = zmq_ctx_set (ctx, ZMQ_IO_THREADS, 1);
+    if (rc != 0) {
+        printf ("error in zmq_ctx_set: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    socks = (void **) calloc (conns, sizeof (void *));
+    for (i = 0; i != conns; i++) {
+        socks [i] = zmq_socket (ctx, binding ? ZMQ_PULL : ZMQ_PUSH);
+        if (!socks [i]) {
+            printf ("error in zmq_socket: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+
+        //  Keep the slow receiver's backlog in TCP rather than in pipes.
+        if (i == 0) {
+            rc = zmq_setsockopt (socks [i], binding ? ZMQ_RCVHWM : ZMQ_SNDHWM,
+                &slow_hwm, sizeof slow_hwm);
+            if (rc != 0) {
+                printf ("error in zmq_setsockopt: %s\n", zmq_strerror (errno));
+                return -1;
+            }
+        }
+        rc = zmq_setsockopt (socks [i], ZMQ_LINGER, &linger, sizeof linger);
+        if (rc != 0) {
+            printf ("error in zmq_setsockopt: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+
+        snprintf (endpoint, sizeof endpoint, "tcp://%s:%d", ip, base_port + i);
+        rc = binding ? zmq_bind (socks [i], endpoint)
+                  : zmq_connect (socks [i], endpoint);
+        if (rc != 0) {
+            printf ("error in %s: %s\n", binding ? "zmq_bind" : "zmq_connect",
+                zmq_strerror (errno));
+            return -1;
+        }
+    }
+
+    if (binding)
+        rc = receive_all (socks, conns, message_size, slow_us);
+    else
+        rc = send_all (socks, conns, message_size, seconds);
+    if (rc != 0)
+        return -1;
+
+    for (i = 0; i != conns; i++) {
+        rc = zmq_close (socks [i]);
+        if (rc != 0) {
+            printf ("error in zmq_close: %s\n", zmq_strerror (errno));
+            return -1;
+        }
+    }
+    free (socks);
+
+    rc = zmq_ctx_term (ctx);
+    if (rc != 0) {
+        printf ("error in zmq_ctx_term: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    return 0;
+}
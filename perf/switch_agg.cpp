@@ -0,0 +1,273 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+//  Aggregation through the switch emulator, all on one box. A ZMQ_AGGREGATOR
+//  on <ps-ip> takes the gradients of <workers> workers, each a host of its
+//  own on the switch at the addresses following <ps-ip>. Every worker sends
+//  <iterations> gradients of <elements> floats hot and waits for their sum.
+//  With enough <slots> the switch sums them on the way, with few most
+//  chunks pass it unsummed and the aggregator does the work.
+
+#include "../include/zmq.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int ps_id = 8;
+
+struct worker_t
+{
+    void *ctx;
+    int index;
+    char endpoint [64];
+    size_t elements;
+    int iterations;
+    int workers;
+    volatile int rc;
+};
+
+//  Element i of the gradient of worker w in iteration it. Small integers,
+//  so that every sum is exact whatever the order.
+static float gradient (int w, int it, size_t i)
+{
+    return (float) ((w + 1) * (int) ((i + it) % 64));
+}
+
+static void worker (void *arg)
+{
+    worker_t *w = (worker_t *) arg;
+    const size_t size = sizeof (zmq_tensor_hdr_t) + w->elements * sizeof (float);
+    char *buf = (char *) malloc (size);
+    const int timeout = 5000;
+    zmq_tensor_hdr_t hdr;
+    zmq_msg_t msg;
+    int rc;
+
+    w->rc = -1;
+    void *s = zmq_socket (w->ctx, ZMQ_DEALER);
+    if (!s) {
+        printf ("error in zmq_socket: %s\n", zmq_strerror (errno));
+        return;
+    }
+    rc = zmq_set_localid (s, (uint16_t) (ps_id + 1 + w->index));
+    if (rc == 0)
+        rc = zmq_set_remoteid (s, (uint16_t) ps_id);
+    if (rc == 0)
+        rc = zmq_setsockopt (s, ZMQ_RCVTIMEO, &timeout, sizeof timeout);
+    if (rc == 0)
+        rc = zmq_connect (s, w->endpoint);
+    if (rc != 0) {
+        printf ("error in zmq_connect: %s\n", zmq_strerror (errno));
+        return;
+    }
+
+    memset (&hdr, 0, sizeof hdr);
+    hdr.key = 1;
+    hdr.dtype = ZMQ_DTYPE_F32;
+    hdr.count = (uint32_t) w->elements;
+    float *elems = (float *) (buf + sizeof hdr);
+    const float workers_sum = (float) (w->workers * (w->workers + 1) / 2);
+    zmq_msg_init (&msg);
+
+    for (int it = 0; it != w->iterations; it++) {
+        hdr.version = (uint32_t) it;
+        memcpy (buf, &hdr, sizeof hdr);
+        for (size_t i = 0; i != w->elements; i++)
+            elems [i] = gradient (w->index, it, i);
+        rc = zmq_send (s, buf, size, ZMQ_KEY | ZMQ_HOT);
+        if (rc < 0) {
+            printf ("error in zmq_send: %s\n", zmq_strerror (errno));
+            return;
+        }
+
+        //  The sum comes back in chunks, each with its own header.
+        size_t received = 0;
+        while (received < w->elements) {
+            rc = zmq_msg_recv (&msg, s, 0);
+            if (rc < 0) {
+                printf ("worker %d: no sum for iteration %d: %s\n", w->index,
+                    it, zmq_strerror (errno));
+                return;
+            }
+            zmq_tensor_hdr_t sum;
+            if (zmq_msg_size (&msg) < sizeof sum)
+                continue;
+            memcpy (&sum, zmq_msg_data (&msg), sizeof sum);
+            if (sum.version != (uint32_t) it)
+                continue;
+            const float *s_elems =
+                (const float *) ((char *) zmq_msg_data (&msg) + sizeof sum);
+            for (uint32_t i = 0; i != sum.count; i++) {
+                const float want =
+                    workers_sum * (float) ((sum.offset + i + it) % 64);
+                if (s_elems [i] != want) {
+                    printf ("worker %d: wrong sum at %u of iteration %d\n",
+                        w->index, sum.offset + i, it);
+                    return;
+                }
+            }
+            received += sum.count;
+        }
+    }
+
+    zmq_msg_close (&msg);
+    free (buf);
+    zmq_close (s);
+    w->rc = 0;
+}
+
+int main (int argc, char *argv [])
+{
+    unsigned a, b, c, d;
+    const char *mask = "255.255.255.0";
+    char ip [32];
+    int rc;
+
+    if (argc != 7 || sscanf (argv [1], "%u.%u.%u.%u", &a, &b, &c, &d) != 4) {
+        printf ("usage: switch_agg <ps-ip> <port> <workers> <slots> "
+            "<elements> <iterations>\n");
+        return 1;
+    }
+    const int port = atoi (argv [2]);
+    const int workers = atoi (argv [3]);
+    const int slots = atoi (argv [4]);
+    const size_t elements = atoi (argv [5]);
+    const int iterations = atoi (argv [6]);
+    if (workers < 1 || d + workers > 254 || elements < 1 || iterations < 1) {
+        printf ("need workers, elements and iterations, and room for the "
+            "workers after <ps-ip>\n");
+        return 1;
+    }
+
+    rc = zmq_switch_init (slots, workers, 100);
+    if (rc == 0)
+        rc = zmq_global_init (argv [1], "0.0.0.0", mask);
+    for (int i = 0; rc == 0 && i != workers; i++) {
+        snprintf (ip, sizeof ip, "%u.%u.%u.%u", a, b, c, d + 1 + i);
+        rc = zmq_switch_add_host (ip, mask);
+    }
+    if (rc != 0) {
+        printf ("error setting up the switch: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    void *ctx = zmq_ctx_new ();
+    if (!ctx) {
+        printf ("error in zmq_ctx_new: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    void *ps = zmq_socket (ctx, ZMQ_AGGREGATOR);
+    if (!ps) {
+        printf ("error in zmq_socket: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+    const int poll_ms = 10;
+    char endpoint [64];
+    snprintf (endpoint, sizeof endpoint, "tcp://%s:%d", argv [1], port);
+    rc = zmq_set_localid (ps, (uint16_t) ps_id);
+    if (rc == 0)
+        rc = zmq_setsockopt (ps, ZMQ_AGG_WORKERS, &workers, sizeof workers);
+    if (rc == 0)
+        rc = zmq_setsockopt (ps, ZMQ_RCVTIMEO, &poll_ms, sizeof poll_ms);
+    if (rc == 0)
+        rc = zmq_bind (ps, endpoint);
+    if (rc != 0) {
+        printf ("error in zmq_bind: %s\n", zmq_strerror (errno));
+        return -1;
+    }
+
+    worker_t *w = (worker_t *) calloc (workers, sizeof (worker_t));
+    void **threads = (void **) calloc (workers, sizeof (void *));
+    void *watch = zmq_stopwatch_start ();
+    for (int i = 0; i != workers; i++) {
+        w [i].ctx = ctx;
+        w [i].index = i;
+        snprintf (w [i].endpoint, sizeof w [i].endpoint,
+            "tcp://%u.%u.%u.%u:0;%s:%d", a, b, c, d + 1 + i, argv [1], port);
+        w [i].elements = elements;
+        w [i].iterations = iterations;
+        w [i].workers = workers;
+        w [i].rc = -1;
+        threads [i] = zmq_threadstart (worker, &w [i]);
+    }
+
+    //  The aggregator sums what the switch left while it is asked for
+    //  messages. The workers tell when they are done by their threads
+    //  ending, which the aggregator cannot see: it is polled until the
+    //  time the slowest sum may take has passed without a message.
+    zmq_msg_t msg;
+    zmq_msg_init (&msg);
+    int idle = 0;
+    while (idle * poll_ms < 10000) {
+        rc = zmq_msg_recv (&msg, ps, 0);
+        idle = rc < 0 ? idle + 1 : 0;
+        int done = 0;
+        for (int i = 0; i != workers; i++)
+            done += w [i].rc == 0;
+        if (done == workers)
+            break;
+    }
+    for (int i = 0; i != workers; i++)
+        zmq_threadclose (threads [i]);
+    unsigned long elapsed = zmq_stopwatch_stop (watch);
+    if (elapsed == 0)
+        elapsed = 1;
+    zmq_msg_close (&msg);
+
+    int failed = 0;
+    for (int i = 0; i != workers; i++)
+        failed += w [i].rc != 0;
+
+    zmq_switch_stats_t stats;
+    zmq_switch_stats (&stats);
+    const double rate = (double) elements * iterations / elapsed * 1000000;
+    printf ("workers: %d\n", workers);
+    printf ("slots: %d\n", slots);
+    printf ("elements: %lu\n", (unsigned long) elements);
+    printf ("iterations: %d\n", iterations);
+    printf ("failed workers: %d\n", failed);
+    printf ("mean throughput: %.0f [elements/s] per worker\n", rate);
+    printf ("hot segments: %lu\n", (unsigned long) stats.hot);
+    printf ("summed on the switch: %lu\n", (unsigned long) stats.summed);
+    printf ("sums complete: %lu, partial: %lu\n",
+        (unsigned long) stats.complete, (unsigned long) stats.partial);
+    printf ("passed cold: %lu (collisions %lu)\n", (unsigned long) stats.cold,
+        (unsigned long) stats.collisions);
+    printf ("acks: %lu, sums resent: %lu, dropped: %lu\n",
+        (unsigned long) stats.acks, (unsigned long) stats.resent,
+        (unsigned long) stats.dropped);
+
+    free (threads);
+    free (w);
+    zmq_close (ps);
+    zmq_ctx_term (ctx);
+    return failed ? -1 : 0;
+}
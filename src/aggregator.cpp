@@ -0,0 +1,431 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "precompiled.hpp"
+#include "macros.hpp"
+#include "aggregator.hpp"
+#include "pipe.hpp"
+#include "reduce.hpp"
+#include "tensor.hpp"
+#include "msg_pool.hpp"
+#include "config.hpp"
+#include "err.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+
+zmq::aggregator_t::aggregator_t (class ctx_t *parent_, uint32_t tid_,
+      int sid_) :
+    socket_base_t (parent_, tid_, sid_),
+    next_seq (0),
+    arena (NULL),
+    arena_size (agg_arena_size),
+    workers (0),
+    timeout (agg_timeout)
+{
+    options.type = ZMQ_AGGREGATOR;
+}
+
+zmq::aggregator_t::~aggregator_t ()
+{
+    while (!backlog.empty ()) {
+        int rc = backlog.front ().close ();
+        errno_assert (rc == 0);
+        backlog.pop_front ();
+    }
+    free (arena);
+}
+
+void zmq::aggregator_t::xattach_pipe (pipe_t *pipe_, bool subscribe_to_all_)
+{
+    LIBZMQ_UNUSED (subscribe_to_all_);
+
+    zmq_assert (pipe_);
+
+    fq.attach (pipe_);
+    dist.attach (pipe_);
+    pipes.push_back (pipe_);
+}
+
+int zmq::aggregator_t::xsetsockopt (int option_, const void *optval_,
+    size_t optvallen_)
+{
+    bool is_int = (optvallen_ == sizeof (int));
+    int value = 0;
+    if (is_int) memcpy (&value, optval_, sizeof (int));
+
+    switch (option_) {
+        case ZMQ_AGG_WORKERS:
+            if (is_int && value >= 0) {
+                workers = value;
+                return 0;
+            }
+            break;
+
+        case ZMQ_AGG_REMOTES:
+            if (optvallen_ % sizeof (uint16_t) == 0 &&
+                  (optval_ || optvallen_ == 0)) {
+                const uint16_t *ids = static_cast <const uint16_t *> (optval_);
+                remotes.assign (ids, ids + optvallen_ / sizeof (uint16_t));
+                return 0;
+            }
+            break;
+
+        case ZMQ_AGG_TIMEOUT:
+            if (is_int && value > 0) {
+                timeout = value;
+                return 0;
+            }
+            break;
+
+        case ZMQ_AGG_ARENA:
+            if (optvallen_ == sizeof (int64_t)) {
+                int64_t size;
+                memcpy (&size, optval_, sizeof size);
+
+                //  The arena can only be replaced while no chunk is in it.
+                if (size < agg_slot_size || (arena &&
+                      free_slots.size () != arena_size / agg_slot_size))
+                    break;
+                free (arena);
+                arena = NULL;
+                free_slots.clear ();
+                arena_size = (size_t) size;
+                return 0;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+int zmq::aggregator_t::xsend (msg_t *msg_)
+{
+    //  The application's messages go to all workers like the sums, after
+    //  the ones still waiting.
+    if (!flush_backlog () || !writable ()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return dist.send_to_matching (msg_);
+}
+
+int zmq::aggregator_t::xrecv (msg_t *msg_)
+{
+    expire ();
+
+    while (true) {
+        //  Nothing is taken in while sums wait for room, so that a worker
+        //  that does not keep up holds the others back rather than have
+        //  them fill memory.
+        if (!flush_backlog ()) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        pipe_t *pipe = NULL;
+        int rc = fq.recvpipe (msg_, &pipe);
+        if (rc != 0)
+            return rc;
+
+        //  What is not a chunk to sum goes to the application.
+        if (contribute (msg_, pipe) != 0)
+            return 0;
+    }
+}
+
+bool zmq::aggregator_t::xhas_in ()
+{
+    expire ();
+    return fq.has_in ();
+}
+
+bool zmq::aggregator_t::xhas_out ()
+{
+    return flush_backlog () && writable ();
+}
+
+int zmq::aggregator_t::xnext_timeout ()
+{
+    //  Stale entries only make for an early wake-up.
+    if (expiries.empty ())
+        return -1;
+    const uint64_t now = clock.now_ms ();
+    const uint64_t deadline = expiries.front ().deadline;
+    if (deadline <= now)
+        return 0;
+    return (int) std::min (deadline - now, (uint64_t) INT_MAX);
+}
+
+const zmq::blob_t &zmq::aggregator_t::get_credential () const
+{
+    return fq.get_credential ();
+}
+
+void zmq::aggregator_t::xread_activated (pipe_t *pipe_)
+{
+    fq.activated (pipe_);
+}
+
+void zmq::aggregator_t::xwrite_activated (pipe_t *pipe_)
+{
+    dist.activated (pipe_);
+    flush_backlog ();
+}
+
+void zmq::aggregator_t::xpipe_terminated (pipe_t *pipe_)
+{
+    fq.pipe_terminated (pipe_);
+    dist.pipe_terminated (pipe_);
+    pipes.erase (std::remove (pipes.begin (), pipes.end (), pipe_),
+        pipes.end ());
+}
+
+int zmq::aggregator_t::contribute (msg_t *msg_, pipe_t *pipe_)
+{
+    zmq_tensor_hdr_t hdr;
+    if (workers == 0 || !(msg_->flags () & msg_t::netml_key) ||
+          !check_tensor (msg_->data (), msg_->size ()) ||
+          msg_->size () == sizeof hdr)
+        return -1;
+    memcpy (&hdr, msg_->data (), sizeof hdr);
+    const size_t len = (size_t) hdr.count * tensor_dtype_size (hdr.dtype);
+    if (len > (size_t) agg_slot_size)
+        return -1;
+
+    const unsigned char *elems =
+        static_cast <unsigned char *> (msg_->data ()) + sizeof hdr;
+    contributor_t from = {pipe_, remotes.empty () ? 0 : msg_->get_remote_id ()};
+    chunk_id_t id;
+    id.key = hdr.key;
+    id.version = hdr.version;
+    id.offset = hdr.offset;
+
+    chunks_t::iterator it = chunks.find (id);
+    if (it == chunks.end ()) {
+        //  With the arena full, the oldest chunk goes out as it is.
+        unsigned char *slot = alloc_slot ();
+        if (!slot && evict ())
+            slot = alloc_slot ();
+        zmq_assert (slot);
+        memcpy (slot, elems, len);
+
+        chunk_t chunk;
+        chunk.slot = slot;
+        chunk.dtype = hdr.dtype;
+        chunk.count = hdr.count;
+        //  A sum from a switch counts the workers in it.
+        chunk.contributions = hdr.workers ? hdr.workers : 1;
+        chunk.seq = next_seq++;
+        chunk.closed = false;
+        it = chunks.insert (std::make_pair (id, chunk)).first;
+        it->second.contributors.push_back (from);
+
+        expiry_t expiry = {clock.now_ms () + timeout, id, chunk.seq};
+        expiries.push_back (expiry);
+    }
+    else {
+        //  Late workers, ones that disagree on the shape of the chunk and
+        //  ones sending it again, e.g. after a reconnect, are not counted.
+        chunk_t &chunk = it->second;
+        if (!chunk.closed && chunk.dtype == hdr.dtype &&
+              chunk.count == hdr.count && !contributed (chunk, from)) {
+            int rc = reduce (chunk.slot, elems, hdr.count, hdr.dtype,
+                ZMQ_OP_SUM);
+            errno_assert (rc == 0);
+            chunk.contributions += hdr.workers ? hdr.workers : 1;
+            chunk.contributors.push_back (from);
+        }
+    }
+
+    if (!it->second.closed && it->second.contributions >= workers) {
+        emit (it->first, it->second);
+        chunks.erase (it);
+    }
+
+    int rc = msg_->close ();
+    errno_assert (rc == 0);
+    rc = msg_->init ();
+    errno_assert (rc == 0);
+    return 0;
+}
+
+bool zmq::aggregator_t::contributed (const chunk_t &chunk_,
+    const contributor_t &from_)
+{
+    for (size_t i = 0; i != chunk_.contributors.size (); i++)
+        if (chunk_.contributors [i].pipe == from_.pipe &&
+              chunk_.contributors [i].remote_id == from_.remote_id)
+            return true;
+    return false;
+}
+
+void zmq::aggregator_t::emit (const chunk_id_t &id_, chunk_t &chunk_)
+{
+    zmq_tensor_hdr_t hdr;
+    memset (&hdr, 0, sizeof hdr);
+    hdr.key = id_.key;
+    hdr.version = id_.version;
+    hdr.dtype = chunk_.dtype;
+    hdr.workers = (uint8_t) std::min (chunk_.contributions, 255);
+    hdr.count = chunk_.count;
+    hdr.offset = id_.offset;
+
+    const size_t len = (size_t) chunk_.count * tensor_dtype_size (chunk_.dtype);
+    unsigned char *data =
+        static_cast <unsigned char *> (pool_alloc (sizeof hdr + len));
+    alloc_assert (data);
+    memcpy (data, &hdr, sizeof hdr);
+    memcpy (data + sizeof hdr, chunk_.slot, len);
+
+    free_slot (chunk_.slot);
+    chunk_.slot = NULL;
+    chunk_.closed = true;
+
+    msg_t sum;
+    int rc = sum.init_data (data, sizeof hdr + len, call_pool_free, NULL);
+    errno_assert (rc == 0);
+    sum.set_flags (msg_t::netml_key);
+
+    //  Over a connection shared by the workers, every one of them gets a
+    //  copy addressed to it. Otherwise each has a pipe of its own.
+    if (remotes.empty ()) {
+        backlog.push_back (msg_t ());
+        rc = backlog.back ().init ();
+        errno_assert (rc == 0);
+        rc = backlog.back ().move (sum);
+        errno_assert (rc == 0);
+        return;
+    }
+    for (size_t i = 0; i != remotes.size (); i++) {
+        backlog.push_back (msg_t ());
+        msg_t &copy = backlog.back ();
+        rc = copy.init ();
+        errno_assert (rc == 0);
+        rc = copy.copy (sum);
+        errno_assert (rc == 0);
+        rc = copy.set_remote_id (remotes [i]);
+        errno_assert (rc == 0);
+    }
+    rc = sum.close ();
+    errno_assert (rc == 0);
+}
+
+void zmq::aggregator_t::expire ()
+{
+    const uint64_t now = clock.now_ms ();
+
+    while (!expiries.empty ()) {
+        const expiry_t expiry = expiries.front ();
+        chunks_t::iterator it = chunks.find (expiry.id);
+        const bool stale = it == chunks.end () || it->second.seq != expiry.seq;
+        if (!stale && expiry.deadline > now)
+            break;
+        expiries.pop_front ();
+        if (stale)
+            continue;
+
+        //  A chunk that timed out goes out with what it has. It is kept
+        //  closed for another timeout to drop what the late workers send.
+        if (it->second.closed) {
+            chunks.erase (it);
+            continue;
+        }
+        emit (it->first, it->second);
+        it->second.seq = next_seq++;
+        expiry_t closed = {now + timeout, it->first, it->second.seq};
+        expiries.push_back (closed);
+    }
+}
+
+bool zmq::aggregator_t::evict ()
+{
+    for (std::deque <expiry_t>::iterator e = expiries.begin ();
+          e != expiries.end (); ++e) {
+        chunks_t::iterator it = chunks.find (e->id);
+        if (it == chunks.end () || it->second.seq != e->seq ||
+              it->second.closed)
+            continue;
+
+        emit (it->first, it->second);
+        it->second.seq = next_seq++;
+        expiry_t closed = {clock.now_ms () + timeout, it->first,
+            it->second.seq};
+        expiries.push_back (closed);
+        return true;
+    }
+    return false;
+}
+
+unsigned char *zmq::aggregator_t::alloc_slot ()
+{
+    if (!arena) {
+        arena = static_cast <unsigned char *> (malloc (arena_size));
+        alloc_assert (arena);
+        for (size_t i = arena_size / agg_slot_size; i-- != 0;)
+            free_slots.push_back (arena + i * agg_slot_size);
+    }
+    if (free_slots.empty ())
+        return NULL;
+    unsigned char *slot = free_slots.back ();
+    free_slots.pop_back ();
+    return slot;
+}
+
+void zmq::aggregator_t::free_slot (unsigned char *slot_)
+{
+    free_slots.push_back (slot_);
+}
+
+bool zmq::aggregator_t::writable ()
+{
+    dist.unmatch ();
+    for (size_t i = 0; i != pipes.size (); i++)
+        dist.match (pipes [i]);
+    return dist.check_hwm ();
+}
+
+bool zmq::aggregator_t::flush_backlog ()
+{
+    while (!backlog.empty ()) {
+        if (!writable ())
+            return false;
+        int rc = dist.send_to_matching (&backlog.front ());
+        errno_assert (rc == 0);
+        backlog.pop_front ();
+    }
+    return true;
+}
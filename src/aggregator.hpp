@@ -0,0 +1,190 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __ZMQ_AGGREGATOR_HPP_INCLUDED__
+#define __ZMQ_AGGREGATOR_HPP_INCLUDED__
+
+#include "socket_base.hpp"
+#include "session_base.hpp"
+#include "fq.hpp"
+#include "dist.hpp"
+#include "clock.hpp"
+#include "msg.hpp"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace zmq
+{
+
+    class ctx_t;
+    class pipe_t;
+    class io_thread_t;
+    class socket_base_t;
+
+    //  Sums the chunks of keyed tensors it receives from ZMQ_AGG_WORKERS
+    //  workers and sends every sum back to all of them, as the switch does
+    //  for NETML_AGG. Chunks are told apart by key, version (the
+    //  iteration) and offset and summed in slots of a fixed arena.
+    class aggregator_t :
+        public socket_base_t
+    {
+    public:
+
+        aggregator_t (zmq::ctx_t *parent_, uint32_t tid_, int sid);
+        ~aggregator_t ();
+
+    protected:
+
+        //  Overrides of functions from socket_base_t.
+        void xattach_pipe (zmq::pipe_t *pipe_, bool subscribe_to_all_);
+        int xsetsockopt (int option_, const void *optval_, size_t optvallen_);
+        int xsend (zmq::msg_t *msg_);
+        int xrecv (zmq::msg_t *msg_);
+        bool xhas_in ();
+        bool xhas_out ();
+        int xnext_timeout ();
+        const blob_t &get_credential () const;
+        void xread_activated (zmq::pipe_t *pipe_);
+        void xwrite_activated (zmq::pipe_t *pipe_);
+        void xpipe_terminated (zmq::pipe_t *pipe_);
+
+    private:
+
+        struct chunk_id_t
+        {
+            uint64_t key;
+            uint32_t version;
+            uint32_t offset;
+
+            bool operator < (const chunk_id_t &other_) const
+            {
+                if (key != other_.key)
+                    return key < other_.key;
+                if (version != other_.version)
+                    return version < other_.version;
+                return offset < other_.offset;
+            }
+        };
+
+        //  A worker, by the pipe its contributions come in on and, over a
+        //  connection shared by the workers, its remote ID.
+        struct contributor_t
+        {
+            pipe_t *pipe;
+            uint32_t remote_id;
+        };
+
+        //  A chunk still being summed, or one whose sum went out before
+        //  all workers were in. Contributions to the latter are dropped,
+        //  so are repeated ones.
+        struct chunk_t
+        {
+            unsigned char *slot;
+            uint8_t dtype;
+            uint32_t count;
+            int contributions;
+            std::vector <contributor_t> contributors;
+            uint64_t seq;
+            bool closed;
+        };
+
+        typedef std::map <chunk_id_t, chunk_t> chunks_t;
+        chunks_t chunks;
+
+        //  Chunks in the order they were started (or closed), when they
+        //  time out. Entries of chunks that completed meanwhile are
+        //  skipped by their sequence number.
+        struct expiry_t
+        {
+            uint64_t deadline;
+            chunk_id_t id;
+            uint64_t seq;
+        };
+        std::deque <expiry_t> expiries;
+        uint64_t next_seq;
+
+        //  Sums a contribution that came in on pipe_ into its chunk.
+        //  Returns -1 if msg_ is not a chunk this socket can sum, in which
+        //  case it is left alone.
+        int contribute (msg_t *msg_, pipe_t *pipe_);
+
+        //  True if from_ has contributed to chunk_ already.
+        static bool contributed (const chunk_t &chunk_,
+            const contributor_t &from_);
+
+        //  Queues the sum of a chunk for every worker and releases its
+        //  slot.
+        void emit (const chunk_id_t &id_, chunk_t &chunk_);
+
+        //  Sends the sums of the chunks that timed out as they are.
+        void expire ();
+
+        //  Sends the sum of the oldest chunk still open as it is, to make
+        //  room in the arena. False if there is none.
+        bool evict ();
+
+        //  The arena, cut into slots of agg_slot_size bytes. It is
+        //  allocated when the first chunk comes in.
+        unsigned char *arena;
+        size_t arena_size;
+        std::vector <unsigned char *> free_slots;
+
+        unsigned char *alloc_slot ();
+        void free_slot (unsigned char *slot_);
+
+        //  Settings of ZMQ_AGG_WORKERS, ZMQ_AGG_REMOTES and
+        //  ZMQ_AGG_TIMEOUT.
+        int workers;
+        std::vector <uint16_t> remotes;
+        int timeout;
+
+        //  Messages come in fair-queued and every one that goes out goes
+        //  to all pipes, none of which may be full.
+        fq_t fq;
+        dist_t dist;
+        std::vector <pipe_t *> pipes;
+        bool writable ();
+
+        //  Sums waiting for room in the pipes. No chunk is taken in while
+        //  there are any.
+        std::deque <msg_t> backlog;
+        bool flush_backlog ();
+
+        clock_t clock;
+
+        aggregator_t (const aggregator_t&);
+        const aggregator_t &operator = (const aggregator_t&);
+    };
+
+}
+
+#endif
@@ -0,0 +1,522 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "precompiled.hpp"
+#include "codec.hpp"
+#include "half.hpp"
+#include "random.hpp"
+#include "err.hpp"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "../include/zmq.h"
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define ZMQ_HAVE_CODEC_AVX2
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    //  Elements may sit at any offset within a message.
+    inline float load_float (const unsigned char *p_)
+    {
+        float f;
+        memcpy (&f, p_, sizeof f);
+        return f;
+    }
+
+    inline void store_float (unsigned char *p_, float f_)
+    {
+        memcpy (p_, &f_, sizeof f_);
+    }
+
+    //  splitmix64, draws the rounding offsets of ZMQ_CODEC_Q8.
+    inline uint64_t next_random (uint64_t &state_)
+    {
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    //  NaN ranks above everything, so that top-k never hides it.
+    inline float magnitude (float f_)
+    {
+        return f_ != f_ ? INFINITY : fabsf (f_);
+    }
+
+    template <uint16_t (*from_float) (float)>
+    void narrow (const unsigned char *src_, size_t count_,
+        unsigned char *dst_)
+    {
+        for (size_t i = 0; i != count_; i++) {
+            uint16_t h = from_float (load_float (src_ + i * 4));
+            memcpy (dst_ + i * 2, &h, 2);
+        }
+    }
+
+    template <float (*to_float) (uint16_t)>
+    void widen (const unsigned char *src_, size_t count_,
+        unsigned char *dst_)
+    {
+        for (size_t i = 0; i != count_; i++) {
+            uint16_t h;
+            memcpy (&h, src_ + i * 2, 2);
+            store_float (dst_ + i * 4, to_float (h));
+        }
+    }
+
+#ifdef ZMQ_HAVE_CODEC_AVX2
+    //  The kernels do what they can in whole vectors and return how many
+    //  elements that was, the scalar code does the rest. They are picked
+    //  at run time as in reduce.cpp.
+    bool have_avx2 ()
+    {
+        static const bool avx2 = __builtin_cpu_supports ("avx2") &&
+            __builtin_cpu_supports ("f16c");
+        return avx2;
+    }
+
+    __attribute__ ((target ("avx2,f16c")))
+    size_t narrow_f16_avx2 (const unsigned char *src_, size_t count_,
+        unsigned char *dst_)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count_; i += 8) {
+            __m256 f = _mm256_loadu_ps ((const float *) (src_ + i * 4));
+            _mm_storeu_si128 ((__m128i *) (dst_ + i * 2),
+                _mm256_cvtps_ph (f, _MM_FROUND_TO_NEAREST_INT));
+        }
+        return i;
+    }
+
+    __attribute__ ((target ("avx2,f16c")))
+    size_t widen_f16_avx2 (const unsigned char *src_, size_t count_,
+        unsigned char *dst_)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count_; i += 8) {
+            __m128i h = _mm_loadu_si128 ((const __m128i *) (src_ + i * 2));
+            _mm256_storeu_ps ((float *) (dst_ + i * 4), _mm256_cvtph_ps (h));
+        }
+        return i;
+    }
+
+    //  The upper halves of the floats in b_, rounded to nearest even as
+    //  float_to_bf16 does.
+    __attribute__ ((target ("avx2")))
+    inline __m256i round_bf16 (__m256i b_)
+    {
+        const __m256i lsb = _mm256_and_si256 (_mm256_srli_epi32 (b_, 16),
+            _mm256_set1_epi32 (1));
+        __m256i r = _mm256_add_epi32 (b_,
+            _mm256_add_epi32 (lsb, _mm256_set1_epi32 (0x7fff)));
+        const __m256i nan = _mm256_cmpgt_epi32 (
+            _mm256_and_si256 (b_, _mm256_set1_epi32 (0x7fffffff)),
+            _mm256_set1_epi32 (0x7f800000));
+        r = _mm256_blendv_epi8 (r,
+            _mm256_or_si256 (b_, _mm256_set1_epi32 (0x400000)), nan);
+        return _mm256_srli_epi32 (r, 16);
+    }
+
+    __attribute__ ((target ("avx2")))
+    size_t narrow_bf16_avx2 (const unsigned char *src_, size_t count_,
+        unsigned char *dst_)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count_; i += 16) {
+            const __m256i *s = (const __m256i *) (src_ + i * 4);
+            __m256i p = _mm256_packus_epi32 (
+                round_bf16 (_mm256_loadu_si256 (s)),
+                round_bf16 (_mm256_loadu_si256 (s + 1)));
+            _mm256_storeu_si256 ((__m256i *) (dst_ + i * 2),
+                _mm256_permute4x64_epi64 (p, 0xd8));
+        }
+        return i;
+    }
+
+    __attribute__ ((target ("avx2")))
+    size_t widen_bf16_avx2 (const unsigned char *src_, size_t count_,
+        unsigned char *dst_)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count_; i += 8) {
+            __m256i h = _mm256_cvtepu16_epi32 (
+                _mm_loadu_si128 ((const __m128i *) (src_ + i * 2)));
+            _mm256_storeu_si256 ((__m256i *) (dst_ + i * 4),
+                _mm256_slli_epi32 (h, 16));
+        }
+        return i;
+    }
+
+    __attribute__ ((target ("avx2")))
+    size_t min_max_avx2 (const unsigned char *src_, size_t count_,
+        float &min_, float &max_)
+    {
+        if (count_ < 8)
+            return 0;
+        __m256 lo = _mm256_loadu_ps ((const float *) src_);
+        __m256 hi = lo;
+        size_t i = 8;
+        for (; i + 8 <= count_; i += 8) {
+            __m256 f = _mm256_loadu_ps ((const float *) (src_ + i * 4));
+            lo = _mm256_min_ps (lo, f);
+            hi = _mm256_max_ps (hi, f);
+        }
+        float l [8], h [8];
+        _mm256_storeu_ps (l, lo);
+        _mm256_storeu_ps (h, hi);
+        min_ = l [0];
+        max_ = h [0];
+        for (int j = 1; j != 8; j++) {
+            min_ = std::min (min_, l [j]);
+            max_ = std::max (max_, h [j]);
+        }
+        return i;
+    }
+
+    //  Eight xorshift32 generators, seeded from state_, give the rounding
+    //  offsets.
+    __attribute__ ((target ("avx2")))
+    size_t quantize_avx2 (const unsigned char *src_, size_t count_,
+        float min_, float inv_, unsigned char *dst_, uint64_t &state_)
+    {
+        uint32_t seeds [8];
+        for (int j = 0; j != 8; j++)
+            seeds [j] = (uint32_t) next_random (state_) | 1;
+        __m256i x = _mm256_loadu_si256 ((const __m256i *) seeds);
+
+        const __m256 vmin = _mm256_set1_ps (min_);
+        const __m256 vinv = _mm256_set1_ps (inv_);
+        const __m256 unit = _mm256_set1_ps (1.0f / 16777216);
+        const __m256 zero = _mm256_setzero_ps ();
+        const __m256 top = _mm256_set1_ps (255);
+
+        size_t i = 0;
+        for (; i + 8 <= count_; i += 8) {
+            x = _mm256_xor_si256 (x, _mm256_slli_epi32 (x, 13));
+            x = _mm256_xor_si256 (x, _mm256_srli_epi32 (x, 17));
+            x = _mm256_xor_si256 (x, _mm256_slli_epi32 (x, 5));
+            __m256 u = _mm256_mul_ps (
+                _mm256_cvtepi32_ps (_mm256_srli_epi32 (x, 8)), unit);
+            __m256 f = _mm256_loadu_ps ((const float *) (src_ + i * 4));
+            __m256 t = _mm256_add_ps (
+                _mm256_mul_ps (_mm256_sub_ps (f, vmin), vinv), u);
+            t = _mm256_min_ps (_mm256_max_ps (t, zero), top);
+            __m256i q = _mm256_cvttps_epi32 (t);
+            q = _mm256_packus_epi32 (q, q);
+            q = _mm256_packus_epi16 (q, q);
+            uint32_t lo = (uint32_t) _mm_cvtsi128_si32 (
+                _mm256_castsi256_si128 (q));
+            uint32_t hi = (uint32_t) _mm_cvtsi128_si32 (
+                _mm256_extracti128_si256 (q, 1));
+            memcpy (dst_ + i, &lo, 4);
+            memcpy (dst_ + i + 4, &hi, 4);
+        }
+        return i;
+    }
+
+    __attribute__ ((target ("avx2")))
+    size_t dequantize_avx2 (const unsigned char *src_, size_t count_,
+        float min_, float step_, unsigned char *dst_)
+    {
+        const __m256 vmin = _mm256_set1_ps (min_);
+        const __m256 vstep = _mm256_set1_ps (step_);
+
+        size_t i = 0;
+        for (; i + 8 <= count_; i += 8) {
+            __m256i q = _mm256_cvtepu8_epi32 (
+                _mm_loadl_epi64 ((const __m128i *) (src_ + i)));
+            __m256 f = _mm256_add_ps (
+                _mm256_mul_ps (_mm256_cvtepi32_ps (q), vstep), vmin);
+            _mm256_storeu_ps ((float *) (dst_ + i * 4), f);
+        }
+        return i;
+    }
+#endif
+}
+
+zmq::tensor_codec_t::tensor_codec_t () :
+    type (ZMQ_CODEC_NONE),
+    topk (1000),
+    seed (0)
+{
+}
+
+zmq::tensor_codec_t::~tensor_codec_t ()
+{
+}
+
+void zmq::tensor_codec_t::set (int codec_, int topk_)
+{
+    zmq_assert (codec_ == ZMQ_CODEC_NONE || supported (codec_));
+    zmq_assert (topk_ > 0 && topk_ <= 1000);
+    type = codec_;
+    topk = topk_;
+    seed = ((uint64_t) generate_random () << 32) | generate_random ();
+}
+
+int zmq::tensor_codec_t::codec () const
+{
+    return type;
+}
+
+size_t zmq::tensor_codec_t::topk_count (size_t count_) const
+{
+    if (count_ == 0)
+        return 0;
+    return std::max ((count_ * topk + 999) / 1000, (size_t) 1);
+}
+
+size_t zmq::tensor_codec_t::chunk_count (size_t room_) const
+{
+    switch (type) {
+        case ZMQ_CODEC_F16:
+        case ZMQ_CODEC_BF16:
+            return room_ / 2;
+        case ZMQ_CODEC_Q8:
+            return room_ - 8;
+        case ZMQ_CODEC_TOPK: {
+            //  As many elements as leave room for the ones kept, within
+            //  reach of the indices.
+            const size_t kept = (room_ - 4) / 6;
+            return std::min (kept * 1000 / topk, (size_t) 65535);
+        }
+        default:
+            return room_ / 4;
+    }
+}
+
+size_t zmq::tensor_codec_t::coded_size (size_t count_) const
+{
+    switch (type) {
+        case ZMQ_CODEC_F16:
+        case ZMQ_CODEC_BF16:
+            return count_ * 2;
+        case ZMQ_CODEC_Q8:
+            return 8 + count_;
+        case ZMQ_CODEC_TOPK:
+            return 4 + topk_count (count_) * 6;
+        default:
+            return count_ * 4;
+    }
+}
+
+void zmq::tensor_codec_t::encode (const unsigned char *src_, size_t count_,
+    unsigned char *dst_)
+{
+    size_t done = 0;
+
+    switch (type) {
+        case ZMQ_CODEC_F16:
+#ifdef ZMQ_HAVE_CODEC_AVX2
+            if (have_avx2 ())
+                done = narrow_f16_avx2 (src_, count_, dst_);
+#endif
+            narrow <float_to_half> (src_ + done * 4, count_ - done,
+                dst_ + done * 2);
+            break;
+        case ZMQ_CODEC_BF16:
+#ifdef ZMQ_HAVE_CODEC_AVX2
+            if (have_avx2 ())
+                done = narrow_bf16_avx2 (src_, count_, dst_);
+#endif
+            narrow <float_to_bf16> (src_ + done * 4, count_ - done,
+                dst_ + done * 2);
+            break;
+        case ZMQ_CODEC_Q8:
+            encode_q8 (src_, count_, dst_);
+            break;
+        case ZMQ_CODEC_TOPK:
+            encode_topk (src_, count_, dst_);
+            break;
+        default:
+            memcpy (dst_, src_, count_ * 4);
+            break;
+    }
+}
+
+void zmq::tensor_codec_t::encode_q8 (const unsigned char *src_,
+    size_t count_, unsigned char *dst_)
+{
+    float min = 0;
+    float max = 0;
+    size_t i = 0;
+#ifdef ZMQ_HAVE_CODEC_AVX2
+    if (have_avx2 ())
+        i = min_max_avx2 (src_, count_, min, max);
+#endif
+    if (i == 0 && count_)
+        min = max = load_float (src_);
+    for (; i < count_; i++) {
+        const float f = load_float (src_ + i * 4);
+        min = std::min (min, f);
+        max = std::max (max, f);
+    }
+
+    //  Each element is rounded up with the probability of its distance
+    //  from the step below, so that the rounding is unbiased.
+    const float step = (max - min) / 255;
+    const float inv = step > 0 ? 1 / step : 0;
+    store_float (dst_, min);
+    store_float (dst_ + 4, step);
+    unsigned char *q = dst_ + 8;
+
+    i = 0;
+#ifdef ZMQ_HAVE_CODEC_AVX2
+    if (have_avx2 ())
+        i = quantize_avx2 (src_, count_, min, inv, q, seed);
+#endif
+    for (; i < count_; i++) {
+        const float u = (float) (next_random (seed) >> 40) / 16777216;
+        float t = (load_float (src_ + i * 4) - min) * inv + u;
+        if (!(t >= 0))
+            t = 0;
+        q [i] = (unsigned char) std::min (t, 255.0f);
+    }
+}
+
+void zmq::tensor_codec_t::encode_topk (const unsigned char *src_,
+    size_t count_, unsigned char *dst_)
+{
+    const size_t kept = topk_count (count_);
+    const uint32_t n = (uint32_t) kept;
+    memcpy (dst_, &n, 4);
+    unsigned char *pos = dst_ + 4;
+
+    //  The threshold is the kept-th largest magnitude. Of the elements
+    //  that equal it, the first ones are kept.
+    scratch.resize (count_);
+    for (size_t i = 0; i != count_; i++)
+        scratch [i] = magnitude (load_float (src_ + i * 4));
+    float threshold = 0;
+    size_t ties = kept;
+    if (kept < count_) {
+        std::nth_element (scratch.begin (), scratch.begin () + (count_ - kept),
+            scratch.end ());
+        threshold = scratch [count_ - kept];
+        ties = 0;
+        for (size_t i = count_ - kept; i != count_; i++)
+            if (scratch [i] == threshold)
+                ties++;
+    }
+
+    for (size_t i = 0; i != count_; i++) {
+        const float f = load_float (src_ + i * 4);
+        const float m = magnitude (f);
+        if (m < threshold)
+            continue;
+        if (m == threshold) {
+            if (ties == 0)
+                continue;
+            ties--;
+        }
+        const uint16_t index = (uint16_t) i;
+        memcpy (pos, &index, 2);
+        store_float (pos + 2, f);
+        pos += 6;
+    }
+    zmq_assert (pos == dst_ + 4 + kept * 6);
+}
+
+int zmq::tensor_codec_t::decode (int codec_, const unsigned char *src_,
+    size_t size_, unsigned char *dst_, size_t count_)
+{
+    size_t done = 0;
+
+    switch (codec_) {
+        case ZMQ_CODEC_F16:
+            if (size_ != count_ * 2)
+                return -1;
+#ifdef ZMQ_HAVE_CODEC_AVX2
+            if (have_avx2 ())
+                done = widen_f16_avx2 (src_, count_, dst_);
+#endif
+            widen <half_to_float> (src_ + done * 2, count_ - done,
+                dst_ + done * 4);
+            return 0;
+
+        case ZMQ_CODEC_BF16:
+            if (size_ != count_ * 2)
+                return -1;
+#ifdef ZMQ_HAVE_CODEC_AVX2
+            if (have_avx2 ())
+                done = widen_bf16_avx2 (src_, count_, dst_);
+#endif
+            widen <bf16_to_float> (src_ + done * 2, count_ - done,
+                dst_ + done * 4);
+            return 0;
+
+        case ZMQ_CODEC_Q8: {
+            if (size_ != 8 + count_)
+                return -1;
+            const float min = load_float (src_);
+            const float step = load_float (src_ + 4);
+            const unsigned char *q = src_ + 8;
+#ifdef ZMQ_HAVE_CODEC_AVX2
+            if (have_avx2 ())
+                done = dequantize_avx2 (q, count_, min, step, dst_);
+#endif
+            for (size_t i = done; i < count_; i++)
+                store_float (dst_ + i * 4, min + q [i] * step);
+            return 0;
+        }
+
+        case ZMQ_CODEC_TOPK: {
+            uint32_t n;
+            if (size_ < 4)
+                return -1;
+            memcpy (&n, src_, 4);
+            if (n > count_ || size_ != 4 + (size_t) n * 6)
+                return -1;
+            memset (dst_, 0, count_ * 4);
+            const unsigned char *pos = src_ + 4;
+            for (uint32_t i = 0; i != n; i++, pos += 6) {
+                uint16_t index;
+                memcpy (&index, pos, 2);
+                if (index >= count_)
+                    return -1;
+                memcpy (dst_ + (size_t) index * 4, pos + 2, 4);
+            }
+            return 0;
+        }
+
+        default:
+            return -1;
+    }
+}
+
+bool zmq::tensor_codec_t::supported (int codec_)
+{
+    return codec_ >= ZMQ_CODEC_F16 && codec_ <= ZMQ_CODEC_TOPK;
+}
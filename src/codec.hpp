@@ -0,0 +1,113 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __ZMQ_CODEC_HPP_INCLUDED__
+#define __ZMQ_CODEC_HPP_INCLUDED__
+
+#include <stddef.h>
+#include <vector>
+
+#include "stdint.hpp"
+
+namespace zmq
+{
+
+    //  Compresses the float32 elements of keyed tensor chunks on the way
+    //  out, as set with ZMQ_TENSOR_CODEC, and expands them on the
+    //  way in. The chunk header still counts elements, the frame carries
+    //  the id of the codec in the byte after its flags.
+    //
+    //  ZMQ_CODEC_F16, _BF16   the elements as 16-bit floats
+    //  ZMQ_CODEC_Q8           the minimum and step of the chunk as floats,
+    //                         then a byte per element, stochastically
+    //                         rounded
+    //  ZMQ_CODEC_TOPK         the number of elements kept as a uint32,
+    //                         then each of them as a uint16 index into the
+    //                         chunk and a float
+    //
+    //  Like the elements, all of it is in the byte order of the sender.
+    class tensor_codec_t
+    {
+    public:
+
+        tensor_codec_t ();
+        ~tensor_codec_t ();
+
+        //  Codes chunks with codec_ from now on, keeping topk_ out of every
+        //  1000 elements for ZMQ_CODEC_TOPK.
+        void set (int codec_, int topk_);
+
+        //  ZMQ_CODEC_NONE unless set otherwise.
+        int codec () const;
+
+        //  Most elements a chunk may hold to be coded into room_ bytes.
+        size_t chunk_count (size_t room_) const;
+
+        //  Bytes count_ elements take coded.
+        size_t coded_size (size_t count_) const;
+
+        //  Codes the count_ elements at src_ into coded_size (count_)
+        //  bytes at dst_.
+        void encode (const unsigned char *src_, size_t count_,
+            unsigned char *dst_);
+
+        //  Expands the size_ bytes at src_, coded with codec_, into count_
+        //  elements at dst_. Returns -1 if they are not what codec_ makes
+        //  of count_ elements.
+        static int decode (int codec_, const unsigned char *src_,
+            size_t size_, unsigned char *dst_, size_t count_);
+
+        //  True if decode knows codec_.
+        static bool supported (int codec_);
+
+    private:
+
+        int type;
+        int topk;
+
+        //  Drives the stochastic rounding of ZMQ_CODEC_Q8.
+        uint64_t seed;
+
+        //  Magnitudes ZMQ_CODEC_TOPK picks the largest of.
+        std::vector <float> scratch;
+
+        size_t topk_count (size_t count_) const;
+        void encode_q8 (const unsigned char *src_, size_t count_,
+            unsigned char *dst_);
+        void encode_topk (const unsigned char *src_, size_t count_,
+            unsigned char *dst_);
+
+        tensor_codec_t (const tensor_codec_t&);
+        const tensor_codec_t &operator = (const tensor_codec_t&);
+    };
+
+}
+
+#endif
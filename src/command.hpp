@@ -39,6 +39,7 @@ namespace zmq
     class object_t;
     class own_t;
     struct i_engine;
+    class stream_engine_t;
     class pipe_t;
     class socket_base_t;
 
@@ -74,6 +75,7 @@ namespace zmq
             reap,
             reaped,
             inproc_connected,
+            migrate,
             done
         } type;
 
@@ -115,13 +117,15 @@ namespace zmq
             //  messages it has read so far.
             struct {
                 uint64_t msgs_read;
+                uint64_t hot_msgs_read;
             } activate_write;
 
             //  Sent by pipe reader to writer after creating a new inpipe.
-            //  The parameter is actually of type pipe_t::upipe_t, however,
+            //  The parameters are actually of type pipe_t::upipe_t, however,
             //  its definition is private so we'll have to do with void*.
             struct {
                 void *pipe;
+                void *hot_pipe;
             } hiccup;
 
             //  Sent by pipe reader to pipe writer to ask it to terminate
@@ -176,6 +180,12 @@ namespace zmq
             struct {
             } done;
 
+            //  Sent by an overloaded I/O thread to a less loaded one to
+            //  hand over an engine, together with its session.
+            struct {
+                zmq::stream_engine_t *engine;
+            } migrate;
+
         } args;
 #ifdef _MSC_VER
     };
@@ -59,18 +59,81 @@ namespace zmq
         //  unnecessary network stack traversals.
         in_batch_size = 8192,
 
+        //  A decoder sizes the buffer it receives into for that many
+        //  messages of the average size it has seen, between
+        //  min_in_buffer_size and in_batch_size. Messages smaller than
+        //  their share of the buffer are copied out instead of pointing
+        //  into it, so that no message pins a buffer many times its size.
+        //  The same goes for the pool pbufs a decoder reads from directly.
+        in_buffer_msgs = 16,
+        min_in_buffer_size = 2048,
+
         //  Maximal batching size for engines with sending functionality.
         //  So, if there are 10 messages that fit into the batch size, all of
         //  them may be written by a single 'send' system call, thus avoiding
         //  unnecessary network stack traversals.
         out_batch_size = 8192,
 
+        //  Data messages at least this large are not copied into the out
+        //  batch. Their body is handed to lwIP by reference and stays
+        //  pinned until the peer has acked the segments carrying it. So is
+        //  the body of any message in memory passed to zmq_register_memory.
+        zerocopy_send_threshold = 8192,
+
+        //  Bytes each remote may send per round when the data path of an
+        //  engine serves several remotes in deficit round robin order.
+        out_quantum = 65536,
+
+        //  Maximal number of messages the data path of an engine takes
+        //  from its session ahead of sending them. The deeper the backlog,
+        //  the more remotes it can interleave.
+        out_backlog = 1024,
+
+        //  Bytes of each size class a thread keeps in its cache of message
+        //  memory. The blocks it frees beyond that go back to malloc.
+        msg_pool_cache_size = 2097152,
+
+        //  Points every remote gets on the consistent hash ring of a
+        //  sharding socket. More points spread the keys more evenly.
+        shard_ring_points = 64,
+
+        //  Bytes of a tensor an allreduce sends in one piece. Pieces are
+        //  passed on as soon as they are in, so that the steps overlap.
+        allreduce_chunk_size = 65536,
+
+        //  Tensors smaller than this are reduced over a tree rather than
+        //  a ring when the group leaves the choice to the library. The
+        //  tree takes fewer steps, the ring uses every link in both
+        //  directions.
+        allreduce_tree_size = 65536,
+
+        //  Bytes of elements an aggregator sums in one slot of its arena.
+        //  A chunk that fills a segment takes one slot, so does one coded
+        //  with ZMQ_CODEC_Q8 once expanded.
+        agg_slot_size = 8192,
+
+        //  Default size of the arena of an aggregator, in bytes.
+        agg_arena_size = 16777216,
+
+        //  Default time an aggregator waits for the last workers of a
+        //  chunk, in milliseconds.
+        agg_timeout = 1000,
+
         //  Maximal delta between high and low watermark.
         max_wm_delta = 1024,
 
         //  Maximum number of events the I/O thread can process in one go.
         max_io_events = 256,
 
+        //  Length of the window over which an I/O thread measures the
+        //  traffic it handles, in milliseconds.
+        traffic_window_ms = 100,
+
+        //  Bytes every packet is weighed as on top of its payload when
+        //  comparing the traffic of I/O threads. Small packets cost the
+        //  stack far more than their size suggests.
+        traffic_packet_cost = 256,
+
         //  Maximal delay to process command in API thread (in CPU ticks).
         //  3,000,000 ticks equals to 1 - 2 milliseconds on current CPUs.
         //  Note that delay is only applied when there is continuous stream of
@@ -47,6 +47,8 @@
 #include "err.hpp"
 #include "msg.hpp"
 #include "random.hpp"
+#include "numa.hpp"
+#include "zmqlwip.h"
 
 #ifdef ZMQ_HAVE_VMCI
 #include <vmci_sockets.h>
@@ -77,7 +79,11 @@ zmq::ctx_t::ctx_t () :
     blocky (true),
     ipv6 (false),
     thread_priority (ZMQ_THREAD_PRIORITY_DFLT),
-    thread_sched_policy (ZMQ_THREAD_SCHED_POLICY_DFLT)
+    thread_sched_policy (ZMQ_THREAD_SCHED_POLICY_DFLT),
+    io_spin_us (-1),
+    io_rtc (false),
+    io_migrate_ivl (0),
+    reaper_cpu (-1)
 {
 #ifdef HAVE_FORK
     pid = getpid();
@@ -283,6 +289,31 @@ int zmq::ctx_t::set (int option_, int optval_)
         scoped_lock_t locker(opt_sync);
         max_msgsz = optval_ < INT_MAX? optval_: INT_MAX;
     }
+    else
+    if (option_ == ZMQ_IO_SPIN_US && optval_ >= -1) {
+        scoped_lock_t locker(opt_sync);
+        io_spin_us = optval_;
+    }
+    else
+    if (option_ == ZMQ_IO_RUN_TO_COMPLETION && optval_ >= 0) {
+        scoped_lock_t locker(opt_sync);
+        io_rtc = (optval_ != 0);
+    }
+    else
+    if (option_ == ZMQ_IO_MIGRATE_IVL && optval_ >= 0) {
+        scoped_lock_t locker(opt_sync);
+        io_migrate_ivl = optval_;
+    }
+    else
+    if (option_ == ZMQ_IO_THREAD_CPU_ADD && optval_ >= -1) {
+        scoped_lock_t locker(opt_sync);
+        io_thread_cpus.push_back (optval_);
+    }
+    else
+    if (option_ == ZMQ_REAPER_CPU && optval_ >= -1) {
+        scoped_lock_t locker(opt_sync);
+        reaper_cpu = optval_;
+    }
     else {
         errno = EINVAL;
         rc = -1;
@@ -290,7 +321,7 @@ int zmq::ctx_t::set (int option_, int optval_)
     return rc;
 }
 
-int zmq::ctx_t::get (int option_)
+int zmq::ctx_t::get (int option_) const
 {
     int rc = 0;
     if (option_ == ZMQ_MAX_SOCKETS)
@@ -313,6 +344,18 @@ int zmq::ctx_t::get (int option_)
     else
     if (option_ == ZMQ_MSG_T_SIZE)
         rc = sizeof (zmq_msg_t);
+    else
+    if (option_ == ZMQ_IO_SPIN_US)
+        rc = io_spin_us;
+    else
+    if (option_ == ZMQ_IO_RUN_TO_COMPLETION)
+        rc = io_rtc;
+    else
+    if (option_ == ZMQ_IO_MIGRATE_IVL)
+        rc = io_migrate_ivl;
+    else
+    if (option_ == ZMQ_REAPER_CPU)
+        rc = reaper_cpu;
     else {
         errno = EINVAL;
         rc = -1;
@@ -332,6 +375,10 @@ zmq::socket_base_t *zmq::ctx_t::create_socket (int type_)
         opt_sync.lock ();
         int mazmq = max_sockets;
         int ios = io_thread_count;
+        std::vector <int> cpus = io_thread_cpus;
+        cpus.resize (ios, -1);
+        int rcpu = reaper_cpu;
+        bool pinned = !thread_affinity_cpus.empty ();
         opt_sync.unlock ();
         slot_count = mazmq + ios + 2;
         slots = (i_mailbox **) malloc (sizeof (i_mailbox*) * slot_count);
@@ -340,20 +387,40 @@ zmq::socket_base_t *zmq::ctx_t::create_socket (int type_)
         //  Initialise the infrastructure for zmq_ctx_term thread.
         slots [term_tid] = &term_mailbox;
 
-        //  Create the reaper thread.
+        //  Threads not placed explicitly share the CPUs of the NIC's node
+        //  that DPDK does not poll on.
+        int local_node = -1;
+        std::set <int> local;
+        if (!pinned) {
+            local_node = zmq_lwip_numa_node ();
+            local = numa_node_cpus (local_node);
+            int lcores [16];
+            int nlcores = zmq_lwip_get_cpus (lcores, 16);
+            for (int i = 0; i < nlcores && i < 16; i++)
+                local.erase (lcores [i]);
+        }
+
+        //  Create the reaper thread. Its poller and mailbox are allocated
+        //  on its node and it inherits the preference when started.
+        int node;
+        std::set <int> placement = place_thread (rcpu, local, local_node, node);
+        numa_prefer_node (node);
         reaper = new (std::nothrow) reaper_t (this, reaper_tid);
         alloc_assert (reaper);
         slots [reaper_tid] = reaper->get_mailbox ();
-        reaper->start ();
+        reaper->start (placement);
 
         //  Create I/O thread objects and launch them.
         for (int i = 2; i != ios + 2; i++) {
+            placement = place_thread (cpus [i - 2], local, local_node, node);
+            numa_prefer_node (node);
             io_thread_t *io_thread = new (std::nothrow) io_thread_t (this, i);
             alloc_assert (io_thread);
             io_threads.push_back (io_thread);
             slots [i] = io_thread->get_mailbox ();
-            io_thread->start ();
+            io_thread->start (placement);
         }
+        numa_prefer_node (-1);
 
         //  In the unused part of the slot array, create a list of empty slots.
         for (int32_t i = (int32_t) slot_count - 1;
@@ -394,6 +461,25 @@ zmq::socket_base_t *zmq::ctx_t::create_socket (int type_)
     return s;
 }
 
+int zmq::ctx_t::io_stats (int io_thread_, io_stats_t *stats_)
+{
+    scoped_lock_t locker(slot_sync);
+
+    opt_sync.lock ();
+    const int ios = io_thread_count;
+    opt_sync.unlock ();
+    if (io_thread_ < -1 || io_thread_ >= ios) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    //  Until the first socket is created there are no threads to count.
+    for (int i = 0; i != (int) io_threads.size (); i++)
+        if (io_thread_ == -1 || io_thread_ == i)
+            io_threads [i]->get_poller ()->add_stats (stats_);
+    return 0;
+}
+
 void zmq::ctx_t::destroy_socket (class socket_base_t *socket_)
 {
     scoped_lock_t locker(slot_sync);
@@ -417,11 +503,13 @@ zmq::object_t *zmq::ctx_t::get_reaper ()
     return reaper;
 }
 
-void zmq::ctx_t::start_thread (thread_t &thread_, thread_fn *tfn_, void *arg_) const
+void zmq::ctx_t::start_thread (thread_t &thread_, thread_fn *tfn_, void *arg_,
+    const std::set <int> &cpus_) const
 {
     static unsigned int nthreads_started = 0;
 
-    thread_.setSchedulingParameters(thread_priority, thread_sched_policy, thread_affinity_cpus);
+    thread_.setSchedulingParameters(thread_priority, thread_sched_policy,
+        cpus_.empty () ? thread_affinity_cpus : cpus_);
     thread_.start(tfn_, arg_);
 #ifndef ZMQ_HAVE_ANDROID
     std::ostringstream s;
@@ -433,6 +521,24 @@ void zmq::ctx_t::start_thread (thread_t &thread_, thread_fn *tfn_, void *arg_) c
     nthreads_started++;
 }
 
+std::set <int> zmq::ctx_t::place_thread (int cpu_,
+    const std::set <int> &local_, int local_node_, int &node_) const
+{
+    std::set <int> cpus;
+    if (cpu_ >= 0) {
+        cpus.insert (cpu_);
+        node_ = numa_node_of_cpu (cpu_);
+    }
+    else
+    if (!local_.empty ()) {
+        cpus = local_;
+        node_ = local_node_;
+    }
+    else
+        node_ = -1;
+    return cpus;
+}
+
 void zmq::ctx_t::send_command (uint32_t tid_, const command_t &command_)
 {
     slots [tid_]->send (command_);
@@ -443,13 +549,18 @@ zmq::io_thread_t *zmq::ctx_t::choose_io_thread (uint64_t affinity_)
     if (io_threads.empty ())
         return NULL;
 
-    //  Find the I/O thread with minimum load.
+    //  Find the I/O thread handling the least traffic. While traffic does
+    //  not tell them apart, e.g. when idle, take the one with minimum load.
+    uint32_t min_traffic = 0;
     int min_load = -1;
     io_thread_t *selected_io_thread = NULL;
     for (io_threads_t::size_type i = 0; i != io_threads.size (); i++) {
         if (!affinity_ || (affinity_ & (uint64_t (1) << i))) {
+            uint32_t traffic = io_threads [i]->get_traffic ();
             int load = io_threads [i]->get_load ();
-            if (selected_io_thread == NULL || load < min_load) {
+            if (selected_io_thread == NULL || traffic < min_traffic ||
+                  (traffic == min_traffic && load < min_load)) {
+                min_traffic = traffic;
                 min_load = load;
                 selected_io_thread = io_threads [i];
             }
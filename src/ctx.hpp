@@ -53,6 +53,17 @@ namespace zmq
     class reaper_t;
     class pipe_t;
 
+    //  Counters of the I/O threads, see zmq_io_stats. wakeups [i] counts
+    //  wake-ups that took from 2^(i-1) up to 2^i microseconds, the last
+    //  bucket everything longer.
+    struct io_stats_t
+    {
+        enum { wake_buckets = 16 };
+        uint64_t rx_queues;
+        uint64_t parks;
+        uint64_t wakeups [wake_buckets];
+    };
+
     //  Information associated with inproc endpoint. Note that endpoint options
     //  are registered as well so that the peer can access them without a need
     //  for synchronisation, handshaking or similar.
@@ -92,14 +103,16 @@ namespace zmq
 
         //  Set and get context properties.
         int set (int option_, int optval_);
-        int get (int option_);
+        int get (int option_) const;
 
         //  Create and destroy a socket.
         zmq::socket_base_t *create_socket (int type_);
         void destroy_socket (zmq::socket_base_t *socket_);
 
-        //  Start a new thread with proper scheduling parameters.
-        void start_thread (thread_t &thread_, thread_fn *tfn_, void *arg_) const;
+        //  Start a new thread with proper scheduling parameters. The thread
+        //  runs on cpus_, or on the context-wide affinity set if empty.
+        void start_thread (thread_t &thread_, thread_fn *tfn_, void *arg_,
+            const std::set <int> &cpus_) const;
 
         //  Send command to the destination thread.
         void send_command (uint32_t tid_, const command_t &command_);
@@ -112,6 +125,10 @@ namespace zmq
         //  Returns reaper thread object.
         zmq::object_t *get_reaper ();
 
+        //  Adds the counters of I/O thread io_thread_, or of all of them if
+        //  it is -1, to stats_. Returns -1 for a thread that does not exist.
+        int io_stats (int io_thread_, io_stats_t *stats_);
+
         //  Management of inproc endpoints.
         int register_endpoint (const char *addr_, const endpoint_t &endpoint_);
         int unregister_endpoint (const std::string &addr_, socket_base_t *socket_);
@@ -217,6 +234,29 @@ namespace zmq
         std::set<int> thread_affinity_cpus;
         std::string thread_name_prefix;
 
+        //  How long an idle I/O thread busy-polls before it blocks,
+        //  in microseconds. -1 means it never blocks.
+        int io_spin_us;
+
+        //  If true, I/O threads poll a NIC queue and run the stack
+        //  themselves instead of waiting for the DPDK thread.
+        bool io_rtc;
+
+        //  How often I/O threads compare their traffic and hand engines
+        //  over to less loaded ones, in milliseconds. 0 disables it.
+        int io_migrate_ivl;
+
+        //  CPU to pin the n-th I/O thread and the reaper to, -1 for none.
+        //  Threads without one run on the NIC's NUMA node, off the DPDK
+        //  lcores, unless a context-wide thread affinity is set.
+        std::vector <int> io_thread_cpus;
+        int reaper_cpu;
+
+        //  Returns the CPUs to start a thread asked to run on cpu_ on and
+        //  sets node_ to the NUMA node to allocate its memory from.
+        std::set <int> place_thread (int cpu_, const std::set <int> &local_,
+            int local_node_, int &node_) const;
+
         //  Synchronisation of access to context options.
         mutex_t opt_sync;
 
@@ -42,6 +42,11 @@ zmq::dealer_t::dealer_t (class ctx_t *parent_, uint32_t tid_, int sid_) :
 
 zmq::dealer_t::~dealer_t ()
 {
+    while (!backlog.empty ()) {
+        int rc = backlog.front ().close ();
+        errno_assert (rc == 0);
+        backlog.pop_front ();
+    }
 }
 
 void zmq::dealer_t::xattach_pipe (pipe_t *pipe_, bool subscribe_to_all_)
@@ -82,6 +87,12 @@ int zmq::dealer_t::xsetsockopt (int option_, const void *optval_,
             }
             break;
 
+        case ZMQ_SHARD_RANGES:
+            return shard.set_ranges (optval_, optvallen_);
+
+        case ZMQ_SHARD_RING:
+            return shard.set_ring (optval_, optvallen_);
+
         default:
             break;
     }
@@ -92,12 +103,48 @@ int zmq::dealer_t::xsetsockopt (int option_, const void *optval_,
 
 int zmq::dealer_t::xsend (msg_t *msg_)
 {
-    return sendpipe (msg_, NULL);
+    //  The messages split off a keyed one go out before anything else.
+    if (!flush_backlog ()) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if (!shard.active () || !(msg_->flags () & msg_t::netml_key))
+        return sendpipe (msg_, NULL);
+
+    //  The message is taken as a whole, the pipe may have room for only
+    //  some of its parts yet.
+    if (!lb.has_out ()) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (shard.split (msg_, backlog) != 0)
+        return -1;
+    flush_backlog ();
+    return 0;
+}
+
+bool zmq::dealer_t::flush_backlog ()
+{
+    while (!backlog.empty ()) {
+        if (lb.sendpipe (&backlog.front (), NULL) != 0)
+            return false;
+        backlog.pop_front ();
+    }
+    return true;
 }
 
 int zmq::dealer_t::xrecv (msg_t *msg_)
 {
-    return recvpipe (msg_, NULL);
+    while (true) {
+        int rc = recvpipe (msg_, NULL);
+        if (rc != 0)
+            return rc;
+
+        //  Answers to a request are held back until all of them are in.
+        if (shard.gather (msg_) != 0)
+            return 0;
+    }
 }
 
 bool zmq::dealer_t::xhas_in ()
@@ -107,7 +154,7 @@ bool zmq::dealer_t::xhas_in ()
 
 bool zmq::dealer_t::xhas_out ()
 {
-    return lb.has_out ();
+    return flush_backlog () && lb.has_out ();
 }
 
 const zmq::blob_t &zmq::dealer_t::get_credential () const
@@ -124,6 +171,7 @@ void zmq::dealer_t::xread_activated (pipe_t *pipe_)
 void zmq::dealer_t::xwrite_activated (pipe_t *pipe_)
 {
     lb.activated (pipe_);
+    flush_backlog ();
 }
 
 void zmq::dealer_t::xpipe_terminated (pipe_t *pipe_)
@@ -34,6 +34,9 @@
 #include "session_base.hpp"
 #include "fq.hpp"
 #include "lb.hpp"
+#include "shard.hpp"
+
+#include <deque>
 
 namespace zmq
 {
@@ -80,6 +83,15 @@ namespace zmq
         // if true, send an empty message to every connected router peer
         bool probe_router;
 
+        //  Routes keyed messages by ZMQ_SHARD_RANGES or ZMQ_SHARD_RING.
+        shard_t shard;
+
+        //  Messages split off a keyed one, waiting for room in the pipe.
+        std::deque <msg_t> backlog;
+
+        //  Sends what it can of the backlog. True if all of it went.
+        bool flush_backlog ();
+
         dealer_t (const dealer_t&);
         const dealer_t &operator = (const dealer_t&);
     };
@@ -30,16 +30,21 @@
 #include "precompiled.hpp"
 #include "decoder_allocators.hpp"
 
+#include <algorithm>
 #include <cmath>
 
+#include "config.hpp"
 #include "msg.hpp"
+#include "msg_pool.hpp"
 
 zmq::shared_message_memory_allocator::shared_message_memory_allocator (std::size_t bufsize_) :
     buf(NULL),
     bufsize(0),
     max_size(bufsize_),
     msg_content(NULL),
-    maxCounters (static_cast <size_t> (std::ceil (static_cast <double> (max_size) / static_cast <double> (msg_t::max_vsm_size))))
+    maxCounters (static_cast <size_t> (std::ceil (static_cast <double> (max_size) / static_cast <double> (msg_t::max_vsm_size)))),
+    buf_total(0),
+    avg_size(max_size / in_buffer_msgs)
 {
 }
 
@@ -48,7 +53,9 @@ zmq::shared_message_memory_allocator::shared_message_memory_allocator (std::size
     bufsize(0),
     max_size(bufsize_),
     msg_content(NULL),
-    maxCounters(maxMessages)
+    maxCounters(maxMessages),
+    buf_total(0),
+    avg_size(max_size / in_buffer_msgs)
 {
 }
 
@@ -73,15 +80,20 @@ unsigned char* zmq::shared_message_memory_allocator::allocate ()
         }
     }
 
-    // if buf != NULL it is not used by any message so we can re-use it for the next run
+    // if buf != NULL it is not used by any message so we can re-use it for the next run,
+    // unless the messages seen since call for a buffer of another size
+    std::size_t const total = target_size ();
+    if (buf && buf_total != total) {
+        reinterpret_cast <zmq::atomic_counter_t *> (buf)->~atomic_counter_t ();
+        pool_free (buf);
+        release ();
+    }
+
     if (!buf) {
         // allocate memory for reference counters together with reception buffer
-        std::size_t const allocationsize =
-              max_size + sizeof (zmq::atomic_counter_t) +
-              maxCounters * sizeof (zmq::msg_t::content_t);
-
-        buf = static_cast <unsigned char *> (std::malloc (allocationsize));
+        buf = static_cast <unsigned char *> (pool_alloc (total));
         alloc_assert (buf);
+        buf_total = total;
 
         new (buf) atomic_counter_t (1);
     } else {
@@ -90,8 +102,11 @@ unsigned char* zmq::shared_message_memory_allocator::allocate ()
         c->set (1);
     }
 
-    bufsize = max_size;
-    msg_content = reinterpret_cast <zmq::msg_t::content_t*> (buf + sizeof (atomic_counter_t) + max_size);
+    // No more messages share the buffer than shares lets through
+    std::size_t const counters = std::min (maxCounters, (std::size_t) in_buffer_msgs);
+    zmq_assert (total > sizeof (atomic_counter_t) + counters * sizeof (zmq::msg_t::content_t));
+    bufsize = total - sizeof (atomic_counter_t) - counters * sizeof (zmq::msg_t::content_t);
+    msg_content = reinterpret_cast <zmq::msg_t::content_t*> (buf + sizeof (atomic_counter_t) + bufsize);
     return buf + sizeof (zmq::atomic_counter_t);
 }
 
@@ -99,7 +114,8 @@ void zmq::shared_message_memory_allocator::deallocate ()
 {
     zmq::atomic_counter_t* c = reinterpret_cast<zmq::atomic_counter_t* >(buf);
     if (buf && !c->sub(1)) {
-        xfree(buf);
+        c->~atomic_counter_t ();
+        pool_free(buf);
     }
     release();
 }
@@ -127,11 +143,33 @@ void zmq::shared_message_memory_allocator::call_dec_ref(void*, void* hint)
 
     if (!c->sub (1)) {
         c->~atomic_counter_t ();
-        xfree (buf);
+        pool_free (buf);
         buf = NULL;
     }
 }
 
+void zmq::shared_message_memory_allocator::observe (std::size_t msg_size_)
+{
+    //  Weighs the last eight messages or so.
+    avg_size = avg_size - avg_size / 8 + std::min (msg_size_, max_size) / 8;
+}
+
+bool zmq::shared_message_memory_allocator::shares (std::size_t msg_size_) const
+{
+    //  A buffer holds at most in_buffer_msgs messages that point into it,
+    //  anything smaller goes into a block of its own.
+    return msg_size_ * in_buffer_msgs >= bufsize;
+}
+
+std::size_t zmq::shared_message_memory_allocator::target_size () const
+{
+    //  Powers of two fill the blocks of the message pool.
+    std::size_t target = min_in_buffer_size;
+    while (target < max_size && target < avg_size * in_buffer_msgs)
+        target *= 2;
+    return std::min (target, max_size);
+}
+
 
 std::size_t zmq::shared_message_memory_allocator::size () const
 {
@@ -90,6 +90,10 @@ namespace zmq
     // from zero to one, gets passed to the user application, processed in the user thread and deleted
     // which would then deallocate the buffer. The drawback is that the buffer may be allocated longer
     // than necessary because it is only deleted when allocate is called the next time.
+    //
+    // Buffers come from the message pool and follow the sizes of the messages decoded, see
+    // in_buffer_msgs. A buffer that is no longer referenced is reused for the next run if it
+    // still has the right size.
     class shared_message_memory_allocator
     {
     public:
@@ -115,6 +119,12 @@ namespace zmq
 
         void inc_ref ();
 
+        // Feed the size of a message decoded into the sizing of the next buffers.
+        void observe (std::size_t msg_size_);
+
+        // Whether a message of that size is built on the buffer rather than copied out.
+        bool shares (std::size_t msg_size_) const;
+
         static void call_dec_ref (void*, void* buffer);
 
         std::size_t size () const;
@@ -144,11 +154,20 @@ namespace zmq
         }
 
     private:
+        // Size of the next buffer, reference counters included.
+        std::size_t target_size () const;
+
         unsigned char* buf;
         std::size_t bufsize;
         std::size_t max_size;
         zmq::msg_t::content_t* msg_content;
         std::size_t maxCounters;
+
+        // Size of the current buffer as allocated.
+        std::size_t buf_total;
+
+        // Moving average of the sizes observed.
+        std::size_t avg_size;
     };
 }
 
@@ -137,7 +137,7 @@ void zmq::devpoll_t::reset_pollout (handle_t handle_)
 
 void zmq::devpoll_t::start ()
 {
-    ctx.start_thread (worker, worker_routine, this);
+    ctx.start_thread (worker, worker_routine, this, cpus);
 }
 
 void zmq::devpoll_t::stop ()
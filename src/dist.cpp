@@ -65,6 +65,18 @@ void zmq::dist_t::attach (pipe_t *pipe_)
     }
 }
 
+void zmq::dist_t::activate_hot ()
+{
+    //  Between messages all the eligible pipes are active.
+    zmq_assert (!more);
+    for (pipes_t::size_type i = eligible; i < pipes.size (); ++i)
+        if (pipes [i]->check_hwm (true)) {
+            pipes.swap (i, active);
+            active++;
+            eligible++;
+        }
+}
+
 void zmq::dist_t::match (pipe_t *pipe_)
 {
     //  If pipe is already matching do nothing.
@@ -123,6 +135,10 @@ void zmq::dist_t::pipe_terminated (pipe_t *pipe_)
 
 void zmq::dist_t::activated (pipe_t *pipe_)
 {
+    //  A hot message may have made it active already.
+    if (pipes.index (pipe_) < eligible)
+        return;
+
     //  Move the pipe from passive to eligible state.
     if (eligible < pipes.size ()) {
         pipes.swap (pipes.index (pipe_), eligible);
@@ -139,6 +155,8 @@ void zmq::dist_t::activated (pipe_t *pipe_)
 
 int zmq::dist_t::send_to_all (msg_t *msg_)
 {
+    if (!more && (msg_->flags () & msg_t::netml_hotdata))
+        activate_hot ();
     matching = active;
     return send_to_matching (msg_);
 }
@@ -223,10 +241,10 @@ bool zmq::dist_t::write (pipe_t *pipe_, msg_t *msg_)
     return true;
 }
 
-bool zmq::dist_t::check_hwm ()
+bool zmq::dist_t::check_hwm (bool hot_)
 {
     for (pipes_t::size_type i = 0; i < matching; ++i)
-        if (!pipes [i]->check_hwm ())
+        if (!pipes [i]->check_hwm (hot_))
             return false;
 
     return true;
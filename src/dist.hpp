@@ -56,6 +56,12 @@ namespace zmq
         //  Activates pipe that have previously reached high watermark.
         void activated (zmq::pipe_t *pipe_);
 
+        //  Before a hot message is matched, makes the pipes that wait for
+        //  room in their cold lane but have some in their hot lane active
+        //  again. A pipe whose cold lane is still full when the next cold
+        //  message comes is deactivated anew.
+        void activate_hot ();
+
         //  Mark the pipe as matching. Subsequent call to send_to_matching
         //  will send message also to this pipe.
         void match (zmq::pipe_t *pipe_);
@@ -77,8 +83,8 @@ namespace zmq
 
         bool has_out ();
 
-        // check HWM of all pipes matching
-        bool check_hwm ();
+        // check HWM of all pipes matching, in the hot lane if hot_
+        bool check_hwm (bool hot_ = false);
 
     private:
 
@@ -134,6 +134,57 @@ namespace zmq
             return pos;
         }
 
+        //  Encodes into the buffer (the encoder's own one if data_ points
+        //  to NULL) until the body of the message in progress is reached,
+        //  then hands the body out in body_ and body_size_ without copying.
+        //  If the buffer fills up first, body_ is left NULL and the rest of
+        //  the message goes through encode.
+        inline size_t encode_zerocopy (unsigned char **data_, size_t size_,
+            unsigned char **body_, size_t *body_size_)
+        {
+            unsigned char *buffer = !*data_ ? buf : *data_;
+            size_t buffersize = !*data_ ? bufsize : size_;
+
+            *body_ = NULL;
+            *body_size_ = 0;
+
+            if (in_progress == NULL)
+                return 0;
+
+            size_t pos = 0;
+            while (pos < buffersize) {
+                if (!to_write) {
+                    if (new_msg_flag) {
+                        int rc = in_progress->close ();
+                        errno_assert (rc == 0);
+                        rc = in_progress->init ();
+                        errno_assert (rc == 0);
+                        in_progress = NULL;
+                        break;
+                    }
+                    (static_cast <T*> (this)->*next) ();
+                }
+
+                if (write_pos == in_progress->data ()
+                 && to_write == in_progress->size ()) {
+                    *body_ = write_pos;
+                    *body_size_ = to_write;
+                    write_pos = NULL;
+                    to_write = 0;
+                    continue;
+                }
+
+                size_t to_copy = std::min (to_write, buffersize - pos);
+                memcpy (buffer + pos, write_pos, to_copy);
+                pos += to_copy;
+                write_pos += to_copy;
+                to_write -= to_copy;
+            }
+
+            *data_ = buffer;
+            return pos;
+        }
+
         void load_msg (msg_t *msg_)
         {
             zmq_assert (in_progress == NULL);
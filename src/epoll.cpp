@@ -32,6 +32,7 @@
 #if defined ZMQ_USE_EPOLL
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/syscall.h>
 #include <sys/prctl.h>
 #include <stdlib.h>
@@ -45,11 +46,24 @@
 #include "err.hpp"
 #include "config.hpp"
 #include "i_poll_events.hpp"
+#include "clock.hpp"
+
+#include "lwip/sockets.h"
+#include "lwip/netml_raw.h"
+#include "lwip/netml_trace.h"
+#include "zmqlwip.h"
 
 zmq::epoll_t::epoll_t (const zmq::ctx_t &ctx_, bool lwip) :
     ctx(ctx_),
     stopping (false),
-	maxfd (0)
+	maxfd (0),
+	wake_fd (retired_fd),
+	wake_time (0),
+	parks (0),
+	rtc (false),
+	rx_queue (-1),
+	lwip_busy (false),
+	raw_busy (false)
 {
 #ifdef ZMQ_USE_EPOLL_CLOEXEC
     //  Setting this option result in sane behaviour when exec() functions
@@ -61,6 +75,25 @@ zmq::epoll_t::epoll_t (const zmq::ctx_t &ctx_, bool lwip) :
 #endif
     errno_assert (epoll_fd != -1);
 	is_lwip = lwip;
+
+	spin_us = ctx.get (ZMQ_IO_SPIN_US);
+	memset (wake_hist, 0, sizeof wake_hist);
+	if (spin_us >= 0) {
+		wake_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+		errno_assert (wake_fd != -1);
+
+		//  A NULL entry tells handle_epoll this is the wake-up fd.
+		memset (&wake_ev, 0, sizeof wake_ev);
+		wake_ev.events = EPOLLIN;
+		wake_ev.data.ptr = NULL;
+		int rc = epoll_ctl (epoll_fd, EPOLL_CTL_ADD, wake_fd, &wake_ev);
+		errno_assert (rc != -1);
+	}
+
+	if (is_lwip && ctx.get (ZMQ_IO_RUN_TO_COMPLETION)) {
+		rtc = true;
+		rx_queue = zmq_lwip_rx_claim ();
+	}
 }
 
 zmq::epoll_t::~epoll_t ()
@@ -69,6 +102,11 @@ zmq::epoll_t::~epoll_t ()
     worker.stop ();
 //	lwip_worker.stop();
 
+	if (rx_queue >= 0)
+		zmq_lwip_rx_release (rx_queue);
+
+    if (wake_fd != retired_fd)
+		close (wake_fd);
     close (epoll_fd);
 //    for (retired_t::iterator it = retired.begin (); it != retired.end (); ++it) {
 //        LIBZMQ_DELETE(*it);
@@ -81,6 +119,10 @@ zmq::epoll_t::~epoll_t ()
 	for (lwip_entries_t::iterator it = lwip_entries.begin(); it != lwip_entries.end(); ++it) {
 		LIBZMQ_DELETE(*it);
 	}
+
+	for (lwip_entries_t::iterator it = raw_entries.begin(); it != raw_entries.end(); ++it) {
+		LIBZMQ_DELETE(*it);
+	}
 }
 
 zmq::epoll_t::handle_t zmq::epoll_t::add_fd (fd_t fd_, i_poll_events *events_)
@@ -126,6 +168,11 @@ zmq::epoll_t::handle_t zmq::epoll_t::add_fd_lwip (fd_t fd_, i_poll_events *event
 		maxfd = fd_ + 1;
 	fds_sync.unlock();
 
+	if (wake_fd != retired_fd || rtc) {
+		lwip_setwakeup (fd_, lwip_wakeup, this);
+		lwip_dirty.set (1);
+	}
+
     //  Increase the load metric of the thread.
     adjust_load (1);
 
@@ -158,12 +205,60 @@ zmq::epoll_t::find_entry_by_fd (lwip_entries_t &entries, fd_t fd)
 	return NULL;
 }
 
+zmq::epoll_t::handle_t zmq::epoll_t::add_raw_lwip (netml_raw *raw_,
+				i_poll_events *events_)
+{
+    poll_entry_t *pe = new (std::nothrow) poll_entry_t;
+    alloc_assert (pe);
+
+    memset (pe, 0, sizeof (poll_entry_t));
+
+    pe->fd = retired_fd;
+    pe->events = events_;
+    pe->raw = raw_;
+
+	raw_entries.push_back(pe);
+	netml_raw_setnotify (raw_, raw_wakeup, this);
+	raw_dirty.add (1);
+
+    //  Increase the load metric of the thread.
+    adjust_load (1);
+
+    return pe;
+}
+
+void zmq::epoll_t::rm_raw_lwip (poll_entry_t *pe_)
+{
+	netml_raw_setnotify (pe_->raw, NULL, NULL);
+	pe_->raw = NULL;
+
+	for (lwip_entries_t::iterator it = raw_entries.begin();
+					it != raw_entries.end(); it++) {
+		if (*it == pe_) {
+			raw_entries.erase(it);
+			break;
+		}
+	}
+
+    retired_sync.lock ();
+    retired.push_back (pe_);
+    retired_sync.unlock ();
+
+    //  Decrease the load metric of the thread.
+    adjust_load (-1);
+}
+
 void zmq::epoll_t::rm_fd_lwip (handle_t handle_)
 {
 	lwip_entries_t::iterator it;
 	fd_t fd;
 	poll_entry_t *pe = (poll_entry_t *)handle_;
 
+	if (pe->raw) {
+		rm_raw_lwip (pe);
+		return;
+	}
+
 	fds_sync.lock();
 
 	fd = pe->fd;
@@ -184,6 +279,9 @@ void zmq::epoll_t::rm_fd_lwip (handle_t handle_)
 
 	fds_sync.unlock();
 
+	if (wake_fd != retired_fd || rtc)
+		lwip_setwakeup (fd, NULL, NULL);
+
     retired_sync.lock ();
     retired.push_back (pe);
     retired_sync.unlock ();
@@ -204,9 +302,16 @@ void zmq::epoll_t::set_pollin_lwip (handle_t handle_)
 {
     poll_entry_t *pe = (poll_entry_t*) handle_;
 
+	if (pe->raw) {
+		pe->ev.events |= EPOLLIN;
+		raw_dirty.add (1);
+		return;
+	}
+
 	fds_sync.lock();
 	FD_SET(pe->fd, &fds_set.read);
 	fds_sync.unlock();
+	lwip_dirty.set (1);
 }
 
 void zmq::epoll_t::reset_pollin (handle_t handle_)
@@ -220,6 +325,12 @@ void zmq::epoll_t::reset_pollin (handle_t handle_)
 void zmq::epoll_t::reset_pollin_lwip (handle_t handle_)
 {
     poll_entry_t *pe = (poll_entry_t*) handle_;
+
+	if (pe->raw) {
+		pe->ev.events &= ~((short) EPOLLIN);
+		return;
+	}
+
 	fds_sync.lock();
 	FD_CLR(pe->fd, &fds_set.read);
 	fds_sync.unlock();
@@ -237,9 +348,16 @@ void zmq::epoll_t::set_pollout_lwip (handle_t handle_)
 {
     poll_entry_t *pe = (poll_entry_t*) handle_;
 
+	if (pe->raw) {
+		pe->ev.events |= EPOLLOUT;
+		raw_dirty.add (1);
+		return;
+	}
+
 	fds_sync.lock();
 	FD_SET(pe->fd, &fds_set.write);
 	fds_sync.unlock();
+	lwip_dirty.set (1);
 }
 
 void zmq::epoll_t::reset_pollout (handle_t handle_)
@@ -254,6 +372,11 @@ void zmq::epoll_t::reset_pollout_lwip (handle_t handle_)
 {
     poll_entry_t *pe = (poll_entry_t*) handle_;
 
+	if (pe->raw) {
+		pe->ev.events &= ~((short) EPOLLOUT);
+		return;
+	}
+
 	fds_sync.lock();
 	FD_CLR(pe->fd, &fds_set.write);
 	fds_sync.unlock();
@@ -261,7 +384,7 @@ void zmq::epoll_t::reset_pollout_lwip (handle_t handle_)
 
 void zmq::epoll_t::start ()
 {
-    ctx.start_thread (worker, worker_routine, this);
+    ctx.start_thread (worker, worker_routine, this, cpus);
 
 //	if (is_lwip)
 //		ctx.start_thread(lwip_worker, lwip_routine, this);
@@ -277,20 +400,38 @@ int zmq::epoll_t::max_fds ()
     return -1;
 }
 
-void zmq::epoll_t::handle_epoll()
+void zmq::epoll_t::add_stats (io_stats_t *stats_) const
+{
+	if (rx_queue >= 0)
+		stats_->rx_queues++;
+	stats_->parks += __atomic_load_n (&parks, __ATOMIC_RELAXED);
+	for (int i = 0; i < io_stats_t::wake_buckets; i++)
+		stats_->wakeups [i] +=
+			__atomic_load_n (&wake_hist [i], __ATOMIC_RELAXED);
+}
+
+int zmq::epoll_t::handle_epoll(int timeout_)
 {
 	int n = 0;
 	epoll_event ev_buf[max_io_events];
 
-	n = epoll_wait(epoll_fd, ev_buf, max_io_events, 0);
+	n = epoll_wait(epoll_fd, ev_buf, max_io_events, timeout_);
 	if (n == -1) {
 		errno_assert(errno == EINTR);
-		return;
+		return 0;
 	}
 
     for (int i = 0; i < n; i ++) {
         struct poll_entry_t *pe = ((poll_entry_t*) ev_buf [i].data.ptr);
 
+        if (!pe) {
+			//  Woken up by lwip_wakeup, the lwIP sockets are checked by
+			//  the caller.
+			uint64_t cnt;
+			ssize_t sz = read (wake_fd, &cnt, sizeof cnt);
+			errno_assert (sz == sizeof cnt || errno == EAGAIN);
+			continue;
+		}
         if (pe->fd == retired_fd)
   			continue;
         if (ev_buf [i].events & (EPOLLERR | EPOLLHUP)) {
@@ -307,12 +448,13 @@ void zmq::epoll_t::handle_epoll()
             pe->events->in_event ();
 		}
     }
+	return n;
 }
 
-void zmq::epoll_t::handle_lwip()
+int zmq::epoll_t::handle_lwip()
 {
 	if (lwip_entries.empty())
-		return;
+		return 0;
 
 	struct fd_ev {
 		struct poll_entry_t *pe;
@@ -341,11 +483,11 @@ void zmq::epoll_t::handle_lwip()
 	if (rc == -1) {
 		errno_assert(errno == EINTR);
 		fds_sync.unlock();
-		return;
+		return 0;
 	}
 	if (rc == 0) {
 		fds_sync.unlock();
-		return;
+		return 0;
 	}
 
 	for (unsigned i = 0; i < lwip_entries.size(); i++) {
@@ -362,8 +504,7 @@ void zmq::epoll_t::handle_lwip()
 			events[n].pe = entry;
 			n++;
 			if (n == max_io_events) {
-				fprintf(stdout, "[%s][%d]: exceed max event limit\n",
-								__FILE__, __LINE__);
+				NETML_TRACE (ZMQ, POLL_OVERFLOW, 0, 0, n, 0, this);
 				break;
 			}
 		}
@@ -372,8 +513,7 @@ void zmq::epoll_t::handle_lwip()
 			events[n].pe = entry;
 			n++;
 			if (n == max_io_events) {
-				fprintf(stdout, "[%s][%d]: exceed max event limit\n",
-								__FILE__, __LINE__);
+				NETML_TRACE (ZMQ, POLL_OVERFLOW, 0, 0, n, 0, this);
 				break;
 			}
 		}
@@ -382,8 +522,7 @@ void zmq::epoll_t::handle_lwip()
 			events[n].pe = entry;
 			n++;
 			if (n == max_io_events) {
-				fprintf(stdout, "[%s][%d]: exceed max event limit\n",
-								__FILE__, __LINE__);
+				NETML_TRACE (ZMQ, POLL_OVERFLOW, 0, 0, n, 0, this);
 				break;
 			}
 		}
@@ -400,19 +539,174 @@ void zmq::epoll_t::handle_lwip()
 		else
 			ev->pe->events->out_event();
 	}
+	return n;
+}
+
+int zmq::epoll_t::handle_raw()
+{
+	struct raw_ev {
+		poll_entry_t *pe;
+		int ready;
+	};
+
+	struct raw_ev events[max_io_events];
+	int n = 0;
+
+	//  Consume the pending notifications before sampling the state. The
+	//  locked decrement orders the two, so a notification that comes in
+	//  meanwhile stays pending for the next round.
+	atomic_counter_t::integer_t dirty = raw_dirty.get ();
+	if (dirty)
+		raw_dirty.sub (dirty);
+
+	for (unsigned i = 0; i < raw_entries.size(); i++) {
+		poll_entry_t *entry = raw_entries[i];
+		int ready = netml_raw_events (entry->raw);
+
+		if (!(entry->ev.events & EPOLLIN))
+			ready &= ~NETML_RAW_IN;
+		if (!(entry->ev.events & EPOLLOUT))
+			ready &= ~NETML_RAW_OUT;
+		if (!ready)
+			continue;
+
+		events[n].pe = entry;
+		events[n].ready = ready;
+		n++;
+		if (n == max_io_events) {
+			NETML_TRACE (ZMQ, POLL_OVERFLOW, 0, 0, n, 0, this);
+			break;
+		}
+	}
+
+	//  Entries removed by an earlier event have raw reset.
+	for (int i = 0; i < n; i++) {
+		struct raw_ev *ev = &events[i];
+
+		if (ev->ready & (NETML_RAW_IN | NETML_RAW_ERR)) {
+			if (!ev->pe->raw)
+				continue;
+			ev->pe->events->in_event();
+		}
+		if (ev->ready & NETML_RAW_OUT) {
+			if (!ev->pe->raw)
+				continue;
+			ev->pe->events->out_event();
+		}
+	}
+	return n;
+}
+
+void zmq::epoll_t::park ()
+{
+	//  Announce the thread is about to block before looking at the lwIP
+	//  sockets for the last time. An event signalled after that look sees
+	//  the flag and writes wake_fd, so it cannot get lost. Both sides go
+	//  through a locked instruction (the counter here, SYS_ARCH_PROTECT in
+	//  event_callback), which orders the flag against the socket state.
+	parked.add (1);
+	wake_time = 0;
+
+	if ((!is_lwip || handle_lwip () == 0) && handle_raw () == 0) {
+		int timeout = (int) execute_timers ();
+		__atomic_store_n (&parks, parks + 1, __ATOMIC_RELAXED);
+		handle_epoll (timeout ? timeout : -1);
+
+		uint64_t woken = wake_time;
+		if (woken) {
+			uint64_t now = clock_t::now_us ();
+			uint64_t latency = now > woken ? now - woken : 0;
+			int bucket = 0;
+			while (latency && bucket < io_stats_t::wake_buckets - 1) {
+				latency >>= 1;
+				bucket++;
+			}
+			__atomic_store_n (&wake_hist [bucket], wake_hist [bucket] + 1,
+				__ATOMIC_RELAXED);
+		}
+	}
+
+	parked.sub (1);
+}
+
+void zmq::epoll_t::lwip_wakeup (void *arg_)
+{
+	epoll_t *self = (epoll_t *) arg_;
+
+	//  A plain store is enough, the scan that clears the flag reads the
+	//  socket state under SYS_ARCH_PROTECT afterwards.
+	self->lwip_dirty.set (1);
+	self->wake ();
+}
+
+void zmq::epoll_t::raw_wakeup (void *arg_)
+{
+	epoll_t *self = (epoll_t *) arg_;
+
+	//  Locked, so the connection state written before is visible to the
+	//  scan and the read of parked in wake cannot move ahead of it.
+	self->raw_dirty.add (1);
+	self->wake ();
+}
+
+void zmq::epoll_t::wake ()
+{
+	if (!parked.get ())
+		return;
+
+	if (!wake_time)
+		wake_time = clock_t::now_us ();
+	uint64_t one = 1;
+	ssize_t sz = write (wake_fd, &one, sizeof one);
+	errno_assert (sz == sizeof one);
 }
 
 void zmq::epoll_t::loop_epoll ()
 {
+	//  When the thread ran out of work (now_us), 0 while busy.
+	uint64_t idle_since = 0;
+
     while (!stopping) {
 
-        //  Execute any due timers.
-//        int timeout = (int) execute_timers ();
+        //  Execute any due timers. The time to the next timer only matters
+        //  once the thread parks.
+        execute_timers ();
+
+		int n = handle_epoll(0);
+
+		//  In run-to-completion mode the packets of the claimed queue go
+		//  through tcp_input right here, and the readiness they cause is
+		//  dispatched below without leaving the thread.
+		if (rx_queue >= 0)
+			n += zmq_lwip_rx_poll (rx_queue);
+
+		if (is_lwip && !rtc)
+			n += handle_lwip();
+		else if (rtc && (lwip_busy || lwip_dirty.get ())) {
+			lwip_dirty.set (0);
+			int events = handle_lwip();
+			lwip_busy = events > 0;
+			n += events;
+		}
 
-		handle_epoll();
+		if (raw_busy || raw_dirty.get ()) {
+			int events = handle_raw();
+			raw_busy = events > 0;
+			n += events;
+		}
 
-		if (is_lwip)
-			handle_lwip();
+		//  A thread owning an RX queue has to keep polling it.
+		if (n || spin_us < 0 || rx_queue >= 0)
+			idle_since = 0;
+		else {
+			uint64_t now = clock_t::now_us ();
+			if (!idle_since)
+				idle_since = now;
+			if (now - idle_since >= (uint64_t) spin_us) {
+				park ();
+				idle_since = 0;
+			}
+		}
 
         //  Destroy retired event sources.
         retired_sync.lock ();
@@ -42,6 +42,9 @@
 #include "thread.hpp"
 #include "poller_base.hpp"
 #include "mutex.hpp"
+#include "atomic_counter.hpp"
+
+struct netml_raw;
 
 namespace zmq
 {
@@ -72,7 +75,13 @@ namespace zmq
 
         static int max_fds ();
 
+        //  Adds the counters of this thread to stats_. They may be read
+        //  from any thread.
+        void add_stats (io_stats_t *stats_) const;
+
 		handle_t add_fd_lwip (fd_t fd_, zmq::i_poll_events *events_);
+		handle_t add_raw_lwip (struct netml_raw *raw_,
+						zmq::i_poll_events *events_);
         void rm_fd_lwip (handle_t handle_);
         void set_pollin_lwip (handle_t handle_);
         void reset_pollin_lwip (handle_t handle_);
@@ -101,6 +110,9 @@ namespace zmq
             fd_t fd;
             epoll_event ev;
             zmq::i_poll_events *events;
+            //  Raw lwIP connection (fd is retired_fd then), interest is
+            //  kept in ev.events.
+            struct netml_raw *raw;
         };
 
         //  List of retired event sources.
@@ -149,8 +161,57 @@ namespace zmq
 		static poll_entry_t *
 				find_entry_by_fd (lwip_entries_t &entries, fd_t fd);
 
-		void handle_epoll();
-		void handle_lwip();
+		//  All return the number of events dispatched.
+		int handle_epoll(int timeout_);
+		int handle_lwip();
+		int handle_raw();
+
+		void rm_raw_lwip (poll_entry_t *pe_);
+
+		//  Block until a socket, the mailbox or a timer needs attention.
+		void park ();
+
+		//  Installed on every lwIP socket, see lwip_setwakeup.
+		static void lwip_wakeup (void *arg_);
+
+		//  Installed on every raw connection, see netml_raw_setnotify.
+		static void raw_wakeup (void *arg_);
+
+		//  Signal wake_fd if the thread is parked.
+		void wake ();
+
+		//  Microseconds to keep polling without events before parking,
+		//  -1 to never park (ZMQ_IO_SPIN_US).
+		int spin_us;
+
+		//  Signalled by lwip_wakeup while the thread is parked.
+		fd_t wake_fd;
+		epoll_event wake_ev;
+		atomic_counter_t parked;
+
+		//  When the pending wake-up was signalled (now_us), 0 if none.
+		volatile uint64_t wake_time;
+
+		//  Wake-up latency histogram, see io_stats_t. Only this thread
+		//  writes it.
+		uint64_t wake_hist [io_stats_t::wake_buckets];
+		uint64_t parks;
+
+		//  Run-to-completion mode (ZMQ_IO_RUN_TO_COMPLETION). The thread
+		//  polls the NIC queue it claimed (-1 if none was left) and only
+		//  scans its lwIP sockets when lwip_wakeup reported an event or
+		//  the previous scan found some.
+		bool rtc;
+		int rx_queue;
+		atomic_counter_t lwip_dirty;
+		bool lwip_busy;
+
+		//  Raw connections are only touched by the I/O thread, so they
+		//  need no lock. They are scanned the same way as lwIP sockets in
+		//  run-to-completion mode.
+		lwip_entries_t raw_entries;
+		atomic_counter_t raw_dirty;
+		bool raw_busy;
 
         epoll_t (const epoll_t&);
         const epoll_t &operator = (const epoll_t&);
@@ -0,0 +1,354 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "precompiled.hpp"
+#include "group.hpp"
+#include "socket_base.hpp"
+#include "reduce.hpp"
+#include "tensor.hpp"
+#include "msg_pool.hpp"
+#include "config.hpp"
+#include "likely.hpp"
+#include "err.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+zmq::group_t::group_t (socket_base_t *socket_, const uint16_t *remote_ids_,
+      int size_, int rank_, int algo_) :
+    tag (0xcafe6a11),
+    socket (socket_),
+    remote_ids (remote_ids_, remote_ids_ + size_),
+    size (size_),
+    rank (rank_),
+    algo (algo_),
+    seq (0),
+    tree (false),
+    buf (NULL),
+    count (0),
+    dtype (0),
+    op (0),
+    esize (0),
+    chunk (0),
+    max_chunks (0),
+    completed (0),
+    expected (0)
+{
+}
+
+zmq::group_t::~group_t ()
+{
+    while (!out.empty ()) {
+        int rc = out.front ().close ();
+        errno_assert (rc == 0);
+        out.pop_front ();
+    }
+    while (!early.empty ()) {
+        int rc = early.front ().close ();
+        errno_assert (rc == 0);
+        early.pop_front ();
+    }
+    tag = 0xdeadbeef;
+}
+
+bool zmq::group_t::check_tag ()
+{
+    return tag == 0xcafe6a11;
+}
+
+int zmq::group_t::allreduce (void *buf_, size_t count_, int dtype_, int op_)
+{
+    if (!reduce_supported (dtype_, op_) || (count_ && !buf_) ||
+          count_ > UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (size == 1 || count_ == 0)
+        return 0;
+
+    seq++;
+    buf = static_cast <unsigned char *> (buf_);
+    count = count_;
+    dtype = dtype_;
+    op = op_;
+    esize = tensor_dtype_size ((uint8_t) dtype_);
+    chunk = std::max ((size_t) allreduce_chunk_size / esize, (size_t) 1);
+    tree = algo == ZMQ_ALLREDUCE_TREE || (algo == ZMQ_ALLREDUCE_AUTO &&
+        count_ * esize < (size_t) allreduce_tree_size);
+    completed = 0;
+    expected = 0;
+
+    if (tree)
+        tree_start ();
+    else
+        ring_start ();
+
+    //  What peers sent ahead of time goes first.
+    std::deque <msg_t> ahead;
+    ahead.swap (early);
+    int rc = 0;
+    while (!ahead.empty ()) {
+        if (rc == 0)
+            rc = deliver (&ahead.front ());
+        int rc2 = ahead.front ().close ();
+        errno_assert (rc2 == 0);
+        ahead.pop_front ();
+    }
+    if (rc != 0)
+        return -1;
+
+    return run ();
+}
+
+void zmq::group_t::segment (int i_, size_t &begin_, size_t &end_) const
+{
+    begin_ = count * i_ / size;
+    end_ = count * (i_ + 1) / size;
+}
+
+size_t zmq::group_t::chunk_len (size_t begin_, size_t end_, size_t c_) const
+{
+    return std::min (chunk, end_ - begin_ - c_ * chunk);
+}
+
+void zmq::group_t::ring_start ()
+{
+    //  Step s goes from 0 to 2 * size - 3. In step s every peer sends
+    //  segment rank - s to its right and receives segment rank - s - 1
+    //  from its left, reducing it in the first size - 1 steps and taking
+    //  it as it is in the rest. The segment received in a step is the
+    //  one sent in the next, piece by piece as soon as a piece is in.
+    max_chunks = (count / size + 1 + chunk - 1) / chunk;
+    received.assign ((size_t) (2 * size - 2) * max_chunks, 0);
+    for (int s = 0; s != 2 * size - 2; s++) {
+        size_t begin, end;
+        segment (((rank - s - 1) % size + size) % size, begin, end);
+        expected += (end - begin + chunk - 1) / chunk;
+    }
+
+    size_t begin, end;
+    segment (rank, begin, end);
+    for (size_t c = 0; c * chunk < end - begin; c++)
+        post ((rank + 1) % size, 0, begin + c * chunk,
+            chunk_len (begin, end, c));
+}
+
+int zmq::group_t::ring_input (uint16_t step_, size_t offset_, size_t count_,
+    const unsigned char *data_)
+{
+    size_t begin, end;
+    segment (((rank - step_ - 1) % size + size) % size, begin, end);
+    if (step_ >= 2 * size - 2 || offset_ < begin || offset_ + count_ > end) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    unsigned char *dst = buf + offset_ * esize;
+    if (step_ < size - 1)
+        reduce (dst, data_, count_, dtype, op);
+    else
+        memcpy (dst, data_, count_ * esize);
+
+    size_t c = (offset_ - begin) / chunk;
+    size_t len = chunk_len (begin, end, c);
+    size_t &got = received [step_ * max_chunks + c];
+    got += count_;
+    if (got > len) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (got == len) {
+        completed++;
+        if (step_ + 1 < 2 * size - 2)
+            post ((rank + 1) % size, step_ + 1, begin + c * chunk, len);
+    }
+    return 0;
+}
+
+void zmq::group_t::tree_start ()
+{
+    //  A binary tree rooted at rank 0. Step 0 carries partial sums up,
+    //  step 1 the result down, piece by piece: a peer sends a piece up
+    //  once it has it from all its children, the root turns it around.
+    max_chunks = (count + chunk - 1) / chunk;
+    received.assign (2 * max_chunks, 0);
+    expected = max_chunks;
+
+    bool leaf = 2 * rank + 1 >= size;
+    if (leaf)
+        for (size_t c = 0; c != max_chunks; c++)
+            post ((rank - 1) / 2, 0, c * chunk, chunk_len (0, count, c));
+}
+
+int zmq::group_t::tree_input (uint16_t step_, size_t offset_, size_t count_,
+    const unsigned char *data_)
+{
+    if (step_ > 1 || offset_ + count_ > count) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    int children = (2 * rank + 1 < size) + (2 * rank + 2 < size);
+    size_t c = offset_ / chunk;
+    size_t len = chunk_len (0, count, c);
+    size_t &got = received [step_ * max_chunks + c];
+    unsigned char *dst = buf + offset_ * esize;
+
+    if (step_ == 0)
+        reduce (dst, data_, count_, dtype, op);
+    else
+        memcpy (dst, data_, count_ * esize);
+    got += count_;
+
+    size_t want = step_ == 0 ? children * len : len;
+    if (got > want) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (got < want)
+        return 0;
+
+    //  The piece is complete, up to the parent or down to the children.
+    if (step_ == 0 && rank != 0) {
+        post ((rank - 1) / 2, 0, c * chunk, len);
+        return 0;
+    }
+    for (int child = 2 * rank + 1; child <= 2 * rank + 2; child++)
+        if (child < size)
+            post (child, 1, c * chunk, len);
+    completed++;
+    return 0;
+}
+
+void zmq::group_t::post (int peer_, uint16_t step_, size_t offset_,
+    size_t count_)
+{
+    zmq_tensor_hdr_t hdr;
+    memset (&hdr, 0, sizeof hdr);
+    hdr.key = ((uint64_t) seq << 32) | ((uint64_t) step_ << 16) |
+        (uint16_t) rank;
+    hdr.dtype = (uint8_t) dtype;
+    hdr.count = (uint32_t) count_;
+    hdr.offset = (uint32_t) offset_;
+
+    const size_t len = count_ * esize;
+    unsigned char *data =
+        static_cast <unsigned char *> (pool_alloc (sizeof hdr + len));
+    alloc_assert (data);
+    memcpy (data, &hdr, sizeof hdr);
+    memcpy (data + sizeof hdr, buf + offset_ * esize, len);
+
+    out.push_back (msg_t ());
+    int rc = out.back ().init_data (data, sizeof hdr + len, call_pool_free,
+        NULL, remote_ids [peer_]);
+    errno_assert (rc == 0);
+}
+
+int zmq::group_t::flush ()
+{
+    while (!out.empty ()) {
+        if (socket->send (&out.front (), ZMQ_KEY | ZMQ_DONTWAIT) != 0)
+            return errno == EAGAIN ? 0 : -1;
+        out.pop_front ();
+    }
+    return 0;
+}
+
+int zmq::group_t::deliver (msg_t *msg_)
+{
+    //  Anything but the pieces of collectives is not for the group.
+    zmq_tensor_hdr_t hdr;
+    if (!(msg_->flags () & msg_t::netml_key) || msg_->size () < sizeof hdr)
+        return 0;
+    memcpy (&hdr, msg_->data (), sizeof hdr);
+
+    uint32_t piece_seq = (uint32_t) (hdr.key >> 32);
+    if (piece_seq == seq + 1) {
+        early.push_back (msg_t ());
+        int rc = early.back ().init ();
+        errno_assert (rc == 0);
+        rc = early.back ().move (*msg_);
+        errno_assert (rc == 0);
+        return 0;
+    }
+    if (piece_seq != seq)
+        return 0;
+
+    if (hdr.dtype != dtype ||
+          msg_->size () != sizeof hdr + (size_t) hdr.count * esize) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    uint16_t step = (uint16_t) (hdr.key >> 16);
+    const unsigned char *data =
+        static_cast <unsigned char *> (msg_->data ()) + sizeof hdr;
+    return tree ? tree_input (step, hdr.offset, hdr.count, data) :
+        ring_input (step, hdr.offset, hdr.count, data);
+}
+
+int zmq::group_t::run ()
+{
+    while (true) {
+        if (flush () != 0)
+            return -1;
+        if (completed == expected && out.empty ())
+            return 0;
+
+        msg_t msg;
+        int rc = msg.init ();
+        errno_assert (rc == 0);
+        rc = socket->recv (&msg, ZMQ_DONTWAIT);
+        if (rc == 0) {
+            rc = deliver (&msg);
+            int rc2 = msg.close ();
+            errno_assert (rc2 == 0);
+            if (rc != 0)
+                return -1;
+            continue;
+        }
+        const int err = errno;
+        rc = msg.close ();
+        errno_assert (rc == 0);
+        if (err != EAGAIN) {
+            errno = err;
+            return -1;
+        }
+
+        //  Nothing to take, wait for either direction of the stack.
+        zmq_pollitem_t item;
+        item.socket = socket;
+        item.fd = 0;
+        item.events = (short) (ZMQ_POLLIN | (out.empty () ? 0 : ZMQ_POLLOUT));
+        item.revents = 0;
+        if (zmq_poll (&item, 1, -1) < 0)
+            return -1;
+    }
+}
@@ -0,0 +1,138 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __ZMQ_GROUP_HPP_INCLUDED__
+#define __ZMQ_GROUP_HPP_INCLUDED__
+
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+#include "stdint.hpp"
+#include "msg.hpp"
+
+namespace zmq
+{
+
+    class socket_base_t;
+
+    //  Peers running collectives together. All of them reach one another
+    //  over one socket each, peer i at remote ID remote_ids [i], the way
+    //  the remotes of a NetML connection do. The pieces of a collective
+    //  are keyed messages: the key holds the sequence number of the
+    //  collective, its step and the sender, the offset says where the
+    //  elements go.
+
+    class group_t
+    {
+    public:
+
+        group_t (socket_base_t *socket_, const uint16_t *remote_ids_,
+            int size_, int rank_, int algo_);
+        ~group_t ();
+
+        bool check_tag ();
+
+        //  Replaces the count_ elements in buf_ by their reduction over
+        //  all peers, which all call it with the same count_, dtype_ and
+        //  op_. Blocks until done.
+        int allreduce (void *buf_, size_t count_, int dtype_, int op_);
+
+    private:
+
+        //  Sends the first pieces of the algorithm.
+        void ring_start ();
+        void tree_start ();
+
+        //  Takes the count_ elements at data_ for offset_ received in
+        //  step_, sends on what it completes.
+        int ring_input (uint16_t step_, size_t offset_, size_t count_,
+            const unsigned char *data_);
+        int tree_input (uint16_t step_, size_t offset_, size_t count_,
+            const unsigned char *data_);
+
+        //  Queues the elements [offset_, offset_ + count_) of the buffer
+        //  for peer_ as a piece of step_.
+        void post (int peer_, uint16_t step_, size_t offset_, size_t count_);
+
+        //  Hands the queued pieces to the socket for as far as it takes
+        //  them. Returns -1 on an error other than EAGAIN.
+        int flush ();
+
+        //  Checks a received message and feeds it to the algorithm.
+        //  Pieces of the next collective are kept for it.
+        int deliver (msg_t *msg_);
+
+        //  Sends and receives until the collective is complete.
+        int run ();
+
+        //  Elements [begin_, end_) of ring segment i_.
+        void segment (int i_, size_t &begin_, size_t &end_) const;
+
+        //  Length of piece c_ of the elements [begin_, end_).
+        size_t chunk_len (size_t begin_, size_t end_, size_t c_) const;
+
+        uint32_t tag;
+
+        socket_base_t *socket;
+        std::vector <uint16_t> remote_ids;
+        int size;
+        int rank;
+        int algo;
+
+        //  Number of the current collective.
+        uint32_t seq;
+
+        //  Pieces waiting for room in the socket.
+        std::deque <msg_t> out;
+
+        //  Pieces of the next collective, received ahead of it.
+        std::deque <msg_t> early;
+
+        //  The current collective.
+        bool tree;
+        unsigned char *buf;
+        size_t count;
+        int dtype;
+        int op;
+        size_t esize;
+        size_t chunk;
+        size_t max_chunks;
+        std::vector <size_t> received;
+        size_t completed;
+        size_t expected;
+
+        group_t (const group_t&);
+        const group_t &operator = (const group_t&);
+    };
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __ZMQ_HALF_HPP_INCLUDED__
+#define __ZMQ_HALF_HPP_INCLUDED__
+
+#include <string.h>
+
+#include "stdint.hpp"
+
+namespace zmq
+{
+
+    //  Conversions between single precision and the 16-bit floats of
+    //  ZMQ_DTYPE_F16 (IEEE half) and ZMQ_DTYPE_BF16. Both round to nearest
+    //  even.
+
+    inline float half_to_float (uint16_t h_)
+    {
+        uint32_t sign = (uint32_t) (h_ & 0x8000) << 16;
+        uint32_t exp = (h_ >> 10) & 0x1f;
+        uint32_t mant = h_ & 0x3ff;
+        uint32_t bits;
+
+        if (exp == 0x1f)
+            bits = sign | 0x7f800000 | (mant << 13);
+        else
+        if (exp != 0)
+            bits = sign | ((exp + 112) << 23) | (mant << 13);
+        else
+        if (mant == 0)
+            bits = sign;
+        else {
+            //  Subnormal, normalised in single precision.
+            exp = 113;
+            while (!(mant & 0x400)) {
+                mant <<= 1;
+                exp--;
+            }
+            bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+        }
+
+        float f;
+        memcpy (&f, &bits, sizeof f);
+        return f;
+    }
+
+    inline uint16_t float_to_half (float f_)
+    {
+        uint32_t bits;
+        memcpy (&bits, &f_, sizeof bits);
+        uint16_t sign = (uint16_t) ((bits >> 16) & 0x8000);
+        int32_t exp = (int32_t) ((bits >> 23) & 0xff) - 112;
+        uint32_t mant = bits & 0x7fffff;
+
+        if (((bits >> 23) & 0xff) == 0xff)
+            return sign | 0x7c00 | (mant ? 0x200 : 0);
+        if (exp >= 0x1f)
+            return sign | 0x7c00;
+        if (exp <= 0) {
+            //  Subnormal or zero, rounded to nearest even.
+            if (exp < -10)
+                return sign;
+            mant |= 0x800000;
+            uint32_t shift = (uint32_t) (14 - exp);
+            uint32_t half = mant >> shift;
+            uint32_t rest = mant & ((1u << shift) - 1);
+            uint32_t mid = 1u << (shift - 1);
+            if (rest > mid || (rest == mid && (half & 1)))
+                half++;
+            return sign | (uint16_t) half;
+        }
+
+        //  Rounded to nearest even, a carry out of the mantissa bumps the
+        //  exponent as it should.
+        uint32_t half = ((uint32_t) exp << 10) | (mant >> 13);
+        uint32_t rest = mant & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            half++;
+        return sign | (uint16_t) half;
+    }
+
+    inline float bf16_to_float (uint16_t h_)
+    {
+        uint32_t bits = (uint32_t) h_ << 16;
+        float f;
+        memcpy (&f, &bits, sizeof f);
+        return f;
+    }
+
+    inline uint16_t float_to_bf16 (float f_)
+    {
+        uint32_t bits;
+        memcpy (&bits, &f_, sizeof bits);
+        if ((bits & 0x7fffffff) > 0x7f800000)
+            return (uint16_t) ((bits >> 16) | 0x40);
+        bits += 0x7fff + ((bits >> 16) & 1);
+        return (uint16_t) (bits >> 16);
+    }
+
+}
+
+#endif
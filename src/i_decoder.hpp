@@ -32,6 +32,8 @@
 
 #include "stdint.hpp"
 
+struct pbuf;
+
 namespace zmq
 {
 
@@ -56,6 +58,11 @@ namespace zmq
 
         virtual msg_t *msg () = 0;
 
+        //  Announces that the data passed to the following decode calls
+        //  lives in the payload of the lwIP pbuf p_ (NULL when it does not).
+        //  Decoders that can reference the pbuf instead of copying out of
+        //  it override this.
+        virtual void set_pbuf (struct pbuf *p_) { (void) p_; }
 
     };
 
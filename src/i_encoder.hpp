@@ -50,6 +50,13 @@ namespace zmq
         //  Function returns 0 when a new message is required.
         virtual size_t encode (unsigned char **data_, size_t size) = 0;
 
+        //  Same as encode, but stops at the body of the message in progress
+        //  and returns it by reference in body_/body_size_ instead of
+        //  copying it. The caller must hold its own reference to the
+        //  message, the encoder releases it once the body is handed out.
+        virtual size_t encode_zerocopy (unsigned char **data_, size_t size,
+            unsigned char **body_, size_t *body_size_) = 0;
+
         //  Load a new message into encoder.
         virtual void load_msg (msg_t *msg_) = 0;
 
@@ -96,6 +96,11 @@ zmq::io_object_t::handle_t zmq::io_object_t::add_fd_lwip (fd_t fd_)
     return poller->add_fd_lwip (fd_, this);
 }
 
+zmq::io_object_t::handle_t zmq::io_object_t::add_raw_lwip (netml_raw *raw_)
+{
+    return poller->add_raw_lwip (raw_, this);
+}
+
 void zmq::io_object_t::rm_fd_lwip (handle_t handle_)
 {
     poller->rm_fd_lwip (handle_);
@@ -131,6 +136,11 @@ void zmq::io_object_t::cancel_timer (int id_)
     poller->cancel_timer (this, id_);
 }
 
+void zmq::io_object_t::account_traffic (size_t bytes_, size_t packets_)
+{
+    poller->account_traffic (bytes_, packets_);
+}
+
 void zmq::io_object_t::in_event ()
 {
     zmq_assert (false);
@@ -36,6 +36,8 @@
 #include "poller.hpp"
 #include "i_poll_events.hpp"
 
+struct netml_raw;
+
 namespace zmq
 {
 
@@ -72,12 +74,16 @@ namespace zmq
         void cancel_timer (int id_);
 
         handle_t add_fd_lwip (fd_t fd_);
+        handle_t add_raw_lwip (struct netml_raw *raw_);
         void rm_fd_lwip (handle_t handle_);
         void set_pollin_lwip (handle_t handle_);
         void reset_pollin_lwip (handle_t handle_);
         void set_pollout_lwip (handle_t handle_);
         void reset_pollout_lwip (handle_t handle_);
 
+        //  Records traffic handled by the object with the poller.
+        void account_traffic (size_t bytes_, size_t packets_);
+
         //  i_poll_events interface implementation.
         void in_event ();
         void out_event ();
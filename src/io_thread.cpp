@@ -32,12 +32,15 @@
 #include <new>
 
 #include "macros.hpp"
+#include "likely.hpp"
 #include "io_thread.hpp"
 #include "err.hpp"
 #include "ctx.hpp"
+#include "stream_engine.hpp"
 
 zmq::io_thread_t::io_thread_t (ctx_t *ctx_, uint32_t tid_) :
-    object_t (ctx_, tid_)
+    object_t (ctx_, tid_),
+    balance_ivl (ctx_->get (ZMQ_IO_MIGRATE_IVL))
 {
     poller = new (std::nothrow) poller_t (*ctx_, true);
     alloc_assert (poller);
@@ -45,6 +48,9 @@ zmq::io_thread_t::io_thread_t (ctx_t *ctx_, uint32_t tid_) :
     mailbox_handle = poller->add_fd (mailbox.get_fd (), this);
     poller->set_pollin (mailbox_handle);
 
+    if (balance_ivl > 0)
+        poller->add_timer (balance_ivl, this, balance_timer_id);
+
 }
 
 zmq::io_thread_t::~io_thread_t ()
@@ -53,9 +59,10 @@ zmq::io_thread_t::~io_thread_t ()
 }
 
 
-void zmq::io_thread_t::start ()
+void zmq::io_thread_t::start (const std::set <int> &cpus_)
 {
     //  Start the underlying I/O thread.
+    poller->set_cpus (cpus_);
     poller->start ();
 }
 
@@ -74,6 +81,31 @@ int zmq::io_thread_t::get_load ()
     return poller->get_load ();
 }
 
+uint32_t zmq::io_thread_t::get_traffic ()
+{
+    return poller->get_traffic ();
+}
+
+void zmq::io_thread_t::register_engine (stream_engine_t *engine_)
+{
+    engines.push_back (engine_);
+}
+
+void zmq::io_thread_t::unregister_engine (stream_engine_t *engine_)
+{
+    for (engines_t::iterator it = engines.begin (); it != engines.end (); ++it)
+        if (*it == engine_) {
+            engines.erase (it);
+            return;
+        }
+}
+
+void zmq::io_thread_t::hand_over (stream_engine_t *engine_,
+    io_thread_t *target_)
+{
+    send_migrate (target_, engine_);
+}
+
 void zmq::io_thread_t::in_event ()
 {
     //  TODO: Do we want to limit number of commands I/O thread can
@@ -83,8 +115,15 @@ void zmq::io_thread_t::in_event ()
     int rc = mailbox.recv (&cmd, 0);
 
     while (rc == 0 || errno == EINTR) {
-        if (rc == 0)
-            cmd.destination->process_command (cmd);
+        if (rc == 0) {
+            //  Commands for objects that have moved to another thread
+            //  still come in here, pass them on in order.
+            const uint32_t host = cmd.destination->get_host_tid ();
+            if (unlikely (host != get_tid ()))
+                get_ctx ()->send_command (host, cmd);
+            else
+                cmd.destination->process_command (cmd);
+        }
         rc = mailbox.recv (&cmd, 0);
     }
 
@@ -97,10 +136,46 @@ void zmq::io_thread_t::out_event ()
     zmq_assert (false);
 }
 
-void zmq::io_thread_t::timer_event (int)
+void zmq::io_thread_t::timer_event (int id_)
 {
-    //  No timers here. This function is never called.
-    zmq_assert (false);
+    zmq_assert (id_ == balance_timer_id);
+    balance ();
+    poller->add_timer (balance_ivl, this, balance_timer_id);
+}
+
+void zmq::io_thread_t::balance ()
+{
+    const uint64_t traffic = get_traffic ();
+    stream_engine_t *engine = NULL;
+    io_thread_t *target = NULL;
+    uint64_t engine_traffic = 0;
+
+    for (engines_t::size_type i = 0; i != engines.size (); i++) {
+        //  Traffic of the engine since the last round, in KB per second.
+        const uint64_t cost = engines [i]->take_traffic () * 1000 /
+            balance_ivl / 1024;
+        if (cost <= engine_traffic || !engines [i]->can_migrate ())
+            continue;
+
+        io_thread_t *candidate =
+            choose_io_thread (engines [i]->get_affinity ());
+        if (candidate == this)
+            continue;
+        const uint64_t other = candidate->get_traffic ();
+
+        //  Only give away traffic to a thread carrying less than half as
+        //  much, and no more than half the difference, otherwise the hot
+        //  spot would just move along with the engine.
+        if (traffic < 2 * other || cost > (traffic - other) / 2)
+            continue;
+
+        engine = engines [i];
+        target = candidate;
+        engine_traffic = cost;
+    }
+
+    if (engine)
+        engine->migrate (target);
 }
 
 zmq::poller_t *zmq::io_thread_t::get_poller ()
@@ -109,8 +184,15 @@ zmq::poller_t *zmq::io_thread_t::get_poller ()
     return poller;
 }
 
+void zmq::io_thread_t::process_migrate (stream_engine_t *engine_)
+{
+    engine_->replug (this);
+}
+
 void zmq::io_thread_t::process_stop ()
 {
+    if (balance_ivl > 0)
+        poller->cancel_timer (this, balance_timer_id);
     poller->rm_fd (mailbox_handle);
     poller->stop ();
 
@@ -42,6 +42,7 @@ namespace zmq
 {
 
     class ctx_t;
+    class stream_engine_t;
 
     //  Generic part of the I/O thread. Polling-mechanism-specific features
     //  are implemented in separate "polling objects".
@@ -56,8 +57,9 @@ namespace zmq
         //  before invoking destructor. Otherwise the destructor would hang up.
         ~io_thread_t ();
 
-        //  Launch the physical thread.
-        void start ();
+        //  Launch the physical thread on cpus_. If empty, the context-wide
+        //  thread affinity applies.
+        void start (const std::set <int> &cpus_);
 
         //  Ask underlying thread to stop.
         void stop ();
@@ -75,10 +77,24 @@ namespace zmq
 
         //  Command handlers.
         void process_stop ();
+        void process_migrate (zmq::stream_engine_t *engine_);
 
         //  Returns load experienced by the I/O thread.
         int get_load ();
 
+        //  Returns traffic handled by the I/O thread, in KB per second.
+        uint32_t get_traffic ();
+
+        //  Engines plugged to the thread register here, so that an
+        //  overloaded thread can pick one to hand over.
+        void register_engine (zmq::stream_engine_t *engine_);
+        void unregister_engine (zmq::stream_engine_t *engine_);
+
+        //  Passes engine_, already unplugged from this thread, on to
+        //  target_ which plugs it back in.
+        void hand_over (zmq::stream_engine_t *engine_,
+            zmq::io_thread_t *target_);
+
     private:
 
         //  I/O thread accesses incoming commands via this mailbox.
@@ -90,6 +106,19 @@ namespace zmq
         //  I/O multiplexing is performed using a poller object.
         poller_t *poller;
 
+        //  Looks for an engine to move to a less loaded thread.
+        void balance ();
+
+        enum {balance_timer_id = 0x50};
+
+        //  How often the thread checks its traffic against the other
+        //  threads (ZMQ_IO_MIGRATE_IVL), in milliseconds. 0 if it never
+        //  hands engines over.
+        int balance_ivl;
+
+        typedef std::vector <zmq::stream_engine_t *> engines_t;
+        engines_t engines;
+
         io_thread_t (const io_thread_t&);
         const io_thread_t &operator = (const io_thread_t&);
     };
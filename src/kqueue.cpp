@@ -157,7 +157,7 @@ void zmq::kqueue_t::reset_pollout (handle_t handle_)
 
 void zmq::kqueue_t::start ()
 {
-    ctx.start_thread (worker, worker_routine, this);
+    ctx.start_thread (worker, worker_routine, this, cpus);
 }
 
 void zmq::kqueue_t::stop ()
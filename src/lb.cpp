@@ -37,6 +37,9 @@ zmq::lb_t::lb_t () :
     active (0),
     current (0),
     more (false),
+    hot (false),
+    hot_pipe (NULL),
+    hot_current (0),
     dropping (false)
 {
 }
@@ -58,8 +61,10 @@ void zmq::lb_t::pipe_terminated (pipe_t *pipe_)
 
     //  If we are in the middle of multipart message and current pipe
     //  have disconnected, we have to drop the remainder of the message.
-    if (index == current && more)
+    if (more && (hot ? pipe_ == hot_pipe : index == current))
         dropping = true;
+    if (pipe_ == hot_pipe)
+        hot_pipe = NULL;
 
     //  Remove the pipe from the list; adjust number of active pipes
     //  accordingly.
@@ -100,6 +105,9 @@ int zmq::lb_t::sendpipe (msg_t *msg_, pipe_t **pipe_)
         return 0;
     }
 
+    if (more ? hot : (msg_->flags () & msg_t::netml_hotdata) != 0)
+        return send_hot (msg_, pipe_);
+
     while (active > 0) {
         if (pipes [current]->write (msg_))
         {
@@ -149,6 +157,60 @@ int zmq::lb_t::sendpipe (msg_t *msg_, pipe_t **pipe_)
     return 0;
 }
 
+int zmq::lb_t::send_hot (msg_t *msg_, pipe_t **pipe_)
+{
+    //  The first frame goes to the next pipe with room in its hot lane,
+    //  active or not. The other frames follow it.
+    if (!more) {
+        hot_pipe = NULL;
+        for (pipes_t::size_type n = 0; n != pipes.size (); n++) {
+            pipe_t *pipe = pipes [(hot_current + n) % pipes.size ()];
+            if (pipe->check_hwm (true)) {
+                hot_pipe = pipe;
+                hot_current = (hot_current + n + 1) % pipes.size ();
+                break;
+            }
+        }
+        if (!hot_pipe) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    if (!hot_pipe->write (msg_)) {
+        //  The pipe wants write_activated now, which it may only get
+        //  while it is not among the active ones.
+        pipes_t::size_type index = pipes.index (hot_pipe);
+        if (more)
+            hot_pipe->rollback ();
+        if (index < active) {
+            active--;
+            pipes.swap (index, active);
+            if (current == active)
+                current = 0;
+        }
+        more = false;
+        hot = false;
+        hot_pipe = NULL;
+        errno = EAGAIN;
+        return -1;
+    }
+
+    if (pipe_)
+        *pipe_ = hot_pipe;
+
+    more = msg_->flags () & msg_t::more ? true : false;
+    hot = more;
+    if (!more)
+        hot_pipe->flush ();
+
+    //  Detach the message from the data buffer.
+    int rc = msg_->init ();
+    errno_assert (rc == 0);
+
+    return 0;
+}
+
 bool zmq::lb_t::has_out ()
 {
     //  If one part of the message was already written we can definitely
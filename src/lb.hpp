@@ -62,6 +62,10 @@ namespace zmq
 
     private:
 
+        //  Sends a hot message. Those have a lane of their own in each pipe,
+        //  so they may go to a pipe whose cold lane is full.
+        int send_hot (msg_t *msg_, pipe_t **pipe_);
+
         //  List of outbound pipes.
         typedef array_t <pipe_t, 2> pipes_t;
         pipes_t pipes;
@@ -76,6 +80,14 @@ namespace zmq
         //  True if last we are in the middle of a multipart message.
         bool more;
 
+        //  True if that message is a hot one, which goes to hot_pipe
+        //  rather than to the current pipe.
+        bool hot;
+        pipe_t *hot_pipe;
+
+        //  Where the search for a pipe for the next hot message starts.
+        pipes_t::size_type hot_current;
+
         //  True if we are dropping current message.
         bool dropping;
 
@@ -1,4 +1,6 @@
 #include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
 
 #include "lwipopts.h"
 #include "lwip/init.h"
@@ -15,7 +17,11 @@
 #include "lwip/netif.h"
 #include "netif/etharp.h"
 #include "netif/dpdkif.h"
+#include "netif/netml_switch.h"
+#include "lwip/netml_trace.h"
 #include "zmqlwip.h"
+#include "../include/zmq.h"
+#include "numa.hpp"
 
 /* Host IP configuration */
 static ip4_addr_t ipaddr, netmask, gateway;
@@ -24,6 +30,9 @@ static struct netif netdev;
 
 static unsigned is_init = 0;
 
+/* Switch emulator port 0 is plugged into, see zmq_lwip_switch_init */
+static struct netml_switch *netml_sw = NULL;
+
 
 static void
 lwip_port_init(void *arg)
@@ -47,10 +56,28 @@ int zmq_lwip_init(const char *ip, const char *gw, const char *mask) {
 
 	int ret = 0;
 
+	/* Without explicit lcores, keep EAL on the first two CPUs of the NIC's
+	 * node rather than on CPUs 0 and 1 */
+	if (dpdk_get_cpus(NULL, 0) == 0) {
+		std::set<int> cpus = zmq::numa_node_cpus(dpdk_probe_numa_node());
+		if (cpus.size() >= 2) {
+			std::set<int>::iterator it = cpus.begin();
+			int lcores[2];
+			lcores[0] = *it++;
+			lcores[1] = *it;
+			dpdk_set_cpus(lcores, 2);
+		}
+	}
+
 	ret = init_dpdk();
 	if (ret < 0)
 		return -1;
 
+	if (netml_sw != NULL && netml_switch_start(netml_sw) < 0) {
+		fprintf(stderr, "Failed to start the switch emulator\n");
+		return -1;
+	}
+
 	/* convert ip address */
 	if (!ip4addr_aton(ip, &ipaddr)) {
 		fprintf(stderr, "Failed to convert IPv4 address %s\n", ip);
@@ -85,3 +112,251 @@ int zmq_lwip_init(const char *ip, const char *gw, const char *mask) {
 
 	return 0;
 }
+
+int zmq_lwip_add_neighbor(const char *ip, const char *mac) {
+
+	ip4_addr_t addr;
+	struct eth_addr ethaddr;
+	unsigned int m[ETH_HWADDR_LEN];
+	err_t err;
+
+	if (!is_init) {
+		fprintf(stderr, "[%s][%d]: lwip is not initialized\n",
+						__FILE__, __LINE__);
+		return -1;
+	}
+
+	if (!ip4addr_aton(ip, &addr)) {
+		fprintf(stderr, "Failed to convert IPv4 address %s\n", ip);
+		return -1;
+	}
+
+	if (sscanf(mac, "%x:%x:%x:%x:%x:%x",
+				&m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != ETH_HWADDR_LEN) {
+		fprintf(stderr, "Failed to convert MAC address %s\n", mac);
+		return -1;
+	}
+	for (int i = 0; i < ETH_HWADDR_LEN; i++)
+		ethaddr.addr[i] = (u8_t)m[i];
+
+	LOCK_TCPIP_CORE();
+	err = etharp_add_neighbor(&addr, &ethaddr);
+	UNLOCK_TCPIP_CORE();
+
+	if (err != ERR_OK) {
+		fprintf(stderr, "[%s][%d]: Failed (%d) to add neighbor %s,%s\n",
+						__FILE__, __LINE__, err, ip, mac);
+		return -1;
+	}
+	return 0;
+}
+
+/* One neighbor per line: "<ipv4> <mac>". Blank lines and lines starting
+ * with '#' are skipped. Returns the number of neighbors added. */
+int zmq_lwip_load_neighbors(const char *path) {
+
+	FILE *fp = NULL;
+	char line[256], ip[64], mac[64];
+	int lineno = 0, count = 0;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "Failed to open neighbor file %s\n", path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		if (sscanf(line, " %63s", ip) != 1 || ip[0] == '#')
+			continue;
+		if (sscanf(line, "%63s %63s", ip, mac) != 2) {
+			fprintf(stderr, "[%s][%d]: %s:%d: malformed neighbor entry\n",
+							__FILE__, __LINE__, path, lineno);
+			fclose(fp);
+			return -1;
+		}
+		if (zmq_lwip_add_neighbor(ip, mac) < 0) {
+			fclose(fp);
+			return -1;
+		}
+		count++;
+	}
+
+	fclose(fp);
+	fprintf(stdout, "Loaded %d neighbors from %s\n", count, path);
+	return count;
+}
+
+int zmq_lwip_set_rx_queues(int queues) {
+
+	if (is_init || queues <= 0 || queues > UINT16_MAX
+			|| dpdk_set_rx_queues((uint16_t)queues) < 0) {
+		fprintf(stderr, "[%s][%d]: cannot use %d RX queues\n",
+						__FILE__, __LINE__, queues);
+		return -1;
+	}
+	return 0;
+}
+
+int zmq_lwip_rx_claim(void) {
+
+	if (!is_init)
+		return -1;
+	return dpdk_claim_rx_queue();
+}
+
+void zmq_lwip_rx_release(int queue) {
+
+	dpdk_release_rx_queue(queue);
+}
+
+int zmq_lwip_rx_poll(int queue) {
+
+	return dpdk_poll_rx_queue(queue);
+}
+
+int zmq_lwip_set_cpus(const int *cpus, int count) {
+
+	if (is_init || cpus == NULL || dpdk_set_cpus(cpus, count) < 0) {
+		fprintf(stderr, "[%s][%d]: cannot run DPDK on %d CPUs\n",
+						__FILE__, __LINE__, count);
+		return -1;
+	}
+	return 0;
+}
+
+int zmq_lwip_get_cpus(int *cpus, int max) {
+
+	if (!is_init)
+		return 0;
+	return dpdk_get_cpus(cpus, max);
+}
+
+int zmq_lwip_numa_node(void) {
+
+	if (!is_init)
+		return dpdk_probe_numa_node();
+	return dpdk_numa_node();
+}
+
+int zmq_lwip_register_memory(void *addr, size_t len) {
+
+	if (!is_init) {
+		errno = EINVAL;
+		return -1;
+	}
+	return dpdk_register_memory(addr, len);
+}
+
+int zmq_lwip_unregister_memory(void *addr) {
+
+	if (!is_init) {
+		errno = EINVAL;
+		return -1;
+	}
+	return dpdk_unregister_memory(addr);
+}
+
+int zmq_lwip_memory_registered(const void *ptr, size_t len) {
+
+	return is_init && dpdk_memory_registered(ptr, len);
+}
+
+int zmq_lwip_trace_dump(const char *path) {
+
+	//  Works before init too, the rings belong to the threads.
+	return netml_trace_dump(path);
+}
+
+int zmq_lwip_switch_init(int slots, int workers, int timeout) {
+
+	struct netml_switch_config config;
+
+	if (is_init || netml_sw != NULL || slots <= 0 || workers <= 0
+			|| workers > NETML_SWITCH_MAX_WORKERS || timeout <= 0) {
+		fprintf(stderr, "[%s][%d]: cannot set up a switch of %d slots "
+						"for %d workers\n", __FILE__, __LINE__, slots, workers);
+		errno = EINVAL;
+		return -1;
+	}
+
+	config.slots = (u32_t)slots;
+	config.workers = (u16_t)workers;
+	config.timeout = (u32_t)timeout;
+	netml_sw = netml_switch_new(&config);
+	if (netml_sw == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	if (dpdk_attach_switch(netml_sw) < 0) {
+		netml_switch_free(netml_sw);
+		netml_sw = NULL;
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+int zmq_lwip_switch_add_host(const char *ip, const char *mask) {
+
+	ip4_addr_t addr, netmask, gw;
+	struct netif *netif;
+
+	if (!is_init || netml_sw == NULL) {
+		fprintf(stderr, "[%s][%d]: no switch to add a host to\n",
+						__FILE__, __LINE__);
+		errno = EINVAL;
+		return -1;
+	}
+	if (!ip4addr_aton(ip, &addr) || !ip4addr_aton(mask, &netmask)) {
+		fprintf(stderr, "Failed to convert IPv4 address %s/%s\n", ip, mask);
+		errno = EINVAL;
+		return -1;
+	}
+	ip4_addr_set_zero(&gw);
+
+	//  Hosts stay for the life of the process, like the stack.
+	netif = (struct netif *)calloc(1, sizeof(struct netif));
+	if (netif == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	LOCK_TCPIP_CORE();
+	if (netif_add(netif, &addr, &netmask, &gw, netml_sw,
+				netml_switch_netif_init, tcpip_input) == NULL) {
+		UNLOCK_TCPIP_CORE();
+		free(netif);
+		fprintf(stderr, "[%s][%d]: Failed to add host %s\n",
+						__FILE__, __LINE__, ip);
+		errno = ENOSPC;
+		return -1;
+	}
+	netif_set_up(netif);
+	UNLOCK_TCPIP_CORE();
+	return 0;
+}
+
+int zmq_lwip_switch_stats(struct zmq_switch_stats_t *stats) {
+
+	struct netml_switch_stats s;
+
+	if (netml_sw == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	netml_switch_get_stats(netml_sw, &s);
+	stats->frames = s.frames;
+	stats->forwarded = s.forwarded;
+	stats->flooded = s.flooded;
+	stats->hot = s.hot;
+	stats->summed = s.summed;
+	stats->complete = s.complete;
+	stats->partial = s.partial;
+	stats->cold = s.cold;
+	stats->collisions = s.collisions;
+	stats->acks = s.acks;
+	stats->resent = s.resent;
+	stats->dropped = s.dropped;
+	return 0;
+}
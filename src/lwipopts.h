@@ -238,6 +238,12 @@
 
 #define ETHARP_SUPPORT_STATIC_ENTRIES	1
 
+/**
+ * LWIP_NETIF_HWADDRHINT==1: Cache the resolved link-layer address per pcb
+ * (also used for the NetML neighbor table).
+ */
+#define LWIP_NETIF_HWADDRHINT           1
+
 /*
    --------------------------------
    ---------- IP options ----------
@@ -496,4 +502,15 @@ void sys_unlock_tcpip_core(void);
 #endif
 #endif
 
+/*
+   ---------------------------------------
+   ---------- Hook options ---------------
+   ---------------------------------------
+*/
+
+/* Hosts plugged into the NetML switch emulator are netifs of this one
+ * stack: a packet has to leave through the netif of its source address */
+#define LWIP_HOOK_FILENAME              "netif/netml_switch.h"
+#define LWIP_HOOK_IP4_ROUTE_SRC(src, dest) netml_switch_route_src(src, dest)
+
 #endif /* LWIP_LWIPOPTS_H */
@@ -78,8 +78,9 @@ const char *zmq::mechanism_t::socket_type_string (int socket_type) const
                                    "XPUB", "XSUB", "STREAM",
                                    "SERVER", "CLIENT",
                                    "RADIO", "DISH",
-                                   "GATHER", "SCATTER", "DGRAM"};
-    zmq_assert (socket_type >= 0 && socket_type <= 18);
+                                   "GATHER", "SCATTER", "DGRAM",
+                                   "AGGREGATOR"};
+    zmq_assert (socket_type >= 0 && socket_type <= 19);
     return names [socket_type];
 }
 
@@ -247,7 +248,8 @@ bool zmq::mechanism_t::check_socket_type (const std::string& type_) const
         case ZMQ_REP:
             return type_ == "REQ" || type_ == "DEALER";
         case ZMQ_DEALER:
-            return type_ == "REP" || type_ == "DEALER" || type_ == "ROUTER";
+            return type_ == "REP" || type_ == "DEALER" || type_ == "ROUTER" ||
+                type_ == "AGGREGATOR";
         case ZMQ_ROUTER:
             return type_ == "REQ" || type_ == "DEALER" || type_ == "ROUTER";
         case ZMQ_PUSH:
@@ -278,6 +280,8 @@ bool zmq::mechanism_t::check_socket_type (const std::string& type_) const
             return type_ == "GATHER";
         case ZMQ_DGRAM:
             return type_ == "DGRAM";
+        case ZMQ_AGGREGATOR:
+            return type_ == "DEALER";
         default:
             break;
     }
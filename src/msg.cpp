@@ -39,6 +39,7 @@
 #include "likely.hpp"
 #include "metadata.hpp"
 #include "err.hpp"
+#include "msg_pool.hpp"
 
 //  Check whether the sizes of public representation of the message (zmq_msg_t)
 //  and private representation of the message (zmq::msg_t) match.
@@ -107,7 +108,7 @@ int zmq::msg_t::init_size (size_t size_)
         u.lmsg.routing_id = 0;
         u.lmsg.content = NULL;
         if (sizeof (content_t) + size_ > size_)
-            u.lmsg.content = (content_t*) malloc (sizeof (content_t) + size_);
+            u.lmsg.content = (content_t*) pool_alloc (sizeof (content_t) + size_);
         if (unlikely (!u.lmsg.content)) {
             errno = ENOMEM;
             return -1;
@@ -170,7 +171,7 @@ int zmq::msg_t::init_data (void *data_, size_t size_,
         u.lmsg.group[0] = '\0';
         u.lmsg.routing_id = 0;
 		u.lmsg.remote_id = id_;
-        u.lmsg.content = (content_t*) malloc (sizeof (content_t));
+        u.lmsg.content = (content_t*) pool_alloc (sizeof (content_t));
         if (!u.lmsg.content) {
             errno = ENOMEM;
             return -1;
@@ -238,7 +239,7 @@ int zmq::msg_t::close ()
             if (u.lmsg.content->ffn)
                 u.lmsg.content->ffn (u.lmsg.content->data,
                     u.lmsg.content->hint);
-            xfree (u.lmsg.content);
+            pool_free (u.lmsg.content);
         }
     }
 
@@ -504,7 +505,7 @@ bool zmq::msg_t::rm_refs (int refs_)
 
         if (u.lmsg.content->ffn)
             u.lmsg.content->ffn (u.lmsg.content->data, u.lmsg.content->hint);
-        xfree (u.lmsg.content);
+        pool_free (u.lmsg.content);
 
         return false;
     }
@@ -551,6 +552,21 @@ uint32_t zmq::msg_t::get_remote_id ()
 	return UINT16_MAX;
 }
 
+int zmq::msg_t::set_remote_id (uint16_t id_)
+{
+	//  Only messages with external content have room for one.
+	if (u.base.type == type_lmsg) {
+		u.lmsg.remote_id = id_;
+		return 0;
+	}
+	if (u.base.type == type_cmsg) {
+		u.cmsg.remote_id = id_;
+		return 0;
+	}
+	errno = EINVAL;
+	return -1;
+}
+
 const char * zmq::msg_t::group ()
 {
     return u.base.group;
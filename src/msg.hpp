@@ -124,6 +124,7 @@ namespace zmq
         int set_routing_id (uint32_t routing_id_);
         int reset_routing_id ();
 		uint32_t get_remote_id ();
+		int set_remote_id (uint16_t id_);
         const char * group ();
         int set_group (const char* group_);
         int set_group (const char*, size_t length);
@@ -0,0 +1,288 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "precompiled.hpp"
+#include "macros.hpp"
+#include "msg_pool.hpp"
+#include "config.hpp"
+#include "err.hpp"
+#include "likely.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+namespace
+{
+    struct cache_t;
+
+    //  Sits in front of every block.
+    struct header_t
+    {
+        //  NULL for blocks from malloc directly.
+        cache_t *owner;
+        size_t size_class;
+    };
+
+    //  Free blocks are linked through their body.
+    struct free_block_t
+    {
+        free_block_t *next;
+    };
+
+    struct class_stats_t
+    {
+        uint64_t allocs;
+        uint64_t frees;
+        uint64_t remote_frees;
+        uint64_t misses;
+        uint64_t cached;
+    };
+
+    struct cache_t
+    {
+        //  Touched by the owning thread only.
+        free_block_t *free [zmq::pool_classes];
+
+        //  Pushed to by the other threads.
+        free_block_t *returned [zmq::pool_classes];
+
+        //  Written by the owning thread, read by pool_stats.
+        class_stats_t stats [zmq::pool_classes];
+
+        //  All the caches, and those whose thread has exited.
+        cache_t *next;
+        cache_t *next_idle;
+    };
+
+    pthread_mutex_t caches_sync = PTHREAD_MUTEX_INITIALIZER;
+    cache_t *caches = NULL;
+    cache_t *idle_caches = NULL;
+
+    pthread_once_t key_once = PTHREAD_ONCE_INIT;
+    pthread_key_t key;
+
+    __thread cache_t *thread_cache = NULL;
+
+    size_t class_size (size_t class_)
+    {
+        return (size_t) 64 << class_;
+    }
+
+    size_t size_class (size_t size_)
+    {
+        size_t c = 0;
+        while (c != zmq::pool_classes && class_size (c) < size_)
+            c++;
+        return c;
+    }
+
+    //  The counters are only ever written by one thread at a time.
+    void bump (uint64_t &counter_, uint64_t by_ = 1)
+    {
+        __atomic_store_n (&counter_, counter_ + by_, __ATOMIC_RELAXED);
+    }
+
+    void release (free_block_t *list_)
+    {
+        while (list_) {
+            free_block_t *next = list_->next;
+            free ((header_t *) list_ - 1);
+            list_ = next;
+        }
+    }
+
+    //  Runs when a thread that has a cache exits. Its blocks go back to
+    //  malloc, the cache itself waits for the next thread. Blocks still in
+    //  use elsewhere keep pointing to it.
+    void retire_cache (void *cache_)
+    {
+        cache_t *cache = (cache_t *) cache_;
+        thread_cache = NULL;
+
+        for (size_t c = 0; c != zmq::pool_classes; c++) {
+            release (cache->free [c]);
+            cache->free [c] = NULL;
+            release (__atomic_exchange_n (&cache->returned [c], NULL,
+                __ATOMIC_ACQUIRE));
+            __atomic_store_n (&cache->stats [c].cached, 0, __ATOMIC_RELAXED);
+        }
+
+        pthread_mutex_lock (&caches_sync);
+        cache->next_idle = idle_caches;
+        idle_caches = cache;
+        pthread_mutex_unlock (&caches_sync);
+    }
+
+    void create_key ()
+    {
+        int rc = pthread_key_create (&key, retire_cache);
+        posix_assert (rc);
+    }
+
+    cache_t *get_cache ()
+    {
+        if (likely (thread_cache != NULL))
+            return thread_cache;
+
+        pthread_once (&key_once, create_key);
+
+        pthread_mutex_lock (&caches_sync);
+        cache_t *cache = idle_caches;
+        if (cache)
+            idle_caches = cache->next_idle;
+        else {
+            cache = (cache_t *) calloc (1, sizeof (cache_t));
+            if (cache) {
+                cache->next = caches;
+                caches = cache;
+            }
+        }
+        pthread_mutex_unlock (&caches_sync);
+
+        if (cache && pthread_setspecific (key, cache) == 0)
+            thread_cache = cache;
+        return thread_cache;
+    }
+}
+
+void *zmq::pool_alloc (size_t size_)
+{
+    size_t c = size_class (size_);
+    cache_t *cache = c == pool_classes ? NULL : get_cache ();
+
+    if (unlikely (!cache)) {
+        if (size_ + sizeof (header_t) < size_)
+            return NULL;
+        header_t *header = (header_t *) malloc (sizeof (header_t) + size_);
+        if (!header)
+            return NULL;
+        header->owner = NULL;
+        header->size_class = pool_classes;
+        return header + 1;
+    }
+
+    class_stats_t &stats = cache->stats [c];
+    free_block_t *block = cache->free [c];
+    if (!block) {
+        //  Take over what the other threads have given back meanwhile.
+        block = __atomic_exchange_n (&cache->returned [c], NULL,
+            __ATOMIC_ACQUIRE);
+        uint64_t n = 0;
+        for (free_block_t *b = block; b; b = b->next)
+            n++;
+        bump (stats.remote_frees, n);
+        bump (stats.cached, n);
+    }
+
+    header_t *header;
+    if (block) {
+        cache->free [c] = block->next;
+        bump (stats.cached, (uint64_t) -1);
+        header = (header_t *) block - 1;
+    }
+    else {
+        header = (header_t *) malloc (sizeof (header_t) + class_size (c));
+        if (!header)
+            return NULL;
+        header->owner = cache;
+        header->size_class = c;
+        bump (stats.misses);
+    }
+    bump (stats.allocs);
+    return header + 1;
+}
+
+void zmq::pool_free (void *ptr_)
+{
+    if (!ptr_)
+        return;
+
+    header_t *header = (header_t *) ptr_ - 1;
+    cache_t *owner = header->owner;
+    if (!owner) {
+        free (header);
+        return;
+    }
+
+    size_t c = header->size_class;
+    free_block_t *block = (free_block_t *) ptr_;
+
+    if (owner == thread_cache) {
+        class_stats_t &stats = owner->stats [c];
+        bump (stats.frees);
+        if (stats.cached >= msg_pool_cache_size / class_size (c)) {
+            free (header);
+            return;
+        }
+        block->next = owner->free [c];
+        owner->free [c] = block;
+        bump (stats.cached);
+        return;
+    }
+
+    //  Hand it back to the thread that allocated it. Only that thread
+    //  takes the list, all at once, so there is no ABA to worry about.
+    block->next = __atomic_load_n (&owner->returned [c], __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n (&owner->returned [c], &block->next,
+          block, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+}
+
+void zmq::call_pool_free (void *data_, void *)
+{
+    pool_free (data_);
+}
+
+int zmq::pool_stats (int class_, pool_stats_t *stats_)
+{
+    if (class_ < -1 || class_ >= (int) pool_classes)
+        return -1;
+
+    memset (stats_, 0, sizeof (pool_stats_t));
+    if (class_ >= 0)
+        stats_->size = class_size (class_);
+
+    pthread_mutex_lock (&caches_sync);
+    for (cache_t *cache = caches; cache; cache = cache->next)
+        for (size_t c = 0; c != pool_classes; c++) {
+            if (class_ >= 0 && c != (size_t) class_)
+                continue;
+            class_stats_t &stats = cache->stats [c];
+            stats_->allocs += __atomic_load_n (&stats.allocs, __ATOMIC_RELAXED);
+            stats_->frees += __atomic_load_n (&stats.frees, __ATOMIC_RELAXED);
+            stats_->remote_frees +=
+                __atomic_load_n (&stats.remote_frees, __ATOMIC_RELAXED);
+            stats_->misses += __atomic_load_n (&stats.misses, __ATOMIC_RELAXED);
+            stats_->cached += __atomic_load_n (&stats.cached, __ATOMIC_RELAXED);
+        }
+    pthread_mutex_unlock (&caches_sync);
+
+    return 0;
+}
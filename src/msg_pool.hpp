@@ -0,0 +1,73 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ZMQ_MSG_POOL_HPP_INCLUDED__
+#define __ZMQ_MSG_POOL_HPP_INCLUDED__
+
+#include <stddef.h>
+
+#include "stdint.hpp"
+
+namespace zmq
+{
+
+    //  Memory for message contents. Every thread keeps the blocks it frees
+    //  in a cache of its own, one free list per size class, so that the
+    //  next message of that size does not go to malloc. A block freed by
+    //  another thread goes back to the cache of the thread that allocated
+    //  it, through a list that thread takes over when its own runs dry.
+    //  Blocks larger than the largest class come from malloc directly.
+
+    //  Number of size classes, from 64 bytes up in powers of two.
+    enum { pool_classes = 11 };
+
+    void *pool_alloc (size_t size_);
+    void pool_free (void *ptr_);
+
+    //  pool_free as the deallocation function of msg_t::init_data.
+    void call_pool_free (void *data_, void *hint_);
+
+    struct pool_stats_t
+    {
+        size_t size;
+        uint64_t allocs;
+        uint64_t frees;
+        uint64_t remote_frees;
+        uint64_t misses;
+        uint64_t cached;
+    };
+
+    //  Sums the counters of all the threads for size class class_, or for
+    //  all the classes if class_ is -1. Returns -1 for a class that does
+    //  not exist.
+    int pool_stats (int class_, pool_stats_t *stats_);
+
+}
+
+#endif
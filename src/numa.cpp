@@ -0,0 +1,132 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "precompiled.hpp"
+#include "macros.hpp"
+#include "numa.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined ZMQ_HAVE_LINUX
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+int zmq::numa_node_of_cpu (int cpu_)
+{
+#if defined ZMQ_HAVE_LINUX
+    char path [64];
+    snprintf (path, sizeof path, "/sys/devices/system/cpu/cpu%d", cpu_);
+
+    //  The CPU's directory holds a nodeN link to its node.
+    DIR *dir = opendir (path);
+    if (!dir)
+        return -1;
+    int node = -1;
+    struct dirent *entry;
+    while ((entry = readdir (dir)) != NULL)
+        if (strncmp (entry->d_name, "node", 4) == 0 &&
+              sscanf (entry->d_name + 4, "%d", &node) == 1)
+            break;
+    closedir (dir);
+    return node;
+#else
+    LIBZMQ_UNUSED (cpu_);
+    return -1;
+#endif
+}
+
+std::set <int> zmq::numa_node_cpus (int node_)
+{
+    std::set <int> cpus;
+#if defined ZMQ_HAVE_LINUX
+    if (node_ < 0)
+        return cpus;
+
+    char path [64];
+    snprintf (path, sizeof path,
+        "/sys/devices/system/node/node%d/cpulist", node_);
+    FILE *fp = fopen (path, "r");
+    if (!fp)
+        return cpus;
+
+    //  The list looks like "0-7,16-23".
+    int first, last;
+    while (fscanf (fp, "%d", &first) == 1) {
+        last = first;
+        int c = fgetc (fp);
+        if (c == '-') {
+            if (fscanf (fp, "%d", &last) != 1)
+                break;
+            c = fgetc (fp);
+        }
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.insert (cpu);
+        if (c != ',')
+            break;
+    }
+    fclose (fp);
+
+    //  Pinning a thread to a CPU outside of the process' cpuset fails.
+    cpu_set_t allowed;
+    if (sched_getaffinity (0, sizeof allowed, &allowed) == 0) {
+        std::set <int>::iterator it = cpus.begin ();
+        while (it != cpus.end ())
+            if (*it >= CPU_SETSIZE || !CPU_ISSET (*it, &allowed))
+                cpus.erase (it++);
+            else
+                ++it;
+    }
+#else
+    LIBZMQ_UNUSED (node_);
+#endif
+    return cpus;
+}
+
+void zmq::numa_prefer_node (int node_)
+{
+#if defined ZMQ_HAVE_LINUX && defined SYS_set_mempolicy
+    //  Nodes beyond the mask are left alone, so are kernels without NUMA.
+    if (node_ < 0) {
+        syscall (SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+        return;
+    }
+    unsigned long mask = 1UL << node_;
+    if (node_ < (int) sizeof mask * 8 - 1)
+        syscall (SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof mask * 8);
+#else
+    LIBZMQ_UNUSED (node_);
+#endif
+}
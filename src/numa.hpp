@@ -0,0 +1,53 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ZMQ_NUMA_HPP_INCLUDED__
+#define __ZMQ_NUMA_HPP_INCLUDED__
+
+#include <set>
+
+namespace zmq
+{
+
+    //  NUMA topology as the kernel exposes it in sysfs. Where it is not
+    //  available the functions return -1, an empty set or do nothing.
+
+    //  Returns the NUMA node CPU cpu_ belongs to.
+    int numa_node_of_cpu (int cpu_);
+
+    //  Returns the CPUs of NUMA node node_ the process may run on.
+    std::set <int> numa_node_cpus (int node_);
+
+    //  Makes the calling thread take memory from node_ first from now on.
+    //  With node_ equal to -1 it goes back to the node it runs on.
+    void numa_prefer_node (int node_);
+
+}
+
+#endif
@@ -41,13 +41,15 @@
 
 zmq::object_t::object_t (ctx_t *ctx_, uint32_t tid_) :
     ctx (ctx_),
-    tid (tid_)
+    tid (tid_),
+    host_tid (tid_)
 {
 }
 
 zmq::object_t::object_t (object_t *parent_) :
     ctx (parent_->ctx),
-    tid (parent_->tid)
+    tid (parent_->tid),
+    host_tid (parent_->host_tid)
 {
 }
 
@@ -63,6 +65,17 @@ uint32_t zmq::object_t::get_tid ()
 void zmq::object_t::set_tid(uint32_t id)
 {
     tid = id;
+    host_tid = id;
+}
+
+uint32_t zmq::object_t::get_host_tid ()
+{
+    return host_tid;
+}
+
+void zmq::object_t::set_host_tid (uint32_t tid_)
+{
+    host_tid = tid_;
 }
 
 zmq::ctx_t *zmq::object_t::get_ctx ()
@@ -79,7 +92,8 @@ void zmq::object_t::process_command (command_t &cmd_)
         break;
 
     case command_t::activate_write:
-        process_activate_write (cmd_.args.activate_write.msgs_read);
+        process_activate_write (cmd_.args.activate_write.msgs_read,
+            cmd_.args.activate_write.hot_msgs_read);
         break;
 
     case command_t::stop:
@@ -107,7 +121,7 @@ void zmq::object_t::process_command (command_t &cmd_)
         break;
 
     case command_t::hiccup:
-        process_hiccup (cmd_.args.hiccup.pipe);
+        process_hiccup (cmd_.args.hiccup.pipe, cmd_.args.hiccup.hot_pipe);
         break;
 
     case command_t::pipe_term:
@@ -150,6 +164,10 @@ void zmq::object_t::process_command (command_t &cmd_)
         process_seqnum ();
         break;
 
+    case command_t::migrate:
+        process_migrate (cmd_.args.migrate.engine);
+        break;
+
     case command_t::done:
     default:
         zmq_assert (false);
@@ -265,21 +283,24 @@ void zmq::object_t::send_activate_read (pipe_t *destination_)
 }
 
 void zmq::object_t::send_activate_write (pipe_t *destination_,
-    uint64_t msgs_read_)
+    uint64_t msgs_read_, uint64_t hot_msgs_read_)
 {
     command_t cmd;
     cmd.destination = destination_;
     cmd.type = command_t::activate_write;
     cmd.args.activate_write.msgs_read = msgs_read_;
+    cmd.args.activate_write.hot_msgs_read = hot_msgs_read_;
     send_command (cmd);
 }
 
-void zmq::object_t::send_hiccup (pipe_t *destination_, void *pipe_)
+void zmq::object_t::send_hiccup (pipe_t *destination_, void *pipe_,
+    void *hot_pipe_)
 {
     command_t cmd;
     cmd.destination = destination_;
     cmd.type = command_t::hiccup;
     cmd.args.hiccup.pipe = pipe_;
+    cmd.args.hiccup.hot_pipe = hot_pipe_;
     send_command (cmd);
 }
 
@@ -379,6 +400,16 @@ void zmq::object_t::send_done ()
     ctx->send_command (ctx_t::term_tid, cmd);
 }
 
+void zmq::object_t::send_migrate (io_thread_t *destination_,
+    stream_engine_t *engine_)
+{
+    command_t cmd;
+    cmd.destination = destination_;
+    cmd.type = command_t::migrate;
+    cmd.args.migrate.engine = engine_;
+    send_command (cmd);
+}
+
 void zmq::object_t::process_stop ()
 {
     zmq_assert (false);
@@ -409,12 +440,12 @@ void zmq::object_t::process_activate_read ()
     zmq_assert (false);
 }
 
-void zmq::object_t::process_activate_write (uint64_t)
+void zmq::object_t::process_activate_write (uint64_t, uint64_t)
 {
     zmq_assert (false);
 }
 
-void zmq::object_t::process_hiccup (void *)
+void zmq::object_t::process_hiccup (void *, void *)
 {
     zmq_assert (false);
 }
@@ -464,6 +495,11 @@ void zmq::object_t::process_reaped ()
     zmq_assert (false);
 }
 
+void zmq::object_t::process_migrate (stream_engine_t *)
+{
+    zmq_assert (false);
+}
+
 void zmq::object_t::process_seqnum ()
 {
     zmq_assert (false);
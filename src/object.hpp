@@ -45,6 +45,7 @@ namespace zmq
     class socket_base_t;
     class session_base_t;
     class io_thread_t;
+    class stream_engine_t;
     class own_t;
 
     //  Base class for all objects that participate in inter-thread
@@ -60,6 +61,13 @@ namespace zmq
 
         uint32_t get_tid ();
         void set_tid(uint32_t id);
+
+        //  Thread the object runs in. It is the same as tid unless the
+        //  object has been moved to another I/O thread. Commands keep
+        //  being addressed to tid and are forwarded from there, so they
+        //  still arrive in order.
+        uint32_t get_host_tid ();
+        void set_host_tid (uint32_t tid_);
         ctx_t *get_ctx ();
         void process_command (zmq::command_t &cmd_);
         void send_inproc_connected (zmq::socket_base_t *socket_);
@@ -98,8 +106,9 @@ namespace zmq
              zmq::i_engine *engine_, bool inc_seqnum_ = true);
         void send_activate_read (zmq::pipe_t *destination_);
         void send_activate_write (zmq::pipe_t *destination_,
-             uint64_t msgs_read_);
-        void send_hiccup (zmq::pipe_t *destination_, void *pipe_);
+             uint64_t msgs_read_, uint64_t hot_msgs_read_);
+        void send_hiccup (zmq::pipe_t *destination_, void *pipe_,
+             void *hot_pipe_);
         void send_pipe_term (zmq::pipe_t *destination_);
         void send_pipe_term_ack (zmq::pipe_t *destination_);
         void send_pipe_hwm (zmq::pipe_t *destination_, int inhwm_, int outhwm_);
@@ -111,6 +120,8 @@ namespace zmq
         void send_reap (zmq::socket_base_t *socket_);
         void send_reaped ();
         void send_done ();
+        void send_migrate (zmq::io_thread_t *destination_,
+            zmq::stream_engine_t *engine_);
 
         //  These handlers can be overridden by the derived objects. They are
         //  called when command arrives from another thread.
@@ -120,8 +131,9 @@ namespace zmq
         virtual void process_attach (zmq::i_engine *engine_);
         virtual void process_bind (zmq::pipe_t *pipe_);
         virtual void process_activate_read ();
-        virtual void process_activate_write (uint64_t msgs_read_);
-        virtual void process_hiccup (void *pipe_);
+        virtual void process_activate_write (uint64_t msgs_read_,
+            uint64_t hot_msgs_read_);
+        virtual void process_hiccup (void *pipe_, void *hot_pipe_);
         virtual void process_pipe_term ();
         virtual void process_pipe_term_ack ();
         virtual void process_pipe_hwm (int inhwm_, int outhwm_);
@@ -131,6 +143,7 @@ namespace zmq
         virtual void process_term_endpoint (std::string *endpoint_);
         virtual void process_reap (zmq::socket_base_t *socket_);
         virtual void process_reaped ();
+        virtual void process_migrate (zmq::stream_engine_t *engine_);
 
         //  Special handler called after a command that requires a seqnum
         //  was processed. The implementation should catch up with its counter
@@ -145,6 +158,9 @@ namespace zmq
         //  Thread ID of the thread the object belongs to.
         uint32_t tid;
 
+        //  Thread ID of the thread the object runs in.
+        uint32_t host_tid;
+
         void send_command (command_t &cmd_);
 
         object_t (const object_t&);
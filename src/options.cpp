@@ -33,6 +33,7 @@
 #include "options.hpp"
 #include "err.hpp"
 #include "macros.hpp"
+#include "codec.hpp"
 
 #ifndef ZMQ_HAVE_WINDOWS
 #include <net/if.h>
@@ -90,7 +91,10 @@ zmq::options_t::options_t () :
     heartbeat_interval (0),
     heartbeat_timeout (-1),
     use_fd (-1),
-    zap_enforce_domain (false)
+    zap_enforce_domain (false),
+    raw_pcb (false),
+    tensor_codec (ZMQ_CODEC_NONE),
+    tensor_topk (10)
 {
     memset (curve_public_key, 0, CURVE_KEYSIZE);
     memset (curve_secret_key, 0, CURVE_KEYSIZE);
@@ -636,6 +640,28 @@ int zmq::options_t::setsockopt (int option_, const void *optval_,
             }
             break;
 
+        case ZMQ_RAW_PCB:
+            if (is_int) {
+                raw_pcb = (value != 0);
+                return 0;
+            }
+            break;
+
+        case ZMQ_TENSOR_CODEC:
+            if (is_int && (value == ZMQ_CODEC_NONE ||
+                  tensor_codec_t::supported (value))) {
+                tensor_codec = value;
+                return 0;
+            }
+            break;
+
+        case ZMQ_TENSOR_TOPK:
+            if (is_int && value > 0 && value <= 1000) {
+                tensor_topk = value;
+                return 0;
+            }
+            break;
+
 
         default:
 #if defined (ZMQ_ACT_MILITANT)
@@ -1068,6 +1094,27 @@ int zmq::options_t::getsockopt (int option_, void *optval_, size_t *optvallen_)
             }
             break;
 
+        case ZMQ_RAW_PCB:
+            if (is_int) {
+                *value = raw_pcb;
+                return 0;
+            }
+            break;
+
+        case ZMQ_TENSOR_CODEC:
+            if (is_int) {
+                *value = tensor_codec;
+                return 0;
+            }
+            break;
+
+        case ZMQ_TENSOR_TOPK:
+            if (is_int) {
+                *value = tensor_topk;
+                return 0;
+            }
+            break;
+
         default:
 #if defined (ZMQ_ACT_MILITANT)
             malformed = false;
@@ -245,6 +245,16 @@ namespace zmq
 
         //  Enforce a non-empty ZAP domain requirement for PLAIN auth
         bool zap_enforce_domain;
+
+        //  If true, TCP engines drive the lwIP pcb with the raw API
+        //  instead of going through the socket layer.
+        bool raw_pcb;
+
+        //  Codec for the float32 elements of keyed messages sent to peers
+        //  that can decode it, and the elements ZMQ_CODEC_TOPK keeps out
+        //  of every 1000.
+        int tensor_codec;
+        int tensor_topk;
     };
 }
 
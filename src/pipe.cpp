@@ -42,7 +42,8 @@ int zmq::pipepair (class object_t *parents_ [2], class pipe_t* pipes_ [2],
     int hwms_ [2], bool conflate_ [2])
 {
     //   Creates two pipe objects. These objects are connected by two ypipes,
-    //   each to pass messages in one direction.
+    //   each to pass messages in one direction, plus two more for the hot
+    //   lanes unless the direction conflates.
 
     typedef ypipe_t <msg_t, message_pipe_granularity> upipe_normal_t;
     typedef ypipe_conflate_t <msg_t> upipe_conflate_t;
@@ -61,11 +62,23 @@ int zmq::pipepair (class object_t *parents_ [2], class pipe_t* pipes_ [2],
         upipe2 = new (std::nothrow) upipe_normal_t ();
     alloc_assert (upipe2);
 
+    pipe_t::upipe_t *hot1 = NULL;
+    if (!conflate_ [0]) {
+        hot1 = new (std::nothrow) upipe_normal_t ();
+        alloc_assert (hot1);
+    }
+
+    pipe_t::upipe_t *hot2 = NULL;
+    if (!conflate_ [1]) {
+        hot2 = new (std::nothrow) upipe_normal_t ();
+        alloc_assert (hot2);
+    }
+
     pipes_ [0] = new (std::nothrow) pipe_t (parents_ [0], upipe1, upipe2,
-        hwms_ [1], hwms_ [0], conflate_ [0]);
+        hot1, hot2, hwms_ [1], hwms_ [0], conflate_ [0]);
     alloc_assert (pipes_ [0]);
     pipes_ [1] = new (std::nothrow) pipe_t (parents_ [1], upipe2, upipe1,
-        hwms_ [0], hwms_ [1], conflate_ [1]);
+        hot2, hot1, hwms_ [0], hwms_ [1], conflate_ [1]);
     alloc_assert (pipes_ [1]);
 
     pipes_ [0]->set_peer (pipes_ [1]);
@@ -75,19 +88,31 @@ int zmq::pipepair (class object_t *parents_ [2], class pipe_t* pipes_ [2],
 }
 
 zmq::pipe_t::pipe_t (object_t *parent_, upipe_t *inpipe_, upipe_t *outpipe_,
+      upipe_t *hot_inpipe_, upipe_t *hot_outpipe_,
       int inhwm_, int outhwm_, bool conflate_) :
     object_t (parent_),
     inpipe (inpipe_),
     outpipe (outpipe_),
+    hot_inpipe (hot_inpipe_),
+    hot_outpipe (hot_outpipe_),
+    in_hot (false),
+    in_more (false),
+    out_hot (false),
+    out_more (false),
     in_active (true),
     out_active (true),
+    flush_deferred (false),
+    flush_due (false),
     hwm (outhwm_),
     lwm (compute_lwm (inhwm_)),
     inhwmboost(-1),
     outhwmboost(-1),
     msgs_read (0),
     msgs_written (0),
+    hot_msgs_read (0),
+    hot_msgs_written (0),
     peers_msgs_read (0),
+    peers_hot_msgs_read (0),
     peer (NULL),
     sink (NULL),
     state (active),
@@ -148,14 +173,18 @@ bool zmq::pipe_t::check_read ()
         return false;
 
     //  Check if there's an item in the pipe.
-    if (!inpipe->check_read ()) {
+    const bool hot = hot_inpipe && hot_inpipe->check_read ();
+    if (!hot && !inpipe->check_read ()) {
         in_active = false;
         return false;
     }
 
     //  If the next item in the pipe is message delimiter,
-    //  initiate termination process.
-    if (inpipe->probe (is_delimiter)) {
+    //  initiate termination process. Hot messages written ahead of it
+    //  are read first, see read_lane.
+    if (!hot && inpipe->probe (is_delimiter)) {
+        if (hot_inpipe && hot_inpipe->check_read ())
+            return true;
         msg_t msg;
         bool ok = inpipe->read (&msg);
         zmq_assert (ok);
@@ -174,7 +203,7 @@ bool zmq::pipe_t::read (msg_t *msg_)
         return false;
 
 read_message:
-    if (!inpipe->read (msg_)) {
+    if (!read_lane (msg_)) {
         in_active = false;
         return false;
     }
@@ -194,21 +223,60 @@ read_message:
         return false;
     }
 
-    if (!(msg_->flags () & msg_t::more) && !msg_->is_routing_id ())
-        msgs_read++;
+    in_more = msg_->flags () & msg_t::more ? true : false;
+    uint64_t &lane_msgs_read = in_hot ? hot_msgs_read : msgs_read;
+
+    if (!in_more && !msg_->is_routing_id ())
+        lane_msgs_read++;
 
-    if (lwm > 0 && msgs_read % lwm == 0)
-        send_activate_write (peer, msgs_read);
+    if (lwm > 0 && lane_msgs_read % lwm == 0)
+        send_activate_write (peer, msgs_read, hot_msgs_read);
 
     return true;
 }
 
-bool zmq::pipe_t::check_write ()
+bool zmq::pipe_t::read_lane (msg_t *msg_)
+{
+    //  The rest of a message comes from the lane of its first frame.
+    if (in_more)
+        return (in_hot ? hot_inpipe : inpipe)->read (msg_);
+
+    in_hot = true;
+    if (hot_inpipe && hot_inpipe->read (msg_))
+        return true;
+
+    in_hot = false;
+    if (!inpipe->check_read ())
+        return false;
+
+    //  The writer flushes the hot lane before the cold one, so by the time
+    //  the delimiter shows up the hot messages written before it do too.
+    //  Deliver them before the pipe goes down.
+    if (hot_inpipe && inpipe->probe (is_delimiter)) {
+        in_hot = true;
+        if (hot_inpipe->read (msg_))
+            return true;
+        in_hot = false;
+    }
+
+    return inpipe->read (msg_);
+}
+
+bool zmq::pipe_t::check_write (bool hot_)
 {
-    if (unlikely (!out_active || state != active))
+    const bool hot = out_more ? out_hot : hot_ && hot_outpipe;
+
+    //  A pipe waiting for room in its cold lane may still have some in the
+    //  hot one.
+    if (unlikely (state != active || (!out_active && !hot)))
         return false;
 
-    bool full = !check_hwm();
+    return check_lane (hot);
+}
+
+bool zmq::pipe_t::check_lane (bool hot_)
+{
+    bool full = !check_hwm (hot_);
 
     if (unlikely (full)) {
         out_active = false;
@@ -220,14 +288,25 @@ bool zmq::pipe_t::check_write ()
 
 bool zmq::pipe_t::write (msg_t *msg_)
 {
-    if (unlikely (!check_write ()))
+    const bool hot = out_more ? out_hot :
+        hot_outpipe && (msg_->flags () & msg_t::netml_hotdata);
+
+    //  A lane full of cold messages does not hold up hot ones and vice
+    //  versa, so only the lane of this message counts here.
+    if (unlikely (state != active || !check_lane (hot)))
         return false;
 
     bool more = msg_->flags () & msg_t::more ? true : false;
     const bool is_routing_id = msg_->is_routing_id ();
-    outpipe->write (*msg_, more);
-    if (!more && !is_routing_id)
-        msgs_written++;
+    (hot ? hot_outpipe : outpipe)->write (*msg_, more);
+    if (!more && !is_routing_id) {
+        if (hot)
+            hot_msgs_written++;
+        else
+            msgs_written++;
+    }
+    out_hot = hot;
+    out_more = more;
 
     return true;
 }
@@ -235,13 +314,21 @@ bool zmq::pipe_t::write (msg_t *msg_)
 void zmq::pipe_t::rollback ()
 {
     //  Remove incomplete message from the outbound pipe.
-    msg_t msg;
     if (outpipe) {
-        while (outpipe->unwrite (&msg)) {
-            zmq_assert (msg.flags () & msg_t::more);
-            int rc = msg.close ();
-            errno_assert (rc == 0);
-        }
+        rollback_lane (outpipe);
+        if (hot_outpipe)
+            rollback_lane (hot_outpipe);
+    }
+    out_more = false;
+}
+
+void zmq::pipe_t::rollback_lane (upipe_t *lane_)
+{
+    msg_t msg;
+    while (lane_->unwrite (&msg)) {
+        zmq_assert (msg.flags () & msg_t::more);
+        int rc = msg.close ();
+        errno_assert (rc == 0);
     }
 }
 
@@ -251,15 +338,32 @@ void zmq::pipe_t::flush ()
     if (state == term_ack_sent)
         return;
 
+    if (flush_deferred) {
+        flush_due = true;
+        return;
+    }
+
 //    if (outpipe && !outpipe->flush ())
 //        send_activate_read (peer);
 
+	//  Hot lane first, see read_lane.
 	if (outpipe) {
+		if (hot_outpipe)
+			hot_outpipe->flush();
 		outpipe->flush();
 		send_activate_read (peer);
 	}
 }
 
+void zmq::pipe_t::defer_flush (bool defer_)
+{
+    flush_deferred = defer_;
+    if (!defer_ && flush_due) {
+        flush_due = false;
+        flush ();
+    }
+}
+
 void zmq::pipe_t::process_activate_read ()
 {
     if (!in_active && (state == active || state == waiting_for_delimiter)) {
@@ -268,10 +372,12 @@ void zmq::pipe_t::process_activate_read ()
     }
 }
 
-void zmq::pipe_t::process_activate_write (uint64_t msgs_read_)
+void zmq::pipe_t::process_activate_write (uint64_t msgs_read_,
+    uint64_t hot_msgs_read_)
 {
-    //  Remember the peer's message sequence number.
+    //  Remember the peer's message sequence numbers.
     peers_msgs_read = msgs_read_;
+    peers_hot_msgs_read = hot_msgs_read_;
 
     if (!out_active && state == active) {
         out_active = true;
@@ -279,7 +385,7 @@ void zmq::pipe_t::process_activate_write (uint64_t msgs_read_)
     }
 }
 
-void zmq::pipe_t::process_hiccup (void *pipe_)
+void zmq::pipe_t::process_hiccup (void *pipe_, void *hot_pipe_)
 {
     //  Destroy old outpipe. Note that the read end of the pipe was already
     //  migrated to this thread.
@@ -294,9 +400,21 @@ void zmq::pipe_t::process_hiccup (void *pipe_)
     }
     LIBZMQ_DELETE(outpipe);
 
+    if (hot_outpipe) {
+        hot_outpipe->flush ();
+        while (hot_outpipe->read (&msg)) {
+           if (!(msg.flags () & msg_t::more))
+                hot_msgs_written--;
+           int rc = msg.close ();
+           errno_assert (rc == 0);
+        }
+        LIBZMQ_DELETE(hot_outpipe);
+    }
+
     //  Plug in the new outpipe.
     zmq_assert (pipe_);
     outpipe = (upipe_t*) pipe_;
+    hot_outpipe = (upipe_t*) hot_pipe_;
     out_active = true;
 
     //  If appropriate, notify the user about the hiccup.
@@ -378,6 +496,15 @@ void zmq::pipe_t::process_pipe_term_ack ()
 
     LIBZMQ_DELETE(inpipe);
 
+    if (hot_inpipe) {
+        msg_t msg;
+        while (hot_inpipe->read (&msg)) {
+            int rc = msg.close ();
+            errno_assert (rc == 0);
+        }
+        LIBZMQ_DELETE(hot_inpipe);
+    }
+
     //  Deallocate the pipe object
     delete this;
 }
@@ -512,10 +639,17 @@ void zmq::pipe_t::hiccup ()
         inpipe = new (std::nothrow)ypipe_t <msg_t, message_pipe_granularity>();
 
     alloc_assert (inpipe);
+
+    //  The peer is responsible for the old hot inpipe as well.
+    if (hot_inpipe) {
+        hot_inpipe = new (std::nothrow)ypipe_t <msg_t, message_pipe_granularity>();
+        alloc_assert (hot_inpipe);
+    }
+    in_more = false;
     in_active = true;
 
     //  Notify the peer about the hiccup.
-    send_hiccup (peer, (void*) inpipe);
+    send_hiccup (peer, (void*) inpipe, (void*) hot_inpipe);
 }
 
 void zmq::pipe_t::set_hwms (int inhwm_, int outhwm_)
@@ -540,9 +674,11 @@ void zmq::pipe_t::set_hwms_boost(int inhwmboost_, int outhwmboost_)
     outhwmboost = outhwmboost_;
 }
 
-bool zmq::pipe_t::check_hwm () const
+bool zmq::pipe_t::check_hwm (bool hot_) const
 {
-    bool full = hwm > 0 && msgs_written - peers_msgs_read >= uint64_t (hwm);
+    uint64_t queued = hot_ ? hot_msgs_written - peers_hot_msgs_read :
+        msgs_written - peers_msgs_read;
+    bool full = hwm > 0 && queued >= uint64_t (hwm);
     return( !full );
 }
 
@@ -52,6 +52,8 @@ namespace zmq
     //  terminates straight away.
     //  If conflate is true, only the most recently arrived message could be
     //  read (older messages are discarded)
+    //  Unless it conflates, each direction has a second lane for hot
+    //  messages, see pipe_t.
     int pipepair (zmq::object_t *parents_ [2], zmq::pipe_t* pipes_ [2],
         int hwms_ [2], bool conflate_ [2]);
 
@@ -68,6 +70,10 @@ namespace zmq
     //  Note that pipe can be stored in three different arrays.
     //  The array of inbound pipes (1), the array of outbound pipes (2) and
     //  the generic array of pipes to be deallocated (3).
+    //
+    //  Messages whose first frame is flagged netml_hotdata travel in a lane
+    //  of their own and are read ahead of all the cold ones, so that they do
+    //  not queue up behind bulk data. Each lane has its own high watermark.
 
     class pipe_t :
         public object_t,
@@ -97,13 +103,15 @@ namespace zmq
         //  Returns true if there is at least one message to read in the pipe.
         bool check_read ();
 
-        //  Reads a message to the underlying pipe.
+        //  Reads a message to the underlying pipe. Hot messages come first,
+        //  the frames of a message are never interleaved with another one.
         bool read (msg_t *msg_);
 
         //  Checks whether messages can be written to the pipe. If the pipe is
         //  closed or if writing the message would cause high watermark the
-        //  function returns false.
-        bool check_write ();
+        //  function returns false. hot_ tells the lane of the next message,
+        //  in the middle of one it is the lane of that message.
+        bool check_write (bool hot_ = false);
 
         //  Writes a message to the underlying pipe. Returns false if the
         //  message does not pass check_write. If false, the message object
@@ -116,6 +124,11 @@ namespace zmq
         //  Flush the messages downstream.
         void flush ();
 
+        //  While deferred, flush only notes that one is due, and it happens
+        //  when deferring ends. Lets a batch of messages go with a single
+        //  flush and a single activation of the reader.
+        void defer_flush (bool defer_);
+
         //  Temporarily disconnects the inbound message stream and drops
         //  all the messages on the fly. Causes 'hiccuped' event to be generated
         //  in the peer.
@@ -139,8 +152,9 @@ namespace zmq
         // send command to peer for notify the change of hwm
         void send_hwms_to_peer(int inhwm_, int outhwm_);
 
-        //  Returns true if HWM is not reached
-        bool check_hwm () const;
+        //  Returns true if HWM is not reached in the cold lane, or in the
+        //  hot one if hot_ is true.
+        bool check_hwm (bool hot_ = false) const;
     private:
 
         //  Type of the underlying lock-free pipe.
@@ -148,8 +162,9 @@ namespace zmq
 
         //  Command handlers.
         void process_activate_read ();
-        void process_activate_write (uint64_t msgs_read_);
-        void process_hiccup (void *pipe_);
+        void process_activate_write (uint64_t msgs_read_,
+            uint64_t hot_msgs_read_);
+        void process_hiccup (void *pipe_, void *hot_pipe_);
         void process_pipe_term ();
         void process_pipe_term_ack ();
         void process_pipe_hwm (int inhwm_, int outhwm_);
@@ -157,9 +172,19 @@ namespace zmq
         //  Handler for delimiter read from the pipe.
         void process_delimiter ();
 
+        //  Reads the next item from the lane it is due from.
+        bool read_lane (msg_t *msg_);
+
+        //  Checks the high watermark of a lane before writing to it.
+        bool check_lane (bool hot_);
+
+        //  Drops the unfinished message in the lane.
+        static void rollback_lane (upipe_t *lane_);
+
         //  Constructor is private. Pipe can only be created using
         //  pipepair function.
         pipe_t (object_t *parent_, upipe_t *inpipe_, upipe_t *outpipe_,
+            upipe_t *hot_inpipe_, upipe_t *hot_outpipe_,
             int inhwm_, int outhwm_, bool conflate_);
 
         //  Pipepair uses this function to let us know about
@@ -173,10 +198,25 @@ namespace zmq
         upipe_t *inpipe;
         upipe_t *outpipe;
 
+        //  Underlying pipes of the hot lane, NULL for conflating pipes.
+        upipe_t *hot_inpipe;
+        upipe_t *hot_outpipe;
+
+        //  Lanes of the messages being read and written. The lane of a
+        //  message is picked at its first frame.
+        bool in_hot;
+        bool in_more;
+        bool out_hot;
+        bool out_more;
+
         //  Can the pipe be read from / written to?
         bool in_active;
         bool out_active;
 
+        //  See defer_flush.
+        bool flush_deferred;
+        bool flush_due;
+
         //  High watermark for the outbound pipe.
         int hwm;
 
@@ -190,10 +230,13 @@ namespace zmq
         //  Number of messages read and written so far.
         uint64_t msgs_read;
         uint64_t msgs_written;
+        uint64_t hot_msgs_read;
+        uint64_t hot_msgs_written;
 
         //  Last received peer's msgs_read. The actual number in the peer
         //  can be higher at the moment.
         uint64_t peers_msgs_read;
+        uint64_t peers_hot_msgs_read;
 
         //  The pipe object on the other side of the pipepair.
         pipe_t *peer;
@@ -120,7 +120,7 @@ void zmq::poll_t::reset_pollout (handle_t handle_)
 
 void zmq::poll_t::start ()
 {
-    ctx.start_thread (worker, worker_routine, this);
+    ctx.start_thread (worker, worker_routine, this, cpus);
 }
 
 void zmq::poll_t::stop ()
@@ -31,15 +31,41 @@
 #include "poller_base.hpp"
 #include "i_poll_events.hpp"
 #include "err.hpp"
+#include "config.hpp"
 
-zmq::poller_base_t::poller_base_t ()
+#include <new>
+#include <string.h>
+
+zmq::poller_base_t::poller_base_t () :
+    wheel_time (0),
+    next_due (0),
+    timer_count (0),
+    buckets (wheel_slots, (timer_info_t*) NULL),
+    free_timers (NULL),
+    traffic_bytes (0),
+    traffic_packets (0),
+    traffic_stamp (0)
 {
+    memset (wheel, 0, sizeof wheel);
 }
 
 zmq::poller_base_t::~poller_base_t ()
 {
     //  Make sure there is no more load on the shutdown.
     zmq_assert (get_load () == 0);
+
+    for (int level = 0; level != wheel_levels; level++)
+        for (int slot = 0; slot != wheel_slots; slot++)
+            while (wheel [level][slot]) {
+                timer_info_t *timer = wheel [level][slot];
+                wheel [level][slot] = timer->next;
+                delete timer;
+            }
+    while (free_timers) {
+        timer_info_t *timer = free_timers;
+        free_timers = timer->next;
+        delete timer;
+    }
 }
 
 int zmq::poller_base_t::get_load ()
@@ -56,55 +82,250 @@ void zmq::poller_base_t::adjust_load (int amount_)
         load.sub (-amount_);
 }
 
+void zmq::poller_base_t::set_cpus (const std::set <int> &cpus_)
+{
+    cpus = cpus_;
+}
+
+uint32_t zmq::poller_base_t::get_traffic ()
+{
+    //  A thread blocked in the poller stops updating the rate, whatever
+    //  it last measured is gone by now.
+    uint32_t now = (uint32_t) (clock_t::now_us () / 1000);
+    if (now - traffic_time.get () > 2 * traffic_window_ms)
+        return 0;
+    return traffic.get ();
+}
+
+void zmq::poller_base_t::account_traffic (size_t bytes_, size_t packets_)
+{
+    traffic_bytes += bytes_;
+    traffic_packets += packets_;
+}
+
+uint64_t zmq::poller_base_t::traffic_cost (uint64_t bytes_,
+    uint64_t packets_)
+{
+    return bytes_ + packets_ * traffic_packet_cost;
+}
+
+void zmq::poller_base_t::update_traffic (uint64_t current_)
+{
+    const uint64_t elapsed = current_ - traffic_stamp;
+    uint64_t rate = traffic_cost (traffic_bytes, traffic_packets) * 1000 /
+        elapsed / 1024;
+
+    //  Average with the previous window to smooth out bursts, unless the
+    //  thread has not been around to measure it.
+    if (elapsed < 2 * traffic_window_ms)
+        rate = (rate + traffic.get ()) / 2;
+    if (rate > UINT32_MAX)
+        rate = UINT32_MAX;
+
+    traffic.set ((atomic_counter_t::integer_t) rate);
+    traffic_time.set ((atomic_counter_t::integer_t) current_);
+    traffic_bytes = 0;
+    traffic_packets = 0;
+    traffic_stamp = current_;
+}
+
 void zmq::poller_base_t::add_timer (int timeout_, i_poll_events *sink_, int id_)
 {
-    uint64_t expiration = clock.now_ms () + timeout_;
-    timer_info_t info = {sink_, id_};
-    timers.insert (timers_t::value_type (expiration, info));
+    uint64_t current = clock.now_ms ();
+
+    //  An idle wheel may be lagging arbitrarily far behind, catch it up
+    //  instead of stepping through the gap on the next execute_timers.
+    if (timer_count == 0) {
+        wheel_time = current;
+        next_due = current;
+    }
+
+    timer_info_t *timer = free_timers;
+    if (timer)
+        free_timers = timer->next;
+    else {
+        timer = new (std::nothrow) timer_info_t;
+        alloc_assert (timer);
+    }
+    timer->sink = sink_;
+    timer->id = id_;
+    timer->expiration = current + timeout_;
+    if (timer->expiration < wheel_time)
+        timer->expiration = wheel_time;
+
+    wheel_insert (timer);
+    hash_insert (timer);
+    if (timer_count++ == 0 || timer->expiration < next_due)
+        next_due = timer->expiration;
 }
 
 void zmq::poller_base_t::cancel_timer (i_poll_events *sink_, int id_)
 {
-    //  Complexity of this operation is O(n). We assume it is rarely used.
-    for (timers_t::iterator it = timers.begin (); it != timers.end (); ++it)
-        if (it->second.sink == sink_ && it->second.id == id_) {
-            timers.erase (it);
-            return;
-        }
+    timer_info_t *timer = hash_find (sink_, id_);
 
     //  Timer not found.
-    zmq_assert (false);
+    zmq_assert (timer);
+
+    wheel_remove (timer);
+    hash_remove (timer);
+    timer->next = free_timers;
+    free_timers = timer;
+    timer_count--;
 }
 
 uint64_t zmq::poller_base_t::execute_timers ()
 {
+    //  Get the current time.
+    uint64_t current = clock.now_ms ();
+
+    if (current - traffic_stamp >= traffic_window_ms)
+        update_traffic (current);
+
     //  Fast track.
-    if (timers.empty ())
+    if (timer_count == 0)
         return 0;
 
-    //  Get the current time.
-    uint64_t current = clock.now_ms ();
+    //  Nothing can be due before next_due, so there is no need to turn
+    //  the wheel yet.
+    if (current < next_due)
+        return next_due - current;
 
-    //   Execute the timers that are already due.
-    timers_t::iterator it = timers.begin ();
-    while (it != timers.end ()) {
+    while (wheel_time <= current && timer_count) {
 
-        //  If we have to wait to execute the item, same will be true about
-        //  all the following items (multimap is sorted). Thus we can stop
-        //  checking the subsequent timers and return the time to wait for
-        //  the next timer (at least 1ms).
-        if (it->first > current)
-            return it->first - current;
+        //  Entering a new round of level 0, pull the timers of the next
+        //  round down from the higher levels.
+        if ((wheel_time & wheel_mask) == 0)
+            cascade (1);
 
-        //  Trigger the timer.
-        it->second.sink->timer_event (it->second.id);
+        //  Everything in the current level 0 slot is due. Timers are
+        //  removed one at a time, so timer_event may add or cancel timers,
+        //  including ones in this very slot.
+        timer_info_t **slot = &wheel [0][wheel_time & wheel_mask];
+        while (*slot) {
+            timer_info_t *timer = *slot;
+            wheel_remove (timer);
+            hash_remove (timer);
+            timer->next = free_timers;
+            free_timers = timer;
+            timer_count--;
 
-        //  Remove it from the list of active timers.
-        timers_t::iterator o = it;
-        ++it;
-        timers.erase (o);
+            //  Trigger the timer.
+            timer->sink->timer_event (timer->id);
+        }
+        wheel_time++;
     }
 
     //  There are no more timers.
-    return 0;
+    if (timer_count == 0)
+        return 0;
+
+    next_due = next_expiration ();
+    return next_due - current;
+}
+
+void zmq::poller_base_t::wheel_insert (timer_info_t *timer_)
+{
+    //  Timers further out than the whole wheel sit in the last level and
+    //  get re-inserted with their real expiration when cascaded.
+    uint64_t expiration = timer_->expiration;
+    uint64_t delta = expiration - wheel_time;
+    int level = 0;
+    while (level != wheel_levels - 1 &&
+          delta >= ((uint64_t) 1 << (wheel_bits * (level + 1))))
+        level++;
+    if (delta >= ((uint64_t) 1 << (wheel_bits * wheel_levels)))
+        expiration = wheel_time + ((uint64_t) 1 << (wheel_bits * wheel_levels)) - 1;
+
+    timer_info_t **slot =
+        &wheel [level][(expiration >> (wheel_bits * level)) & wheel_mask];
+    timer_->next = *slot;
+    if (timer_->next)
+        timer_->next->pprev = &timer_->next;
+    timer_->pprev = slot;
+    *slot = timer_;
+}
+
+void zmq::poller_base_t::wheel_remove (timer_info_t *timer_)
+{
+    *timer_->pprev = timer_->next;
+    if (timer_->next)
+        timer_->next->pprev = timer_->pprev;
+}
+
+void zmq::poller_base_t::cascade (int level_)
+{
+    if (level_ == wheel_levels)
+        return;
+
+    int index = (int) ((wheel_time >> (wheel_bits * level_)) & wheel_mask);
+
+    //  This level wraps around as well, refill it from the next one first.
+    if (index == 0)
+        cascade (level_ + 1);
+
+    timer_info_t *timer = wheel [level_][index];
+    wheel [level_][index] = NULL;
+    while (timer) {
+        timer_info_t *next = timer->next;
+        wheel_insert (timer);
+        timer = next;
+    }
+}
+
+uint64_t zmq::poller_base_t::next_expiration () const
+{
+    //  Look for the first populated slot in the rest of the level 0 round.
+    //  Otherwise the next timer cannot fire before the wheel reaches the
+    //  next round, where the higher levels are cascaded.
+    uint64_t round_end = (wheel_time | wheel_mask) + 1;
+    for (uint64_t tick = wheel_time; tick != round_end; tick++)
+        if (wheel [0][tick & wheel_mask])
+            return tick;
+    return round_end;
+}
+
+size_t zmq::poller_base_t::hash (i_poll_events *sink_, int id_)
+{
+    size_t key = (size_t) sink_ ^ ((size_t) id_ * 0x9e3779b9);
+    return key ^ (key >> 16);
+}
+
+void zmq::poller_base_t::hash_insert (timer_info_t *timer_)
+{
+    //  Keep the load factor at or below one.
+    if (timer_count >= buckets.size ()) {
+        std::vector <timer_info_t*> old (buckets.size () * 2,
+            (timer_info_t*) NULL);
+        old.swap (buckets);
+        for (size_t i = 0; i != old.size (); i++)
+            while (old [i]) {
+                timer_info_t *timer = old [i];
+                old [i] = timer->hash_next;
+                size_t b = hash (timer->sink, timer->id) & (buckets.size () - 1);
+                timer->hash_next = buckets [b];
+                buckets [b] = timer;
+            }
+    }
+
+    size_t b = hash (timer_->sink, timer_->id) & (buckets.size () - 1);
+    timer_->hash_next = buckets [b];
+    buckets [b] = timer_;
+}
+
+void zmq::poller_base_t::hash_remove (timer_info_t *timer_)
+{
+    timer_info_t **it =
+        &buckets [hash (timer_->sink, timer_->id) & (buckets.size () - 1)];
+    while (*it != timer_)
+        it = &(*it)->hash_next;
+    *it = timer_->hash_next;
+}
+
+zmq::poller_base_t::timer_info_t *zmq::poller_base_t::hash_find (
+    i_poll_events *sink_, int id_) const
+{
+    timer_info_t *timer = buckets [hash (sink_, id_) & (buckets.size () - 1)];
+    while (timer && (timer->sink != sink_ || timer->id != id_))
+        timer = timer->hash_next;
+    return timer;
 }
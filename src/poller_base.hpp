@@ -30,7 +30,8 @@
 #ifndef __ZMQ_POLLER_BASE_HPP_INCLUDED__
 #define __ZMQ_POLLER_BASE_HPP_INCLUDED__
 
-#include <map>
+#include <set>
+#include <vector>
 
 #include "clock.hpp"
 #include "atomic_counter.hpp"
@@ -51,6 +52,19 @@ namespace zmq
         //  invoked from a different thread!
         int get_load ();
 
+        //  Returns the traffic handled by the poller's thread recently, in
+        //  KB per second with every packet weighed as traffic_packet_cost
+        //  bytes on top of its payload. Can be invoked from a different
+        //  thread as well.
+        uint32_t get_traffic ();
+
+        //  Records bytes_ and packets_ of traffic. Called by the objects
+        //  living in the poller's thread only.
+        void account_traffic (size_t bytes_, size_t packets_);
+
+        //  The weight of bytes_ and packets_ of traffic, in bytes.
+        static uint64_t traffic_cost (uint64_t bytes_, uint64_t packets_);
+
         //  Add a timeout to expire in timeout_ milliseconds. After the
         //  expiration timer_event on sink_ object will be called with
         //  argument set to id_.
@@ -59,8 +73,15 @@ namespace zmq
         //  Cancel the timer created by sink_ object with ID equal to id_.
         void cancel_timer (zmq::i_poll_events *sink_, int id_);
 
+        //  Sets the CPUs the poller's thread is pinned to when started.
+        //  If empty, the context-wide thread affinity applies.
+        void set_cpus (const std::set <int> &cpus_);
+
     protected:
 
+        //  CPUs to start the worker thread on.
+        std::set <int> cpus;
+
         //  Called by individual poller implementations to manage the load.
         void adjust_load (int amount_);
 
@@ -73,19 +94,76 @@ namespace zmq
         //  Clock instance private to this I/O thread.
         clock_t clock;
 
-        //  List of active timers.
+        //  Timers are kept in a hierarchical timing wheel with a resolution
+        //  of one millisecond. Level 0 holds the timers due within the next
+        //  wheel_slots milliseconds, every higher level covers wheel_slots
+        //  times the span of the level below it and is cascaded down as the
+        //  wheel turns. Adding and cancelling a timer are O(1).
+        enum {
+            wheel_bits = 8,
+            wheel_slots = 1 << wheel_bits,
+            wheel_mask = wheel_slots - 1,
+            wheel_levels = 4
+        };
+
         struct timer_info_t
         {
             zmq::i_poll_events *sink;
             int id;
+            uint64_t expiration;
+
+            //  Links within the wheel slot.
+            timer_info_t *next;
+            timer_info_t **pprev;
+
+            //  Link within the (sink, id) lookup bucket.
+            timer_info_t *hash_next;
         };
-        typedef std::multimap <uint64_t, timer_info_t> timers_t;
-        timers_t timers;
+
+        void wheel_insert (timer_info_t *timer_);
+        void wheel_remove (timer_info_t *timer_);
+        void cascade (int level_);
+        uint64_t next_expiration () const;
+
+        //  Folds the traffic accounted since traffic_stamp into the rate.
+        void update_traffic (uint64_t current_);
+
+        void hash_insert (timer_info_t *timer_);
+        void hash_remove (timer_info_t *timer_);
+        timer_info_t *hash_find (zmq::i_poll_events *sink_, int id_) const;
+        static size_t hash (zmq::i_poll_events *sink_, int id_);
+
+        timer_info_t *wheel [wheel_levels][wheel_slots];
+
+        //  The next millisecond the wheel has not processed yet.
+        uint64_t wheel_time;
+
+        //  Lower bound of the earliest expiration, used to answer
+        //  execute_timers without touching the wheel.
+        uint64_t next_due;
+
+        size_t timer_count;
+
+        //  Lookup of active timers by (sink, id) for cancel_timer.
+        std::vector <timer_info_t*> buckets;
+
+        //  Recycled timers, so that re-arming does not allocate.
+        timer_info_t *free_timers;
 
         //  Load of the poller. Currently the number of file descriptors
         //  registered.
         atomic_counter_t load;
 
+        //  Traffic accounted since traffic_stamp (in ms).
+        uint64_t traffic_bytes;
+        uint64_t traffic_packets;
+        uint64_t traffic_stamp;
+
+        //  Smoothed traffic rate as returned by get_traffic and the time
+        //  (in ms, truncated) it was last updated at.
+        atomic_counter_t traffic;
+        atomic_counter_t traffic_time;
+
         poller_base_t (const poller_base_t&);
         const poller_base_t &operator = (const poller_base_t&);
     };
@@ -189,7 +189,7 @@ void zmq::pollset_t::reset_pollout (handle_t handle_)
 
 void zmq::pollset_t::start ()
 {
-    ctx.start_thread (worker, worker_routine, this);
+    ctx.start_thread (worker, worker_routine, this, cpus);
 }
 
 void zmq::pollset_t::stop ()
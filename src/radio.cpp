@@ -127,6 +127,8 @@ int zmq::radio_t::xsend (msg_t *msg_)
     }
 
     dist.unmatch ();
+    if (msg_->flags () & msg_t::netml_hotdata)
+        dist.activate_hot ();
 
     std::pair<subscriptions_t::iterator, subscriptions_t::iterator> range =
         subscriptions.equal_range (std::string(msg_->group ()));
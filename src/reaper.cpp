@@ -62,9 +62,10 @@ zmq::mailbox_t *zmq::reaper_t::get_mailbox ()
     return &mailbox;
 }
 
-void zmq::reaper_t::start ()
+void zmq::reaper_t::start (const std::set <int> &cpus_)
 {
     //  Start the thread.
+    poller->set_cpus (cpus_);
     poller->start ();
 }
 
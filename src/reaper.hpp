@@ -50,7 +50,7 @@ namespace zmq
 
         mailbox_t *get_mailbox ();
 
-        void start ();
+        void start (const std::set <int> &cpus_);
         void stop ();
 
         //  i_poll_events implementation.
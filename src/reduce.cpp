@@ -0,0 +1,237 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "precompiled.hpp"
+#include "reduce.hpp"
+#include "half.hpp"
+#include "err.hpp"
+
+#include <string.h>
+
+#include "../include/zmq.h"
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#define ZMQ_HAVE_REDUCE_AVX2
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    template <typename T> inline T combine (T a_, T b_, int op_)
+    {
+        switch (op_) {
+            case ZMQ_OP_SUM:
+                return a_ + b_;
+            case ZMQ_OP_PROD:
+                return a_ * b_;
+            case ZMQ_OP_MIN:
+                return b_ < a_ ? b_ : a_;
+            default:
+                return b_ > a_ ? b_ : a_;
+        }
+    }
+
+    //  One loop per op, so that the compiler can vectorise each of them.
+    template <typename T> void reduce_typed (void *dst_, const void *src_,
+        size_t count_, int op_)
+    {
+        T *dst = static_cast <T *> (dst_);
+        const T *src = static_cast <const T *> (src_);
+
+        switch (op_) {
+            case ZMQ_OP_SUM:
+                for (size_t i = 0; i != count_; i++)
+                    dst [i] = combine (dst [i], src [i], ZMQ_OP_SUM);
+                break;
+            case ZMQ_OP_PROD:
+                for (size_t i = 0; i != count_; i++)
+                    dst [i] = combine (dst [i], src [i], ZMQ_OP_PROD);
+                break;
+            case ZMQ_OP_MIN:
+                for (size_t i = 0; i != count_; i++)
+                    dst [i] = combine (dst [i], src [i], ZMQ_OP_MIN);
+                break;
+            default:
+                for (size_t i = 0; i != count_; i++)
+                    dst [i] = combine (dst [i], src [i], ZMQ_OP_MAX);
+                break;
+        }
+    }
+
+    template <float (*to_float) (uint16_t), uint16_t (*from_float) (float)>
+    void reduce_half (void *dst_, const void *src_, size_t count_, int op_)
+    {
+        //  Elements may sit at any offset within a message.
+        unsigned char *dst = static_cast <unsigned char *> (dst_);
+        const unsigned char *src = static_cast <const unsigned char *> (src_);
+
+        for (size_t i = 0; i != count_; i++) {
+            uint16_t a, b;
+            memcpy (&a, dst + i * 2, 2);
+            memcpy (&b, src + i * 2, 2);
+            a = from_float (combine (to_float (a), to_float (b), op_));
+            memcpy (dst + i * 2, &a, 2);
+        }
+    }
+
+#ifdef ZMQ_HAVE_REDUCE_AVX2
+    //  Sums are what aggregation spends its time on, so they get kernels of
+    //  their own. The library is built for the baseline instruction set,
+    //  the kernels are picked at run time on CPUs that have AVX2.
+    bool have_avx2 ()
+    {
+        static const bool avx2 = __builtin_cpu_supports ("avx2") &&
+            __builtin_cpu_supports ("f16c");
+        return avx2;
+    }
+
+    __attribute__ ((target ("avx2")))
+    void sum_f32_avx2 (void *dst_, const void *src_, size_t count_)
+    {
+        float *dst = static_cast <float *> (dst_);
+        const float *src = static_cast <const float *> (src_);
+
+        size_t i = 0;
+        for (; i + 16 <= count_; i += 16) {
+            __m256 a0 = _mm256_loadu_ps (dst + i);
+            __m256 a1 = _mm256_loadu_ps (dst + i + 8);
+            a0 = _mm256_add_ps (a0, _mm256_loadu_ps (src + i));
+            a1 = _mm256_add_ps (a1, _mm256_loadu_ps (src + i + 8));
+            _mm256_storeu_ps (dst + i, a0);
+            _mm256_storeu_ps (dst + i + 8, a1);
+        }
+        for (; i != count_; i++)
+            dst [i] += src [i];
+    }
+
+    __attribute__ ((target ("avx2")))
+    void sum_i32_avx2 (void *dst_, const void *src_, size_t count_)
+    {
+        int32_t *dst = static_cast <int32_t *> (dst_);
+        const int32_t *src = static_cast <const int32_t *> (src_);
+
+        size_t i = 0;
+        for (; i + 16 <= count_; i += 16) {
+            __m256i *d = reinterpret_cast <__m256i *> (dst + i);
+            const __m256i *s = reinterpret_cast <const __m256i *> (src + i);
+            __m256i a0 = _mm256_add_epi32 (_mm256_loadu_si256 (d),
+                _mm256_loadu_si256 (s));
+            __m256i a1 = _mm256_add_epi32 (_mm256_loadu_si256 (d + 1),
+                _mm256_loadu_si256 (s + 1));
+            _mm256_storeu_si256 (d, a0);
+            _mm256_storeu_si256 (d + 1, a1);
+        }
+        for (; i != count_; i++)
+            dst [i] += src [i];
+    }
+
+    //  Rounds to nearest even on the way back, as float_to_half does.
+    __attribute__ ((target ("avx2,f16c")))
+    void sum_f16_avx2 (void *dst_, const void *src_, size_t count_)
+    {
+        unsigned char *dst = static_cast <unsigned char *> (dst_);
+        const unsigned char *src = static_cast <const unsigned char *> (src_);
+
+        size_t i = 0;
+        for (; i + 8 <= count_; i += 8) {
+            __m128i *d = reinterpret_cast <__m128i *> (dst + i * 2);
+            const __m128i *s = reinterpret_cast <const __m128i *> (src + i * 2);
+            __m256 a = _mm256_add_ps (_mm256_cvtph_ps (_mm_loadu_si128 (d)),
+                _mm256_cvtph_ps (_mm_loadu_si128 (s)));
+            _mm_storeu_si128 (d, _mm256_cvtps_ph (a, _MM_FROUND_TO_NEAREST_INT));
+        }
+        if (i != count_)
+            reduce_half <zmq::half_to_float, zmq::float_to_half> (
+                dst + i * 2, src + i * 2, count_ - i, ZMQ_OP_SUM);
+    }
+#endif
+}
+
+bool zmq::reduce_supported (int dtype_, int op_)
+{
+    if (op_ < ZMQ_OP_SUM || op_ > ZMQ_OP_MAX)
+        return false;
+    return dtype_ >= ZMQ_DTYPE_U8 && dtype_ <= ZMQ_DTYPE_F64;
+}
+
+int zmq::reduce (void *dst_, const void *src_, size_t count_, int dtype_,
+    int op_)
+{
+    if (!reduce_supported (dtype_, op_)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+#ifdef ZMQ_HAVE_REDUCE_AVX2
+    if (op_ == ZMQ_OP_SUM && have_avx2 ()) {
+        switch (dtype_) {
+            case ZMQ_DTYPE_F16:
+                sum_f16_avx2 (dst_, src_, count_);
+                return 0;
+            case ZMQ_DTYPE_I32:
+                sum_i32_avx2 (dst_, src_, count_);
+                return 0;
+            case ZMQ_DTYPE_F32:
+                sum_f32_avx2 (dst_, src_, count_);
+                return 0;
+        }
+    }
+#endif
+
+    switch (dtype_) {
+        case ZMQ_DTYPE_U8:
+            reduce_typed <uint8_t> (dst_, src_, count_, op_);
+            break;
+        case ZMQ_DTYPE_I8:
+            reduce_typed <int8_t> (dst_, src_, count_, op_);
+            break;
+        case ZMQ_DTYPE_F16:
+            reduce_half <zmq::half_to_float, zmq::float_to_half> (dst_, src_,
+                count_, op_);
+            break;
+        case ZMQ_DTYPE_BF16:
+            reduce_half <zmq::bf16_to_float, zmq::float_to_bf16> (dst_, src_,
+                count_, op_);
+            break;
+        case ZMQ_DTYPE_I32:
+            reduce_typed <int32_t> (dst_, src_, count_, op_);
+            break;
+        case ZMQ_DTYPE_F32:
+            reduce_typed <float> (dst_, src_, count_, op_);
+            break;
+        case ZMQ_DTYPE_I64:
+            reduce_typed <int64_t> (dst_, src_, count_, op_);
+            break;
+        case ZMQ_DTYPE_F64:
+            reduce_typed <double> (dst_, src_, count_, op_);
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __ZMQ_REDUCE_HPP_INCLUDED__
+#define __ZMQ_REDUCE_HPP_INCLUDED__
+
+#include <stddef.h>
+
+namespace zmq
+{
+
+    //  Combines the count_ elements at src_ into those at dst_, element by
+    //  element, with op_ (one of ZMQ_OP_*). dtype_ is one of ZMQ_DTYPE_*;
+    //  16-bit floats are combined in single precision and rounded back.
+    //  Sums of f16, i32 and f32 use AVX2 where the CPU has it.
+    //  Returns -1 with errno set to EINVAL for an unknown type or op.
+    int reduce (void *dst_, const void *src_, size_t count_, int dtype_,
+        int op_);
+
+    //  True if reduce knows dtype_ and op_.
+    bool reduce_supported (int dtype_, int op_);
+
+}
+
+#endif
@@ -45,6 +45,7 @@ zmq::router_t::router_t (class ctx_t *parent_, uint32_t tid_, int sid_) :
     more_in (false),
     current_out (NULL),
     more_out (false),
+    hot_out (false),
     next_integral_routing_id (generate_random ()),
     mandatory (false),
     //  raw_socket functionality in ROUTER is deprecated
@@ -204,6 +205,7 @@ int zmq::router_t::xsend (msg_t *msg_)
         if (msg_->flags () & msg_t::more) {
 
             more_out = true;
+            hot_out = (msg_->flags () & msg_t::netml_hotdata) != 0;
 
             //  Find the pipe associated with the routing id stored in the prefix.
             //  If there's no such pipe just silently ignore the message, unless
@@ -216,9 +218,9 @@ int zmq::router_t::xsend (msg_t *msg_)
                 current_out = it->second.pipe;
 
                 // Check whether pipe is closed or not
-                if (!current_out->check_write()) {
+                if (!current_out->check_write (hot_out)) {
                     // Check whether pipe is full or not
-                    bool pipe_full = !current_out->check_hwm ();
+                    bool pipe_full = !current_out->check_hwm (hot_out);
                     it->second.active = false;
                     current_out = NULL;
 
@@ -254,6 +256,10 @@ int zmq::router_t::xsend (msg_t *msg_)
     //  Check whether this is the last part of the message.
     more_out = msg_->flags () & msg_t::more ? true : false;
 
+    //  The pipe takes the lane of a message from its first part.
+    if (hot_out)
+        msg_->set_flags (msg_t::netml_hotdata);
+
     //  Push the message into the pipe. If there's no out pipe, just drop it.
     if (current_out) {
 
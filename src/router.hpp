@@ -121,6 +121,11 @@ namespace zmq
         //  If true, more outgoing message parts are expected.
         bool more_out;
 
+        //  If true, the outgoing message goes in the hot lane of its pipe.
+        //  Set by ZMQ_HOT on the routing ID part, which is what the room
+        //  in the pipe is checked on.
+        bool hot_out;
+
         //  Routing IDs are generated. It's a simple increment and wrap-over
         //  algorithm. This value is the next ID to use (if not used already).
         uint32_t next_integral_routing_id;
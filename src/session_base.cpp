@@ -46,6 +46,7 @@
 #include "udp_engine.hpp"
 
 #include "ctx.hpp"
+#include "io_thread.hpp"
 #include "req.hpp"
 #include "radio.hpp"
 #include "dish.hpp"
@@ -84,6 +85,7 @@ zmq::session_base_t *zmq::session_base_t::create (class io_thread_t *io_thread_,
     case ZMQ_GATHER:
     case ZMQ_SCATTER:
     case ZMQ_DGRAM:
+    case ZMQ_AGGREGATOR:
         s = new (std::nothrow) session_base_t (io_thread_, active_,
             socket_, options_, addr_);
         break;
@@ -419,6 +421,30 @@ void zmq::session_base_t::process_attach (i_engine *engine_)
     engine->plug (io_thread, this);
 }
 
+bool zmq::session_base_t::can_migrate ()
+{
+    //  Objects created by the session inherit its host thread, moving a
+    //  second time could reorder their commands in flight.
+    return engine && pipe && !zap_pipe && terminating_pipes.empty ()
+        && !pending && !has_linger_timer && !is_terminating ()
+        && get_host_tid () == get_tid ();
+}
+
+bool zmq::session_base_t::migrate (io_thread_t *io_thread_)
+{
+    if (!can_migrate ())
+        return false;
+
+    //  The session has no timers or handles running at this point, only
+    //  its commands need to find the new thread.
+    io_object_t::unplug ();
+    io_object_t::plug (io_thread_);
+    io_thread = io_thread_;
+    set_host_tid (io_thread_->get_tid ());
+    pipe->set_host_tid (io_thread_->get_tid ());
+    return true;
+}
+
 void zmq::session_base_t::engine_error (
         zmq::stream_engine_t::error_reason_t reason)
 {
@@ -68,6 +68,12 @@ namespace zmq
         void flush ();
         void engine_error (zmq::stream_engine_t::error_reason_t reason);
 
+        //  Used by the engine to move the session along with itself to
+        //  io_thread_. It only moves while attached to the engine and the
+        //  socket, and only once. Returns false if it cannot move.
+        bool can_migrate ();
+        bool migrate (zmq::io_thread_t *io_thread_);
+
         //  i_pipe_events interface implementation.
         void read_activated (zmq::pipe_t *pipe_);
         void write_activated (zmq::pipe_t *pipe_);
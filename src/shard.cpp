@@ -0,0 +1,346 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "precompiled.hpp"
+#include "shard.hpp"
+#include "tensor.hpp"
+#include "msg_pool.hpp"
+#include "config.hpp"
+#include "likely.hpp"
+#include "err.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+    bool range_less (const zmq_shard_range_t &a_, const zmq_shard_range_t &b_)
+    {
+        return a_.key < b_.key || (a_.key == b_.key && a_.offset < b_.offset);
+    }
+
+    //  splitmix64 finaliser, spreads keys that differ in a few low bits.
+    uint64_t hash_key (uint64_t x_)
+    {
+        x_ += 0x9e3779b97f4a7c15ULL;
+        x_ = (x_ ^ (x_ >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x_ = (x_ ^ (x_ >> 27)) * 0x94d049bb133111ebULL;
+        return x_ ^ (x_ >> 31);
+    }
+}
+
+zmq::shard_t::shard_t ()
+{
+}
+
+zmq::shard_t::~shard_t ()
+{
+    for (gathers_t::iterator it = gathers.begin (); it != gathers.end (); ++it) {
+        int rc = it->second.msg.close ();
+        errno_assert (rc == 0);
+    }
+}
+
+int zmq::shard_t::set_ranges (const void *optval_, size_t optvallen_)
+{
+    if (optvallen_ % sizeof (zmq_shard_range_t) != 0 ||
+          (optvallen_ && !optval_)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const zmq_shard_range_t *entries =
+        static_cast <const zmq_shard_range_t *> (optval_);
+    std::vector <zmq_shard_range_t> table (entries,
+        entries + optvallen_ / sizeof (zmq_shard_range_t));
+    std::sort (table.begin (), table.end (), range_less);
+    for (size_t i = 0; i != table.size (); i++) {
+        if (table [i].remote_id == UINT16_MAX ||
+              (i && !range_less (table [i - 1], table [i]))) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    ranges.swap (table);
+    ring.clear ();
+    return 0;
+}
+
+int zmq::shard_t::set_ring (const void *optval_, size_t optvallen_)
+{
+    if (optvallen_ % sizeof (uint16_t) != 0 || (optvallen_ && !optval_)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const uint16_t *remotes = static_cast <const uint16_t *> (optval_);
+    ring_t points;
+    for (size_t i = 0; i != optvallen_ / sizeof (uint16_t); i++) {
+        uint16_t remote;
+        memcpy (&remote, remotes + i, sizeof remote);
+        if (remote == UINT16_MAX) {
+            errno = EINVAL;
+            return -1;
+        }
+        //  Every remote keeps its points whoever joins or leaves, so that
+        //  only the keys next to them move.
+        for (uint64_t p = 0; p != shard_ring_points; p++)
+            points.push_back (std::make_pair (
+                hash_key (((uint64_t) remote << 32) | p), remote));
+    }
+    std::sort (points.begin (), points.end ());
+
+    ring.swap (points);
+    ranges.clear ();
+    return 0;
+}
+
+bool zmq::shard_t::active () const
+{
+    return !ranges.empty () || !ring.empty ();
+}
+
+uint16_t zmq::shard_t::lookup (uint64_t key_, uint32_t offset_,
+    uint32_t &count_)
+{
+    if (!ring.empty ()) {
+        ring_t::iterator it = std::lower_bound (ring.begin (), ring.end (),
+            std::make_pair (hash_key (key_), (uint16_t) 0));
+        if (it == ring.end ())
+            it = ring.begin ();
+        return it->second;
+    }
+
+    //  The first range reaches down to the start of the key space.
+    zmq_shard_range_t pos;
+    pos.key = key_;
+    pos.offset = offset_;
+    std::vector <zmq_shard_range_t>::iterator next =
+        std::upper_bound (ranges.begin (), ranges.end (), pos, range_less);
+    std::vector <zmq_shard_range_t>::iterator it =
+        next == ranges.begin () ? next : next - 1;
+
+    if (next != ranges.end () && next->key == key_ &&
+          next->offset - offset_ < count_)
+        count_ = next->offset - offset_;
+    return it->remote_id;
+}
+
+int zmq::shard_t::split (msg_t *msg_, std::deque <msg_t> &out_)
+{
+    zmq_tensor_hdr_t hdr;
+    memcpy (&hdr, msg_->data (), sizeof hdr);
+    const bool request = msg_->size () == sizeof hdr;
+    const size_t esize = request ? 0 : tensor_dtype_size (hdr.dtype);
+    const unsigned char *elems =
+        static_cast <unsigned char *> (msg_->data ()) + sizeof hdr;
+    const unsigned char flags = msg_->flags () & ~msg_t::more;
+    const bool more = (msg_->flags () & msg_t::more) != 0;
+
+    const size_t first = out_.size ();
+
+    if (request && hdr.count && start_gather (hdr) != 0)
+        return -1;
+
+    uint32_t done = 0;
+    do {
+        uint32_t count = hdr.count - done;
+        uint16_t remote = lookup (hdr.key, hdr.offset + done, count);
+
+        //  A tensor that goes whole to one remote is passed on as it is,
+        //  unless it is too small to carry a remote ID.
+        if (count == hdr.count && msg_->set_remote_id (remote) == 0) {
+            out_.push_back (msg_t ());
+            msg_t &part = out_.back ();
+            int rc = part.init ();
+            errno_assert (rc == 0);
+            rc = part.move (*msg_);
+            errno_assert (rc == 0);
+            return 0;
+        }
+
+        zmq_tensor_hdr_t slice = hdr;
+        slice.offset = hdr.offset + done;
+        slice.count = count;
+        const size_t len = (size_t) count * esize;
+        unsigned char *data =
+            static_cast <unsigned char *> (pool_alloc (sizeof slice + len));
+        if (unlikely (!data))
+            return drop (out_, first);
+        memcpy (data, &slice, sizeof slice);
+        memcpy (data + sizeof slice, elems + (size_t) done * esize, len);
+
+        out_.push_back (msg_t ());
+        msg_t &part = out_.back ();
+        int rc = part.init_data (data, sizeof slice + len, call_pool_free,
+            NULL, remote);
+        if (unlikely (rc != 0)) {
+            pool_free (data);
+            out_.pop_back ();
+            return drop (out_, first);
+        }
+        done += count;
+
+        //  Only the last part continues into the parts that follow.
+        part.set_flags (flags);
+        if (done == hdr.count && more)
+            part.set_flags (msg_t::more);
+    } while (done < hdr.count);
+
+    int rc = msg_->close ();
+    errno_assert (rc == 0);
+    rc = msg_->init ();
+    errno_assert (rc == 0);
+    return 0;
+}
+
+int zmq::shard_t::drop (std::deque <msg_t> &out_, size_t first_)
+{
+    //  Nothing of a message goes out unless all of it does.
+    while (out_.size () > first_) {
+        int rc = out_.back ().close ();
+        errno_assert (rc == 0);
+        out_.pop_back ();
+    }
+    errno = ENOMEM;
+    return -1;
+}
+
+int zmq::shard_t::start_gather (const zmq_tensor_hdr_t &hdr_)
+{
+    const size_t esize = tensor_dtype_size (hdr_.dtype);
+
+    msg_t msg;
+    int rc = msg.init_size (sizeof hdr_ + (size_t) hdr_.count * esize);
+    if (unlikely (rc != 0))
+        return -1;
+    memcpy (msg.data (), &hdr_, sizeof hdr_);
+    msg.set_flags (msg_t::netml_key);
+
+    //  A new request for the key replaces the one still out.
+    gathers_t::iterator it = gathers.find (hdr_.key);
+    if (it == gathers.end ()) {
+        it = gathers.insert (std::make_pair (hdr_.key, gather_t ())).first;
+        rc = it->second.msg.init ();
+        errno_assert (rc == 0);
+    }
+    gather_t &g = it->second;
+    rc = g.msg.move (msg);
+    errno_assert (rc == 0);
+    g.offset = hdr_.offset;
+    g.count = hdr_.count;
+    g.done = 0;
+    g.covered.clear ();
+    return 0;
+}
+
+bool zmq::shard_t::cover (gather_t &g_, uint32_t begin_, uint32_t end_)
+{
+    covered_t::iterator next = g_.covered.upper_bound (begin_);
+    if (next != g_.covered.end () && next->first < end_)
+        return false;
+    if (next != g_.covered.begin ()) {
+        covered_t::iterator prev = next;
+        --prev;
+        if (prev->second > begin_)
+            return false;
+        if (prev->second == begin_) {
+            begin_ = prev->first;
+            g_.covered.erase (prev);
+        }
+    }
+    if (next != g_.covered.end () && next->first == end_) {
+        end_ = next->second;
+        g_.covered.erase (next);
+    }
+    g_.covered [begin_] = end_;
+    return true;
+}
+
+int zmq::shard_t::gather (msg_t *msg_)
+{
+    zmq_tensor_hdr_t hdr;
+    if (gathers.empty () || !(msg_->flags () & msg_t::netml_key) ||
+          msg_->size () < sizeof hdr)
+        return -1;
+    memcpy (&hdr, msg_->data (), sizeof hdr);
+
+    gathers_t::iterator it = gathers.find (hdr.key);
+    if (it == gathers.end ())
+        return -1;
+    gather_t &g = it->second;
+
+    //  Only elements within the request and of its type are taken.
+    zmq_tensor_hdr_t want;
+    memcpy (&want, g.msg.data (), sizeof want);
+    const size_t esize = tensor_dtype_size (want.dtype);
+    if (hdr.dtype != want.dtype || hdr.count == 0 ||
+          msg_->size () != sizeof hdr + (size_t) hdr.count * esize ||
+          hdr.offset < g.offset || hdr.offset - g.offset > g.count ||
+          hdr.count > g.count - (hdr.offset - g.offset))
+        return -1;
+
+    //  A repeated or overlapping answer would count elements twice.
+    int rc;
+    const uint32_t begin = hdr.offset - g.offset;
+    if (!cover (g, begin, begin + hdr.count)) {
+        rc = msg_->close ();
+        errno_assert (rc == 0);
+        rc = msg_->init ();
+        errno_assert (rc == 0);
+        return 0;
+    }
+
+    unsigned char *dst = static_cast <unsigned char *> (g.msg.data ());
+    memcpy (dst + sizeof hdr + (size_t) begin * esize,
+        static_cast <unsigned char *> (msg_->data ()) + sizeof hdr,
+        (size_t) hdr.count * esize);
+    want.version = hdr.version;
+    memcpy (dst, &want, sizeof want);
+    g.done += hdr.count;
+
+    if (g.done < g.count) {
+        rc = msg_->close ();
+        errno_assert (rc == 0);
+        rc = msg_->init ();
+        errno_assert (rc == 0);
+        return 0;
+    }
+
+    //  The tensor continues into whatever its last answer did.
+    const bool more = (msg_->flags () & msg_t::more) != 0;
+    rc = msg_->move (g.msg);
+    errno_assert (rc == 0);
+    if (more)
+        msg_->set_flags (msg_t::more);
+    gathers.erase (it);
+    return 1;
+}
@@ -0,0 +1,123 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __ZMQ_SHARD_HPP_INCLUDED__
+#define __ZMQ_SHARD_HPP_INCLUDED__
+
+#include <stddef.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "../include/zmq.h"
+#include "stdint.hpp"
+#include "msg.hpp"
+
+namespace zmq
+{
+
+    //  Routes keyed messages to the remotes that hold their elements, all
+    //  over the one connection of a NetML socket. The map is either a
+    //  table of ranges, which may cut a tensor between several remotes,
+    //  or a consistent hash ring that sends every tensor whole to one.
+    //  The answers to a request (a tensor header without elements) are
+    //  gathered back into one message per key.
+
+    class shard_t
+    {
+    public:
+
+        shard_t ();
+        ~shard_t ();
+
+        //  Replace the map, from the next message on. An empty value
+        //  removes it. Requests still out are gathered all the same.
+        int set_ranges (const void *optval_, size_t optvallen_);
+        int set_ring (const void *optval_, size_t optvallen_);
+
+        bool active () const;
+
+        //  Cuts the keyed message msg_ into one message per remote holding
+        //  some of its elements and appends them to out_, each with its
+        //  remote ID set. msg_ is left empty.
+        int split (msg_t *msg_, std::deque <msg_t> &out_);
+
+        //  Takes the keyed message msg_ into the gather it answers.
+        //  Returns -1 if it answers none, 0 if it was taken, or dropped
+        //  for answering elements answered already, and msg_ left empty,
+        //  1 if it completed the gather and msg_ holds the tensor.
+        int gather (msg_t *msg_);
+
+    private:
+
+        //  The remote holding element offset_ of tensor key_. count_ is
+        //  cut down to the elements it holds from there.
+        uint16_t lookup (uint64_t key_, uint32_t offset_, uint32_t &count_);
+
+        //  Prepares the message the answers to hdr_ are gathered into.
+        int start_gather (const zmq_tensor_hdr_t &hdr_);
+
+        //  Closes the messages split from first_ on. Returns -1.
+        int drop (std::deque <msg_t> &out_, size_t first_);
+
+        //  Sorted by key and offset.
+        std::vector <zmq_shard_range_t> ranges;
+
+        //  Points of the remotes on the hash ring, sorted.
+        typedef std::vector <std::pair <uint64_t, uint16_t> > ring_t;
+        ring_t ring;
+
+        //  The elements answered so far, as ranges by their first
+        //  element, relative to the offset of the request. Adjacent ranges
+        //  are merged, so there are few.
+        typedef std::map <uint32_t, uint32_t> covered_t;
+
+        struct gather_t
+        {
+            msg_t msg;
+            uint32_t offset;
+            uint32_t count;
+            uint32_t done;
+            covered_t covered;
+        };
+        typedef std::map <uint64_t, gather_t> gathers_t;
+        gathers_t gathers;
+
+        //  Records the elements [begin_, end_) of g_ as answered. Returns
+        //  false if some of them were already.
+        static bool cover (gather_t &g_, uint32_t begin_, uint32_t end_);
+
+        shard_t (const shard_t&);
+        const shard_t &operator = (const shard_t&);
+    };
+
+}
+
+#endif
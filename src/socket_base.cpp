@@ -96,6 +96,8 @@
 #include "gather.hpp"
 #include "scatter.hpp"
 #include "dgram.hpp"
+#include "aggregator.hpp"
+#include "tensor.hpp"
 
 
 
@@ -166,6 +168,9 @@ zmq::socket_base_t *zmq::socket_base_t::create (int type_, class ctx_t *parent_,
         case ZMQ_DGRAM:
             s = new (std::nothrow) dgram_t (parent_, tid_, sid_);
             break;
+        case ZMQ_AGGREGATOR:
+            s = new (std::nothrow) aggregator_t (parent_, tid_, sid_);
+            break;
         default:
             errno = EINVAL;
             return NULL;
@@ -1108,7 +1113,11 @@ int zmq::socket_base_t::term_endpoint (const char *addr_)
 int zmq::socket_base_t::send (msg_t *msg_, int flags_)
 {
     scoped_optional_lock_t sync_lock(thread_safe ? &sync : NULL);
+    return send_locked (msg_, flags_);
+}
 
+int zmq::socket_base_t::send_locked (msg_t *msg_, int flags_)
+{
     //  Check whether the library haven't been shut down yet.
     if (unlikely (ctx_terminated)) {
         errno = ETERM;
@@ -1121,32 +1130,20 @@ int zmq::socket_base_t::send (msg_t *msg_, int flags_)
         return -1;
     }
 
+    //  A keyed message must be a tensor the engine can cut into chunks.
+    if (unlikely ((flags_ & ZMQ_KEY) &&
+          !check_tensor (msg_->data (), msg_->size ()))) {
+        errno = EINVAL;
+        return -1;
+    }
+
     //  Process pending commands, if any.
     int rc = process_commands (0, true);
     if (unlikely (rc != 0)) {
         return -1;
     }
 
-    //  Clear any user-visible flags that are set on the message.
-    msg_->reset_flags (msg_t::more);
-
-    //  At this point we impose the flags on the message.
-    if (flags_ & ZMQ_SNDMORE)
-        msg_->set_flags (msg_t::more);
-
-	msg_->reset_flags (msg_t::netml_data);
-	if (flags_ & ZMQ_DATA)
-		msg_->set_flags (msg_t::netml_data);
-
-	msg_->reset_flags (msg_t::netml_hotdata);
-	if (flags_ & ZMQ_HOT)
-		msg_->set_flags (msg_t::netml_hotdata);
-
-	msg_->reset_flags (msg_t::netml_key);
-	if (flags_ & ZMQ_KEY)
-		msg_->set_flags (msg_t::netml_key);
-
-    msg_->reset_metadata ();
+    impose_flags (msg_, flags_);
 
     //  Try to send the message using method in each socket class
     rc = xsend (msg_);
@@ -1193,10 +1190,122 @@ int zmq::socket_base_t::send (msg_t *msg_, int flags_)
     return 0;
 }
 
+int zmq::socket_base_t::send_many (zmq_mmsg_t *msgs_, int count_, int flags_)
+{
+    scoped_optional_lock_t sync_lock(thread_safe ? &sync : NULL);
+
+    if (unlikely (!msgs_ || count_ <= 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (unlikely (ctx_terminated)) {
+        errno = ETERM;
+        return -1;
+    }
+
+    //  The pending commands are processed once for the whole batch.
+    if (unlikely (process_commands (0, true) != 0))
+        return -1;
+
+    //  The pipes note the flushes due from here on and do them once at
+    //  the end. No commands are processed while they do, so no pipe is
+    //  attached or terminated meanwhile.
+    defer_flushes (true);
+
+    int sent = 0;
+    while (sent < count_) {
+        msg_t *msg = (msg_t *) msgs_ [sent].msg;
+        if (unlikely (!msg || !msg->check ())) {
+            errno = EFAULT;
+            break;
+        }
+        if (msgs_ [sent].remote_id != UINT16_MAX
+         && msg->set_remote_id (msgs_ [sent].remote_id) != 0)
+            break;
+        if (unlikely ((msgs_ [sent].flags & ZMQ_KEY) &&
+              !check_tensor (msg->data (), msg->size ()))) {
+            errno = EINVAL;
+            break;
+        }
+        impose_flags (msg, msgs_ [sent].flags);
+        if (xsend (msg) != 0) {
+            //  Only the first message may wait for room, the usual way.
+            //  The commands it waits for can change the pipes, so the
+            //  flushes are not deferred while it does.
+            if (sent != 0 || errno != EAGAIN || (flags_ & ZMQ_DONTWAIT) ||
+                  options.sndtimeo == 0)
+                break;
+            defer_flushes (false);
+            if (send_locked (msg, msgs_ [0].flags) != 0)
+                return -1;
+            defer_flushes (true);
+        }
+        sent++;
+    }
+
+    defer_flushes (false);
+
+    if (sent == 0)
+        return -1;
+    return sent;
+}
+
+void zmq::socket_base_t::defer_flushes (bool defer_)
+{
+    for (pipes_t::size_type i = 0; i != pipes.size (); ++i)
+        pipes [i]->defer_flush (defer_);
+}
+
+int zmq::socket_base_t::recv_many (zmq_mmsg_t *msgs_, int count_, int flags_)
+{
+    scoped_optional_lock_t sync_lock(thread_safe ? &sync : NULL);
+
+    if (unlikely (!msgs_ || count_ <= 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    //  The first message goes the usual way, the rest is only what is
+    //  already there.
+    int received = 0;
+    while (received < count_) {
+        msg_t *msg = (msg_t *) msgs_ [received].msg;
+        if (received == 0) {
+            if (recv_locked (msg, flags_) != 0)
+                return -1;
+        }
+        else {
+            if (unlikely (!msg || !msg->check ()) || xrecv (msg) != 0)
+                break;
+            extract_flags (msg);
+        }
+
+        int flags = 0;
+        if (msg->flags () & msg_t::more)
+            flags |= ZMQ_SNDMORE;
+        if (msg->flags () & msg_t::netml_data)
+            flags |= ZMQ_DATA;
+        if (msg->flags () & msg_t::netml_hotdata)
+            flags |= ZMQ_HOT;
+        if (msg->flags () & msg_t::netml_key)
+            flags |= ZMQ_KEY;
+        msgs_ [received].flags = flags;
+        msgs_ [received].remote_id = (uint16_t) msg->get_remote_id ();
+        received++;
+    }
+
+    return received;
+}
+
 int zmq::socket_base_t::recv (msg_t *msg_, int flags_)
 {
     scoped_optional_lock_t sync_lock(thread_safe ? &sync : NULL);
+    return recv_locked (msg_, flags_);
+}
 
+int zmq::socket_base_t::recv_locked (msg_t *msg_, int flags_)
+{
     //  Check whether the library haven't been shut down yet.
     if (unlikely (ctx_terminated)) {
         errno = ETERM;
@@ -1264,7 +1373,13 @@ int zmq::socket_base_t::recv (msg_t *msg_, int flags_)
     //  we are able to fetch a message.
     bool block = (ticks != 0);
     while (true) {
-        if (unlikely (process_commands (block ? timeout : 0, false) != 0)) {
+        //  Timers of the socket fire from xrecv, so the wait is cut short
+        //  for the next one.
+        int wait = block ? timeout : 0;
+        const int next = xnext_timeout ();
+        if (next >= 0 && (wait < 0 || next < wait))
+            wait = next;
+        if (unlikely (process_commands (wait, false) != 0)) {
             return -1;
         }
         rc = xrecv (msg_);
@@ -1319,6 +1434,12 @@ bool zmq::socket_base_t::has_out ()
     return xhas_out ();
 }
 
+int zmq::socket_base_t::next_timeout ()
+{
+    scoped_optional_lock_t sync_lock(thread_safe ? &sync : NULL);
+    return xnext_timeout ();
+}
+
 void zmq::socket_base_t::start_reaping (poller_t *poller_)
 {
     //  Plug the socket to the reaper thread.
@@ -1502,6 +1623,11 @@ int zmq::socket_base_t::xleave (const char *group_)
     return -1;
 }
 
+int zmq::socket_base_t::xnext_timeout ()
+{
+    return -1;
+}
+
 int zmq::socket_base_t::xrecv (msg_t *)
 {
     errno = ENOTSUP;
@@ -1624,6 +1750,30 @@ void zmq::socket_base_t::extract_flags (msg_t *msg_)
     rcvmore = msg_->flags () & msg_t::more ? true : false;
 }
 
+void zmq::socket_base_t::impose_flags (msg_t *msg_, int flags_)
+{
+    //  Clear any user-visible flags that are set on the message.
+    msg_->reset_flags (msg_t::more);
+
+    //  At this point we impose the flags on the message.
+    if (flags_ & ZMQ_SNDMORE)
+        msg_->set_flags (msg_t::more);
+
+	msg_->reset_flags (msg_t::netml_data);
+	if (flags_ & ZMQ_DATA)
+		msg_->set_flags (msg_t::netml_data);
+
+	msg_->reset_flags (msg_t::netml_hotdata);
+	if (flags_ & ZMQ_HOT)
+		msg_->set_flags (msg_t::netml_hotdata);
+
+	msg_->reset_flags (msg_t::netml_key);
+	if (flags_ & ZMQ_KEY)
+		msg_->set_flags (msg_t::netml_key);
+
+    msg_->reset_metadata ();
+}
+
 int zmq::socket_base_t::monitor (const char *addr_, int events_)
 {
     scoped_lock_t lock(monitor_sync);
@@ -95,6 +95,13 @@ namespace zmq
         int term_endpoint (const char *addr_);
         int send (zmq::msg_t *msg_, int flags_);
         int recv (zmq::msg_t *msg_, int flags_);
+
+        //  Send or receive up to count_ messages, as many as can go without
+        //  blocking once the first one went. Pending commands are processed
+        //  and the pipes are flushed once per batch. Return the number of
+        //  messages that went.
+        int send_many (zmq_mmsg_t *msgs_, int count_, int flags_);
+        int recv_many (zmq_mmsg_t *msgs_, int count_, int flags_);
         int add_signaler (signaler_t *s);
         int remove_signaler (signaler_t *s);
         int close ();
@@ -104,6 +111,11 @@ namespace zmq
         bool has_in ();
         bool has_out ();
 
+        //  Milliseconds until the socket has work of its own to do that no
+        //  input will wake it for, -1 if none. Blocking calls and pollers
+        //  wait no longer than that.
+        int next_timeout ();
+
         //  Joining and leaving groups
         int join (const char *group);
         int leave (const char *group);
@@ -172,6 +184,9 @@ namespace zmq
         virtual bool xhas_in ();
         virtual int xrecv (zmq::msg_t *msg_);
 
+        //  The default implementation assumes there are no timers.
+        virtual int xnext_timeout ();
+
         //  Returns the credential for the peer from which we have received
         //  the last message. If no message has been received yet,
         //  the function returns empty credential.
@@ -223,6 +238,19 @@ namespace zmq
         //  to be later retrieved by getsockopt.
         void extract_flags (msg_t *msg_);
 
+        //  Imposes the send flags on the message.
+        void impose_flags (msg_t *msg_, int flags_);
+
+        //  The bodies of send and recv, for callers that already hold
+        //  sync. A blocking wait releases sync only once, so it must not
+        //  be taken twice.
+        int send_locked (msg_t *msg_, int flags_);
+        int recv_locked (msg_t *msg_, int flags_);
+
+        //  Defers the flushes of all pipes, or does the ones due, for
+        //  send_many.
+        void defer_flushes (bool defer_);
+
         //  Used to check whether the object is a socket.
         uint32_t tag;
 
@@ -527,6 +527,18 @@ int zmq::socket_poller_t::adjust_timeout (zmq::clock_t& clock, long timeout_,
     return 1;
 }
 
+int zmq::socket_poller_t::cap_timeout (int timeout_)
+{
+    for (items_t::iterator it = items.begin (); it != items.end (); ++it) {
+        if (!it->socket)
+            continue;
+        const int next = it->socket->next_timeout ();
+        if (next >= 0 && (timeout_ < 0 || next < timeout_))
+            timeout_ = next;
+    }
+    return timeout_;
+}
+
 int zmq::socket_poller_t::wait (zmq::socket_poller_t::event_t *events_,
                                                          int n_events_,
                                                          long timeout_)
@@ -580,6 +592,8 @@ int zmq::socket_poller_t::wait (zmq::socket_poller_t::event_t *events_,
             timeout = -1;
         else
             timeout = end - now;
+        if (!first_pass)
+            timeout = cap_timeout (timeout);
 
         //  Wait for events.
         while (true) {
@@ -630,13 +644,15 @@ int zmq::socket_poller_t::wait (zmq::socket_poller_t::event_t *events_,
             timeout.tv_usec = 0;
             ptimeout = &timeout;
         }
-        else
-        if (timeout_ < 0)
-            ptimeout = NULL;
         else {
-            timeout.tv_sec = (long) ((end - now) / 1000);
-            timeout.tv_usec = (long) ((end - now) % 1000 * 1000);
-            ptimeout = &timeout;
+            const int ms = cap_timeout (timeout_ < 0 ? -1 : (int) (end - now));
+            if (ms < 0)
+                ptimeout = NULL;
+            else {
+                timeout.tv_sec = (long) (ms / 1000);
+                timeout.tv_usec = (long) (ms % 1000 * 1000);
+                ptimeout = &timeout;
+            }
         }
 
         //  Wait for events. Ignore interrupts if there's infinite timeout.
@@ -96,6 +96,10 @@ namespace zmq
         int adjust_timeout (zmq::clock_t& clock, long timeout_, uint64_t& now,
                                                           uint64_t& end,
                                                           bool& first_pass);
+
+        //  Caps timeout_ (-1 for none) at the next timeout of the sockets
+        //  polled, see socket_base_t::next_timeout.
+        int cap_timeout (int timeout_);
         void rebuild ();
 
         //  Used to check whether the object is a socket_poller.
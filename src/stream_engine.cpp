@@ -61,23 +61,52 @@
 #include "tcp.hpp"
 #include "likely.hpp"
 #include "wire.hpp"
+#include "tensor.hpp"
+#include "v2_protocol.hpp"
 
 #include "lwipopts.h"
+#include "lwip/pbuf.h"
+#include "lwip/sockets.h"
+#include "lwip/api.h"
+#include "lwip/netml_raw.h"
+#include "lwip/netml_trace.h"
+#include "zmqlwip.h"
+
+namespace
+{
+    //  Keeps the body of a message sent by reference alive: the msg_t copy
+    //  holds a reference on the content after the encoder has closed
+    //  tx_msg. lwIP calls this once the last segment carrying the body
+    //  has been acked.
+    void zerocopy_msg_free (void *arg_)
+    {
+        zmq::msg_t *msg = static_cast <zmq::msg_t *> (arg_);
+        int rc = msg->close ();
+        errno_assert (rc == 0);
+        delete msg;
+    }
+}
 
 zmq::stream_engine_t::stream_engine_t (fd_t fd_, const options_t &options_,
                                        const std::string &endpoint_) :
     s (fd_),
+    raw (NULL),
     as_server(false),
     handle((handle_t)NULL),
     inpos (NULL),
     insize (0),
+    inpbuf (NULL),
     decoder (NULL),
 	outpos (NULL),
 	outsize (0),
 	encoder (NULL),
-	last_remote (UINT16_MAX),
-	is_msg_end (true),
-	is_hot (false),
+	next_output (0),
+	pull_lane (NULL),
+	pending_msgs (0),
+	out_vec (NULL),
+	out_vec_pos (0),
+	out_vec_cnt (0),
+	out_done_cnt (0),
     metadata (NULL),
     handshaking (true),
     greeting_size (v2_greeting_size),
@@ -86,6 +115,10 @@ zmq::stream_engine_t::stream_engine_t (fd_t fd_, const options_t &options_,
     options (options_),
     endpoint (endpoint_),
     plugged (false),
+    io_thread (NULL),
+    migrate_to (NULL),
+    traffic_bytes (0),
+    traffic_packets (0),
     next_msg (&stream_engine_t::routing_id_msg),
     process_msg (&stream_engine_t::process_routing_id_msg),
     io_error (false),
@@ -103,6 +136,10 @@ zmq::stream_engine_t::stream_engine_t (fd_t fd_, const options_t &options_,
     int rc = tx_msg.init ();
     errno_assert (rc == 0);
 
+	out_vec = (struct netml_vector *) malloc (max_out_vectors *
+					sizeof (struct netml_vector));
+	alloc_assert (out_vec);
+
     //  Put the socket into non-blocking mode.
     unblock_socket (s, true);
 
@@ -165,6 +202,11 @@ zmq::stream_engine_t::~stream_engine_t ()
         s = retired_fd;
     }
 
+    if (raw) {
+        netml_raw_close (raw);
+        raw = NULL;
+    }
+
     int rc = tx_msg.close ();
     errno_assert (rc == 0);
 
@@ -176,7 +218,29 @@ zmq::stream_engine_t::~stream_engine_t ()
         }
     }
 
+    release_inpbuf ();
+
 	LIBZMQ_DELETE(encoder);
+	for (size_t i = 0; i < outputs.size (); i++) {
+		for (int l = 0; l < 2; l++) {
+			out_lane_t &lane = outputs [i]->lanes [l];
+			LIBZMQ_DELETE(lane.encoder);
+			rc = lane.msg.close ();
+			errno_assert (rc == 0);
+			while (!lane.pending.empty ()) {
+				rc = lane.pending.front ().close ();
+				errno_assert (rc == 0);
+				lane.pending.pop_front ();
+			}
+			if (lane.zc)
+				netml_ref_put (lane.zc);
+			free (lane.kbuf);
+		}
+		delete outputs [i];
+	}
+	for (int i = 0; i < out_done_cnt; i++)
+		netml_ref_put (out_done [i]);
+	free (out_vec);
     LIBZMQ_DELETE(decoder);
     LIBZMQ_DELETE(mechanism);
 }
@@ -200,7 +264,18 @@ void zmq::stream_engine_t::plug (io_thread_t *io_thread_,
 
 	// connect to I/O threads poller object
 	io_object_t::plug(io_thread_);
-	handle = add_fd_lwip(s);
+	io_thread = io_thread_;
+	io_thread->register_engine(this);
+	if (options.raw_pcb) {
+		raw = netml_raw_attach(s);
+		if (raw)
+			s = retired_fd;
+		else
+			fprintf(stderr, "[%s][%d]: cannot take over socket %d (%d), "
+							"staying on the socket layer\n",
+							__FILE__, __LINE__, s, errno);
+	}
+	handle = raw ? add_raw_lwip(raw) : add_fd_lwip(s);
 	io_error = false;
 
 	decoder = new (std::nothrow)v2_decoder_t(in_batch_size, options.maxmsgsize);
@@ -212,6 +287,10 @@ void zmq::stream_engine_t::plug (io_thread_t *io_thread_,
 	if (!is_ctl) {
 		next_msg = &stream_engine_t::pull_msg_from_session;
 		process_msg = &stream_engine_t::push_msg_to_session;
+
+		//  NetML connections have no handshake to agree on a codec in,
+		//  so the option applies as set. Every receiver decodes them all.
+		codec.set (options.tensor_codec, options.tensor_topk);
 	}
 
 	handshaking = false;
@@ -248,11 +327,19 @@ void zmq::stream_engine_t::unplug ()
         cancel_timer (heartbeat_ivl_timer_id);
         has_heartbeat_timer = false;
     }
+
+    if (migrate_to) {
+        cancel_timer (migrate_timer_id);
+        migrate_to = NULL;
+    }
+
     //  Cancel all fd subscriptions.
     if (!io_error)
         rm_fd_lwip (handle);
 
     //  Disconnect from I/O threads poller object.
+    io_thread->unregister_engine (this);
+    io_thread = NULL;
     io_object_t::unplug ();
 
     session = NULL;
@@ -286,14 +373,12 @@ void zmq::stream_engine_t::in_event ()
     //  If there's no data to process in the buffer... 
     if (!insize) {
 
-        //  Retrieve the buffer and read as much data as possible.
-        //  Note that buffer can be arbitrarily large. However, we assume
-        //  the underlying TCP layer has fixed buffer size and thus the
-        //  number of bytes read will be always limited.
-        size_t bufsize = 0;
-        decoder->get_buffer (&inpos, &bufsize);
-
-        const int rc = tcp_read (s, inpos, bufsize);
+        //  Take over the next received pbuf and decode straight out of
+        //  its payload. The decoder keeps its own reference on the pbuf
+        //  for message bodies it does not copy.
+        release_inpbuf ();
+        const int rc = raw ? tcp_read_pbuf (raw, &inpbuf)
+                           : tcp_read_pbuf (s, &inpbuf);
 
         if (rc == 0) {
             // connection closed by peer
@@ -311,9 +396,10 @@ void zmq::stream_engine_t::in_event ()
         }
 
         //  Adjust input size
+        inpos = (unsigned char *) inpbuf->payload;
         insize = static_cast <size_t> (rc);
-        // Adjust buffer size to received bytes
-        decoder->resize_buffer(insize);
+        account (insize, 1);
+        decoder->set_pbuf (inpbuf);
     }
 
     int rc = 0;
@@ -337,6 +423,9 @@ void zmq::stream_engine_t::in_event ()
             break;
     }
 
+    if (!insize)
+        release_inpbuf ();
+
     //  Tear down the connection if we have failed to decode input data
     //  or the session has rejected the message.
     if (rc == -1) {
@@ -352,100 +441,383 @@ void zmq::stream_engine_t::in_event ()
     session->flush ();
 }
 
-void zmq::stream_engine_t::data_out_event()
+zmq::stream_engine_t::outctl *zmq::stream_engine_t::get_output (uint16_t id_)
 {
-	bool is_clear = false;
+	std::map <uint16_t, outctl *>::iterator it = targets.find (id_);
+	if (it != targets.end ())
+		return it->second;
+
+	outctl *out = new (std::nothrow) outctl;
+	alloc_assert (out);
+	out->id = id_;
+	out->deficit = 0;
+	for (int i = 0; i < 2; i++) {
+		out_lane_t &lane = out->lanes [i];
+		lane.encoder = new (std::nothrow) v2_encoder_t (out_batch_size);
+		alloc_assert (lane.encoder);
+		int rc = lane.msg.init ();
+		errno_assert (rc == 0);
+		lane.outpos = NULL;
+		lane.outsize = 0;
+		lane.zc = NULL;
+		lane.zcbody = NULL;
+		lane.zcsize = 0;
+		lane.kbuf = NULL;
+		lane.kcap = 0;
+		lane.kpos = NULL;
+		lane.ksize = 0;
+		lane.krec = 0;
+	}
+	outputs.push_back (out);
+	targets.insert (std::make_pair (id_, out));
+	return out;
+}
 
-	while (!is_clear) {
-		outpos = NULL;
-		outsize = encoder->encode(&outpos, 0);
+void zmq::stream_engine_t::queue_data_msg ()
+{
+	//  The frames of a multi-part message follow the first one, so that
+	//  they end up in the same stream.
+	if (!pull_lane) {
+		outctl *out = get_output ((uint16_t) tx_msg.get_remote_id ());
+		pull_lane = &out->lanes [(tx_msg.flags () & msg_t::netml_hotdata) ?
+						1 : 0];
+	}
 
-#if 0
-		if (has_remain) {
-			encoder->load_msg(&tx_msg);
+	NETML_TRACE (ZMQ, ENGINE_QUEUE, tx_msg.get_remote_id (), tx_msg.flags (),
+				tx_msg.size (), pending_msgs, this);
 
-			unsigned char *bufptr = outpos + outsize;
-			size_t n = encoder->encode(&bufptr, out_batch_size - outsize);
+	pull_lane->pending.push_back (msg_t ());
+	msg_t &queued = pull_lane->pending.back ();
+	int rc = queued.init ();
+	errno_assert (rc == 0);
+	rc = queued.move (tx_msg);
+	errno_assert (rc == 0);
+	pending_msgs++;
 
-			zmq_assert(n > 0);
-			if (outpos == NULL)
-				outpos = bufptr;
-			outsize += n;
+	if (!(queued.flags () & msg_t::more))
+		pull_lane = NULL;
+}
+
+bool zmq::stream_engine_t::fill_lane (out_lane_t &lane_)
+{
+	if (lane_.outsize || lane_.zcsize || lane_.ksize)
+		return true;
+
+	lane_.outpos = NULL;
+	lane_.outsize = lane_.encoder->encode (&lane_.outpos, 0);
+
+	while (lane_.outsize < (size_t) out_batch_size && !lane_.pending.empty ()) {
+		//  The chunks of a keyed message start a segment, they wait for
+		//  what is batched ahead of them to go out first.
+		bool keyed = (lane_.pending.front ().flags () & msg_t::netml_key) != 0;
+		if (keyed && lane_.outsize)
+			break;
 
-			if (!(tx_msg.flags() & msg_t::more)) {
-				is_msg_end = true;
+		int rc = lane_.msg.move (lane_.pending.front ());
+		errno_assert (rc == 0);
+		lane_.pending.pop_front ();
+		pending_msgs--;
+
+		if (keyed) {
+			encode_chunks (lane_);
+			break;
+		}
+
+		lane_.encoder->load_msg (&lane_.msg);
+
+		unsigned char *bufptr = lane_.outpos + lane_.outsize;
+		size_t n = 0;
+
+		if (lane_.msg.size () >= zerocopy_send_threshold
+				|| (lane_.msg.size () && zmq_lwip_memory_registered (
+						lane_.msg.data (), lane_.msg.size ()))) {
+			//  Pin the body before the encoder lets go of the message,
+			//  only the frame header goes into the batch.
+			msg_t *pinned = new (std::nothrow) msg_t;
+			alloc_assert (pinned);
+			rc = pinned->init ();
+			errno_assert (rc == 0);
+			rc = pinned->copy (lane_.msg);
+			errno_assert (rc == 0);
+			lane_.zc = netml_ref_alloc (zerocopy_msg_free, pinned);
+			alloc_assert (lane_.zc);
+
+			n = lane_.encoder->encode_zerocopy (&bufptr,
+							out_batch_size - lane_.outsize,
+							&lane_.zcbody, &lane_.zcsize);
+			if (!lane_.zcbody) {
+				netml_ref_put (lane_.zc);
+				lane_.zc = NULL;
 			}
 		}
-#endif
-		while (outsize < (size_t)out_batch_size) {
-			uint16_t remote = 0;
-			uint8_t flags;
+		else
+			n = lane_.encoder->encode (&bufptr,
+							out_batch_size - lane_.outsize);
+
+		zmq_assert (n > 0);
+		if (lane_.outpos == NULL)
+			lane_.outpos = bufptr;
+		lane_.outsize += n;
+
+		//  The body has to go out right behind its header.
+		if (lane_.zc)
+			break;
+	}
+
+	return lane_.outsize || lane_.zcsize || lane_.ksize;
+}
+
+void zmq::stream_engine_t::encode_chunks (out_lane_t &lane_)
+{
+	//  Checked by the socket on send.
+	zmq_tensor_hdr_t hdr;
+	zmq_assert (check_tensor (lane_.msg.data (), lane_.msg.size ()));
+	memcpy (&hdr, lane_.msg.data (), sizeof hdr);
+	const unsigned char *elems =
+		static_cast <unsigned char *> (lane_.msg.data ()) + sizeof hdr;
+
+	//  Every chunk is a frame of its own: flags, codec, size, tensor
+	//  header and as many whole elements as fit behind them. A request,
+	//  which has the header only, goes in one.
+	const size_t frame_hdr = 6 + tensor_hdr_size;
+	const bool request = lane_.msg.size () == sizeof hdr;
+	const size_t esize = request ? 0 : tensor_dtype_size (hdr.dtype);
+	const bool coded = !request && hdr.count &&
+					hdr.dtype == ZMQ_DTYPE_F32 &&
+					codec.codec () != ZMQ_CODEC_NONE;
+	const size_t per_chunk = request ? hdr.count :
+					coded ? codec.chunk_count (NETML_CHUNK_MAX - frame_hdr) :
+					(NETML_CHUNK_MAX - frame_hdr) / esize;
+	const size_t chunks = request || !hdr.count ? 1 :
+					(hdr.count + per_chunk - 1) / per_chunk;
+	const size_t last = (size_t) hdr.count - (chunks - 1) * per_chunk;
+	const size_t chunk_size = coded ? codec.coded_size (per_chunk) :
+					per_chunk * esize;
+	const size_t total = chunks * frame_hdr + (chunks - 1) * chunk_size +
+					(coded ? codec.coded_size (last) : last * esize);
+
+	if (lane_.kcap < total) {
+		free (lane_.kbuf);
+		lane_.kbuf = (unsigned char *) malloc (total);
+		alloc_assert (lane_.kbuf);
+		lane_.kcap = total;
+	}
+
+	unsigned char *pos = lane_.kbuf;
+	zmq_tensor_hdr_t chunk = hdr;
+	for (size_t i = 0; i < chunks; i++) {
+		chunk.offset = hdr.offset + (uint32_t) (i * per_chunk);
+		chunk.count = (uint32_t) std::min (per_chunk,
+						(size_t) hdr.count - i * per_chunk);
+		const size_t len = coded ? codec.coded_size (chunk.count) :
+						chunk.count * esize;
+
+		//  The chunks arrive as the parts of one message.
+		unsigned char flags = v2_protocol_t::large_flag |
+						v2_protocol_t::key_flag;
+		if (i + 1 < chunks || (lane_.msg.flags () & msg_t::more))
+			flags |= v2_protocol_t::more_flag;
+		pos [0] = flags;
+		pos [1] = coded ? (unsigned char) codec.codec () : 0;
+		put_uint32 (pos + 2, (uint32_t) (tensor_hdr_size + len));
+		put_tensor_hdr (pos + 6, chunk);
+		if (coded)
+			codec.encode (elems, chunk.count, pos + frame_hdr);
+		else
+			memcpy (pos + frame_hdr, elems, len);
+		elems += chunk.count * esize;
+		pos += frame_hdr + len;
+	}
+
+	lane_.kpos = lane_.kbuf;
+	lane_.ksize = total;
+	lane_.krec = frame_hdr + chunk_size;
+
+	int rc = lane_.msg.close ();
+	errno_assert (rc == 0);
+	rc = lane_.msg.init ();
+	errno_assert (rc == 0);
+}
 
+int zmq::stream_engine_t::emit_lane (out_lane_t &lane_, uint16_t id_,
+				bool hot_, int64_t &budget_, struct netml_vector *vec_,
+				struct netml_ref **done_)
+{
+	int cnt = 0;
+
+	if (lane_.outsize && budget_ > 0) {
+		size_t n = std::min (lane_.outsize, (size_t) budget_);
+		vec_ [cnt].ptr = lane_.outpos;
+		vec_ [cnt].len = n;
+		vec_ [cnt].remote_id = id_;
+		vec_ [cnt].is_hot = hot_;
+		vec_ [cnt].ref = NULL;
+		vec_ [cnt].chunk = 0;
+		cnt++;
+		lane_.outpos += n;
+		lane_.outsize -= n;
+		budget_ -= n;
+	}
+
+	if (!lane_.outsize && lane_.zcsize && budget_ > 0) {
+		size_t n = std::min (lane_.zcsize, (size_t) budget_);
+		vec_ [cnt].ptr = lane_.zcbody;
+		vec_ [cnt].len = n;
+		vec_ [cnt].remote_id = id_;
+		vec_ [cnt].is_hot = hot_;
+		vec_ [cnt].ref = lane_.zc;
+		vec_ [cnt].chunk = 0;
+		cnt++;
+		lane_.zcbody += n;
+		lane_.zcsize -= n;
+		budget_ -= n;
+
+		//  The segments hold their own references once written.
+		if (!lane_.zcsize) {
+			*done_ = lane_.zc;
+			lane_.zc = NULL;
+			lane_.zcbody = NULL;
+		}
+	}
+
+	//  Keyed chunks go out whole, at least one of them per pass.
+	if (!lane_.outsize && lane_.ksize && budget_ > 0) {
+		size_t recs = std::max ((size_t) budget_ / lane_.krec, (size_t) 1);
+		size_t n = std::min (lane_.ksize, recs * lane_.krec);
+		vec_ [cnt].ptr = lane_.kpos;
+		vec_ [cnt].len = n;
+		vec_ [cnt].remote_id = id_;
+		vec_ [cnt].is_hot = hot_;
+		vec_ [cnt].ref = NULL;
+		vec_ [cnt].chunk = (u16_t) lane_.krec;
+		cnt++;
+		lane_.kpos += n;
+		lane_.ksize -= n;
+		budget_ -= n;
+	}
+
+	return cnt;
+}
+
+bool zmq::stream_engine_t::has_data () const
+{
+	if (pending_msgs || pull_lane || out_vec_cnt)
+		return true;
+	for (size_t i = 0; i < outputs.size (); i++)
+		for (int l = 0; l < 2; l++)
+			if (outputs [i]->lanes [l].outsize || outputs [i]->lanes [l].zcsize ||
+					outputs [i]->lanes [l].ksize)
+				return true;
+	return false;
+}
+
+void zmq::stream_engine_t::data_out_event()
+{
+	while (true) {
+		//  Whatever the stack had no room for goes first, the lanes'
+		//  buffers it points into are not refilled before.
+		if (out_vec_cnt) {
+			int rc = flush_data ();
+			if (rc == -1) {
+				reset_pollout_lwip (handle);
+				return;
+			}
+			//  Resumed by the next out event, once acks made room.
+			if (rc == 0)
+				return;
+		}
+
+		//  Take messages off the session ahead of sending them, so that
+		//  every remote with data waiting gets its turn below.
+		while (pending_msgs < out_backlog) {
 			if ((this->*next_msg)(&tx_msg) == -1)
 				break;
-			remote = tx_msg.get_remote_id();
-			flags = tx_msg.flags();
-			fprintf(stdout, "[%s][%d]: load data msg, target %u, size %lu,"
-							" flags %x\n", __FILE__, __LINE__,
-							remote, tx_msg.size(), flags);
-
-			if (last_remote == UINT16_MAX)
-				last_remote = remote;
-			else if (last_remote != remote) {
-				fprintf(stderr, "[%s][%d]: different target!!!\n", __FILE__, __LINE__);
-				zmq_assert(last_remote == remote);
+			queue_data_msg ();
+		}
+
+		//  One deficit round robin pass over the remotes. Each one may
+		//  send out_quantum bytes plus what it did not use last time,
+		//  hot data first. A large body is cut into quantum sized pieces
+		//  instead of holding up the other remotes.
+		int cnt = 0;
+		size_t count = outputs.size ();
+		size_t visited = 0;
+		for (; visited < count && cnt + 4 <= max_out_vectors; visited++) {
+			outctl *out = outputs [(next_output + visited) % count];
+
+			bool cold = fill_lane (out->lanes [0]);
+			bool hot = fill_lane (out->lanes [1]);
+			if (!cold && !hot) {
+				out->deficit = 0;
+				continue;
 			}
 
-			encoder->load_msg(&tx_msg);
+			out->deficit += out_quantum;
+			for (int l = 1; l >= 0; l--) {
+				struct netml_ref *zc = NULL;
+				cnt += emit_lane (out->lanes [l], out->id, l == 1,
+								out->deficit, out_vec + cnt, &zc);
+				if (zc)
+					out_done [out_done_cnt++] = zc;
+			}
+		}
+		if (count)
+			next_output = (next_output + visited) % count;
 
-			unsigned char *bufptr = outpos + outsize;
-			size_t n = encoder->encode(&bufptr, out_batch_size - outsize);
+		//  Nothing left, wait for restart_output.
+		if (cnt == 0) {
+			output_stopped = true;
+			reset_pollout_lwip (handle);
+			return;
+		}
 
-			zmq_assert(n > 0);
-			if (outpos == NULL)
-				outpos = bufptr;
-			outsize += n;
+		out_vec_pos = 0;
+		out_vec_cnt = cnt;
+	}
+}
 
-			if (!(flags & msg_t::more)) {
-				fprintf(stdout, "[%s][%d]: end of the message to %u\n",
-								__FILE__, __LINE__, remote);
-				is_msg_end = true;
-				is_hot = (flags & msg_t::netml_hotdata) ? true : false;
-				break;
-			}
-			else
-				is_msg_end = false;
+int zmq::stream_engine_t::flush_data()
+{
+	while (out_vec_pos < out_vec_cnt) {
+		struct netml_vector *vec = out_vec + out_vec_pos;
+		int count = out_vec_cnt - out_vec_pos;
+		int nbytes = raw ? tcp_write_batch(raw, vec, count)
+						 : tcp_write_batch(s, vec, count);
+		if (nbytes < 0)
+			return -1;
+
+		//  The send buffer or queue is full, the rest waits.
+		if (nbytes == 0) {
+			NETML_TRACE (ZMQ, ENGINE_BLOCKED, 0, 0, 0, count, this);
+			return 0;
 		}
+		NETML_TRACE (ZMQ, ENGINE_WRITE, 0, 0, nbytes, count, this);
+
+		account (nbytes, (nbytes + TCP_MSS - 1) / TCP_MSS);
 
-		if (outsize && is_msg_end) {
-			int nbytes = 0;
-			unsigned nsent = 0;
-
-			while (nsent < outsize) {
-				nbytes = tcp_write(s, outpos, outsize, last_remote, is_hot);
-				if (nbytes < 0) {
-					fprintf(stdout, "[%s][%d]: failed to send\n", __FILE__, __LINE__);
-					reset_pollout_lwip(handle);
-					return;
-				}
-
-				if (nbytes == 0) {
-					fprintf(stdout, "[%s][%d]: block 10 us\n", __FILE__, __LINE__);
-					usleep(10);
-				}
-				else {
-					nsent += nbytes;
-					outpos += nbytes;
-					outsize -= nbytes;
-				}
+		//  Skip what has been enqueued, the write may end inside an entry.
+		size_t left = nbytes;
+		while (left > 0) {
+			if (left >= vec->len) {
+				left -= vec->len;
+				vec++;
+				out_vec_pos++;
+			}
+			else {
+				vec->ptr = (const unsigned char *) vec->ptr + left;
+				vec->len -= left;
+				left = 0;
 			}
-			last_remote = UINT16_MAX;
-		}
-		else if (outsize == 0) {
-			is_clear = true;
-			break;
 		}
 	}
+
+	//  The segments hold their own references now.
+	for (int i = 0; i < out_done_cnt; i++)
+		netml_ref_put (out_done [i]);
+	out_done_cnt = 0;
+	out_vec_pos = 0;
+	out_vec_cnt = 0;
+	return 1;
 }
 
 void zmq::stream_engine_t::ctl_out_event()
@@ -483,158 +855,19 @@ void zmq::stream_engine_t::ctl_out_event()
 	}
 
 	if (outsize) {
-		int nbytes = tcp_write(s, outpos, outsize, 0 /* is_data */);
+		int nbytes = raw ? tcp_write(raw, outpos, outsize, 0 /* is_data */)
+						 : tcp_write(s, outpos, outsize, 0 /* is_data */);
 
 		if (nbytes == -1) {
 			reset_pollout_lwip(handle);
 			return;
 		}
+		account (nbytes, (nbytes + TCP_MSS - 1) / TCP_MSS);
 		outpos += nbytes;
 		outsize -= nbytes;
 	}
 }
 
-#if 0
-bool zmq::stream_engine_t::can_handle_data()
-{
-	for (unsigned i = 0; i < num_target; i++) {
-		if (outputs[i].outsize >= (size_t)out_batch_size) {
-			return false;
-		}
-		if (outputs[i].hotoutsize >= (size_t)out_batch_size) {
-			return false;
-		}
-	}
-	return true;
-}
-
-bool zmq::stream_engine_t::has_data()
-{
-	for (unsigned i = 0; i < num_target; i++) {
-		if (outputs[i].outsize > 0)
-			return true;
-		if (outputs[i].hotoutsize > 0)
-			return true;
-	}
-	return false;
-}
-
-void zmq::stream_engine_t::data_out_event()
-{
-	unsigned i = 0;
-
-	if (!is_id_set && socket->get_localid() != UINT16_MAX) {
-		lwip_setlocalid(s, socket->get_localid());
-		is_id_set = true;
-//		fprintf(stdout, "[%s][%d]: set local id %u\n",
-//						__FILE__, __LINE__, socket->get_localid());
-	}
-
-	if (!has_data()) {
-		for (i = 0; i < num_target; i++) {
-			outputs[i].outpos = NULL;
-			outputs[i].outsize = outputs[i].encoder->encode(
-							&outputs[i].outpos, 0);
-			outputs[i].hotoutpos = NULL;
-			outputs[i].hotoutsize = outputs[i].hotencoder->encode(
-							&outputs[i].hotoutpos, 0);
-		}
-
-		while (can_handle_data()) {
-			if ((this->*next_msg)(&tx_msg) == -1)
-				break;
-//			fprintf(stdout, "[%s][%d]: load data msg , target %u, size %lu, flags %x\n",
-//							__FILE__, __LINE__,
-//							tx_msg.get_remote_id(),
-//							tx_msg.size(),
-//							tx_msg.flags());
-			if (!(tx_msg.flags() & msg_t::netml_data)) {
-				fprintf(stderr, "[%s][%d]: data path send control message\n",
-								__FILE__, __LINE__);
-			}
-
-			outctl *out = NULL;
-			std::map<uint16_t, unsigned>::iterator it =
-					targets.find(tx_msg.get_remote_id());
-			if (it == targets.end()) {
-				outputs.push_back(outctl(tx_msg.get_remote_id()));
-				out = &(outputs[num_target]);
-
-				out->encoder = new (std::nothrow)v2_encoder_t(out_batch_size);
-				alloc_assert(out->encoder);
-
-				out->hotencoder = new (std::nothrow)v2_encoder_t(out_batch_size);
-				alloc_assert(out->hotencoder);
-
-				targets.insert(std::pair<uint16_t, unsigned>(
-						tx_msg.get_remote_id(), num_target));
-				num_target++;
-			}
-			else {
-				out = &outputs[it->second];
-			}
-
-			if (tx_msg.flags() & msg_t::netml_hotdata) {
-				out->hotencoder->load_msg(&tx_msg);
-				unsigned char *bufptr = out->hotoutpos + out->hotoutsize;
-				size_t n = out->hotencoder->encode(&bufptr,
-								out_batch_size - out->hotoutsize);
-
-				zmq_assert(n > 0);
-				if (out->hotoutpos == NULL)
-					out->hotoutpos = bufptr;
-				out->hotoutsize += n;
-			}
-			else {
-				out->encoder->load_msg(&tx_msg);
-				unsigned char *bufptr = out->outpos + out->outsize;
-				size_t n = out->encoder->encode(&bufptr,
-								out_batch_size - out->outsize);
-
-				zmq_assert(n > 0);
-				if (out->outpos == NULL)
-					out->outpos = bufptr;
-				out->outsize += n;
-			}
-		}
-
-//		if (!has_data()) {
-//			output_stopped = true;
-//			reset_pollout_lwip(handle);
-//			return;
-//		}
-	}
-
-	for (unsigned i = 0; i < num_target; i++) {
-		outctl *out = &outputs[i];
-
-		if (out->outsize) {
-			int nbytes = tcp_write(s, out->outpos, out->outsize, out->id);
-
-			if (nbytes == -1) {
-				reset_pollout_lwip(handle);
-				return;
-			}
-
-			out->outpos += nbytes;
-			out->outsize -= nbytes;
-		}
-		if (out->hotoutsize) {
-			int nbytes = tcp_write(s, out->hotoutpos, out->hotoutsize,
-							out->id, true /* hot */);
-
-			if (nbytes == -1) {
-				reset_pollout_lwip(handle);
-				return;
-			}
-
-			out->hotoutpos += nbytes;
-			out->hotoutsize -= nbytes;
-		}
-	}
-}
-#endif
-
 void zmq::stream_engine_t::out_event()
 {
 	zmq_assert(!io_error);
@@ -791,6 +1024,9 @@ void zmq::stream_engine_t::restart_input ()
             break;
     }
 
+    if (!insize)
+        release_inpbuf ();
+
     if (rc == -1 && errno == EAGAIN)
         session->flush ();
     else
@@ -810,6 +1046,113 @@ void zmq::stream_engine_t::restart_input ()
     }
 }
 
+void zmq::stream_engine_t::migrate (io_thread_t *io_thread_)
+{
+	zmq_assert (plugged && !migrate_to);
+
+	//  Move from the poller loop, with no session or pipe code further up
+	//  the stack that would still run in this thread afterwards.
+	migrate_to = io_thread_;
+	add_timer (0, migrate_timer_id);
+}
+
+void zmq::stream_engine_t::try_migrate ()
+{
+	if (io_error || !session->can_migrate ()) {
+		migrate_to = NULL;
+		return;
+	}
+
+	//  A message boundary: nothing left to decode of the current pbuf, no
+	//  message the session has not taken and no batch partially written.
+	if (input_stopped || insize || outsize || has_data () ||
+			has_handshake_timer) {
+		add_timer (1, migrate_timer_id);
+		return;
+	}
+
+	io_thread_t *target = migrate_to;
+	migrate_to = NULL;
+	bool rc = session->migrate (target);
+	zmq_assert (rc);
+
+	//  Heartbeat timeouts are dropped, the next heartbeats arm them again.
+	if (has_ttl_timer) {
+		cancel_timer (heartbeat_ttl_timer_id);
+		has_ttl_timer = false;
+	}
+	if (has_timeout_timer) {
+		cancel_timer (heartbeat_timeout_timer_id);
+		has_timeout_timer = false;
+	}
+	if (has_heartbeat_timer)
+		cancel_timer (heartbeat_ivl_timer_id);
+
+	rm_fd_lwip (handle);
+	io_thread->unregister_engine (this);
+	io_object_t::unplug ();
+
+	//  The target may run the engine as soon as the command is sent.
+	io_thread_t *source = io_thread;
+	io_thread = NULL;
+	source->hand_over (this, target);
+}
+
+void zmq::stream_engine_t::replug (io_thread_t *io_thread_)
+{
+	zmq_assert (plugged && !io_thread);
+
+	io_object_t::plug (io_thread_);
+	io_thread = io_thread_;
+	io_thread->register_engine (this);
+
+	handle = raw ? add_raw_lwip (raw) : add_fd_lwip (s);
+	set_pollin_lwip (handle);
+	set_pollout_lwip (handle);
+
+	if (has_heartbeat_timer)
+		add_timer (options.heartbeat_interval, heartbeat_ivl_timer_id);
+
+	//  Flush whatever arrived while the engine was on its way.
+	in_event ();
+}
+
+bool zmq::stream_engine_t::can_migrate ()
+{
+	return plugged && !migrate_to && !io_error && session->can_migrate ();
+}
+
+uint64_t zmq::stream_engine_t::get_affinity () const
+{
+	return options.affinity;
+}
+
+uint64_t zmq::stream_engine_t::take_traffic ()
+{
+	uint64_t cost = poller_base_t::traffic_cost (traffic_bytes,
+					traffic_packets);
+	traffic_bytes = 0;
+	traffic_packets = 0;
+	return cost;
+}
+
+void zmq::stream_engine_t::account (size_t bytes_, size_t packets_)
+{
+	traffic_bytes += bytes_;
+	traffic_packets += packets_;
+	account_traffic (bytes_, packets_);
+}
+
+void zmq::stream_engine_t::release_inpbuf ()
+{
+    if (inpbuf) {
+        if (decoder)
+            decoder->set_pbuf (NULL);
+        pbuf_free (inpbuf);
+        inpbuf = NULL;
+    }
+}
+
 bool zmq::stream_engine_t::handshake ()
 {
 #if 0
@@ -1376,6 +1719,8 @@ void zmq::stream_engine_t::timer_event (int id_)
         has_timeout_timer = false;
         error(timeout_error);
     }
+    else if(id_ == migrate_timer_id)
+        try_migrate();
     else
         // There are no other valid timer ids!
         assert(false);
@@ -31,6 +31,9 @@
 #define __ZMQ_STREAM_ENGINE_HPP_INCLUDED__
 
 #include <stddef.h>
+#include <deque>
+#include <map>
+#include <vector>
 
 #include "fd.hpp"
 #include "i_engine.hpp"
@@ -40,6 +43,10 @@
 #include "options.hpp"
 #include "socket_base.hpp"
 #include "metadata.hpp"
+#include "codec.hpp"
+
+struct netml_vector;
+struct netml_raw;
 
 namespace zmq
 {
@@ -81,6 +88,20 @@ namespace zmq
         void zap_msg_available ();
         const char *get_endpoint () const;
 
+        //  Moves the engine and its session over to io_thread_ at the next
+        //  message boundary.
+        void migrate (zmq::io_thread_t *io_thread_);
+
+        //  Plugs the engine into io_thread_ it has been handed over to.
+        void replug (zmq::io_thread_t *io_thread_);
+
+        bool can_migrate ();
+        uint64_t get_affinity () const;
+
+        //  Returns the traffic handled since the previous call, weighed
+        //  as by poller_base_t::traffic_cost.
+        uint64_t take_traffic ();
+
         //  i_poll_events interface implementation.
         void in_event ();
         void out_event ();
@@ -99,6 +120,16 @@ namespace zmq
         //  Detects the protocol used by the peer.
         bool handshake ();
 
+        //  Drops the engine's reference on the current input pbuf.
+        void release_inpbuf ();
+
+        //  Records traffic with the poller and for take_traffic.
+        void account (size_t bytes_, size_t packets_);
+
+        //  Hands the engine over to migrate_to if it is at a message
+        //  boundary, otherwise retries a bit later.
+        void try_migrate ();
+
         int routing_id_msg (msg_t *msg_);
         int process_routing_id_msg (msg_t *msg_);
 
@@ -129,14 +160,86 @@ namespace zmq
         int process_heartbeat_message(msg_t * msg_);
         int produce_pong_message(msg_t * msg_);
 
-		bool can_handle_data();
-		bool has_data();
 		void ctl_out_event();
 		void data_out_event();
 
+		//  Output state of the data path for one remote. Hot and cold
+		//  data to a remote are two streams of ZMTP frames, each with its
+		//  own encoder, so that any of them can be cut off at any byte
+		//  without breaking the framing of the others.
+		struct out_lane_t {
+			i_encoder *encoder;
+
+			//  The message the encoder works on.
+			msg_t msg;
+
+			//  Messages taken from the session, not encoded yet.
+			std::deque <msg_t> pending;
+
+			//  Encoded data not handed to the stack yet, followed by the
+			//  body of a large message sent by reference.
+			unsigned char *outpos;
+			size_t outsize;
+			struct netml_ref *zc;
+			unsigned char *zcbody;
+			size_t zcsize;
+
+			//  A keyed message cut into chunks, records of krec bytes
+			//  that each go into a segment of their own.
+			unsigned char *kbuf;
+			size_t kcap;
+			unsigned char *kpos;
+			size_t ksize;
+			size_t krec;
+		};
+
+		struct outctl {
+			uint16_t id;
+
+			//  Cold and hot lane.
+			out_lane_t lanes [2];
+
+			//  Bytes the remote may still send in the current round.
+			int64_t deficit;
+		};
+
+		//  Returns the output state of remote id_, creates it if needed.
+		outctl *get_output (uint16_t id_);
+
+		//  Queues tx_msg on the lane of its remote.
+		void queue_data_msg ();
+
+		//  Encodes pending messages of lane_ unless it still has data to
+		//  send. Returns true if there is anything to send.
+		bool fill_lane (out_lane_t &lane_);
+
+		//  Cuts the keyed message of lane_ into tensor chunks that each
+		//  fill one NetML segment, along element boundaries. Float32
+		//  elements are coded with codec first.
+		void encode_chunks (out_lane_t &lane_);
+
+		//  Fills vec_ with up to budget_ bytes of lane_ and returns the
+		//  number of entries used. A body sent by reference that is
+		//  used up is returned in done_, to be released once written.
+		int emit_lane (out_lane_t &lane_, uint16_t id_, bool hot_,
+			int64_t &budget_, struct netml_vector *vec_,
+			struct netml_ref **done_);
+
+		//  True if the data path holds anything not handed to the stack.
+		bool has_data () const;
+
+		//  Hands out_vec to the stack for as far as it has room. Returns
+		//  1 once all of it is written, 0 if the rest has to wait for
+		//  the next out event and -1 if the connection failed.
+		int flush_data();
+
         //  Underlying socket.
         fd_t s;
 
+        //  Connection taken over from s with the raw lwIP API
+        //  (ZMQ_RAW_PCB), s is closed then.
+        struct netml_raw *raw;
+
         //  True iff this is server's engine.
         bool as_server;
 
@@ -146,6 +249,8 @@ namespace zmq
 
         unsigned char *inpos;
         size_t insize;
+        //  The pbuf inpos/insize point into, released once it is decoded.
+        struct pbuf *inpbuf;
         i_decoder *decoder;
 
 		bool is_ctl;
@@ -154,38 +259,35 @@ namespace zmq
 		size_t outsize;
 		i_encoder *encoder;
 
-		uint16_t last_remote;
-		bool is_msg_end;
-		bool is_hot;
+		//  Data path, see data_out_event.
+		std::vector <outctl *> outputs;
+		std::map <uint16_t, outctl *> targets;
 
-#if 0
-		class outctl {
-		public:
-			unsigned char *outpos;
-			size_t outsize;
-			i_encoder *encoder;
-			unsigned char *hotoutpos;
-			size_t hotoutsize;
-			i_encoder *hotencoder;
-			uint16_t id;
+		//  The remote the next round robin pass starts with.
+		size_t next_output;
 
-			outctl(uint16_t id_ = UINT16_MAX) :
-					outpos(NULL), outsize(0), encoder(NULL),
-					hotoutpos(NULL), hotoutsize(0), hotencoder(NULL),
-					id(id_) {};
-		};
+		//  Lane the rest of the message being taken from the session
+		//  goes to, NULL at a message boundary.
+		out_lane_t *pull_lane;
 
-		std::vector<outctl> outputs;
+		//  Number of messages on all lanes.
+		size_t pending_msgs;
 
-		// for control path
-		outctl *output;
+		//  Codes the float32 elements of keyed messages on data
+		//  connections, with the codec of ZMQ_TENSOR_CODEC.
+		tensor_codec_t codec;
 
-		// for data path
-		unsigned num_target;
-		std::map<uint16_t, unsigned> targets;
+		enum {max_out_vectors = 64};
+
+		//  The current pass of the data path, written from out_vec_pos
+		//  on, and the bodies sent by reference it used up, released
+		//  once it is written.
+		struct netml_vector *out_vec;
+		int out_vec_pos;
+		int out_vec_cnt;
+		struct netml_ref *out_done [max_out_vectors];
+		int out_done_cnt;
 
-		bool is_id_set = false;
-#endif
         //  Metadata to be attached to received messages. May be NULL.
         metadata_t *metadata;
 
@@ -222,6 +324,18 @@ namespace zmq
 
         bool plugged;
 
+        //  I/O thread the engine is plugged to.
+        zmq::io_thread_t *io_thread;
+
+        //  I/O thread to move to, NULL unless a migration is pending.
+        zmq::io_thread_t *migrate_to;
+
+        enum {migrate_timer_id = 0x90};
+
+        //  Traffic handled since the last take_traffic.
+        uint64_t traffic_bytes;
+        uint64_t traffic_packets;
+
         int (stream_engine_t::*next_msg) (msg_t *msg_);
 
         int (stream_engine_t::*process_msg) (msg_t *msg_);
@@ -46,6 +46,8 @@
 #endif
 
 #include "lwip/sockets.h"
+#include "lwip/api.h"
+#include "lwip/netml_raw.h"
 
 int zmq::tune_tcp_socket (fd_t s_)
 {
@@ -197,7 +199,7 @@ int zmq::tune_tcp_maxrt (fd_t sockfd_, int timeout_)
 }
 
  int zmq::tcp_write (fd_t s_, const void *data_, size_t size_,
-				 int is_data, bool is_hot)
+				 int is_data, bool is_hot, struct netml_ref *ref_)
 {
 #ifdef ZMQ_HAVE_WINDOWS
 
@@ -232,14 +234,15 @@ int zmq::tune_tcp_maxrt (fd_t sockfd_, int timeout_)
 #else
 	ssize_t nbytes = 0;
 	if (is_data) {
-		if (is_hot) {
-    		nbytes = lwip_send_netml (s_, data_, size_,
-						LWIP_MSG_NETML | LWIP_MSG_NETML_HOT, is_data);
-		}
-		else {
-			nbytes = lwip_send_netml (s_, data_, size_,
-						LWIP_MSG_NETML, is_data);
-		}
+		int flags = LWIP_MSG_NETML;
+		if (is_hot)
+			flags |= LWIP_MSG_NETML_HOT;
+
+		if (ref_)
+			nbytes = lwip_send_netml_ref (s_, data_, size_, flags, is_data,
+						ref_);
+		else
+			nbytes = lwip_send_netml (s_, data_, size_, flags, is_data);
 	}
 	else
 		nbytes = lwip_send_netml (s_, data_, size_, 0, 0);
@@ -270,6 +273,28 @@ int zmq::tune_tcp_maxrt (fd_t sockfd_, int timeout_)
 #endif
 }
 
+int zmq::tcp_write_batch (fd_t s_, const struct netml_vector *vec_,
+                          int count_)
+{
+    const ssize_t nbytes = lwip_send_netml_batch (s_, vec_, count_);
+
+    //  Nothing fitted into the send buffer, try again later.
+    if (nbytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+          errno == EINTR))
+        return 0;
+
+    //  Signalise peer failure.
+    if (nbytes == -1) {
+        errno_assert (errno != EBADF
+                   && errno != EFAULT
+                   && errno != EINVAL
+                   && errno != ENOTSOCK);
+        return -1;
+    }
+
+    return static_cast <int> (nbytes);
+}
+
 int zmq::tcp_read (fd_t s_, void *data_, size_t size_)
 {
 #ifdef ZMQ_HAVE_WINDOWS
@@ -318,6 +343,84 @@ int zmq::tcp_read (fd_t s_, void *data_, size_t size_)
 #endif
 }
 
+int zmq::tcp_read_pbuf (fd_t s_, struct pbuf **p_)
+{
+    const ssize_t rc = lwip_recv_pbuf (s_, p_, 0);
+
+    if (rc == -1) {
+        errno_assert (errno != EBADF
+                   && errno != EFAULT
+                   && errno != ENOMEM
+                   && errno != ENOTSOCK);
+        if (errno == EWOULDBLOCK || errno == EINTR)
+            errno = EAGAIN;
+    }
+
+    return static_cast <int> (rc);
+}
+
+int zmq::tcp_write (netml_raw *raw_, const void *data_, size_t size_,
+                    int is_data, bool is_hot, struct netml_ref *ref_)
+{
+    int flags = 0;
+    if (is_data) {
+        flags = LWIP_MSG_NETML;
+        if (is_hot)
+            flags |= LWIP_MSG_NETML_HOT;
+    }
+    const ssize_t nbytes = netml_raw_send (raw_, data_, size_, flags,
+        is_data, is_data ? ref_ : NULL);
+
+    if (nbytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+
+    //  Signalise peer failure.
+    if (nbytes == -1) {
+        errno_assert (errno != EFAULT
+                   && errno != EINVAL);
+        return -1;
+    }
+
+    return static_cast <int> (nbytes);
+}
+
+int zmq::tcp_write_batch (netml_raw *raw_, const struct netml_vector *vec_,
+                          int count_)
+{
+    const ssize_t nbytes = netml_raw_send_batch (raw_, vec_, count_);
+
+    if (nbytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+
+    if (nbytes == -1) {
+        errno_assert (errno != EFAULT
+                   && errno != EINVAL);
+        return -1;
+    }
+
+    return static_cast <int> (nbytes);
+}
+
+int zmq::tcp_read (netml_raw *raw_, void *data_, size_t size_)
+{
+    const ssize_t rc = netml_raw_recv (raw_, data_, size_);
+
+    if (rc == -1 && errno == EWOULDBLOCK)
+        errno = EAGAIN;
+
+    return static_cast <int> (rc);
+}
+
+int zmq::tcp_read_pbuf (netml_raw *raw_, struct pbuf **p_)
+{
+    const ssize_t rc = netml_raw_recv_pbuf (raw_, p_);
+
+    if (rc == -1 && errno == EWOULDBLOCK)
+        errno = EAGAIN;
+
+    return static_cast <int> (rc);
+}
+
 void zmq::tcp_assert_tuning_error (zmq::fd_t s_, int rc_)
 {
     if (rc_ == 0)
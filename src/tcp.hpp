@@ -32,6 +32,11 @@
 
 #include "fd.hpp"
 
+struct pbuf;
+struct netml_ref;
+struct netml_vector;
+struct netml_raw;
+
 namespace zmq
 {
 
@@ -54,14 +59,39 @@ namespace zmq
     //  Writes data to the socket. Returns the number of bytes actually
     //  written (even zero is to be considered to be a success). In case
     //  of error or orderly shutdown by the other peer -1 is returned.
+    //  Data is copied unless ref_ is given, in which case the stack
+    //  references it and holds ref_ until the data has been acked.
     int tcp_write (fd_t s_, const void *data_, size_t size_,
-					int is_data, bool is_hot = false);
+					int is_data, bool is_hot = false,
+					struct netml_ref *ref_ = NULL);
+
+    //  Writes count_ NetML entries, possibly for different remote ids, with
+    //  a single round trip into the stack. Returns the number of bytes
+    //  written across the entries, which may end inside one; zero is a
+    //  success. In case of error -1 is returned.
+    int tcp_write_batch (fd_t s_, const struct netml_vector *vec_,
+                         int count_);
 
     //  Reads data from the socket (up to 'size' bytes).
     //  Returns the number of bytes actually read or -1 on error.
     //  Zero indicates the peer has closed the connection.
     int tcp_read (fd_t s_, void *data_, size_t size_);
 
+    //  Hands over the next received pbuf instead of copying its payload.
+    //  Returns the payload length of *p_ or -1 on error, zero indicates
+    //  the peer has closed the connection. The caller releases *p_ with
+    //  pbuf_free.
+    int tcp_read_pbuf (fd_t s_, struct pbuf **p_);
+
+    //  Same as above, over a connection taken over with netml_raw_attach.
+    int tcp_write (struct netml_raw *raw_, const void *data_, size_t size_,
+                   int is_data, bool is_hot = false,
+                   struct netml_ref *ref_ = NULL);
+    int tcp_write_batch (struct netml_raw *raw_,
+                         const struct netml_vector *vec_, int count_);
+    int tcp_read (struct netml_raw *raw_, void *data_, size_t size_);
+    int tcp_read_pbuf (struct netml_raw *raw_, struct pbuf **p_);
+
     //  Asserts that an internal error did not occur.  Does not assert
     //  on network errors such as reset or aborted connections.
     void tcp_assert_tuning_error (fd_t s_, int rc_);
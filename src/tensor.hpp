@@ -0,0 +1,109 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __ZMQ_TENSOR_HPP_INCLUDED__
+#define __ZMQ_TENSOR_HPP_INCLUDED__
+
+#include <stddef.h>
+#include <string.h>
+
+#include "../include/zmq.h"
+#include "wire.hpp"
+
+namespace zmq
+{
+
+    //  Size of a zmq_tensor_hdr_t on the wire, where its fields are in
+    //  network byte order. The elements travel in the byte order of the
+    //  sender.
+    enum { tensor_hdr_size = 24 };
+
+    //  Bytes per element of dtype_, 0 for an unknown type.
+    inline size_t tensor_dtype_size (uint8_t dtype_)
+    {
+        switch (dtype_) {
+            case ZMQ_DTYPE_U8:
+            case ZMQ_DTYPE_I8:
+                return 1;
+            case ZMQ_DTYPE_F16:
+            case ZMQ_DTYPE_BF16:
+                return 2;
+            case ZMQ_DTYPE_I32:
+            case ZMQ_DTYPE_F32:
+                return 4;
+            case ZMQ_DTYPE_I64:
+            case ZMQ_DTYPE_F64:
+                return 8;
+            default:
+                return 0;
+        }
+    }
+
+    inline void put_tensor_hdr (unsigned char *buffer_,
+        const zmq_tensor_hdr_t &hdr_)
+    {
+        put_uint64 (buffer_, hdr_.key);
+        put_uint32 (buffer_ + 8, hdr_.version);
+        put_uint8 (buffer_ + 12, hdr_.dtype);
+        put_uint8 (buffer_ + 13, hdr_.workers);
+        buffer_ [14] = buffer_ [15] = 0;
+        put_uint32 (buffer_ + 16, hdr_.count);
+        put_uint32 (buffer_ + 20, hdr_.offset);
+    }
+
+    inline void get_tensor_hdr (const unsigned char *buffer_,
+        zmq_tensor_hdr_t &hdr_)
+    {
+        hdr_.key = get_uint64 (buffer_);
+        hdr_.version = get_uint32 (buffer_ + 8);
+        hdr_.dtype = get_uint8 (buffer_ + 12);
+        hdr_.workers = get_uint8 (buffer_ + 13);
+        hdr_.reserved [0] = hdr_.reserved [1] = 0;
+        hdr_.count = get_uint32 (buffer_ + 16);
+        hdr_.offset = get_uint32 (buffer_ + 20);
+    }
+
+    //  True if size_ bytes at data_ make a tensor frame as the application
+    //  hands it over, header in host byte order. A header without the
+    //  elements it counts asks for them.
+    inline bool check_tensor (const void *data_, size_t size_)
+    {
+        zmq_tensor_hdr_t hdr;
+        if (size_ < sizeof hdr)
+            return false;
+        memcpy (&hdr, data_, sizeof hdr);
+        size_t esize = tensor_dtype_size (hdr.dtype);
+        size_t body = size_ - sizeof hdr;
+        return esize != 0 && (body == 0 || body == hdr.count * esize);
+    }
+
+}
+
+#endif
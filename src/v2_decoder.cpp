@@ -36,12 +36,19 @@
 #include "v2_decoder.hpp"
 #include "likely.hpp"
 #include "wire.hpp"
+#include "tensor.hpp"
+#include "codec.hpp"
+#include "config.hpp"
 #include "err.hpp"
 
+#include "lwip/pbuf.h"
+
 zmq::v2_decoder_t::v2_decoder_t (size_t bufsize_, int64_t maxmsgsize_) :
     shared_message_memory_allocator( bufsize_),
     decoder_base_t <v2_decoder_t, shared_message_memory_allocator> (this),
     msg_flags (0),
+    msg_codec (0),
+    pbuf (NULL),
     maxmsgsize (maxmsgsize_)
 {
     int rc = in_progress.init ();
@@ -64,15 +71,15 @@ int zmq::v2_decoder_t::flags_ready (unsigned char const*)
         msg_flags |= msg_t::more;
     if (tmpbuf [0] & v2_protocol_t::command_flag)
         msg_flags |= msg_t::command;
+    if (tmpbuf [0] & v2_protocol_t::key_flag)
+        msg_flags |= msg_t::netml_key;
+    msg_codec = tmpbuf [1];
 
     //  The payload length is either one or eight bytes,
     //  depending on whether the 'large' bit is set.
     if (tmpbuf [0] & v2_protocol_t::large_flag) {
 //        next_step (tmpbuf, 8, &v2_decoder_t::eight_byte_size_ready);
-		if (tmpbuf[0] & v2_protocol_t::key_flag)
-			next_step(tmpbuf, 4, &v2_decoder_t::key_size_ready);
-		else
-			next_step(tmpbuf, 4, &v2_decoder_t::four_byte_size_ready);
+		next_step(tmpbuf, 4, &v2_decoder_t::four_byte_size_ready);
 	} else
         next_step (tmpbuf, 1, &v2_decoder_t::one_byte_size_ready);
 
@@ -84,12 +91,6 @@ int zmq::v2_decoder_t::one_byte_size_ready (unsigned char const* read_from)
     return size_ready(tmpbuf[0], read_from);
 }
 
-int zmq::v2_decoder_t::key_size_ready (unsigned char const *read_from) {
-	uint32_t nb_key = get_uint32(tmpbuf);
-
-	return size_ready(nb_key * sizeof(uint64_t), read_from);
-}
-
 int zmq::v2_decoder_t::four_byte_size_ready (unsigned char const* read_from) {
     //  The payload size is encoded as 64-bit unsigned integer.
     //  The most significant byte comes first.
@@ -115,6 +116,29 @@ int zmq::v2_decoder_t::size_ready(uint64_t msg_size, unsigned char const* read_p
     int rc = in_progress.close();
     assert(rc == 0);
 
+    //  The next buffers are sized after the messages seen.
+    observe (static_cast <size_t> (msg_size));
+
+    if (pbuf) {
+        unsigned char *payload = (unsigned char *) pbuf->payload;
+
+        if (read_pos >= payload && read_pos + msg_size <= payload + pbuf->len &&
+              msg_size * in_buffer_msgs >= PBUF_POOL_BUFSIZE) {
+            //  The whole body is already sitting in the pbuf, point the
+            //  message at it and keep the pbuf alive until it is closed.
+            rc = in_progress.init ((unsigned char *) read_pos,
+                static_cast <size_t> (msg_size), call_pbuf_free, pbuf, NULL);
+            if (rc == 0 && !in_progress.is_vsm ())
+                pbuf_ref (pbuf);
+        }
+        else
+            //  The body is too small to pin a pool pbuf for, as for the
+            //  buffers below, or it continues in segments not received
+            //  yet. It is copied into a message of its own, from the
+            //  message pool.
+            rc = in_progress.init_size (static_cast <size_t> (msg_size));
+    }
+    else
     // the current message can exceed the current buffer. We have to copy the buffer
     // data into a new message and complete it in the next receive.
 
@@ -125,6 +149,12 @@ int zmq::v2_decoder_t::size_ready(uint64_t msg_size, unsigned char const* read_p
         rc = in_progress.init_size (static_cast <size_t> (msg_size));
     }
     else
+    if (!shares (static_cast <size_t> (msg_size)))
+    {
+        // too small to pin the buffer for, the message gets a block of its own
+        rc = in_progress.init_size (static_cast <size_t> (msg_size));
+    }
+    else
     {
         // construct message using n bytes from the buffer as storage
         // increase buffer ref count
@@ -162,8 +192,60 @@ int zmq::v2_decoder_t::size_ready(uint64_t msg_size, unsigned char const* read_p
     return 0;
 }
 
+int zmq::v2_decoder_t::expand_chunk ()
+{
+    zmq_tensor_hdr_t hdr;
+    memcpy (&hdr, in_progress.data (), sizeof hdr);
+    const unsigned char *coded =
+        (unsigned char *) in_progress.data () + sizeof hdr;
+    const size_t coded_size = in_progress.size () - sizeof hdr;
+
+    //  Only float32 elements are coded, at most as many as a chunk holds.
+    if (hdr.dtype != ZMQ_DTYPE_F32 || hdr.count > 65535 ||
+          !tensor_codec_t::supported (msg_codec)) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    msg_t expanded;
+    int rc = expanded.init_size (sizeof hdr + (size_t) hdr.count * 4);
+    if (unlikely (rc != 0))
+        return -1;
+    unsigned char *data = (unsigned char *) expanded.data ();
+    if (tensor_codec_t::decode (msg_codec, coded, coded_size,
+          data + sizeof hdr, hdr.count) != 0) {
+        rc = expanded.close ();
+        errno_assert (rc == 0);
+        errno = EPROTO;
+        return -1;
+    }
+    memcpy (data, &hdr, sizeof hdr);
+    expanded.set_flags (in_progress.flags ());
+
+    rc = in_progress.move (expanded);
+    errno_assert (rc == 0);
+    return 0;
+}
+
+void zmq::v2_decoder_t::call_pbuf_free (void *, void *hint_)
+{
+    pbuf_free ((struct pbuf *) hint_);
+}
+
 int zmq::v2_decoder_t::message_ready (unsigned char const*)
 {
+    //  The tensor header of a keyed chunk is handed to the application
+    //  in host byte order.
+    if ((in_progress.flags () & msg_t::netml_key) &&
+          in_progress.size () >= tensor_hdr_size) {
+        zmq_tensor_hdr_t hdr;
+        get_tensor_hdr ((unsigned char *) in_progress.data (), hdr);
+        memcpy (in_progress.data (), &hdr, sizeof hdr);
+
+        if (msg_codec != ZMQ_CODEC_NONE && expand_chunk () != 0)
+            return -1;
+    }
+
     //  Message is completely read. Signal this to the caller
     //  and prepare to decode next message.
     next_step (tmpbuf, 2, &v2_decoder_t::flags_ready);
@@ -50,20 +50,36 @@ namespace zmq
         //  i_decoder interface.
         virtual msg_t *msg () { return &in_progress; }
 
+        //  Message bodies lying entirely inside the payload of p_ are
+        //  referenced instead of copied; the pbuf is released when the
+        //  last msg_t pointing into it is closed.
+        virtual void set_pbuf (struct pbuf *p_) { pbuf = p_; }
+
     private:
 
         int flags_ready (unsigned char const*);
         int one_byte_size_ready (unsigned char const*);
         int four_byte_size_ready (unsigned char const*);
-        int key_size_ready (unsigned char const*);
         int message_ready (unsigned char const*);
 
+        //  Replaces the coded elements of in_progress with float32 ones.
+        int expand_chunk ();
+
         int size_ready(uint64_t size_, unsigned char const*);
 
+        //  msg_t free function for bodies living in a pbuf.
+        static void call_pbuf_free (void *data_, void *hint_);
+
         unsigned char tmpbuf [4];
         unsigned char msg_flags;
+
+        //  ZMQ_CODEC_* the elements of a keyed chunk are coded with.
+        unsigned char msg_codec;
         msg_t in_progress;
 
+        //  The pbuf the data being decoded comes from, if any.
+        struct pbuf *pbuf;
+
         const int64_t maxmsgsize;
 
         v2_decoder_t (const v2_decoder_t&);
@@ -63,13 +63,14 @@ void zmq::v2_encoder_t::message_ready ()
     //  messages, 64-bit unsigned integer in network byte order is used.
     const size_t size = in_progress->size ();
 
-	if (in_progress->flags() & msg_t::netml_key) {
+	//  Keyed messages are cut into chunks by the stream engine, which
+	//  writes their frames itself.
+	if (in_progress->flags() & msg_t::netml_key)
 		protocol_flags |= v2_protocol_t::key_flag;
 
-		put_uint32(tmpbuf + 2, size/sizeof(uint64_t));
-	}
-	else
-		put_uint32(tmpbuf + 2, size);
+	//  Only the chunks the stream engine writes are ever coded.
+	tmpbuf [1] = ZMQ_CODEC_NONE;
+	put_uint32(tmpbuf + 2, size);
 
 	next_step(tmpbuf, 6, &v2_encoder_t::size_ready, false);
 //    if (unlikely (size > 255)) {
@@ -41,6 +41,7 @@ zmq::xpub_t::xpub_t (class ctx_t *parent_, uint32_t tid_, int sid_) :
     verbose_subs (false),
     verbose_unsubs (false),
     more (false),
+    hot (false),
     lossy (true),
     manual (false),
     pending_pipes (),
@@ -246,6 +247,9 @@ int zmq::xpub_t::xsend (msg_t *msg_)
 
     //  For the first part of multi-part message, find the matching pipes.
     if (!more) {
+        hot = (msg_->flags () & msg_t::netml_hotdata) != 0;
+        if (hot)
+            dist.activate_hot ();
         subscriptions.match ((unsigned char*) msg_->data (), msg_->size (),
             mark_as_matching, this);
         // If inverted matching is used, reverse the selection now
@@ -255,7 +259,7 @@ int zmq::xpub_t::xsend (msg_t *msg_)
     }
 
     int rc = -1;            //  Assume we fail
-    if (lossy || dist.check_hwm ()) {
+    if (lossy || dist.check_hwm (hot)) {
         if (dist.send_to_matching (msg_) == 0) {
             //  If we are at the end of multi-part message we can mark
             //  all the pipes as non-matching.
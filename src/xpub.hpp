@@ -96,6 +96,9 @@ namespace zmq
         //  True if we are in the middle of sending a multi-part message.
         bool more;
 
+        //  True if the message being sent is a hot one, see ZMQ_HOT.
+        bool hot;
+
         //  Drop messages if HWM reached, otherwise return with EAGAIN
         bool lossy;
 
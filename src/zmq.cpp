@@ -81,11 +81,13 @@ struct iovec {
 #include "ctx.hpp"
 #include "err.hpp"
 #include "msg.hpp"
+#include "msg_pool.hpp"
 #include "fd.hpp"
 #include "metadata.hpp"
 #include "signaler.hpp"
 #include "socket_poller.hpp"
 #include "timers.hpp"
+#include "group.hpp"
 #include "zmqlwip.h"
 
 #if defined ZMQ_HAVE_OPENPGM
@@ -97,6 +99,11 @@ struct iovec {
 typedef char check_msg_t_size
     [sizeof (zmq::msg_t) ==  sizeof (zmq_msg_t) ? 1 : -1];
 
+//  Compile time check whether zmq_io_stats_t has room for all the buckets
+//  the I/O threads count wake-ups in.
+typedef char check_io_stats_buckets
+    [(int) zmq::io_stats_t::wake_buckets == ZMQ_IO_WAKE_BUCKETS ? 1 : -1];
+
 
 void zmq_version (int *major_, int *minor_, int *patch_)
 {
@@ -121,6 +128,84 @@ int zmq_global_init(const char *ip, const char *gw, const char *mask)
 	return zmq_lwip_init(ip, gw, mask);
 }
 
+int zmq_add_neighbor(const char *ip, const char *mac)
+{
+	return zmq_lwip_add_neighbor(ip, mac);
+}
+
+int zmq_load_neighbors(const char *path)
+{
+	return zmq_lwip_load_neighbors(path);
+}
+
+int zmq_set_rx_queues(int queues)
+{
+	if (zmq_lwip_set_rx_queues(queues) < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+int zmq_set_dpdk_cpus(const int *cpus, int count)
+{
+	if (zmq_lwip_set_cpus(cpus, count) < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+int zmq_register_memory(void *addr, size_t len)
+{
+	if (!addr || !len) {
+		errno = EINVAL;
+		return -1;
+	}
+	return zmq_lwip_register_memory(addr, len);
+}
+
+int zmq_unregister_memory(void *addr)
+{
+	if (!addr) {
+		errno = EINVAL;
+		return -1;
+	}
+	return zmq_lwip_unregister_memory(addr);
+}
+
+int zmq_trace_dump(const char *path)
+{
+	if (!path) {
+		errno = EINVAL;
+		return -1;
+	}
+	return zmq_lwip_trace_dump(path);
+}
+
+int zmq_switch_init(int slots, int workers, int timeout)
+{
+	return zmq_lwip_switch_init(slots, workers, timeout);
+}
+
+int zmq_switch_add_host(const char *ip, const char *mask)
+{
+	if (!ip || !mask) {
+		errno = EINVAL;
+		return -1;
+	}
+	return zmq_lwip_switch_add_host(ip, mask);
+}
+
+int zmq_switch_stats(zmq_switch_stats_t *stats)
+{
+	if (!stats) {
+		errno = EINVAL;
+		return -1;
+	}
+	return zmq_lwip_switch_stats(stats);
+}
+
 //  New context API
 
 void *zmq_ctx_new (void)
@@ -643,6 +728,57 @@ int zmq_msg_recv (zmq_msg_t *msg_, void *s_, int flags_)
     return s_recvmsg (s, msg_, flags_);
 }
 
+int zmq_msg_send_many (zmq_mmsg_t *msgs_, int count_, void *s_, int flags_)
+{
+    zmq::socket_base_t *s = as_socket_base_t (s_);
+    if (!s)
+        return -1;
+    return s->send_many (msgs_, count_, flags_);
+}
+
+int zmq_msg_recv_many (zmq_mmsg_t *msgs_, int count_, void *s_, int flags_)
+{
+    zmq::socket_base_t *s = as_socket_base_t (s_);
+    if (!s)
+        return -1;
+    return s->recv_many (msgs_, count_, flags_);
+}
+
+int zmq_pool_stats (int size_class_, zmq_pool_stats_t *stats_)
+{
+    zmq::pool_stats_t stats;
+    if (!stats_ || zmq::pool_stats (size_class_, &stats) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    stats_->size = stats.size;
+    stats_->allocs = stats.allocs;
+    stats_->frees = stats.frees;
+    stats_->remote_frees = stats.remote_frees;
+    stats_->misses = stats.misses;
+    stats_->cached = stats.cached;
+    return 0;
+}
+
+int zmq_io_stats (void *ctx_, int io_thread_, zmq_io_stats_t *stats_)
+{
+    if (!ctx_ || !((zmq::ctx_t *) ctx_)->check_tag ()) {
+        errno = EFAULT;
+        return -1;
+    }
+    zmq::io_stats_t stats;
+    memset (&stats, 0, sizeof stats);
+    if (!stats_ || ((zmq::ctx_t *) ctx_)->io_stats (io_thread_, &stats) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    stats_->rx_queues = stats.rx_queues;
+    stats_->parks = stats.parks;
+    for (int i = 0; i < ZMQ_IO_WAKE_BUCKETS; i++)
+        stats_->wakeups [i] = stats.wakeups [i];
+    return 0;
+}
+
 int zmq_msg_close (zmq_msg_t *msg_)
 {
     return ((zmq::msg_t*) msg_)->close ();
@@ -853,6 +989,23 @@ inline int zmq_poller_poll (zmq_pollitem_t *items_, int nitems_, long timeout_)
 }
 #endif // ZMQ_HAVE_POLLER
 
+#if !defined ZMQ_HAVE_POLLER
+//  Caps timeout_ (-1 for none) at the next timeout of the sockets polled.
+static int poll_cap_timeout (zmq_pollitem_t *items_, int nitems_,
+    int timeout_)
+{
+    for (int i = 0; i != nitems_; i++) {
+        if (!items_ [i].socket)
+            continue;
+        const int next =
+            ((zmq::socket_base_t *) items_ [i].socket)->next_timeout ();
+        if (next >= 0 && (timeout_ < 0 || next < timeout_))
+            timeout_ = next;
+    }
+    return timeout_;
+}
+#endif
+
 int zmq_poll (zmq_pollitem_t *items_, int nitems_, long timeout_)
 {
     //  TODO: the function implementation can just call zmq_pollfd_poll with
@@ -935,6 +1088,8 @@ int zmq_poll (zmq_pollitem_t *items_, int nitems_, long timeout_)
             timeout = -1;
         else
             timeout = end - now;
+        if (!first_pass)
+            timeout = poll_cap_timeout (items_, nitems_, timeout);
 
         //  Wait for events.
         {
@@ -1103,13 +1258,16 @@ int zmq_poll (zmq_pollitem_t *items_, int nitems_, long timeout_)
             timeout.tv_usec = 0;
             ptimeout = &timeout;
         }
-        else
-        if (timeout_ < 0)
-            ptimeout = NULL;
         else {
-            timeout.tv_sec = (long) ((end - now) / 1000);
-            timeout.tv_usec = (long) ((end - now) % 1000 * 1000);
-            ptimeout = &timeout;
+            const int ms = poll_cap_timeout (items_, nitems_,
+                timeout_ < 0 ? -1 : (int) (end - now));
+            if (ms < 0)
+                ptimeout = NULL;
+            else {
+                timeout.tv_sec = (long) (ms / 1000);
+                timeout.tv_usec = (long) (ms % 1000 * 1000);
+                ptimeout = &timeout;
+            }
         }
 
         //  Wait for events. Ignore interrupts if there's infinite timeout.
@@ -1490,6 +1648,48 @@ int zmq_timers_execute (void *timers_)
     return ((zmq::timers_t*)timers_)->execute ();
 }
 
+//  Collectives
+
+void *zmq_group_new (void *s_, const uint16_t *remote_ids_, int size_,
+	int rank_, int algo_)
+{
+	zmq::socket_base_t *s = as_socket_base_t (s_);
+	if (!s)
+		return NULL;
+	if (!remote_ids_ || size_ < 1 || size_ > UINT16_MAX || rank_ < 0 ||
+			rank_ >= size_ || algo_ < ZMQ_ALLREDUCE_AUTO ||
+			algo_ > ZMQ_ALLREDUCE_TREE) {
+		errno = EINVAL;
+		return NULL;
+	}
+	zmq::group_t *group = new (std::nothrow) zmq::group_t (s, remote_ids_,
+					size_, rank_, algo_);
+	alloc_assert (group);
+	return group;
+}
+
+int zmq_group_close (void *group_)
+{
+	zmq::group_t *group = (zmq::group_t *) group_;
+	if (!group || !group->check_tag ()) {
+		errno = EFAULT;
+		return -1;
+	}
+	delete group;
+	return 0;
+}
+
+int zmq_allreduce (void *group_, void *buf_, size_t count_, int dtype_,
+	int op_)
+{
+	zmq::group_t *group = (zmq::group_t *) group_;
+	if (!group || !group->check_tag ()) {
+		errno = EFAULT;
+		return -1;
+	}
+	return group->allreduce (buf_, count_, dtype_, op_);
+}
+
 //  The proxy functionality
 
 int zmq_proxy (void *frontend_, void *backend_, void *capture_)
@@ -94,6 +94,11 @@
 #define ZMQ_THREAD_AFFINITY_CPU_ADD 7
 #define ZMQ_THREAD_AFFINITY_CPU_REMOVE 8
 #define ZMQ_THREAD_NAME_PREFIX 9
+#define ZMQ_IO_SPIN_US 10
+#define ZMQ_IO_RUN_TO_COMPLETION 11
+#define ZMQ_IO_MIGRATE_IVL 12
+#define ZMQ_IO_THREAD_CPU_ADD 13
+#define ZMQ_REAPER_CPU 14
 
 /*  DRAFT Socket methods.                                                     */
 int zmq_join (void *s, const char *group);
@@ -1,11 +1,35 @@
 #ifndef __ZMQ_LWIP_H__
 #define __ZMQ_LWIP_H__
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int zmq_lwip_init(const char *ip, const char *gw, const char *mask);
+int zmq_lwip_add_neighbor(const char *ip, const char *mac);
+int zmq_lwip_load_neighbors(const char *path);
+
+int zmq_lwip_set_rx_queues(int queues);
+int zmq_lwip_rx_claim(void);
+void zmq_lwip_rx_release(int queue);
+int zmq_lwip_rx_poll(int queue);
+
+int zmq_lwip_set_cpus(const int *cpus, int count);
+int zmq_lwip_get_cpus(int *cpus, int max);
+int zmq_lwip_numa_node(void);
+
+int zmq_lwip_register_memory(void *addr, size_t len);
+int zmq_lwip_unregister_memory(void *addr);
+int zmq_lwip_memory_registered(const void *ptr, size_t len);
+
+int zmq_lwip_trace_dump(const char *path);
+
+struct zmq_switch_stats_t;
+int zmq_lwip_switch_init(int slots, int workers, int timeout);
+int zmq_lwip_switch_add_host(const char *ip, const char *mask);
+int zmq_lwip_switch_stats(struct zmq_switch_stats_t *stats);
 
 #ifdef __cplusplus
 }
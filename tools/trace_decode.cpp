@@ -0,0 +1,124 @@
+/*
+    Copyright (c) 2007-2016 Contributors as noted in the AUTHORS file
+
+    This file is part of libzmq, the ZeroMQ core engine in C++.
+
+    libzmq is free software; you can redistribute it and/or modify it under
+    the terms of the GNU Lesser General Public License (LGPL) as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    As a special exception, the Contributors give you permission to link
+    this library with independent modules to produce an executable,
+    regardless of the license terms of these independent modules, and to
+    copy and distribute the resulting executable under terms of your choice,
+    provided that you also meet, for each linked independent module, the
+    terms and conditions of the license of that module. An independent
+    module is a module which is not derived from or based on this library.
+    If you modify this library, you must extend this exception to your
+    version of the library.
+
+    libzmq is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//  Prints a NetML trace dump written by zmq_trace_dump as text, the records
+//  of all threads merged in time order. Times are in microseconds since the
+//  first record.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "../lwip/src/include/lwip/netml_trace.h"
+
+static const char *event_names [] = {
+#define NETML_TRACE_NAME(name) #name,
+    NETML_TRACE_EVENTS (NETML_TRACE_NAME)
+#undef NETML_TRACE_NAME
+};
+
+struct entry_t
+{
+    netml_trace_rec rec;
+    unsigned thread;
+};
+
+static bool earlier (const entry_t &a, const entry_t &b)
+{
+    return a.rec.tsc < b.rec.tsc;
+}
+
+int main (int argc, char *argv [])
+{
+    if (argc != 2) {
+        printf ("usage: trace_decode <dump-file>\n");
+        return 1;
+    }
+
+    FILE *fp = fopen (argv [1], "rb");
+    if (!fp) {
+        perror (argv [1]);
+        return 1;
+    }
+
+    netml_trace_header hdr;
+    if (fread (&hdr, sizeof hdr, 1, fp) != 1
+     || memcmp (hdr.magic, NETML_TRACE_MAGIC, sizeof hdr.magic) != 0
+     || hdr.rec_size != sizeof (netml_trace_rec) || hdr.tsc_hz == 0) {
+        printf ("%s: not a NetML trace dump of this version\n", argv [1]);
+        return 1;
+    }
+
+    std::vector <netml_trace_thread> threads (hdr.threads);
+    std::vector <entry_t> entries;
+    for (unsigned i = 0; i != hdr.threads; i++) {
+        if (fread (&threads [i], sizeof threads [i], 1, fp) != 1) {
+            printf ("%s: truncated\n", argv [1]);
+            return 1;
+        }
+        threads [i].name [sizeof threads [i].name - 1] = 0;
+        for (unsigned j = 0; j != threads [i].count; j++) {
+            entry_t e;
+            if (fread (&e.rec, sizeof e.rec, 1, fp) != 1) {
+                printf ("%s: truncated\n", argv [1]);
+                return 1;
+            }
+            e.thread = i;
+            entries.push_back (e);
+        }
+    }
+    fclose (fp);
+
+    std::stable_sort (entries.begin (), entries.end (), earlier);
+
+    printf ("%14s %-16s %-16s %6s %6s %10s %10s %10s\n", "time[us]",
+        "thread", "event", "remote", "flags", "len", "aux", "conn");
+    for (size_t i = 0; i != entries.size (); i++) {
+        const netml_trace_rec &rec = entries [i].rec;
+        const netml_trace_thread &thr = threads [entries [i].thread];
+        double us = (double) (rec.tsc - entries [0].rec.tsc) * 1000000 /
+            hdr.tsc_hz;
+        char thread [32];
+        snprintf (thread, sizeof thread, "%s/%u",
+            thr.name [0] ? thr.name : "?", thr.tid);
+
+        if (rec.event < NETML_EV_MAX)
+            printf ("%14.3f %-16s %-16s", us, thread, event_names [rec.event]);
+        else
+            printf ("%14.3f %-16s %-16u", us, thread, rec.event);
+        printf (" %6u %6x %10u %10u %10x\n", rec.remote_id, rec.flags,
+            rec.len, rec.aux, rec.conn);
+    }
+
+    printf ("%u threads, %u records\n", hdr.threads,
+        (unsigned) entries.size ());
+    return 0;
+}